@@ -18,6 +18,7 @@
 
 #include "eddl/net/net.h"
 #include "eddl/net/netloss.h"
+#include "eddl/net/dataloader.h"
 #include "eddl/initializers/initializer.h"
 #include "eddl/regularizers/regularizer.h"
 #include "eddl/losses/loss.h"
@@ -67,6 +68,46 @@ namespace eddl {
     void removeLayer(Net *net, string l);
     void setTrainable(model net, string lanme, bool val);
 
+    /**
+      *  @brief Stores a 16-bit copy of the weights of the dense layers that is used for inference (evaluate/predict), with float accumulation. Only for CPU.
+      *  The copy is converted again when the weights change (training, load, set_parameters...). Small layers keep it expanded to float.
+      *
+      *  @param net  Model (already built)
+      *  @param dtype  "float16", "bfloat16" or "float32" (to remove the copy)
+      *  @return     (void)
+    */
+    void setWeightsDtype(model net, const string& dtype);
+
+    /**
+      *  @brief Fuses the chains of pointwise layers (activations, arithmetic operators, Add,...) when the model is built: each chain runs as a single layer that only keeps its final output. Only for CPU.
+      *  The fused model can not be exported to ONNX or moved to GPU, and the layers inside a chain (but the last one) are no longer part of it.
+      *
+      *  @param net  Model (not built yet)
+      *  @param enable  False to build the model as it is (default)
+      *  @return     (void)
+    */
+    void setFusion(model net, bool enable=true);
+
+    /**
+      *  @brief Stores the outputs of the convolutions, pooling, batchnorm and pointwise layers as (batch, rows, cols, channels) when the model is built, so their kernels work on contiguous channels and the batchnorm does not permute its data. Only for CPU.
+      *  The shape of the outputs is still (batch, channels, rows, cols). The layers that read them (dense, reshape, concat,...) and the outputs of the model get the usual layout.
+      *
+      *  @param net  Model (not built yet)
+      *  @param enable  False to build the model with the usual layout (default)
+      *  @return     (void)
+    */
+    void setChannelsLast(model net, bool enable=true);
+
+    /**
+      *  @brief Gathers the samples of the next batch on a background thread while the current one trains (fit and prefetch_batch). Only for CPU data.
+      *  A batch is gathered before it is trained, so the input and output tensors must not be changed between the prefetch and the train_batch of a batch.
+      *
+      *  @param net  Model
+      *  @param enable  False to gather each batch when it is trained (default)
+      *  @return     (void)
+    */
+    void setInputOverlap(model net, bool enable=true);
+
     vector<vtensor> get_parameters(model net, bool deepcopy=false, bool tocpu=false);
     void set_parameters(model net, const vector<vtensor>& params);
 
@@ -135,13 +176,26 @@ namespace eddl {
       *  @brief Executes the code in the GPU.
       *
       *  @param th  Integer to set which GPUs will be used (1=on, 0=off)
-      *  @param mem  Indicates the memory consumption of the model. One of "full_mem" (default), "mid_mem" or "low_mem".
+      *  @param mem  Indicates the memory consumption of the model. One of "full_mem" (default), "mid_mem", "low_mem" or "recompute_mem".
+      *  "recompute_mem" is "low_mem" plus activation recomputation: only some layer outputs (see Checkpoint) are kept after the forward and the rest are recomputed, segment by segment, during the backward.
       *  @return     The computer service itself.
     */
 
     compserv CS_CPU(int th,string mem);
 
 
+    /**
+      *  @brief Executes the code in the CPU, with the threads and the memory placed for machines with several sockets.
+      *
+      *  @param th  Indicates the number of threads to use (-1 = all available threads)
+      *  @param mem  Indicates the memory consumption of the model. One of "full_mem" (default), "mid_mem", "low_mem" or "recompute_mem".
+      *  @param pin  Pins each thread to its own core
+      *  @param numa  Splits the threads in groups per NUMA node (socket), interleaves the parameters across the nodes and allocates the activations in the node of the threads that work on them (first touch)
+      *  @return     The computer service itself.
+    */
+    compserv CS_CPU(int th, string mem, bool pin, bool numa=false);
+
+
     /**
       *  @brief Executes the code in the GPU.
       *
@@ -236,6 +290,24 @@ namespace eddl {
     */
     compserv CS_COMPSS(string filename);
 
+    /**
+      *  @brief Seeds the random generators of the library (tensor fills, initializers, dropout, noise, data augmentation and batch sampling).
+      *
+      *  @param seed  Seed. The same seed gives the same sequence of random numbers, whatever the number of threads
+      *  @return     (void)
+    */
+    void set_seed(unsigned long seed);
+
+    /**
+      *  @brief Reproducible CPU runs: seeds the generators (see set_seed) and makes the kernels that split a reduction among the threads use a fixed split.
+      *  Two runs with the same seed give the same results, bit by bit, with any number of threads.
+      *
+      *  @param enable  Enables or disables the mode
+      *  @param seed  Seed of the random generators (only when enabling)
+      *  @return     (void)
+    */
+    void set_deterministic(bool enable, unsigned long seed=1234);
+
 
     // Info and logs
 
@@ -417,6 +489,15 @@ namespace eddl {
       *  @return     (void) Trains the model
     */
     void fit(model m, const vector<Tensor *> &in, const vector<Tensor *> &out, int batch, int epochs);
+    /**
+      *  @brief Trains the model for a fixed number of epochs, reading the data from bin files as it goes (see DataLoader).
+      *
+      *  @param m  Model to train
+      *  @param loader  Loader with a file per input and output of the model (its batch size is used)
+      *  @param epochs  Number of epochs to train the model
+      *  @return     (void) Trains the model
+    */
+    void fit(model m, DataLoader *loader, int epochs);
     /**
       *  @brief Returns the loss value & metrics values for the model in test mode.
       *
@@ -437,6 +518,26 @@ namespace eddl {
     */
     vector<Tensor *>  predict(model m, const vector<Tensor *> &in);
 
+    /**
+      *  @brief Observes the range of the inputs of the Dense and Conv layers over a sample set (post-training quantization). Only for CPU.
+      *
+      *  @param m  Model
+      *  @param in  Input data (a representative subset of the training data)
+      *  @param bs  Batch size
+      *  @return    (void)
+    */
+    void calibrate(model m, const vector<Tensor *> &in, int bs=100);
+
+    /**
+      *  @brief Enables (or disables) the int8 inference of the calibrated Dense and Conv layers: int8 weights (one scale per output channel) and inputs, with int32 accumulation. It is used by evaluate/predict. Only for CPU.
+      *  The int8 weights are not updated by the training: calibrate and quantize again after changing the weights.
+      *
+      *  @param m  Model (already calibrated)
+      *  @param enable  False to go back to float
+      *  @return    (void)
+    */
+    void quantize(model m, bool enable=true);
+
 
     // Finer methods
 
@@ -460,6 +561,19 @@ namespace eddl {
     */
     void train_batch(model net, vector<Tensor *> in, vector<Tensor *> out, vector<int> indices);
 
+    /**
+      *  @brief Gathers (on a background thread) the samples of the input vector that are on the selected indices vector,
+      *  so the next train_batch/eval_batch with the same data and indices does not have to. Call it before training the
+      *  current batch to overlap both. It does nothing unless the input overlap is enabled (see setInputOverlap) and the data is on CPU.
+      *
+      *  @param net Net to train
+      *  @param in Vector of samples
+      *  @param out Vector of labels or expected output
+      *  @param indices Vector of indices of the samples of the next batch
+      *  @return    (void)
+    */
+    void prefetch_batch(model net, vector<Tensor *> in, vector<Tensor *> out, vector<int> indices);
+
     /**
       *  @brief Evaluate the model using the samples of the input vector that are on the selected indices vector
       *
@@ -2175,6 +2289,20 @@ namespace eddl {
     layer L1L2(layer l,float l1,float l2);
 
 
+    ///////////////////////////////////////
+    //  ACTIVATION RECOMPUTATION
+    ///////////////////////////////////////
+
+    /**
+      *  @brief Keeps the output of the layer when the net is built with CS_CPU(th, "recompute_mem").
+      *  If no layer of the net is marked, one output every sqrt(N) layers is kept.
+      *
+      *  @param l  Layer to mark
+      *  @return     The layer `l` marked as checkpoint
+    */
+    layer Checkpoint(layer l);
+
+
     ///////////////////////////////////////
     //  DATASETS
     ///////////////////////////////////////
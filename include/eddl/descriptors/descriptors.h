@@ -28,7 +28,8 @@ using namespace std;
 
 class MapReduceDescriptor {
 public:
-    int *ind;
+    vector<int> axis;
+    int *ind;  // Not built for the CPU
     int *gind;
 
 
@@ -72,6 +73,7 @@ public:
 
     int nk, kr, kc, kz;
     int sr, sc;
+    int dr, dc; // dilation
     int in, ir, ic, iz;
     int r, c, z;
     int padrt,padrb;
@@ -84,7 +86,7 @@ public:
     vector<int> kernel_size;
     vector<int> strides;
     string padding; // valid/none, same/zeros, custom
-    int groups;
+    int groups = 1;
     vector<int> dilation_rate;
     bool use_bias;
     int mem_level; // see CS
@@ -101,12 +103,20 @@ public:
     Tensor *O= nullptr; // Outputmap
 
     // CPU implementation
-    float *ptrI;
+    float *ptrI = nullptr; // im2col of the batch (FPGA only, the CPU lowers by tiles)
     Eigen::MatrixXf matI; // input
     Eigen::MatrixXf matK; // kernels
     Eigen::MatrixXf matO; // output
     Eigen::MatrixXf matD; // Delta
     Eigen::MatrixXf matgK; // gradient kernels
+    int winograd = 0; // Output tile of the Winograd F(mxm,3x3) (2 or 4), 0 for im2col
+    bool depthwise = false; // One input channel for each group (see cpu_depthwise.cpp)
+    bool channels_last_in = false; // Input (and its delta) stored (b,r,c,z) (see Net::set_layout)
+    bool channels_last_out = false; // Output (and its delta) stored (b,r,c,z)
+    float *ptrW = nullptr; // Winograd workspace
+    float *ptrKcl = nullptr; // K in the order of the channels-last tiles (see conv_kernels_cl)
+    float *ptrgKcl = nullptr; // Workspace of the gradient in that order
+    bool Kcl_stale = true; // K has changed since ptrKcl was permuted (see LConv::weights_changed)
 
     // GPU implementation
     Tensor *gpuI; // input
@@ -170,12 +180,15 @@ public:
 
     int nk, kz, kd, kr, kc;  // nk=num filters, kz=kernel channels, kd=kernel depth, kr=kernel rows, kc=Kernel cols
     int sd, sr, sc;  // sd=stride depth, sr=stride rows, sc=stride cols
+    int dd, dr, dc;  // dilation
     int in, iz, id, ir, ic;  // in=input batches, iz=input channels, id=input depth, ir=input rows, ic=input cols
     int z, d, r, c;  // z=channels, d=depth, r=rows, c=cols
     int paddf,paddb;  // pad(ding) d(epth) + f(ront) / b(ack)
     int padrt,padrb; // pad(ding) r(ows) + t(op) / b(ottom)
     int padcl,padcr; // pad(ding) c(ols) + l(eft) / r(ight)
     int size;  // Auxiliar var
+    int groups = 1;
+    vector<int> dilation_rate;
     bool use_bias;
     int mem_level; // see CS
 
@@ -191,7 +204,7 @@ public:
     Tensor *O= nullptr; // Outputmap
 
     // CPU implementation
-    float *ptrI;
+    float *ptrI = nullptr; // vol2col of the batch (FPGA only, the CPU lowers by tiles)
     Eigen::MatrixXf matI; // input
     Eigen::MatrixXf matK; // kernels
     Eigen::MatrixXf matO; // output
@@ -217,7 +230,11 @@ public:
 
     ConvolDescriptor3D(int filters, const vector<int> &ks, const vector<int> &st, const string& p, bool use_bias, int mem=0);
 
-    ConvolDescriptor3D(const vector<int> &ks, const vector<int> &st, const vector<int> &p, int mem=0);
+    ConvolDescriptor3D(int filters, const vector<int> &ks, const vector<int> &st, const string& p,
+                       int groups, const vector<int> &dilation_rate, bool use_bias, int mem=0);
+
+    ConvolDescriptor3D(const vector<int> &ks, const vector<int> &st, const vector<int> &p, int mem=0,
+                       int groups=1, const vector<int> &dilation_rate={});
 
     ~ConvolDescriptor3D();
 
@@ -234,7 +251,7 @@ public:
 class PoolDescriptor {
 
 public:
-    Tensor *indX, *indY; // indexes
+    Tensor *indX = nullptr, *indY = nullptr; // indexes (max pooling)
     vector<int> ksize;
     vector<int> stride;
     vector<int> pad; // {rows-top, rows-bottom, cols-left, cols-right}
@@ -249,6 +266,7 @@ public:
     int size;  // Auxiliar var
     bool use_bias;
     int mem_level; // see CS
+    bool channels_last = false; // Input and output (and their deltas) stored (b,r,c,z) (see Net::set_layout)
 
     Tensor *I= nullptr; // Input map
     Tensor *ID= nullptr;// Delta input map
@@ -288,7 +306,7 @@ public:
 class PoolDescriptor3D {
 
 public:
-    Tensor *indX, *indY; // indexes
+    Tensor *indX = nullptr, *indY = nullptr; // indexes (max pooling)
     vector<int> ksize;
     vector<int> stride;
     vector<int> pad; // {depth-front, depth-back, rows-top, rows-bottom, cols-left, cols-right}
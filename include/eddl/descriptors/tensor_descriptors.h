@@ -54,12 +54,32 @@ public:
 
     vector<string> indices;
 
+    // Strided view of the input: the output element (i0,...,in) is the input element
+    // offset + i0*strides[0] + ... + in*strides[n]. The CPU kernels walk it by runs of
+    // "run_size" consecutive input elements (no address table is needed)
+    int offset;
+    vector<int> strides;
+    int run_size;
+    int run_dims;  // Output dimensions walked by the runs
+    bool contiguous;  // The output is a contiguous block of the input (it can be a view)
+
     explicit SelDescriptor(int dev);
     SelDescriptor(const vector<string>& indices, int dev);
 
     virtual void build(vector<int> ishape);
     void resize(int b) override;
     virtual void build_indices();
+    void build_view(int offset, const vector<int> &strides);
+
+    // Input address of the first element of a run
+    inline int run_address(int run) {
+        int addr = offset;
+        for (int d = run_dims - 1; d >= 0; d--) {
+            addr += (run % oshape[d]) * strides[d];
+            run /= oshape[d];
+        }
+        return addr;
+    }
 };
 
 class PermuteDescriptor : public SelDescriptor {
@@ -0,0 +1,53 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#ifndef EDDL_CPU_NUMA_H
+#define EDDL_CPU_NUMA_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Smaller blocks are left to the system (they share pages with other data)
+#define CPU_NUMA_MIN_BYTES (1 << 20)
+
+// Placement of the threads and the memory on machines with several NUMA nodes
+// (sockets). Linux only: elsewhere there is a single node, pinning does nothing
+// and the memory stays where the system puts it.
+
+// Cores (that this process can use) of each node
+vector<vector<int>> cpu_numa_topology();
+int cpu_numa_nodes();
+
+// Pins the calling thread to a core
+bool cpu_pin_thread(int cpu);
+
+// Size of the OpenMP team and core of each of its threads (the ones of the
+// workers of the pool, so the static split of an OpenMP loop and the first
+// touch of the pool land in the same node). cpus empty: not pinned
+void cpu_omp_set_threads(int threads, const vector<int> &cpus);
+
+// New blocks (see eddl_system_malloc) are touched first by the threads of the
+// pool that will work on them
+void cpu_numa_set_first_touch(bool enable);
+bool cpu_numa_first_touch();
+
+// Writes zeros to a block from the pool threads (the range of each thread is
+// the one it gets in the elementwise kernels, so its pages end up in its node)
+void cpu_numa_touch(void *ptr, size_t bytes);
+
+// Moves the pages of a block already in use to the nodes of the threads that
+// work on them (as cpu_numa_touch does with a new one)
+bool cpu_numa_place(void *ptr, size_t bytes);
+
+// Spreads the pages of a block across all the nodes (data read by every thread)
+bool cpu_numa_interleave(void *ptr, size_t bytes);
+
+#endif //EDDL_CPU_NUMA_H
@@ -148,8 +148,13 @@
 #define _CPU_REPEAT_NN             144
 #define _CPU_D_REPEAT_NN           145
 #define _CPU_FLIP                  146
+#define _CPU_CONV3D                147
+#define _CPU_CONV3D_GRAD           148
+#define _CPU_CONV3D_BACK           149
+#define _CPU_MPOOL3D               150
+#define _CPU_MPOOL3D_BACK          151
 
-#define _NUM_CPU_FUNCS       147
+#define _NUM_CPU_FUNCS       152
 extern int num_instances[_NUM_CPU_FUNCS];
 void _profile(int f_id, int end);
 void _profile_add_tensor(unsigned long int size);
@@ -10,6 +10,8 @@
 #ifndef EDDL_CPU_TENSOR_H
 #define EDDL_CPU_TENSOR_H
 
+#include <cstdint>
+
 #include "cpu_profile.h"
 
 #include "eddl/tensor/tensor.h"
@@ -23,6 +25,9 @@
 // CPU: Core (static)
 void cpu_transpose(Tensor *A, Tensor *B);
 void cpu_copy(Tensor *A, Tensor *B);
+void cpu_copy_dtype(Tensor *A, Tensor *B);
+void cpu_float2half(const float *src, uint16_t *dst, unsigned long int n, int dtype);
+void cpu_half2float(const uint16_t *src, float *dst, unsigned long int n, int dtype);
 
 void cpu_fill_(Tensor *A, float v);
 void cpu_fill(Tensor *A, int aini, int aend, Tensor *B, int bini, int bend, int inc);
@@ -107,10 +112,45 @@ void cpu_tan(Tensor *A, Tensor *B);
 void cpu_tanh(Tensor *A, Tensor *B);
 void cpu_trunc(Tensor *A, Tensor *B);
 
+// CPU: Vectorized math (raw float32 buffers, x and y may be the same)
+// The instruction set is chosen at startup (the best one of the CPU). Level
+// CPU_SIMD_NONE uses libm
+#define CPU_SIMD_NONE 0
+#define CPU_SIMD_SSE4 1
+#define CPU_SIMD_AVX2 2    // AVX2 + FMA
+#define CPU_SIMD_AVX512 3  // AVX-512F
+
+int cpu_simd_supported();
+int cpu_simd_level();
+int cpu_simd_set_level(int level);  // Returns the level in use (at most the supported one)
+string cpu_simd_name(int level);
+
+void cpu_vexp(const float *x, float *y, long int n);
+void cpu_vlog(const float *x, float *y, long int n);
+void cpu_vtanh(const float *x, float *y, long int n);
+void cpu_vsigmoid(const float *x, float *y, long int n);
+
+// B[c * ldb + r] = A[r * lda + c] (or +=) for a tile of rows x cols (single thread)
+void cpu_vtranspose(const float *A, long int lda, float *B, long int ldb, int rows, int cols, bool inc=false);
+
+// float16 <-> float of the first elements (single thread). Return how many
+// were converted (0 without F16C), the caller converts the rest
+long int cpu_vhalf2float(const uint16_t *src, float *dst, long int n);
+long int cpu_vfloat2half(const float *src, uint16_t *dst, long int n);
+
+// C[i * ldc + j] = sum_p A[i * lda + p] * B[j * ldb + p] for m x n, with the
+// values of A and B in [-127, 127] (single thread)
+void cpu_vgemm_int8(const int8_t *A, long int lda, const int8_t *B, long int ldb, int32_t *C, long int ldc, int m, int n, int k);
+
+// CPU: Permutations (raw float32 buffers, B has the permuted shape of A, see permute_shape)
+void cpu_permute(const float *A, const vector<int> &ishape, const vector<int> &dims, float *B, bool inc=false);
+void cpu_permute_back(const float *B, const vector<int> &ishape, const vector<int> &dims, float *A, bool inc=true);
+
 // CPU: Math (static)
 void cpu_add(float scA, Tensor *A, float scB, Tensor *B, Tensor *C, int incC);
 void cpu_inc(Tensor *A, Tensor *B);
 void cpu_mult2D(Tensor *A, int tA, Tensor *B, int tB, Tensor *C, int incC);
+void cpu_mult2D_half(Tensor *A, int tA, Tensor *B, Tensor *C, int incC);
 void cpu_el_div(Tensor *A, Tensor *B, Tensor *C, int incC);
 void cpu_el_mult(Tensor *A, Tensor *B, Tensor *C, int incC);
 void cpu_sum2D_rowwise(Tensor *A, Tensor *B, Tensor *C);
@@ -168,6 +208,21 @@ int cpu_mode(float *ptr, int size, int *map);
 
 
 // CPU: Reduction
+#define CPU_RED_SUM 0
+#define CPU_RED_MEAN 1
+#define CPU_RED_MAX 2
+#define CPU_RED_MIN 3
+#define CPU_RED_VAR 4
+#define CPU_RED_PROD 5
+
+// Reduces A (with that shape) over axis into B (the kept dims, in order), with
+// no index maps. arg (max/min): position in A of each result
+void cpu_reduce_axis(const float *A, const vector<int> &shape, const vector<int> &axis, float *B, int op, float *arg=nullptr);
+// The opposite: A[i] = alpha * B[group of i] (+= with inc)
+void cpu_expand_axis(const float *B, const vector<int> &shape, const vector<int> &axis, float *A, float alpha, bool inc);
+
+void cpu_reduce(Tensor *A, Tensor *B,string mode,vector<int> axis);
+void cpu_reduce_op(Tensor *A, Tensor *B,string op,vector<int> axis);
 void cpu_reduce(Tensor *A, Tensor *B,string mode,int* map);
 void cpu_reduce_op(Tensor *A, Tensor *B,string op,int* map);
 void cpu_reduce(Tensor *A, Tensor *B,string mode,MapReduceDescriptor *MD);
@@ -0,0 +1,144 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#ifndef EDDL_CPU_THREAD_POOL_H
+#define EDDL_CPU_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Loops with fewer iterations than the grain run on the calling thread. The
+// default grain is meant for cheap elementwise ops (one iteration, one element)
+#define CPU_GRAIN 16384
+
+// Ranges per thread of each loop (the extra ones are the work to steal)
+#define CPU_POOL_SPLIT 4
+
+// Deterministic mode: the kernels that choose how to split a reduction by the
+// number of threads use this one instead
+#define CPU_DETERMINISTIC_THREADS 64
+
+// Persistent threads for the CPU kernels (sized by the CompServ of the net).
+// A parallel loop is split in ranges that are queued to the threads, each one
+// takes the ranges of its own queue and, when it is empty, steals from the
+// others (first from the threads of its group). The calling thread works too.
+// Loops inside a loop (or started while another thread is using the pool) run
+// sequentially.
+//
+// cpus: core of each worker (empty: not pinned). groups: group (NUMA node) of
+// each thread, consecutive threads get consecutive ranges of a loop.
+class CPUPool {
+public:
+    typedef function<void(long int, long int)> Body;
+
+    explicit CPUPool(int threads, const vector<int> &cpus = vector<int>(), const vector<int> &groups = vector<int>());
+    ~CPUPool();
+
+    int size() { return nthreads; }
+    int group(int t) { return groups.empty() ? 0 : groups[t]; }
+
+    // Split of a loop: number of ranges, and thread that owns the range r
+    long int ranges(long int n, long int grain);
+    int owner(long int r, long int nranges) { return (int)(r * nthreads / nranges); }
+
+    void parallel_for(long int begin, long int end, long int grain, const Body &f);
+
+private:
+    struct Range { long int begin, end; };
+    struct Queue {
+        mutex m;
+        deque<Range> ranges;
+    };
+
+    int nthreads;
+    vector<int> cpus;
+    vector<int> groups;
+    vector<thread> workers;
+    vector<unique_ptr<Queue>> queues;  // One per thread (0: the caller)
+
+    const Body *job;
+    atomic<long int> pending;  // Ranges not done yet
+    exception_ptr error;
+    mutex error_m;
+
+    mutex m;
+    condition_variable cv;
+    unsigned long int generation;
+    bool stop;
+
+    mutex busy;  // Taken by the thread that is running a loop
+
+    bool pop(int q, Range &r);
+    bool steal(int q, Range &r);
+    void work(int q);
+    void worker(int q);
+};
+
+// Pool used by the kernels. pin: each worker on its own core. numa: threads in
+// groups per node (the first ones in the first node,...)
+shared_ptr<CPUPool> cpu_pool();
+void cpu_pool_set_threads(int threads, bool pin=false, bool numa=false);
+int cpu_pool_threads();
+
+// Changes every time the pool is replaced (and so the thread, and the node, that
+// gets each range of a loop)
+unsigned long int cpu_pool_layout();
+
+// Runs f(ini, end) over [begin, end) split in ranges of at least grain iterations
+void cpu_parallel_for(long int begin, long int end, long int grain, const CPUPool::Body &f);
+
+// Same as cpu_parallel_for for loops whose ranges run GEMMs of their own (the
+// tiles of a convolution,...): the GEMMs of Eigen would start a team of threads
+// in each range, so they are sequential while the loop is split
+void cpu_parallel_gemm_for(long int begin, long int end, long int grain, const CPUPool::Body &f);
+
+// Grain for loops whose iterations process cost elements each (rows, samples,...)
+inline long int cpu_grain(long int cost) {
+    return (cost >= CPU_GRAIN) ? 1 : CPU_GRAIN / (cost > 0 ? cost : 1);
+}
+
+// Results that do not depend on the number of threads (see cpu_split_threads)
+void cpu_set_deterministic(bool enable);
+bool cpu_deterministic();
+
+// Threads to plan the split of a reduction for
+inline int cpu_split_threads() {
+    return cpu_deterministic() ? CPU_DETERMINISTIC_THREADS : cpu_pool_threads();
+}
+
+// Reduction of [begin, end): f(ini, end) reduces the blocks of CPU_GRAIN
+// iterations (fixed, whatever the threads) and op merges the results in a
+// fixed pairwise tree, so the result is always the same (and more accurate
+// than a running sum)
+template <typename T, typename F, typename Op>
+T cpu_parallel_reduce(long int begin, long int end, T identity, const F &f, const Op &op) {
+    long int blocks = (end - begin + CPU_GRAIN - 1) / CPU_GRAIN;
+    if (blocks <= 1) return (end > begin) ? f(begin, end) : identity;
+
+    vector<T> part(blocks);
+    cpu_parallel_for(0, blocks, 1, [&](long int ini, long int last) {
+        for (long int b = ini; b < last; b++)
+            part[b] = f(begin + b * CPU_GRAIN, std::min(end, begin + (b + 1) * CPU_GRAIN));
+    });
+    for (long int s = 1; s < blocks; s *= 2)
+        for (long int b = 0; b + s < blocks; b += 2 * s) part[b] = op(part[b], part[b + s]);
+    return part[0];
+}
+
+#endif //EDDL_CPU_THREAD_POOL_H
@@ -11,14 +11,43 @@
 #ifndef EDDL_CPU_TENSOR_NN_H
 #define EDDL_CPU_TENSOR_NN_H
 
+#include <cstdint>
+
 #include "eddl/hardware/cpu/cpu_profile.h"
 
 #include "eddl/tensor/tensor.h"
 #include "eddl/descriptors/descriptors.h"
 
+// Floats of the im2col tiles of each thread (256KB, about the L2)
+#define CPU_CONV_TILE (1 << 16)
+
+// Floats of the partial weight gradients of the chunks of the batch (32MB)
+#define CPU_CONV_GRAD_PARTIALS (1 << 23)
+
+// Floats of the Winograd transforms of the blocks of tiles of each thread (1MB)
+#define CPU_WINOGRAD_TILE (1 << 18)
+
+// Input channels of the blocks of the channels-last depthwise back (a few vectors)
+#define CPU_DW_CHANNELS 32
+
+// Rows of A and of B in the tasks of the int8 products (the rows of B stay in the L2)
+#define CPU_INT8_BLOCK 64
+
 // Aux
-float get_pixel(int b,int px,int py,int pz,ConvolDescriptor *D,int isize,int irsize);
-void add_pixel(int b,int px,int py,int pz,ConvolDescriptor *D,int isize,int irsize,float val);
+// Tiles of the im2col matrix of a sample (I or ID): output rows [r0, r1) x
+// channels [z0, z1), column-major ((r1-r0)*c x (z1-z0)*kr*kc)
+int conv_tiles(ConvolDescriptor *D, bool all_channels, int &rows, int &chans);
+void im2col_tile(const float *I,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *P);
+void col2im_tile(const float *P,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *ID);
+// The same tiles of a channels-last input, row-major ((r1-r0)*c x kr*kc*(z1-z0)),
+// and the kernels permuted to their order
+void im2col_tile_cl(const float *I,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *P);
+void col2im_tile_cl(const float *P,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *ID);
+void conv_kernels_cl(ConvolDescriptor *D,int chans,const float *K,float *Kp,bool inverse);
+// Chunks of the batch of the weight gradient when its blocks (tasks) do not
+// keep the threads busy, and the sum of their partials (after gK, in order)
+int conv_grad_chunks(int batch, int tasks, long int gksize);
+void conv_grad_reduce(float *gK, const float *part, int chunks, long int gksize);
 
 // Activations
 void cpu_relu(Tensor *A, Tensor *B);
@@ -86,6 +115,22 @@ void cpu_conv2D(ConvolDescriptor *D);
 void cpu_conv2D_grad(ConvolDescriptor *D);
 void cpu_conv2D_back(ConvolDescriptor *D);
 
+// Conv2D: Winograd F(2x2,3x3) and F(4x4,3x3) (see ConvolDescriptor::winograd)
+unsigned long int cpu_winograd_size(ConvolDescriptor *D);
+void cpu_winograd_conv2D(ConvolDescriptor *D);
+void cpu_winograd_conv2D_grad(ConvolDescriptor *D);
+void cpu_winograd_conv2D_back(ConvolDescriptor *D);
+
+// Conv2D: depthwise, one input channel for each group (see ConvolDescriptor::depthwise)
+void cpu_depthwise_conv2D(ConvolDescriptor *D);
+void cpu_depthwise_conv2D_grad(ConvolDescriptor *D);
+void cpu_depthwise_conv2D_back(ConvolDescriptor *D);
+
+// Int8 inference
+void cpu_quantize_int8(const float *src, int8_t *dst, unsigned long int n, float scale);
+void cpu_dense_int8(Tensor *A, float a_scale, const int8_t *Wq, const float *Wq_scale, Tensor *C);
+void cpu_conv2D_int8(ConvolDescriptor *D, float i_scale, const int8_t *Kq, const float *Kq_scale);
+
 // Conv3D
 void cpu_conv3D(ConvolDescriptor3D *D);
 void cpu_conv3D_grad(ConvolDescriptor3D *D);
@@ -34,6 +34,14 @@ public:
 
     ConvolDescriptor *cd;
 
+    int epilogue;  // Activation fused into the output (FUSED_RELU,...; see Net::fuse_pointwise)
+    float epilogue_k;  // Constant of the activation (leaky_relu)
+
+    // Int8 inference (see quantize)
+    float qrange;            // Largest |input| seen by calibrate
+    bool quantized;
+    vector<int8_t> Kq;       // Same layout as K
+    vector<float> Kq_scale;  // One per filter
 
     // constructors and clones
     LConv(Layer *parent, int filters, const vector<int> &kernel_size, const vector<int> &strides, string padding, const vector<int> &pads,
@@ -73,6 +81,12 @@ public:
 
 	void enable_distributed() override;
 
+    void weights_changed() override;
+
+    void calibrate() override;
+
+    void quantize(bool enable) override;
+
 };
 
 /// Conv1D Layer
@@ -19,6 +19,8 @@
 #define TRMODE 1
 #define TSMODE 0
 
+#define LDENSE_HALF_CACHE (1 << 16)  // Weights (floats) up to which LDense keeps W16 expanded to float (256KB)
+
 using namespace std;
 
 /// Tensor Layer
@@ -122,6 +124,17 @@ public:
 	Tensor *bias;
 	Tensor *gbias;
 	Tensor *acc_gbias;
+	int epilogue;  // Activation fused into the output (FUSED_RELU,...; see Net::fuse_pointwise)
+	float epilogue_k;  // Constant of the activation (leaky_relu)
+	Tensor *W16;  // 16-bit copy of W used by the forward in TSMODE (see set_weights_dtype)
+	Tensor *W16f;  // W16 expanded to float, only for small weights (see LDENSE_HALF_CACHE)
+	bool W16_stale;  // W has changed since W16 was converted
+
+	// Int8 inference (see quantize)
+	float qrange;            // Largest |input| seen by calibrate
+	bool quantized;
+	vector<int8_t> Wq;       // Transposed W (outputs x inputs)
+	vector<float> Wq_scale;  // One per output
 
     LDense(Layer *parent, int ndim, bool use_bias, string name, int dev, int mem);
 
@@ -147,6 +160,14 @@ public:
 
 	void apply_accumulated_gradients() override;
 
+    void set_weights_dtype(int dtype) override;
+
+    void weights_changed() override;
+
+    void calibrate() override;
+
+    void quantize(bool enable) override;
+
     string plot(int c) override;
 
 	static void reset_name_counter();
@@ -378,4 +399,59 @@ public:
     Layer *clone(int c, int bs, vector<Layer *> p, int todev) override;
 };
 
+/// Fused Layer
+// Pointwise operations of LFused. Registers 0..parent.size()-1 hold the outputs
+// of the parents and the result of ops[i] goes to register parent.size()+i
+#define FUSED_ADD 0
+#define FUSED_SUB 1
+#define FUSED_MULT 2
+#define FUSED_DIV 3
+#define FUSED_ADDK 4    // a + k
+#define FUSED_MULTK 5   // a * k
+#define FUSED_KSUB 6    // k - a
+#define FUSED_DIVK 7    // a / k
+#define FUSED_KDIV 8    // k / a
+#define FUSED_RELU 9
+#define FUSED_LEAKY_RELU 10
+#define FUSED_SIGMOID 11
+#define FUSED_TANH 12
+#define FUSED_EXP 13
+#define FUSED_LOG 14
+#define FUSED_SQRT 15
+#define FUSED_ABS 16
+#define FUSED_NONE (-1)  // No epilogue
+
+struct FusedOp {
+    int op;
+    int a, b;  // Registers of the operands (b: binary ops only)
+    float k;   // Constant of the op (if any)
+};
+
+// Activation run by a Dense or a Conv on its own output (see Net::fuse_pointwise):
+// O = op(O + bias) in a single pass, and the backward scales the delta by the
+// derivative of op, taken from O (relu, leaky_relu with k >= 0, sigmoid, tanh)
+void fused_epilogue_forward(int op, float k, Tensor *O, Tensor *bias);
+void fused_epilogue_backward(int op, float k, Tensor *O, Tensor *D);
+
+// A chain of pointwise layers run as a single kernel (see Net::fuse_pointwise).
+// Only the output of the last operation is materialized. Only for CPU.
+class LFused : public MLayer {
+public:
+    static int total_layers;
+
+    vector<FusedOp> ops;
+
+    LFused(vector<Layer *> parent, vector<FusedOp> ops, string name, int dev, int mem);
+
+    void forward() override;
+
+    void backward() override;
+
+    Layer *share(int c, int bs, vector<Layer *> p) override;
+
+    Layer *clone(int c, int bs, vector<Layer *> p, int todev) override;
+
+    string plot(int c) override;
+};
+
 #endif //EDDL_LAYER_CORE_H
@@ -45,6 +45,15 @@ public:
     bool iscloned;
     bool isnorm;
     bool isdecoder;
+    bool isrecomputable; // The forward can be run again to rebuild the output (see Net::recompute_build)
+    bool checkpoint; // The output is kept when the net recomputes activations
+    bool channels_last; // The output and the delta are stored (b,r,c,z) (see Net::set_layout)
+
+    // Memory assigned to the delta by the planner of the net (see Net::mem_plan_build)
+    float *delta_slab;
+    unsigned long int delta_slab_size;
+    int delta_step;  // Backward step that books the delta in the plan
+    bool delta_alloc;  // The delta was booked through alloc_delta
 
     vector<Tensor *> params;
     vector<Tensor *> gradients;
@@ -90,6 +99,7 @@ public:
     virtual void mem_delta_parent();
     virtual void mem_delta();
     virtual void free_delta();
+    Tensor *alloc_delta(const vector<int> &shape, int dev);
 
 
     //virtual
@@ -128,6 +138,16 @@ public:
 
 	virtual void enable_distributed() {}
 
+    // Keeps a copy of the weights in a 16-bit dtype for inference (see Tensor::astype)
+    virtual void set_weights_dtype(int dtype) {}
+
+    // The params have been written (initialize, load, copy, set_parameters): refresh the copies derived from them
+    virtual void weights_changed() {}
+
+    // Int8 inference: observe the range of the input / use int8 weights and inputs in TSMODE (see Net::quantize)
+    virtual void calibrate() {}
+    virtual void quantize(bool enable) {}
+
 };
 
 
@@ -0,0 +1,48 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#ifndef EDDL_MEM_POOL_H
+#define EDDL_MEM_POOL_H
+
+#include <cstddef>
+#include <string>
+
+// Caching allocator used by eddl_malloc/eddl_free/get_fmem (CPU memory only).
+// Requests are rounded up to a size class (4 classes per power of two, min 64 bytes)
+// and released blocks are kept in per-class free lists so that tensors created and
+// destroyed in a loop (i.e. per batch or per timestep) do not hit the system allocator.
+
+struct MemPoolStats {
+    unsigned long long hits = 0;    // Requests served from the cache
+    unsigned long long misses = 0;  // Requests served by the system allocator
+    size_t bytes_in_use = 0;        // Bytes (rounded to its size class) handed out by the pool
+    size_t bytes_cached = 0;        // Bytes kept in the free lists
+    size_t peak_bytes = 0;          // Peak of (bytes_in_use + bytes_cached)
+};
+
+void mem_pool_enable(bool enable);
+bool mem_pool_is_enabled();
+
+void mem_pool_set_max_cached(size_t max_bytes);
+size_t mem_pool_get_max_cached();
+
+MemPoolStats mem_pool_stats();
+void mem_pool_reset_stats();
+void mem_pool_show_stats();
+
+// Returns cached blocks to the system until (at most) "max_bytes" remain cached
+size_t mem_pool_trim(size_t max_bytes=0);
+
+// Internal (used by eddl_malloc and eddl_free). The memory handed out to the
+// user to be released with free() must come from eddl_system_malloc instead
+size_t mem_pool_size_class(size_t size);
+void * mem_pool_malloc(size_t size, const std::string &str_info);
+bool mem_pool_free(void *ptr);
+
+#endif //EDDL_MEM_POOL_H
@@ -35,8 +35,14 @@ public:
     // 0: full memory. better performance in terms of speed
     // 1: mid memory. some memory improvements to save memory
     // 2: low memory. save memory as much as possible
+    // 3: recompute memory. low memory + most of the activations are recomputed during the backward (CPU)
     int mem_level;
 
+    // CPU placement (see cpu_numa.h)
+    bool pin_threads;  // Each thread of the pool on its own core
+    bool numa;         // Threads in groups per NUMA node, parameters interleaved across the nodes and
+                       // activations in the node of the threads that work on them
+
 
 
     CompServ();
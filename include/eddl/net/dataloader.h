@@ -0,0 +1,74 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#ifndef EDDL_DATALOADER_H
+#define EDDL_DATALOADER_H
+
+#include <string>
+#include <vector>
+#include <future>
+#include <utility>
+
+#include "eddl/tensor/tensor.h"
+
+using namespace std;
+
+// Streams a dataset stored in bin files (one per input/output of the net, all
+// with the same number of rows) without loading it in memory. The files are
+// read in chunks of rows (see Tensor::load_partial): the chunks are visited in
+// random order, the rows of each chunk are shuffled, and the next chunk is read
+// on a background thread while the current one is consumed. So at most two
+// chunks per file are in memory.
+//
+// As in Net::fit, every batch is full: the rows that do not complete a batch
+// are not used.
+class DataLoader {
+private:
+    typedef pair<vector<Tensor *>, vector<Tensor *>> Chunk;
+
+    Chunk load_chunk(int c);
+    void delete_chunk(Chunk &chunk);
+    void start_prefetch();
+
+public:
+    vector<string> in_files;
+    vector<string> out_files;
+    vector<vector<int>> in_shapes;   // Shape of the samples (without the rows)
+    vector<vector<int>> out_shapes;
+    int batch_size;
+    int chunk_size;  // Rows per chunk (multiple of batch_size)
+    bool shuffle;
+
+    int num_samples;
+    int num_chunks;
+    int num_batches;  // Per epoch
+
+    // Current epoch
+    vector<int> order;     // Order of the chunks
+    int next_chunk;        // Position (in order) of the next chunk to read
+    Chunk current;         // Chunk being consumed
+    vector<int> rows;      // Order of its rows
+    int pos;               // Next row (in rows)
+    std::future<Chunk> prefetch;
+
+    DataLoader(const vector<string> &in_files, const vector<string> &out_files, int batch_size, int chunk_size=10000, bool shuffle=true);
+    ~DataLoader();
+
+    // Starts a new epoch
+    void reset();
+
+    // Copies the next batch to X and Y (tensors of shape {batch_size, ...}, see new_batch).
+    // Returns false (and starts a new epoch) if there are no more batches in this epoch.
+    bool next_batch(vector<Tensor *> X, vector<Tensor *> Y);
+
+    // Allocates tensors for next_batch
+    void new_batch(vector<Tensor *> &X, vector<Tensor *> &Y);
+};
+
+#endif //EDDL_DATALOADER_H
@@ -13,6 +13,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <future>
 
 #include "eddl/layers/layer.h"
 #include "eddl/optimizers/optim.h"
@@ -36,8 +38,20 @@ typedef vector<Metric *> vmetrics;
 int isIn(Layer *l, vlayer vl, int &ind);
 int isInorig(Layer *l, vlayer vl, int &ind);
 
+class DataLoader;
+
 #define MAX_THREADS 1024
 
+// Activation recomputation states
+#define RECOMPUTE_OFF 0
+#define RECOMPUTE_TODO 1
+#define RECOMPUTE_READY 2
+
+// Delta memory planner states
+#define MEM_PLAN_OFF 0
+#define MEM_PLAN_TODO 1
+#define MEM_PLAN_READY 2
+
 class Net {
 private:
     void make_graph(Optimizer *opt, vloss lo, vmetrics me, bool initialize=true);
@@ -90,6 +104,38 @@ public:
     vtensor Xs[MAX_THREADS];
     vtensor Ys[MAX_THREADS];
 
+    // Activation recomputation (see net_recompute.cpp)
+    int recompute_state;
+    int recompute_segment;  // Segment whose outputs are currently in the arena (-1: none)
+    float *recompute_arena;
+    unsigned long int recompute_arena_size;
+    vector<vlayer> recompute_layers;  // Recomputed layers of each segment (forward order)
+    map<Layer *, int> recompute_need;  // Segment read by the backward of a layer
+
+    // Delta memory planner (see net_mem_plan.cpp)
+    int mem_plan_state;
+    int mem_plan_step;  // Step of the backward that is booking deltas (-1: none)
+    float *mem_plan_arena;
+    unsigned long int mem_plan_arena_size;
+    unsigned long int mem_plan_unplanned_size;  // Sum of the planned deltas (without sharing memory)
+
+    // Input staging (see net_staging.cpp)
+    bool input_overlap = false;  // Gather the next batch while the current one trains (fit, prefetch_batch)
+    int stage_turn = 0;
+    Mtensor stage_x[2];  // Same shapes than Xs/Ys
+    Mtensor stage_y[2];
+    vtensor stage_src_x[2];
+    vtensor stage_src_y[2];
+    vind stage_sind[2];
+    std::future<void> stage_ready[2];
+
+    // Pointwise fusion (see net_fusion.cpp)
+    bool fusion = false;  // Fuse the chains of pointwise layers when the net is built (CPU)
+    vlayer fused;  // Layers replaced by the fused ones (deleted with the net)
+
+    // Channels-last layout (see net_layout.cpp)
+    bool channels_last = false;  // Store the outputs of conv, pooling, batchnorm,... as (b,r,c,z) (CPU)
+
     Net();
     Net(vlayer in, vlayer out);
     ~Net();
@@ -113,6 +159,9 @@ public:
     Layer* getLayer(string l);
     void removeLayer(string l);
     void setTrainable(string lanme, bool val);
+    void set_weights_dtype(int dtype);
+    void calibrate(vtensor tin, int bs=100);
+    void quantize(bool enable=true);
 
 
     int inNet(Layer *l);
@@ -145,6 +194,21 @@ public:
     void do_backward();
     void do_applygrads();
 
+    void recompute_reset();
+    void recompute_build();
+    void recompute(Layer *l);
+
+    void mem_plan_reset();
+    void mem_plan_build();
+    void mem_plan_check();
+
+    void stage_reset();
+    bool stage_load(vtensor &X, vtensor &Y, vind &sind);
+
+    void fuse_pointwise();
+
+    void set_layout();
+
     void reset_accumulated_gradients();
     void apply_accumulated_gradients();
 
@@ -176,6 +240,7 @@ public:
     vector<float> get_metrics();
 
     void fit(vtensor tin, vtensor tout, int batch_size, int epochs);
+    void fit(DataLoader *loader, int epochs);
     void prepare_recurrent(vtensor tin, vtensor tout, int &inl, int &outl, vtensor &xt,vtensor &xtd,vtensor &yt,vtensor &tinr,vtensor &toutr, Tensor *Z=nullptr);
     void prepare_recurrent_enc(vtensor tin, vtensor tout, int &inl, int &outl, vtensor &xt,vtensor &xtd,vtensor &yt,vtensor &tinr,vtensor &toutr, Tensor *Z=nullptr);
     void prepare_recurrent_dec(vtensor tin, vtensor tout, int &inl, int &outl, vtensor &xt,vtensor &xtd,vtensor &yt,vtensor &tinr,vtensor &toutr, Tensor *Z=nullptr);
@@ -183,6 +248,7 @@ public:
 
     void fit_recurrent(vtensor tin, vtensor tout, int batch_size, int epochs);
     void train_batch(vtensor X, vtensor Y, vind sind, int eval = 0);
+    void prefetch_batch(vtensor X, vtensor Y, vind sind);
     void evaluate(vtensor tin, vtensor tout, int bs=100);
     void evaluate_recurrent(vtensor tin, vtensor tout, int bs);
     vtensor predict_recurrent(vtensor tin);
@@ -10,14 +10,34 @@
 #ifndef EDDL_RANDOM_H
 #define EDDL_RANDOM_H
 
+#include <cstdint>
+
 float gaussgen();
 void build_randn_table();
 
-float uniform(float min=0.0f, float max=1.0f);
+float uniform(float min=0.0f, float max=1.0f);  // From the stream of the fills (below)
 float signed_uniform();
 
 float slow_randn(float mean, float sd);
 float fast_randn(float mean, float sd, int seed);
 
+// Counter-based generator (Philox4x32-10, Salmon et al., SC'11): the block of
+// 4 words of a counter only depends on (key, counter), so any range of a
+// stream can be generated by any thread, in any order, with the same result.
+void philox4x32(uint64_t key, uint64_t counter, uint32_t out[4]);
+void philox4x32_blocks(uint64_t key, uint64_t counter, long int n, uint32_t *out);  // n consecutive blocks
+
+// Streams of the random fills: each fill takes the key and reserves the
+// counters of its blocks (the next fill starts after them)
+uint64_t rand_key();
+uint64_t rand_reserve(uint64_t blocks);  // Returns the first counter
+void rand_seed(uint64_t seed);  // Key = seed, counters from 0
+
+// Uniform in [min, max) from a word of a block
+float rand_uniform(uint32_t bits, float min=0.0f, float max=1.0f);
+
+// [0, n), for sampling (a block of the stream each)
+int rand_int(int n);
+
 
 #endif //EDDL_RANDOM_H
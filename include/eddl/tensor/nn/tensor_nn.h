@@ -104,6 +104,10 @@ namespace tensorNN{
     void AvgPool2D(PoolDescriptor *D);
     void AvgPool2D_back(PoolDescriptor *D);
 
+// Int8 inference (CPU). Symmetric: real = scale * q, with q in [-127, 127]
+    void Dense_int8(Tensor *A, float a_scale, const int8_t *Wq, const float *Wq_scale, Tensor *C);
+    void Conv2D_int8(ConvolDescriptor *D, float i_scale, const int8_t *Kq, const float *Kq_scale);
+
 // ***** Tensor operations *****************************
     void repeat_nn(Tensor *A, Tensor *B, vector<int> size);
     void d_repeat_nn(Tensor *D, Tensor *P, vector<int> size);
@@ -122,10 +126,10 @@ namespace tensorNN{
             Tensor *global_mean, Tensor *global_variance,
             Tensor *affine_g, Tensor *affine_b,
             Tensor *mean, Tensor *variance,
-            bool trmode, float epsilon, float momentum);
+            bool trmode, float epsilon, float momentum, bool channels_last=false);
     void BatchNormBackward(Tensor *delta, Tensor *opa, Tensor *pdelta, Tensor *gbn_g,
             Tensor *gbn_b, Tensor *bn_g, Tensor *variance,
-            Tensor *work1, Tensor *work2);
+            Tensor *work1, Tensor *work2, bool channels_last=false);
 
 }
 
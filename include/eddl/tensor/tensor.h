@@ -56,6 +56,12 @@
 #define MAX_GPUS 8
 #define MAX_FPGAS 8
 
+// Storage types. 16-bit tensors (see Tensor::astype) keep their data packed in "ptr"
+// and are meant for storage: only copies, mult2D (as B operand) and save/load accept them
+#define DTYPE_FLOAT32 0
+#define DTYPE_FLOAT16 1
+#define DTYPE_BFLOAT16 2
+
 #define CPU_MIN_FLOAT 1.17549e-38f;  // Minimum finite value
 #define CPU_MAX_FLOAT 3.40282e+38f;  // Maximum finite value
 #define CPU_EPS_FLOAT 1.19209e-07f;  // Machine epsilon (the difference between 1 and the least value greater than 1 that is representable).
@@ -69,6 +75,12 @@
 
 using namespace std;
 
+// Lazy elementwise expressions (see tensor_expr.h)
+namespace tensorExpr {
+    template<typename E> struct Expr;
+    struct Leaf;
+}
+
 // TODO: Remove this. Don't like here
 typedef Eigen::Matrix<float, -1, -1, Eigen::RowMajor> MatrixXRMf;
 typedef vector<int> tshape;
@@ -77,18 +89,20 @@ class Tensor {
 private:
     // Load methods
     static Tensor* load_from_bin(std::ifstream &ifs, int start_row, int end_row);
+    static Tensor* load_from_mmap(const string &filename);
     static Tensor* load_from_img(const string &filename, const string &format);
 //    template<typename T> static Tensor* load_from_numpy(const string &filename, const string &format);  // Deprecated
 //    static Tensor* load_from_txt(std::ifstream &ifs, char delimiter, int headerRows);  // Deprecated
 
     // Save methods
-    void save2bin(std::ofstream &ofs);
+    void save2bin(std::ofstream &ofs, int dtype);
     void save2img(const string &filename, string format);
 //    void save2numpy(const string &filename, string format);
     void save2txt(std::ofstream &ofs, const char delimiter, const vector<string> &header);
 
 public:
     int device;
+    int dtype=DTYPE_FLOAT32;
     bool isshared=false;
     unsigned int ndim;
     unsigned long int size;
@@ -272,9 +286,14 @@ public:
       *  @param format    Filetype. The accepted filetypes are the following:
       *                     - Images: jpg, jpeg, png, bmp, hdr, psd, tga, gif, pic, pgm, ppm.
       *                     - Other: bin
+      *  @param mmap  (bin only) Map the file in memory instead of reading it. The data is read on demand and the
+      *               pages are shared (through the page cache) with any other process mapping the same file.
+      *               Writing to the tensor makes private copies of the pages touched; the file is never modified
+      *               (but it must not be overwritten or truncated while the tensor is alive).
+      *               16-bit files are always read (they have to be converted to float).
       *  @return    Tensor
     */
-    static Tensor* load(const string& filename, string format="");
+    static Tensor* load(const string& filename, string format="", bool mmap=false);
     template<typename T> static Tensor* load(const string& filename, string format="");
 
 //    /**
@@ -311,7 +330,7 @@ public:
       *  @param ofs     Filestream.
       *  @param format    Format to use. The accepted formats are the following:
       *                     - Text: csv, tsv, txt
-      *                     - Other: bin
+      *                     - Other: bin, fp16, bf16 (bin with 16-bit data, loaded as bin)
       *  @return    void
     */
     void savefs(std::ofstream &ofs, string format="");
@@ -323,7 +342,7 @@ public:
       *  @param format    Filetype. The accepted filetypes are the following:
       *                     - Images: png, bmp, tga, jpg, jpeg, hdr.
       *                     - Text: csv, tsv, txt
-      *                     - Other: bin
+      *                     - Other: bin, fp16, bf16 (bin with 16-bit data, loaded as bin)
       *  @return    void
     */
     void save(const string& filename, string format="");
@@ -2850,6 +2869,15 @@ public:
       *  @return     Tensor
     */
     Tensor* select(const vector<string>& indices);
+
+    /**
+      *  @brief Returns a tensor that shares the memory of the selected indices of the tensor (no copy).
+      *  The selected elements must be contiguous in memory, e.g. ``{"2:5", ":", ":"}`` or ``{"1", "0", "3:8"}``.
+      *
+      *  @param indices  Vector of strings representing the indices to be selected. These indices must follow a Python-like syntax. Some examples: ``"0"`` , ``":5"`` , ``":"`` , ``"3:6"``.
+      *  @return     Tensor
+    */
+    Tensor* view(const vector<string>& indices);
     static void select(Tensor *A, Tensor *B, SelDescriptor *sd);
     static void select_back(Tensor *A, Tensor *B, SelDescriptor *sd);
 
@@ -2880,6 +2908,34 @@ public:
     */
     Tensor* clone();
 
+    /**
+     *  @brief Copy of the tensor with another storage type (CPU only).
+     *  16-bit tensors keep two values per float of "ptr" and only are accepted by copy, mult2D (as B), save and astype.
+     *
+     *  @param dtype  DTYPE_FLOAT32, DTYPE_FLOAT16 or DTYPE_BFLOAT16. Conversions round to nearest even.
+     *  @return    Tensor
+    */
+    Tensor* astype(int dtype);
+
+    /**
+     *  @brief Wraps a tensor to build a lazy elementwise expression (float32 CPU tensors, see tensor_expr.h).
+     *  Operators (+, -, *, /) and functions (sqr, sqrt, exp, log, abs, pow, sigmoid, tanh, maximum, minimum)
+     *  over these wrappers and scalars are not computed until the expression is assigned to a tensor.
+     *
+     *  @param A  Input tensor
+     *  @return    Expression
+    */
+    static tensorExpr::Leaf expr(Tensor *A);
+
+    /**
+     *  @brief Evaluates an elementwise expression into this tensor, in a single pass over the data.
+     *  The tensor can be an operand of the expression.
+     *
+     *  @param e  Expression (see Tensor::expr)
+     *  @return    void
+    */
+    template<typename E> void assign(const tensorExpr::Expr<E> &e);
+
     /**
       *  @brief Reallocates a tensor into this one.
       *  Replaces the pointer of this tensor, with the pointer of a reference tensor.
@@ -3214,7 +3270,7 @@ Tensor* Tensor::load(const string& filename, string format){
        format=="hdr" || format=="psd" || format=="tga" || format=="gif" ||
        format=="pic"  || format=="pgm"  || format=="ppm") { // Images
         t = Tensor::load_from_img(filename, format);
-    }else if(format=="bin"){
+    }else if(format=="bin" || format=="fp16" || format=="bf16"){
         t = Tensor::loadfs(ifs, format);
     }else{
         msg("Format not implemented: *.'" + format + "'", "Tensor::load");
@@ -3243,4 +3299,6 @@ void checkCompatibility(Tensor *A, Tensor *B, const string &title);
 */
 void checkCompatibility(Tensor *A, Tensor *B, Tensor *C, const string &title);
 
+#include "eddl/tensor/tensor_expr.h"
+
 #endif //EDDL_TENSOR_H
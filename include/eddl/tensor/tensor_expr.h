@@ -0,0 +1,153 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#ifndef EDDL_TENSOR_EXPR_H
+#define EDDL_TENSOR_EXPR_H
+
+#include <cmath>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/utils.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+// Lazy elementwise expressions (float32 CPU tensors).
+// Tensor::expr(A) wraps a tensor, and the usual operators and functions (below)
+// build an expression tree at compile time without touching any data. Nothing
+// is computed until the expression is assigned to a tensor (Tensor::assign),
+// which runs a single parallel loop (on the CPU pool) over all the elements. So:
+//
+//     auto m = Tensor::expr(mT), g = Tensor::expr(grad);
+//     mT->assign(beta * m + (1.0f - beta) * g);
+//
+// reads mT and grad once and writes mT once, instead of one pass per operation.
+// All the tensors of an expression must have the same size (scalars are
+// broadcasted) and the destination may be one of them, since every element
+// only depends on the same element of the operands.
+
+namespace tensorExpr {
+
+    template<typename E>
+    struct Expr {
+        const E &self() const { return static_cast<const E &>(*this); }
+    };
+
+    // Leaves
+    struct Leaf : public Expr<Leaf> {
+        const float *ptr;
+        unsigned long int size;
+        bool cpu;
+
+        explicit Leaf(Tensor *A) : ptr(A->ptr), size(A->size), cpu(A->isCPU() && (A->dtype == DTYPE_FLOAT32)) {}
+        inline float operator[](unsigned long int i) const { return ptr[i]; }
+    };
+
+    struct Scalar : public Expr<Scalar> {
+        float v;
+        unsigned long int size;  // 0: broadcasted
+        bool cpu;
+
+        explicit Scalar(float v) : v(v), size(0), cpu(true) {}
+        inline float operator[](unsigned long int) const { return v; }
+    };
+
+    // Nodes
+    template<typename Op, typename A>
+    struct Unary : public Expr<Unary<Op, A>> {
+        A a;
+        unsigned long int size;
+        bool cpu;
+
+        explicit Unary(const A &a) : a(a), size(a.size), cpu(a.cpu) {}
+        inline float operator[](unsigned long int i) const { return Op::apply(a[i]); }
+    };
+
+    template<typename Op, typename A, typename B>
+    struct Binary : public Expr<Binary<Op, A, B>> {
+        A a;
+        B b;
+        unsigned long int size;
+        bool cpu;
+
+        Binary(const A &a, const B &b) : a(a), b(b), size(a.size ? a.size : b.size), cpu(a.cpu && b.cpu) {
+            if (a.size && b.size && (a.size != b.size)) msg("Incompatible sizes", "tensorExpr");
+        }
+        inline float operator[](unsigned long int i) const { return Op::apply(a[i], b[i]); }
+    };
+
+    // Operations (the math functions are the ones of cpu_math.cpp)
+    struct OpAdd { static inline float apply(float x, float y) { return x + y; } };
+    struct OpSub { static inline float apply(float x, float y) { return x - y; } };
+    struct OpMult { static inline float apply(float x, float y) { return x * y; } };
+    struct OpDiv { static inline float apply(float x, float y) { return x / y; } };
+    struct OpPow { static inline float apply(float x, float y) { return ::powf(x, y); } };
+    struct OpMaximum { static inline float apply(float x, float y) { return x > y ? x : y; } };
+    struct OpMinimum { static inline float apply(float x, float y) { return x < y ? x : y; } };
+
+    struct OpNeg { static inline float apply(float x) { return -x; } };
+    struct OpAbs { static inline float apply(float x) { return ::fabsf(x); } };
+    struct OpSqr { static inline float apply(float x) { return x * x; } };
+    struct OpSqrt { static inline float apply(float x) { return ::sqrtf(x); } };
+    struct OpExp { static inline float apply(float x) { return ::expf(x); } };
+    struct OpLog { static inline float apply(float x) { return ::logf(x); } };
+    struct OpSigmoid { static inline float apply(float x) { return 1.0f / (1.0f + ::expf(-x)); } };
+    struct OpTanh { static inline float apply(float x) { return ::tanhf(x); } };
+
+#define TENSOR_EXPR_BINARY(NAME, OP) \
+    template<typename A, typename B> \
+    inline Binary<OP, A, B> NAME(const Expr<A> &a, const Expr<B> &b) { return Binary<OP, A, B>(a.self(), b.self()); } \
+    template<typename A> \
+    inline Binary<OP, A, Scalar> NAME(const Expr<A> &a, float b) { return Binary<OP, A, Scalar>(a.self(), Scalar(b)); } \
+    template<typename B> \
+    inline Binary<OP, Scalar, B> NAME(float a, const Expr<B> &b) { return Binary<OP, Scalar, B>(Scalar(a), b.self()); }
+
+#define TENSOR_EXPR_UNARY(NAME, OP) \
+    template<typename A> \
+    inline Unary<OP, A> NAME(const Expr<A> &a) { return Unary<OP, A>(a.self()); }
+
+    TENSOR_EXPR_BINARY(operator+, OpAdd)
+    TENSOR_EXPR_BINARY(operator-, OpSub)
+    TENSOR_EXPR_BINARY(operator*, OpMult)
+    TENSOR_EXPR_BINARY(operator/, OpDiv)
+    TENSOR_EXPR_BINARY(pow, OpPow)
+    TENSOR_EXPR_BINARY(maximum, OpMaximum)
+    TENSOR_EXPR_BINARY(minimum, OpMinimum)
+
+    TENSOR_EXPR_UNARY(operator-, OpNeg)
+    TENSOR_EXPR_UNARY(abs, OpAbs)
+    TENSOR_EXPR_UNARY(sqr, OpSqr)
+    TENSOR_EXPR_UNARY(sqrt, OpSqrt)
+    TENSOR_EXPR_UNARY(exp, OpExp)
+    TENSOR_EXPR_UNARY(log, OpLog)
+    TENSOR_EXPR_UNARY(sigmoid, OpSigmoid)
+    TENSOR_EXPR_UNARY(tanh, OpTanh)
+
+#undef TENSOR_EXPR_BINARY
+#undef TENSOR_EXPR_UNARY
+
+}
+
+
+inline tensorExpr::Leaf Tensor::expr(Tensor *A) {
+    return tensorExpr::Leaf(A);
+}
+
+template<typename E>
+void Tensor::assign(const tensorExpr::Expr<E> &expr) {
+    const E &e = expr.self();
+
+    if (!this->isCPU() || (this->dtype != DTYPE_FLOAT32) || !e.cpu) msg("Only float32 CPU tensors", "Tensor::assign");
+    if ((e.size != 0) && (e.size != this->size)) msg("Incompatible size", "Tensor::assign");
+
+    float *B = this->ptr;
+    cpu_parallel_for(0, this->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B[i] = e[i];
+    });
+}
+
+#endif //EDDL_TENSOR_EXPR_H
@@ -22,8 +22,19 @@ void * eddl_malloc(size_t size, const string & str_info = "");
 
 void eddl_free(void * ptr);
 
+// Bypass the memory pool
+void * eddl_system_malloc(size_t size, const string & str_info = "");
+
+void eddl_system_free(void * ptr);
+
 float *get_fmem(unsigned long int size, const string &str);
 
+// Maps "size" bytes of a file (from "offset") in memory. Returns nullptr if it
+// is not possible; the data pointer is released with eddl_free (or eddl_munmap)
+void * eddl_mmap(const string &filename, size_t offset, size_t size);
+
+bool eddl_munmap(void * ptr);
+
 string bytes2human(unsigned long long int bytes, int decimals=2);
 
 unsigned long get_free_mem();
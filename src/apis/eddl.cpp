@@ -16,6 +16,8 @@
 
 #include "eddl/apis/eddl.h"
 #include "eddl/utils.h"
+#include "eddl/random.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
 using namespace std;
@@ -56,6 +58,32 @@ namespace eddl {
         net->setTrainable(lname,val);
     }
 
+    void setWeightsDtype(model net, const string& dtype)
+    {
+        if (dtype == "float32") net->set_weights_dtype(DTYPE_FLOAT32);
+        else if (dtype == "float16") net->set_weights_dtype(DTYPE_FLOAT16);
+        else if (dtype == "bfloat16") net->set_weights_dtype(DTYPE_BFLOAT16);
+        else msg("Unknown dtype '" + dtype + "'", "setWeightsDtype");
+    }
+
+    void setFusion(model net, bool enable)
+    {
+        if (net->isbuild) msg("The model is already built", "setFusion");
+        net->fusion = enable;
+    }
+
+    void setChannelsLast(model net, bool enable)
+    {
+        if (net->isbuild) msg("The model is already built", "setChannelsLast");
+        net->channels_last = enable;
+    }
+
+    void setInputOverlap(model net, bool enable)
+    {
+        net->input_overlap = enable;
+        if (!enable) net->stage_reset();
+    }
+
     vector<vtensor> get_parameters(model net, bool deepcopy, bool tocpu){
         return net->get_parameters(deepcopy, tocpu);
     }
@@ -178,10 +206,18 @@ namespace eddl {
       if (mem=="low_mem") return new CompServ(th, {}, {}, 0, 2);
       else if (mem=="mid_mem") return new CompServ(th, {}, {}, 0, 1);
       else if (mem=="full_mem") return new CompServ(th, {}, {}, 0, 0);
+      else if (mem=="recompute_mem") return new CompServ(th, {}, {}, 0, 3);
       else msg("Error mem param","CS_CPU"); // Exits
       return nullptr; // To silent warnings
     }
 
+    compserv CS_CPU(int th, string mem, bool pin, bool numa){
+        compserv cs = CS_CPU(th, mem);
+        cs->pin_threads = pin;
+        cs->numa = numa;
+        return cs;
+    }
+
     compserv CS_GPU(const vector<int> g){
         return CS_GPU(g, 1, "full_mem");
     }
@@ -224,6 +260,16 @@ namespace eddl {
         return new CompServ(filename);
     }
 
+    void set_seed(unsigned long seed){
+        rand_seed(seed);
+        srand(seed);
+    }
+
+    void set_deterministic(bool enable, unsigned long seed){
+        if (enable) set_seed(seed);
+        cpu_set_deterministic(enable);
+    }
+
     // Info and logs
     void setlogfile(model net,string fname)
     {
@@ -289,6 +335,9 @@ namespace eddl {
     void fit(model net, const vector<Tensor *> &in, const vector<Tensor *> &out, int batch, int epochs){
         net->fit(in, out, batch, epochs);
     }
+    void fit(model net, DataLoader *loader, int epochs){
+        net->fit(loader, epochs);
+    }
     void evaluate(model net, const vector<Tensor *> &in, const vector<Tensor *> &out,int bs){
         net->evaluate(in, out, bs);
     }
@@ -296,17 +345,28 @@ namespace eddl {
     {
       return m->predict(in);
     }
+    void calibrate(model m, const vector<Tensor *> &in, int bs)
+    {
+      m->calibrate(in, bs);
+    }
+    void quantize(model m, bool enable)
+    {
+      m->quantize(enable);
+    }
 
     // Finer methods
     vector<int> random_indices(int batch_size, int num_samples){
         vector<int> sind;
-        for (int k = 0; k < batch_size; k++) sind.push_back(rand() % num_samples);
+        for (int k = 0; k < batch_size; k++) sind.push_back(rand_int(num_samples));
         return sind;
     }
     void train_batch(model net, vector<Tensor *> in, vector<Tensor *> out, vector<int> indices){
         net->tr_batches++;
         net->train_batch(in, out, indices);
     }
+    void prefetch_batch(model net, vector<Tensor *> in, vector<Tensor *> out, vector<int> indices){
+        net->prefetch_batch(in, out, indices);
+    }
     void eval_batch(model net, vector<Tensor *> in, vector<Tensor *> out, vector<int> indices){
         net->train_batch(in, out, indices,1);
     }
@@ -324,7 +384,7 @@ namespace eddl {
         batch_size=out[0]->shape[0];
         n=in[0]->shape[0];
         vector<int> sind(batch_size);
-        for (i = 0; i < batch_size; i++) sind[i] = rand() % n;
+        for (i = 0; i < batch_size; i++) sind[i] = rand_int(n);
 
         for (i = 0; i<in.size();i++)
             Tensor::select(in[i], out[i], sind, 0, batch_size);
@@ -1244,16 +1304,26 @@ namespace eddl {
     // Manage Tensors inside Layers
     ////////////////////////////////////
 
+    // Copy of the output (or the delta) of a layer, in NCHW even if the layer
+    // stores it channels-last (see Net::set_layout)
+    static Tensor* layout_clone(layer l1, Tensor *t){
+        if (!l1->channels_last) return t->clone();
+        Tensor *view = new Tensor({t->shape[0], t->shape[2], t->shape[3], t->shape[1]}, t);
+        Tensor *out = Tensor::permute(view, {0, 3, 1, 2});
+        delete view;
+        return out;
+    }
+
     // get COPIES of tensors
     // collect from CS when necessary
     Tensor* getOutput(layer l1){
         collectTensor(l1,"output");
-        return l1->output->clone();  // Why not return addresses so that we can easily avoid potential memory leaks?
+        return layout_clone(l1, l1->output);  // Why not return addresses so that we can easily avoid potential memory leaks?
     }
 
     Tensor* getDelta(layer l1){
         collectTensor(l1,"delta");
-        return l1->delta->clone();
+        return layout_clone(l1, l1->delta);
     }
 
     Tensor* getParam(layer l1, int p){
@@ -1422,6 +1492,14 @@ namespace eddl {
         return l;
     }
 
+    ///////////////////////////////////////
+    //  ACTIVATION RECOMPUTATION
+    ///////////////////////////////////////
+    layer Checkpoint(layer l){
+        l->checkpoint = true;
+        return l;
+    }
+
     ///////////////////////////////////////
     //  DATASETS
     ///////////////////////////////////////
@@ -13,6 +13,7 @@
 #include <algorithm>
 
 #include "eddl/hardware/cpu/cpu_profile.h"
+#include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
 
 #ifdef cGPU
 #include "eddl/hardware/gpu/gpu_tensor.h"
@@ -23,6 +24,12 @@
 #include "eddl/hardware/fpga/fpga_hw.h"
 #endif
 
+// Winograd on CPU: min. input and output channels (the transforms cost more
+// than the products they save with fewer) and min. output rows and cols for
+// F(4x4,3x3) (smaller maps use F(2x2,3x3), which wastes less in the borders)
+#define WINOGRAD_MIN_CHANNELS 16
+#define WINOGRAD_F4_SIZE 16
+
 ConvolDescriptor::ConvolDescriptor() {}
 
 ConvolDescriptor::ConvolDescriptor(int filters, const vector<int> &kernel_size, const vector<int> &strides, string padding, const vector<int> &pads,
@@ -56,6 +63,9 @@ ConvolDescriptor::~ConvolDescriptor(){
     // input, output, delta, params[], and gradients[], acc_gradients[] => deleted in ~Layer()
     if (O->isCPU()) {
         eddl_free(ptrI); // because get_fmem() now uses posix_memalign()
+        eddl_free(ptrW);
+        eddl_free(ptrKcl);
+        eddl_free(ptrgKcl);
     }
 #ifdef cGPU
 #ifndef cCUDNN
@@ -86,11 +96,28 @@ void ConvolDescriptor::build(Tensor *A) {
     nk = ksize[0];
     kr = ksize[1];
     kc = ksize[2];
-    kz = A->shape[1];
+
+    // Grouped: each group of nk/groups kernels sees iz/groups input channels
+    if (groups < 1) groups = 1;
+    if ((A->shape[1] % groups) || (nk % groups)) {
+        msg("The input channels (" + to_string(A->shape[1]) + ") and the filters (" + to_string(nk) +
+            ") must be multiples of the groups (" + to_string(groups) + ")", "ConvolDescriptor::build");
+    }
+    if ((groups > 1) && !A->isCPU()) msg("Grouped convolutions are only supported on CPU", "ConvolDescriptor::build");
+    kz = A->shape[1] / groups;
 
     sr = stride[0];
     sc = stride[1];
 
+    // The kernel element (ky, kx) reads the pixel (y*sr + ky*dr, x*sc + kx*dc), so
+    // a dilated kernel spans (kr-1)*dr+1 x (kc-1)*dc+1 pixels
+    dr = (dilation_rate.size() > 0) ? dilation_rate[0] : 1;
+    dc = (dilation_rate.size() > 1) ? dilation_rate[1] : 1;
+    if (dr < 1 || dc < 1) msg("The dilation rate must be positive", "ConvolDescriptor::build");
+#ifndef cCUDNN
+    if ((dr > 1 || dc > 1) && !A->isCPU()) msg("Dilated convolutions are only supported on CPU", "ConvolDescriptor::build");
+#endif
+
     in = A->shape[0]; //batch size
     iz = A->shape[1];
     ir = A->shape[2];
@@ -100,26 +127,26 @@ void ConvolDescriptor::build(Tensor *A) {
         // Compute output
         z = nk;
         vector<int>pr; pr.push_back(pads[0]);pr.push_back(pads[1]);
-        r = compute_output(pr, ir, kr, sr);
+        r = compute_output(pr, ir, kr, sr, dr);
 
         vector<int>pc; pc.push_back(pads[2]);pc.push_back(pads[3]);
-        c = compute_output(pc, ic, kc, sc);
+        c = compute_output(pc, ic, kc, sc, dc);
 
     }else{  // Common padding (same/zeros)
         // Compute output
         z = nk;
 
-        if (padding=="same,none") r = compute_output("same", ir, kr, sr);
-        else if (padding=="none,same")  r = compute_output("none", ir, kr, sr);
-        else r = compute_output(this->padding, ir, kr, sr);
+        if (padding=="same,none") r = compute_output("same", ir, kr, sr, dr);
+        else if (padding=="none,same")  r = compute_output("none", ir, kr, sr, dr);
+        else r = compute_output(this->padding, ir, kr, sr, dr);
 
-        if (padding=="same,none") c = compute_output("none", ic, kc, sc);
-        else if (padding=="none,same")  c = compute_output("same", ic, kc, sc);
-        else c = compute_output(this->padding, ic, kc, sc);
+        if (padding=="same,none") c = compute_output("none", ic, kc, sc, dc);
+        else if (padding=="none,same")  c = compute_output("same", ic, kc, sc, dc);
+        else c = compute_output(this->padding, ic, kc, sc, dc);
 
-        // Compute padding
-        vector<int> padr = compute_padding(r, ir, kr, sr, this->padding,true);  // Order: [top, bottom]
-        vector<int> padc = compute_padding(c, ic, kc, sc, this->padding,false);  // Order: [left, right]
+        // Compute padding (with the span of the dilated kernel)
+        vector<int> padr = compute_padding(r, ir, (kr-1)*dr+1, sr, this->padding,true);  // Order: [top, bottom]
+        vector<int> padc = compute_padding(c, ic, (kc-1)*dc+1, sc, this->padding,false);  // Order: [left, right]
 
         // Set padding
         this->pads.clear();
@@ -174,11 +201,17 @@ void ConvolDescriptor::build(Tensor *A) {
     gbias = new Tensor(vector<int>{nk}, I->device);
 
     if (I->isCPU()) {
-        // mem for ptr, lowering im2col
-        unsigned long int l_size =  (unsigned long)(A->shape[0] * r * c) * (unsigned long)(kr * kc * kz);
-        ptrI=get_fmem(l_size,"ConvolDescriptor::build");
-        matI=Eigen::Map<Eigen::MatrixXf>(ptrI, r*c,kz*kr*kc);
-	   _profile_add_tensor(A->shape[0] * r * c * kr * kc * kz);
+        // The lowering (im2col) works by tiles in a workspace of each thread (see cpu_conv.cpp)
+
+        // One input channel for each group: direct loops
+        depthwise = (groups > 1 && kz == 1);
+
+        // 3x3 with stride 1: Winograd
+        if (kr == 3 && kc == 3 && sr == 1 && sc == 1 && groups <= 1 && dr == 1 && dc == 1 &&
+            kz >= WINOGRAD_MIN_CHANNELS && nk >= WINOGRAD_MIN_CHANNELS) {
+            winograd = (r >= WINOGRAD_F4_SIZE && c >= WINOGRAD_F4_SIZE) ? 4 : 2;
+            ptrW = get_fmem(cpu_winograd_size(this), "ConvolDescriptor::build");
+        }
     }
 #ifdef cGPU
     else if (I->isGPU()) {
@@ -222,7 +255,7 @@ void ConvolDescriptor::build(Tensor *A) {
     cudnnSetConvolution2dDescriptor(convolution_descriptor,
                                     pads[0], pads[2],
                                     stride[0], stride[1],
-                                    1,1,
+                                    dr, dc,
                                     convolution_mode, data_type);
 
 
@@ -263,13 +296,8 @@ void ConvolDescriptor::resize(int b)
     O->resize(b);
 
 
-    // Prevent overflow. (512*512*512*3*3*3 = 3,623,878,656 > MAX_INT (2,147,483,647))
-    unsigned long int l_size =  (unsigned long)(b * r * c) * (unsigned long)(kr * kc * kz);
-
     if (I->isCPU()) {
-        eddl_free(ptrI); // because get_fmem() now uses posix_memalign()
-        ptrI=get_fmem(l_size, "ConvolDescriptor::build");
-	   _profile_add_tensor(l_size);
+        // The workspaces do not depend on the batch (see cpu_conv.cpp and cpu_winograd.cpp)
     }
 #ifdef cGPU
     else if (I->isGPU()) {
@@ -295,6 +323,9 @@ void ConvolDescriptor::resize(int b)
 
 #ifdef cFPGA
     else if (I->isFPGA()) {
+        // Prevent overflow. (512*512*512*3*3*3 = 3,623,878,656 > MAX_INT (2,147,483,647))
+        unsigned long int l_size =  (unsigned long)(b * r * c) * (unsigned long)(kr * kc * kz);
+
         // We reallocate memory on the FGPA for the im2col buffer
 	fpga_destroy_memory(fpga_ptrI);
 	fpga_sizeI = l_size * sizeof(float);
@@ -25,11 +25,14 @@
 
 ConvolDescriptor3D::ConvolDescriptor3D() {}
 
-ConvolDescriptor3D::ConvolDescriptor3D(const vector<int> &ks, const vector<int> &st, const vector<int> &p, int mem) {
+ConvolDescriptor3D::ConvolDescriptor3D(const vector<int> &ks, const vector<int> &st, const vector<int> &p, int mem,
+                                       int groups, const vector<int> &dilation_rate) {
     ksize = vector<int>(ks.begin(), ks.end());
     stride = vector<int>(st.begin(), st.end());
     pad = vector<int>(p.begin(), p.end());
     mem_level=mem;
+    this->groups = groups;
+    this->dilation_rate = dilation_rate;
 
     this->padding = "custom";
 
@@ -37,7 +40,11 @@ ConvolDescriptor3D::ConvolDescriptor3D(const vector<int> &ks, const vector<int>
     if (stride.size() != 3) msg("Strides must have 3 dimensions", "ConvolDescriptor3D::ConvolDescriptor3D");
 }
 
-ConvolDescriptor3D::ConvolDescriptor3D(int filters, const vector<int> &ks, const vector<int> &st, const string& p, bool ub, int mem) {
+ConvolDescriptor3D::ConvolDescriptor3D(int filters, const vector<int> &ks, const vector<int> &st, const string& p, bool ub, int mem) :
+        ConvolDescriptor3D(filters, ks, st, p, 1, {}, ub, mem) {}
+
+ConvolDescriptor3D::ConvolDescriptor3D(int filters, const vector<int> &ks, const vector<int> &st, const string& p,
+                                       int groups, const vector<int> &dilation_rate, bool ub, int mem) {
     if (ks.size() != 3) { msg("Kernels must have 4 dimensions", "ConvolDescriptor3D::ConvolDescriptor3D"); }
     if (st.size() != 3) { msg("Strides must have 3 dimensions", "ConvolDescriptor3D::ConvolDescriptor3D"); }
 
@@ -47,6 +54,8 @@ ConvolDescriptor3D::ConvolDescriptor3D(int filters, const vector<int> &ks, const
     stride = vector<int>(st.begin(), st.end());
     use_bias=ub;
     mem_level=mem;
+    this->groups = groups;
+    this->dilation_rate = dilation_rate;
 
     if (p=="same" || p =="none" || p =="valid" || p =="zeros" || p=="same,none" || p=="none,same") {
         this->padding=p;
@@ -87,15 +96,31 @@ void ConvolDescriptor3D::build(Tensor *A) {
     I = A;
 
     nk = ksize[0];
-    kz = A->shape[1];
     kd = ksize[1];
     kr = ksize[2];
     kc = ksize[3];
 
+    // Grouped: each group of nk/groups kernels sees iz/groups input channels
+    if (groups < 1) groups = 1;
+    if ((A->shape[1] % groups) || (nk % groups)) {
+        msg("The input channels (" + to_string(A->shape[1]) + ") and the filters (" + to_string(nk) +
+            ") must be multiples of the groups (" + to_string(groups) + ")", "ConvolDescriptor3D::build");
+    }
+    if ((groups > 1) && !A->isCPU()) msg("Grouped convolutions are only supported on CPU", "ConvolDescriptor3D::build");
+    kz = A->shape[1] / groups;
+
     sd = stride[0];
     sr = stride[1];
     sc = stride[2];
 
+    // The kernel element (kw, ky, kx) reads the voxel (w*sd + kw*dd, y*sr + ky*dr, x*sc + kx*dc)
+    if (!dilation_rate.empty() && dilation_rate.size() != 3) msg("The dilation rate must have 3 dimensions", "ConvolDescriptor3D::build");
+    dd = dilation_rate.empty() ? 1 : dilation_rate[0];
+    dr = dilation_rate.empty() ? 1 : dilation_rate[1];
+    dc = dilation_rate.empty() ? 1 : dilation_rate[2];
+    if (dd < 1 || dr < 1 || dc < 1) msg("The dilation rate must be positive", "ConvolDescriptor3D::build");
+    if ((dd > 1 || dr > 1 || dc > 1) && !A->isCPU()) msg("Dilated convolutions are only supported on CPU", "ConvolDescriptor3D::build");
+
     iz = A->shape[1];
     id = A->shape[2];
     ir = A->shape[3];
@@ -106,13 +131,13 @@ void ConvolDescriptor3D::build(Tensor *A) {
         z = nk;
 
         vector<int>pd; pd.push_back(pad[0]);pd.push_back(pad[1]);
-        d = compute_output(pd, id, kd, sd);
+        d = compute_output(pd, id, kd, sd, dd);
 
         vector<int>pr; pr.push_back(pad[2]);pr.push_back(pad[3]);
-        r = compute_output(pr, ir, kr, sr);
+        r = compute_output(pr, ir, kr, sr, dr);
 
         vector<int>pc; pc.push_back(pad[4]);pc.push_back(pad[5]);
-        c = compute_output(pc, ic, kc, sc);
+        c = compute_output(pc, ic, kc, sc, dc);
 
     }else{  // Common padding (same/zeros)
         // Compute output
@@ -121,32 +146,32 @@ void ConvolDescriptor3D::build(Tensor *A) {
         z = nk;
 
         // Depth
-        if (padding=="same,none") d = compute_output("same", id, kd, sd);
-        else if (padding=="none,same")  d = compute_output("none", id, kd, sd);
-        else d = compute_output(this->padding, id, kd, sd);
+        if (padding=="same,none") d = compute_output("same", id, kd, sd, dd);
+        else if (padding=="none,same")  d = compute_output("none", id, kd, sd, dd);
+        else d = compute_output(this->padding, id, kd, sd, dd);
 
         // Rows
-        if (padding=="same,none") r = compute_output("same", ir, kr, sr);
-        else if (padding=="none,same")  r = compute_output("none", ir, kr, sr);
-        else r = compute_output(this->padding, ir, kr, sr);
+        if (padding=="same,none") r = compute_output("same", ir, kr, sr, dr);
+        else if (padding=="none,same")  r = compute_output("none", ir, kr, sr, dr);
+        else r = compute_output(this->padding, ir, kr, sr, dr);
 
         // Cols
-        if (padding=="same,none") c = compute_output("none", ic, kc, sc);
-        else if (padding=="none,same")  c = compute_output("same", ic, kc, sc);
-        else c = compute_output(this->padding, ic, kc, sc);
+        if (padding=="same,none") c = compute_output("none", ic, kc, sc, dc);
+        else if (padding=="none,same")  c = compute_output("same", ic, kc, sc, dc);
+        else c = compute_output(this->padding, ic, kc, sc, dc);
 
-        // Compute padding
-        vector<int> padd = compute_padding(d, id, kd, sd, this->padding,true);  // Order: [front, back]
-        vector<int> padr = compute_padding(r, ir, kr, sr, this->padding,true);  // Order: [top, bottom]
-        vector<int> padc = compute_padding(c, ic, kc, sc, this->padding,false);  // Order: [left, right]
+        // Compute padding (with the span of the dilated kernel)
+        vector<int> padd = compute_padding(d, id, (kd-1)*dd+1, sd, this->padding,true);  // Order: [front, back]
+        vector<int> padr = compute_padding(r, ir, (kr-1)*dr+1, sr, this->padding,true);  // Order: [top, bottom]
+        vector<int> padc = compute_padding(c, ic, (kc-1)*dc+1, sc, this->padding,false);  // Order: [left, right]
 
         // Set padding
         pad = {padd[0], padd[1], padr[0], padr[1], padc[0], padc[1]};  // (front, back), (top, bottom), (left, right)
     }
 
-    paddf = pad[0]; paddb = pad[1];  // depth: front-top
-    padrt = pad[1]; padrb = pad[2];  // rows: top-bottom
-    padcl = pad[3]; padcr = pad[4];  // cols: left-right
+    paddf = pad[0]; paddb = pad[1];  // depth: front-back
+    padrt = pad[2]; padrb = pad[3];  // rows: top-bottom
+    padcl = pad[4]; padcr = pad[5];  // cols: left-right
 
     if ((d <= 0) || (r <= 0) || (c <= 0)) {
         if(d <= 0) { std::cerr << "'Depth' are reach 0 or less (" << d << ")" << std::endl; }
@@ -165,11 +190,7 @@ void ConvolDescriptor3D::build(Tensor *A) {
     gbias = new Tensor(vector<int>{nk}, I->device);
 
     if (I->isCPU()) {
-        // mem for ptr, lowering im2col
-        unsigned long int l_size =  (unsigned long)(A->shape[0] * d * r * c) * (unsigned long)(kz * kd* kr * kc);
-        ptrI=get_fmem(l_size,"ConvolDescriptor3D::build");
-        matI=Eigen::Map<Eigen::MatrixXf>(ptrI, d*r*c,kz*kd*kr*kc);
-	   _profile_add_tensor(A->shape[0] * d * r * c * kz * kd * kr * kc);
+        // The lowering (vol2col) works by tiles in a workspace of each thread (see cpu_conv.cpp)
     }
 #ifdef cGPU
     else if (I->isGPU()) {
@@ -222,13 +243,8 @@ void ConvolDescriptor3D::resize(int b)
     O->resize(b);
 
 
-    // Prevent overflow. (512*512*512*512*3*3*3*3 = 3,623,878,656 > MAX_INT (2,147,483,647))
-    unsigned long int l_size =  (unsigned long)(b * d * r * c) * (unsigned long)(kz * kd * kr * kc);
-
     if (I->isCPU()) {
-        eddl_free(ptrI);
-        ptrI=get_fmem(l_size, "ConvolDescriptor3D::build");
-	   _profile_add_tensor(l_size);
+        // Nothing to resize: the vol2col tiles do not depend on the batch
     }
 #ifdef cGPU
     else if (I->isGPU()) {
@@ -243,6 +259,9 @@ void ConvolDescriptor3D::resize(int b)
 
 #ifdef cFPGA
     else if (I->isFPGA()) {
+        // Prevent overflow. (512*512*512*512*3*3*3*3 = 3,623,878,656 > MAX_INT (2,147,483,647))
+        unsigned long int l_size =  (unsigned long)(b * d * r * c) * (unsigned long)(kz * kd * kr * kc);
+
         // We reallocate memory on the FGPA for the im2col buffer
 	fpga_destroy_memory(fpga_ptrI);
 	fpga_sizeI = l_size * sizeof(float);
@@ -10,6 +10,7 @@
 
 
 #include "eddl/descriptors/tensor_descriptors.h"
+#include "eddl/tensor/tensor.h"
 #include "eddl/utils.h"
 
 PermuteDescriptor::PermuteDescriptor(const vector<int>& dims, int dev) : SelDescriptor(dev) {
@@ -22,6 +23,12 @@ void PermuteDescriptor::build(vector<int> ishape){
     this->ishape = ishape;
     this->oshape = permute_shape(ishape, this->dims);
 
+    // The output dimension d walks the input dimension dims[d]
+    vector<int> istride = shape2stride(ishape);
+    vector<int> strides;
+    for(auto &d : this->dims) strides.push_back(istride[d]);
+    this->build_view(0, strides);
+
     // Build indices
     this->build_indices();
 }
@@ -40,5 +47,8 @@ void PermuteDescriptor::build_indices(){
     this->free_memory();
 
     // Compute index translation (output=>input)
-    this->cpu_addresses = permute_indices(this->ishape, this->dims);
+    // The CPU walks the strided view, only the devices need the addresses
+    if (this->device != DEV_CPU) {
+        this->cpu_addresses = permute_indices(this->ishape, this->dims);
+    }
 }
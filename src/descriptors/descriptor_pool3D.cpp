@@ -66,11 +66,13 @@ void PoolDescriptor3D::build(Tensor *A) {
     ic = A->shape[4];
 
     if(this->padding=="custom"){  // Known padding
+        if (pad.size() != 6) msg("Padding must have 6 values", "PoolDescriptor3D::build");
+
         // Compute output
         z = iz;
-        d = compute_output(this->pad, id, kd, sd);
-        r = compute_output(this->pad, ir, kr, sr);
-        c = compute_output(this->pad, ic, kc, sc);
+        d = compute_output(vector<int>{pad[0], pad[1]}, id, kd, sd);
+        r = compute_output(vector<int>{pad[2], pad[3]}, ir, kr, sr);
+        c = compute_output(vector<int>{pad[4], pad[5]}, ic, kc, sc);
 
     }else{  // Common padding (same/zeros)
         // Compute output
@@ -88,9 +90,9 @@ void PoolDescriptor3D::build(Tensor *A) {
         pad = {padd[0], padd[1], padr[0], padr[1], padc[0], padc[1]};  // (front, back), (top, bottom), (left, right)
     }
 
-    paddf = pad[0]; paddb = pad[1];  // depth: front-top
-    padrt = pad[0]; padrb = pad[1];  // rows: top-bottom
-    padcl = pad[2]; padcr = pad[3];  // cols: left-right
+    paddf = pad[0]; paddb = pad[1];  // depth: front-back
+    padrt = pad[2]; padrb = pad[3];  // rows: top-bottom
+    padcl = pad[4]; padcr = pad[5];  // cols: left-right
 
     if ((d <= 0) || (r <= 0) || (c <= 0)) {
         if(d <= 0) { std::cerr << "'Depth' are reach 0 or less (" << d << ")" << std::endl; }
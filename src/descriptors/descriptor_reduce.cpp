@@ -21,7 +21,8 @@
 
 MapReduceDescriptor::MapReduceDescriptor(Tensor *A,vector<int> axis)
 {
-  ind=get_reduction_map(A,axis);
+  this->axis=axis;
+  ind=A->isCPU() ? nullptr : get_reduction_map(A,axis);
   gind=nullptr;
 }
 
@@ -98,6 +99,11 @@ void ReduceDescriptor::build_index() {
   // get indexes for reduction
   index.clear();
 
+  // The CPU reduces along the axis (see cpu_reduce_axis): only the size of the groups
+  red_size=1;
+  for(int a : axis) red_size*=I->shape[a];
+  if (I->isCPU()) return;
+
   vector<int> ind;
   ind.push_back(0);
   for(int i=0;i<I->ndim;i++) {
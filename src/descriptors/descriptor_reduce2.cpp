@@ -10,6 +10,7 @@
 
 #include "eddl/descriptors/tensor_descriptors.h"
 #include "eddl/utils.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 #include <algorithm>
 
 
@@ -129,12 +130,13 @@ void ReduceDescriptor2::build_map(bool reverse){
     this->cpu_addresses = new int[size];
 
     if (!reverse){ // Non-contiguous addresses to reduce.
-        #pragma omp parallel for
-        for(int i=0; i<index.size(); i++) {  // Reduce index
-            for(int j=0; j<index[i].size(); j++){  // Addresses to reduce
-                cpu_addresses[index[i][j]] = i;  // A[Original address to reduce] = reduction address
+        cpu_parallel_for(0, index.size(), cpu_grain(index.empty() ? 1 : index[0].size()), [&](long int ini, long int end) {
+            for(int i=ini; i<end; i++){  // Reduce index
+                for(int j=0; j<index[i].size(); j++){  // Addresses to reduce
+                    cpu_addresses[index[i][j]] = i;  // A[Original address to reduce] = reduction address
+                }
             }
-        }
+        });
     }else{ // Contiguous addresses to reduce.
         int k=0;
         for(int i=0; i<index.size(); i++) {  // Reduce index
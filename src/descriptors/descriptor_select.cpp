@@ -9,13 +9,17 @@
 
 
 #include "eddl/descriptors/tensor_descriptors.h"
+#include "eddl/tensor/tensor.h"
 #include "eddl/utils.h"
 
 SelDescriptor::SelDescriptor(int dev) : TensorDescriptor(dev) {
-
+    this->offset = 0;
+    this->run_size = 1;
+    this->run_dims = 0;
+    this->contiguous = false;
 }
 
-SelDescriptor::SelDescriptor(const vector<string>& indices, int dev) : TensorDescriptor(dev) {
+SelDescriptor::SelDescriptor(const vector<string>& indices, int dev) : SelDescriptor(dev) {
     this->indices = vector<string>(indices);
 }
 
@@ -27,6 +31,12 @@ void SelDescriptor::build(vector<int> ishape){
     this->ishape = ishape;
     this->oshape = indices2shape(this->idxs_range);
 
+    // Same strides than the input, starting at the first selected element
+    vector<int> istride = shape2stride(ishape);
+    int offset = 0;
+    for(int d=0; d<this->idxs_range.size(); d++) offset += this->idxs_range[d][0] * istride[d];
+    this->build_view(offset, istride);
+
     // Build indices
     this->build_indices();
 }
@@ -50,5 +60,24 @@ void SelDescriptor::build_indices(){
     this->free_memory();
 
     // Compute index translation (output=>input)
-    this->cpu_addresses = ranges2indices(this->ishape, this->idxs_range);
+    // The CPU walks the strided view, only the devices need the addresses
+    if (this->device != DEV_CPU) {
+        this->cpu_addresses = ranges2indices(this->ishape, this->idxs_range);
+    }
+}
+
+void SelDescriptor::build_view(int offset, const vector<int> &strides){
+    this->offset = offset;
+    this->strides = vector<int>(strides);
+
+    // Merge the innermost output dimensions that are consecutive in the input
+    this->run_size = 1;
+    this->run_dims = this->oshape.size();
+    while (this->run_dims > 0) {
+        int d = this->run_dims - 1;
+        if (this->oshape[d] != 1 && this->strides[d] != this->run_size) break;
+        this->run_size *= this->oshape[d];
+        this->run_dims--;
+    }
+    this->contiguous = (this->run_dims == 0);
 }
@@ -9,6 +9,7 @@
 
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 #include "eddl/system_info.h"
 
 
@@ -18,18 +19,11 @@ bool cpu_all(Tensor *A){
 
     _profile(_CPU_ALL, 0);
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        if (A->ptr[i] != 1.0f){
-            #pragma omp critical
-            {
-                res = false;
-            }
-#if defined(EDDL_LINUX) || defined(EDDL_UNIX) || defined(EDDL_APPLE)
-            #pragma omp cancel for
-#endif
-        }
-    }
+    res = cpu_parallel_reduce(0, A->size, true, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i)
+            if (A->ptr[i] != 1.0f) return false;
+        return true;
+    }, [](bool a, bool b) { return a && b; });
     _profile(_CPU_ALL, 1);
     return res;
 }
@@ -40,18 +34,11 @@ bool cpu_any(Tensor *A){
     _profile(_CPU_ANY, 0);
 
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        if (A->ptr[i] == 1.0f){
-            #pragma omp critical
-            {
-                res = true;
-            }
-#if defined(EDDL_LINUX) || defined(EDDL_UNIX) || defined(EDDL_APPLE)
-            #pragma omp cancel for
-#endif
-        }
-    }
+    res = cpu_parallel_reduce(0, A->size, false, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i)
+            if (A->ptr[i] == 1.0f) return true;
+        return false;
+    }, [](bool a, bool b) { return a || b; });
     _profile(_CPU_ANY, 1);
     return res;
 }
@@ -59,47 +46,52 @@ bool cpu_any(Tensor *A){
 // CPU: Logic functions: Comparisons
 void cpu_isfinite(Tensor *A, Tensor* B){
     _profile(_CPU_ISFINITE, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = std::isfinite(A->ptr[i]);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = std::isfinite(A->ptr[i]);
+        }
+    });
     _profile(_CPU_ISFINITE, 1);
 }
 
 void cpu_isinf(Tensor *A, Tensor* B){
     _profile(_CPU_ISINF, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = std::isinf(A->ptr[i]);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = std::isinf(A->ptr[i]);
+        }
+    });
     _profile(_CPU_ISINF, 1);
 }
 
 void cpu_isnan(Tensor *A, Tensor* B){
     _profile(_CPU_ISNAN, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = std::isnan(A->ptr[i]);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = std::isnan(A->ptr[i]);
+        }
+    });
     _profile(_CPU_ISNAN, 1);
 }
 
 
 void cpu_isneginf(Tensor *A, Tensor* B){
     _profile(_CPU_ISNEGINF, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = std::isinf(A->ptr[i]) && A->ptr[i] < 0.0f;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = std::isinf(A->ptr[i]) && A->ptr[i] < 0.0f;
+        }
+    });
     _profile(_CPU_ISNEGINF, 1);
 }
 
 void cpu_isposinf(Tensor *A, Tensor* B){
     _profile(_CPU_ISPOSINF, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = std::isinf(A->ptr[i]) && A->ptr[i] > 0.0f;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = std::isinf(A->ptr[i]) && A->ptr[i] > 0.0f;
+        }
+    });
     _profile(_CPU_ISPOSINF, 1);
 }
 
@@ -107,37 +99,41 @@ void cpu_isposinf(Tensor *A, Tensor* B){
 // CPU: Logic functions: Comparisons
 void cpu_logical_and(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_LOGICAL_AND, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = (bool)A->ptr[i] & (bool)B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = (bool)A->ptr[i] & (bool)B->ptr[i];
+        }
+    });
     _profile(_CPU_LOGICAL_AND, 1);
 }
 
 void cpu_logical_or(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_LOGICAL_OR, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = (bool)A->ptr[i] | (bool)B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = (bool)A->ptr[i] | (bool)B->ptr[i];
+        }
+    });
     _profile(_CPU_LOGICAL_OR, 1);
 }
 
 void cpu_logical_not(Tensor *A, Tensor *B){
     _profile(_CPU_LOGICAL_NOT, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = !((bool)A->ptr[i]);  // why not use "~"
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = !((bool)A->ptr[i]);  // why not use "~"
+        }
+    });
     _profile(_CPU_LOGICAL_NOT, 1);
 }
 
 void cpu_logical_xor(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_LOGICAL_XOR, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = (bool)A->ptr[i] ^ (bool)B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = (bool)A->ptr[i] ^ (bool)B->ptr[i];
+        }
+    });
     _profile(_CPU_LOGICAL_XOR, 1);
 }
 
@@ -149,21 +145,15 @@ bool cpu_allclose(Tensor *A, Tensor *B, float rtol, float atol, bool equal_nan){
     int first_idx = -1;
 
     _profile(_CPU_ALLCLOSE, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        bool close = ::fabsf(A->ptr[i] - B->ptr[i]) <= (atol + rtol * ::fabsf(B->ptr[i]));
-        if (!close){
-            #pragma omp critical
-            {
-                allclose = false;
-                if(first_idx < 0) { first_idx=i; }
-
-            }
-#if defined(EDDL_LINUX) || defined(EDDL_UNIX) || defined(EDDL_APPLE)
-            #pragma omp cancel for
-#endif
+    // First element that is not close (-1: none)
+    first_idx = (int)cpu_parallel_reduce(0, A->size, -1L, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            bool close = ::fabsf(A->ptr[i] - B->ptr[i]) <= (atol + rtol * ::fabsf(B->ptr[i]));
+            if (!close) return i;
         }
-    }
+        return -1L;
+    }, [](long int a, long int b) { return (a >= 0) ? a : b; });
+    allclose = (first_idx < 0);
     _profile(_CPU_ALLCLOSE, 1);
 
 //    // TODO: temp!
@@ -179,111 +169,124 @@ bool cpu_allclose(Tensor *A, Tensor *B, float rtol, float atol, bool equal_nan){
 
 void cpu_isclose(Tensor *A, Tensor *B, Tensor *C, float rtol, float atol, bool equal_nan){
     _profile(_CPU_ISCLOSE, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = ::fabsf(A->ptr[i] - B->ptr[i]) <= (atol + rtol * ::fabsf(B->ptr[i]));
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = ::fabsf(A->ptr[i] - B->ptr[i]) <= (atol + rtol * ::fabsf(B->ptr[i]));
+        }
+    });
     _profile(_CPU_ISCLOSE, 1);
 }
 
 
 void cpu_greater(Tensor *A, Tensor *B, float v){
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] > v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] > v;
+        }
+    });
 }
 
 void cpu_greater(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_GREATER, 0);
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] > B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] > B->ptr[i];
+        }
+    });
     _profile(_CPU_GREATER, 1);
 }
 
 
 void cpu_greater_equal(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] >= v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] >= v;
+        }
+    });
 }
 
 void cpu_greater_equal(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_GREATER_EQUAL, 0);
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] >= B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] >= B->ptr[i];
+        }
+    });
     _profile(_CPU_GREATER_EQUAL, 1);
 }
 
 void cpu_less(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] < v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] < v;
+        }
+    });
 }
 
 void cpu_less(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_LESS, 0);
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] < B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] < B->ptr[i];
+        }
+    });
     _profile(_CPU_LESS, 1);
 }
 
 void cpu_less_equal(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] <= v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] <= v;
+        }
+    });
 }
 
 void cpu_less_equal(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_LESS_EQUAL, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] <= B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] <= B->ptr[i];
+        }
+    });
     _profile(_CPU_LESS_EQUAL, 1);
 }
 
 void cpu_equal(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] == v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] == v;
+        }
+    });
 }
 
 void cpu_equal(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_EQUAL, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] == B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] == B->ptr[i];
+        }
+    });
     _profile(_CPU_EQUAL, 1);
 }
 
 void cpu_not_equal(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        B->ptr[i] = A->ptr[i] != v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] != v;
+        }
+    });
 }
 
 void cpu_not_equal(Tensor *A, Tensor *B, Tensor *C){
     _profile(_CPU_NOT_EQUAL, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        C->ptr[i] = A->ptr[i] != B->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = A->ptr[i] != B->ptr[i];
+        }
+    });
     _profile(_CPU_NOT_EQUAL, 1);
 }
 
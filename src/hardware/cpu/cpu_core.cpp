@@ -8,9 +8,11 @@
 */
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 #include "eddl/profiling.h"
 #include <algorithm>
 #include <numeric>
+#include <cstring>
 
 int num_instances[_NUM_CPU_FUNCS];
 float mb_memory_needed;
@@ -163,6 +165,11 @@ case _CPU_AVGPOOL2D              : strcpy(name, "avgpool2d"); break;
 case _CPU_AVGPOOL2D_BACK         : strcpy(name, "avgpool2d_back"); break;
 case _CPU_REPEAT_NN              : strcpy(name, "repeat_nn"); break;
 case _CPU_D_REPEAT_NN            : strcpy(name, "d_repeat_nn"); break;
+case _CPU_CONV3D                 : strcpy(name, "conv3d"); break;
+case _CPU_CONV3D_GRAD            : strcpy(name, "conv3d_grad"); break;
+case _CPU_CONV3D_BACK            : strcpy(name, "conv3d_back"); break;
+case _CPU_MPOOL3D                : strcpy(name, "mpool3d"); break;
+case _CPU_MPOOL3D_BACK           : strcpy(name, "mpool3d_back"); break;
 default                          : strcpy(name, "?????"); break;
 }
 }
@@ -207,28 +214,152 @@ void _profile_remove_tensor(unsigned long int size) {
 
 void cpu_transpose(Tensor * A, Tensor * B) {
     _profile(_CPU_TRANSPOSE, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; i++){
-        B->ptr[i] = A->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i];
+        }
+    });
     _profile(_CPU_TRANSPOSE, 1);
 }
 
 void cpu_copy(Tensor * A, Tensor * B){
     _profile(_CPU_COPY, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; i++){
-        B->ptr[i] = A->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i];
+        }
+    });
     _profile(_CPU_COPY, 1);
 }
 
+// Conversions to/from 16-bit floats, with round to nearest even
+#define CPU_HALF_CHUNK 16384  // Least elements of a range of the loop (and to use threads)
+
+static inline uint16_t float2half(float f){
+    // Rescale with a float multiplication so the FPU does the rounding
+    const uint32_t f32infty = 255u << 23;
+    const uint32_t f16max = (127u + 16u) << 23;
+    const uint32_t denorm_magic_u = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    const uint32_t sign_mask = 0x80000000u;
+    uint32_t x, sign;
+    uint16_t o;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = x & sign_mask;
+    x ^= sign;
+
+    if (x >= f16max) {  // Overflow: inf or nan
+        o = (x > f32infty) ? 0x7e00 : 0x7c00;
+    } else if (x < (113u << 23)) {  // Subnormal or zero
+        float fx, denorm_magic;
+        memcpy(&fx, &x, sizeof(fx));
+        memcpy(&denorm_magic, &denorm_magic_u, sizeof(denorm_magic));
+        fx += denorm_magic;
+        memcpy(&x, &fx, sizeof(x));
+        o = (uint16_t)(x - denorm_magic_u);
+    } else {
+        uint32_t mant_odd = (x >> 13) & 1;
+        x += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        x += mant_odd;
+        o = (uint16_t)(x >> 13);
+    }
+
+    return (uint16_t)(o | (sign >> 16));
+}
+
+static inline float half2float(uint16_t h){
+    const uint32_t shifted_exp = 0x7c00u << 13;
+    const uint32_t magic_u = 113u << 23;
+    uint32_t o = (h & 0x7fffu) << 13;
+    uint32_t exp = shifted_exp & o;
+    float f;
+
+    o += (127u - 15u) << 23;
+    if (exp == shifted_exp) {  // Inf or nan
+        o += (128u - 16u) << 23;
+    } else if (exp == 0) {  // Subnormal or zero
+        float magic;
+        memcpy(&magic, &magic_u, sizeof(magic));
+        o += 1u << 23;
+        memcpy(&f, &o, sizeof(f));
+        f -= magic;
+        memcpy(&o, &f, sizeof(o));
+    }
+    o |= (uint32_t)(h & 0x8000u) << 16;
+
+    memcpy(&f, &o, sizeof(f));
+    return f;
+}
+
+static inline uint16_t float2bfloat(float f){
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffffu) > 0x7f800000u) return (uint16_t)((x >> 16) | 0x40);  // Quiet nan
+    x += 0x7fffu + ((x >> 16) & 1);
+    return (uint16_t)(x >> 16);
+}
+
+static inline float bfloat2float(uint16_t h){
+    uint32_t x = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void cpu_float2half(const float *src, uint16_t *dst, unsigned long int n, int dtype){
+    cpu_parallel_for(0, n, CPU_HALF_CHUNK, [&](long int ini, long int end) {
+        long int i = ini;
+        if (dtype == DTYPE_BFLOAT16) {
+            for (; i < end; i++) dst[i] = float2bfloat(src[i]);
+        } else {
+            i += cpu_vfloat2half(src + ini, dst + ini, end - ini);
+            for (; i < end; i++) dst[i] = float2half(src[i]);
+        }
+    });
+}
+
+void cpu_half2float(const uint16_t *src, float *dst, unsigned long int n, int dtype){
+    cpu_parallel_for(0, n, CPU_HALF_CHUNK, [&](long int ini, long int end) {
+        long int i = ini;
+        if (dtype == DTYPE_BFLOAT16) {
+            for (; i < end; i++) dst[i] = bfloat2float(src[i]);
+        } else {
+            i += cpu_vhalf2float(src + ini, dst + ini, end - ini);
+            for (; i < end; i++) dst[i] = half2float(src[i]);
+        }
+    });
+}
+
+void cpu_copy_dtype(Tensor * A, Tensor * B){
+    // Copy (and convert) between tensors of different storage types
+    auto *A16 = reinterpret_cast<uint16_t *>(A->ptr);
+    auto *B16 = reinterpret_cast<uint16_t *>(B->ptr);
+
+    if (A->dtype == B->dtype) {
+        if (A->dtype == DTYPE_FLOAT32) cpu_copy(A, B);
+        else memcpy(B16, A16, A->size * sizeof(uint16_t));
+    } else if (A->dtype == DTYPE_FLOAT32) {
+        cpu_float2half(A->ptr, B16, A->size, B->dtype);
+    } else if (B->dtype == DTYPE_FLOAT32) {
+        cpu_half2float(A16, B->ptr, A->size, A->dtype);
+    } else {
+        // float16 <-> bfloat16
+        cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int i = ini; i < end; i++) {
+                float f = (A->dtype == DTYPE_BFLOAT16) ? bfloat2float(A16[i]) : half2float(A16[i]);
+                B16[i] = (B->dtype == DTYPE_BFLOAT16) ? float2bfloat(f) : float2half(f);
+            }
+        });
+    }
+}
+
 void cpu_fill_(Tensor *A, float v){
     _profile(_CPU_FILL_, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        A->ptr[i] = v;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            A->ptr[i] = v;
+        }
+    });
     _profile(_CPU_FILL_, 1);
 }
 
@@ -243,87 +374,180 @@ void cpu_fill(Tensor * A, int aini, int aend, Tensor * B, int bini, int bend, in
     for (int i = 2; i < A->ndim; i++)
         t *= A->shape[i];
 
-#pragma omp parallel for
-    for (int i = 0; i < A->shape[0]; i++) {
-        int ap = (i * at) + (aini * t);
-        int bp = (i * bt) + (bini * t);
+    cpu_parallel_for(0, A->shape[0], cpu_grain((aend - aini) * t), [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            int ap = (i * at) + (aini * t);
+            int bp = (i * bt) + (bini * t);
 
-        for (int j = aini; j < aend; j++) {
-            for (int k = 0; k < t; k++, ap++, bp++)
-                if (inc) B->ptr[bp] += A->ptr[ap];
-                else B->ptr[bp] = A->ptr[ap];
+            for (int j = aini; j < aend; j++) {
+                for (int k = 0; k < t; k++, ap++, bp++)
+                    if (inc) B->ptr[bp] += A->ptr[ap];
+                    else B->ptr[bp] = A->ptr[ap];
+            }
         }
-    }
+    });
     _profile(_CPU_FILL, 1);
 }
 
 
+// The descriptor is a strided view of the whole tensor: walk it by runs (see SelDescriptor::build_view)
 void cpu_select(Tensor *A, Tensor *B, SelDescriptor *sd){
     _profile(_CPU_SELECT, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < B->size; i++) {
-        B->ptr[i] = A->ptr[sd->cpu_addresses[i]];
+    auto *pd = dynamic_cast<PermuteDescriptor*>(sd);
+    if (pd != nullptr) {
+        cpu_permute(A->ptr, pd->ishape, pd->dims, B->ptr);
+        _profile(_CPU_SELECT, 1);
+        return;
     }
+
+    int rs = sd->run_size;
+    cpu_parallel_for(0, B->size / rs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int r = ini; r < end; ++r) {
+            float *pa = A->ptr + sd->run_address(r);
+            float *pb = B->ptr + r * rs;
+            for (int i = 0; i < rs; i++) pb[i] = pa[i];
+        }
+    });
     _profile(_CPU_SELECT, 1);
 }
 
 void cpu_select_back(Tensor *A, Tensor *B, SelDescriptor *sd){
     _profile(_CPU_SELECT_BACK, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {  // walk stride
-        B->ptr[sd->cpu_addresses[i]] += A->ptr[i];  // delta_parent += delta
+    auto *pd = dynamic_cast<PermuteDescriptor*>(sd);
+    if (pd != nullptr) {
+        cpu_permute_back(A->ptr, pd->ishape, pd->dims, B->ptr);
+        _profile(_CPU_SELECT_BACK, 1);
+        return;
     }
+
+    int rs = sd->run_size;
+    cpu_parallel_for(0, A->size / rs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int r = ini; r < end; ++r) {  // walk stride
+            float *pa = A->ptr + r * rs;
+            float *pb = B->ptr + sd->run_address(r);
+            for (int i = 0; i < rs; i++) pb[i] += pa[i];  // delta_parent += delta
+        }
+    });
     _profile(_CPU_SELECT_BACK, 1);
 }
 
 void cpu_set_select(Tensor *A, Tensor *B, SelDescriptor *sd){
     _profile(_CPU_SET_SELECT, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < B->size; i++) {
-        A->ptr[sd->cpu_addresses[i]] = B->ptr[i];
-    }
+    int rs = sd->run_size;
+    cpu_parallel_for(0, B->size / rs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int r = ini; r < end; ++r) {
+            float *pa = A->ptr + sd->run_address(r);
+            float *pb = B->ptr + r * rs;
+            for (int i = 0; i < rs; i++) pa[i] = pb[i];
+        }
+    });
     _profile(_CPU_SET_SELECT, 1);
 }
 void cpu_set_select_back(Tensor *A, Tensor *B, SelDescriptor *sd){
     _profile(_CPU_SET_SELECT_BACK, 0);
-    #pragma omp parallel for
-    for (int i = 0; i < B->size; i++) {
-        B->ptr[i] += A->ptr[sd->cpu_addresses[i]];
-    }
+    int rs = sd->run_size;
+    cpu_parallel_for(0, B->size / rs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int r = ini; r < end; ++r) {
+            float *pa = A->ptr + sd->run_address(r);
+            float *pb = B->ptr + r * rs;
+            for (int i = 0; i < rs; i++) pb[i] += pa[i];
+        }
+    });
     _profile(_CPU_SET_SELECT_BACK, 1);
 }
 
 
+// Rows of a batch (select: gather, deselect: scatter). Each row is a memcpy;
+// the source rows of the next iterations are prefetched (the order is random)
+// and big batches are written with streaming stores, which do not pull the
+// old content of B into the cache.
+#define CPU_GATHER_AHEAD 4  // Rows
+#define CPU_GATHER_STREAM (1 << 23)  // Bytes
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_GATHER_X86
+#include <immintrin.h>
+#endif
+
+static inline void prefetch_row(const float *p, long int n) {
+#ifdef CPU_GATHER_X86
+    // The first lines, the hardware prefetcher follows the rest
+    long int bytes = std::min(n * (long int)sizeof(float), 512L);
+    for (long int b = 0; b < bytes; b += 64) __builtin_prefetch((const char *)p + b);
+#endif
+}
+
+static inline void copy_row(float *dst, const float *src, long int n, bool stream) {
+#ifdef CPU_GATHER_X86
+    if (stream) {
+        long int i = 0;
+        for (; i < n && ((uintptr_t)(dst + i) & 15); i++) dst[i] = src[i];
+        for (; i + 4 <= n; i += 4) _mm_stream_ps(dst + i, _mm_loadu_ps(src + i));
+        for (; i < n; i++) dst[i] = src[i];
+        return;
+    }
+#endif
+    memcpy(dst, src, n * sizeof(float));
+}
+
+static inline void stream_fence(bool stream) {
+#ifdef CPU_GATHER_X86
+    if (stream) _mm_sfence();
+#endif
+}
+
 void cpu_select(Tensor * A, Tensor * B, vector<int> sind, int ini, int end,bool mask_zeros){
     _profile(_CPU_SELECT2, 0);
-    int s = A->size / A->shape[0];
-
-#pragma omp parallel for
-    for (int i = ini; i < end; i++) {
-        int p  = sind[i] * s;
-        int pb = (i - ini) * s;
-        for (int j = 0; j < s; j++, p++, pb++)
-            if ((mask_zeros)&&(sind[i]==0)) B->ptr[p]=0;
-            else B->ptr[pb] = A->ptr[p];
-    }
+    long int s = A->size / A->shape[0];
+    bool stream = (end - ini) * s * sizeof(float) >= CPU_GATHER_STREAM;
+
+    cpu_parallel_for(ini, end, cpu_grain(s), [&](long int first, long int last) {
+        for (long int i = first; i < last; ++i) {
+            if (i + CPU_GATHER_AHEAD < last) prefetch_row(A->ptr + sind[i + CPU_GATHER_AHEAD] * s, s);
+
+            float *pb = B->ptr + (i - ini) * s;
+            if ((mask_zeros)&&(sind[i]==0)) std::fill(pb, pb + s, 0.0f);
+            else copy_row(pb, A->ptr + sind[i] * s, s, stream);
+        }
+        stream_fence(stream);
+    });
     _profile(_CPU_SELECT2, 1);
 }
 
 void cpu_deselect(Tensor * A, Tensor * B, vector<int> sind, int ini, int end,int inc,bool mask_zeros){
     _profile(_CPU_DESELECT, 0);
-    int s = A->size / A->shape[0];
-
-#pragma omp parallel for
-    for (int i = ini; i < end; i++) {
-        int p  = sind[i] * s;
-        int pb = (i - ini) * s;
-        for (int j = 0; j < s; j++, p++, pb++)
-            if ((mask_zeros)&&(sind[i]==0)) B->ptr[p]=0;
-            else {
-                if (!inc) B->ptr[p] = A->ptr[pb];
-                else B->ptr[p] += A->ptr[pb];
+    long int s = A->size / A->shape[0];
+
+    // Rows of A that go to the same row of B (e.g. repeated words in an
+    // embedding) are handled by one thread, in order
+    vector<int> order(end - ini);
+    iota(order.begin(), order.end(), ini);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return sind[a] < sind[b]; });
+    vector<int> groups;
+    for (int k = 0; k < order.size(); k++)
+        if (k == 0 || sind[order[k]] != sind[order[k - 1]]) groups.push_back(k);
+    groups.push_back(order.size());
+
+    cpu_parallel_for(0, groups.size() - 1, cpu_grain(s), [&](long int first, long int last) {
+        for (long int g = first; g < last; ++g) {
+            int row = sind[order[groups[g]]];
+            float *pb = B->ptr + row * s;
+            if ((mask_zeros)&&(row==0)) {
+                std::fill(pb, pb + s, 0.0f);
+                continue;
             }
-    }
+            if (inc && g + 1 < last) prefetch_row(B->ptr + sind[order[groups[g + 1]]] * s, s);
+
+            if (!inc) {  // The last one
+                copy_row(pb, A->ptr + (order[groups[g + 1] - 1] - ini) * s, s, false);
+                continue;
+            }
+            for (int k = groups[g]; k < groups[g + 1]; k++) {
+                const float *pa = A->ptr + (order[k] - ini) * s;
+                for (long int j = 0; j < s; j++) pb[j] += pa[j];
+            }
+        }
+    });
     _profile(_CPU_DESELECT, 1);
 }
 
@@ -344,15 +568,16 @@ void cpu_concat(Tensor *A, vector<Tensor*> t, unsigned int axis, bool derivative
         float *src = t[i]->ptr;
 
         // Walk tensor i
-#pragma omp parallel for
-        for (int j = 0; j < t[i]->size; j++) {
-            unsigned int k = j % src_stride;  // Pos (index) in the stride (src)
-            unsigned int stride_idx = j / src_stride;  // Index of the stride (src/dst)
-            unsigned int dest_offset = stride_idx * steps;  // Offset in dest
-
-            if(derivative){ src[j] += dest[dest_offset + k]; }
-            else{ dest[dest_offset + k] = src[j]; }
-        }
+        cpu_parallel_for(0, t[i]->size, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int j = ini; j < end; ++j) {
+                unsigned int k = j % src_stride;  // Pos (index) in the stride (src)
+                unsigned int stride_idx = j / src_stride;  // Index of the stride (src/dst)
+                unsigned int dest_offset = stride_idx * steps;  // Offset in dest
+
+                if(derivative){ src[j] += dest[dest_offset + k]; }
+                else{ dest[dest_offset + k] = src[j]; }
+            }
+        });
     }
     _profile(_CPU_CONCAT, 1);
 }
@@ -9,6 +9,7 @@
 
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 void cpu_range(Tensor *A, float min, float step){
     _profile(_CPU_RANGE, 0);
@@ -24,18 +25,20 @@ void cpu_range(Tensor *A, float min, float step){
 
 void cpu_eye(Tensor *A, int offset){
     _profile(_CPU_EYE, 0);
-    #pragma omp parallel for
-    for(int i=0; i<A->size; i++){
-        if ((i/A->shape[0]+offset) == i%A->shape[1]){ A->ptr[i] = 1.0f; }  // rows+offset == col?
-        else { A->ptr[i] = 0.0f; }
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if ((i/A->shape[0]+offset) == i%A->shape[1]){ A->ptr[i] = 1.0f; }  // rows+offset == col?
+            else { A->ptr[i] = 0.0f; }
+        }
+    });
     _profile(_CPU_EYE, 1);
 }
 
 void cpu_diag(Tensor *A, Tensor *B, int k){
-    #pragma omp parallel for
-    for(int i=0; i<A->size; i++){
-        if ((i/A->shape[0]+k) == i%A->shape[1]){ B->ptr[i] = A->ptr[i]; }  // rows+offset == col?
-        else { B->ptr[i] = 0.0f; }
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if ((i/A->shape[0]+k) == i%A->shape[1]){ B->ptr[i] = A->ptr[i]; }  // rows+offset == col?
+            else { B->ptr[i] = 0.0f; }
+        }
+    });
 }
\ No newline at end of file
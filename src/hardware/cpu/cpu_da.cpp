@@ -15,6 +15,7 @@
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
 #include "eddl/random.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -192,20 +193,22 @@ void cpu_single_crop_scale(int b, Tensor* A, Tensor* B, vector<int> coords_from,
 void cpu_shift(Tensor *A, Tensor *B, vector<int> shift, int mode, float constant) {
     // https://docs.scipy.org/doc/scipy/reference/generated/scipy.ndimage.shift.html
     _profile(_CPU_SHIFT, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_shift(b, A, B, shift, mode, constant);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_shift(b, A, B, shift, mode, constant);
+        }
+    });
     _profile(_CPU_SHIFT, 1);
 }
 
 void cpu_rotate(Tensor *A, Tensor *B, float angle, vector<int> offset_center, int mode, float constant){
     // https://docs.scipy.org/doc/scipy/reference/generated/scipy.ndimage.rotate.html
     _profile(_CPU_ROTATE, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_rotate(b, A, B, angle, offset_center, mode, constant);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_rotate(b, A, B, angle, offset_center, mode, constant);
+        }
+    });
     _profile(_CPU_ROTATE, 1);
 }
 
@@ -225,20 +228,22 @@ void cpu_scale(Tensor *A, Tensor *B, vector<int> new_shape, int mode, float cons
     offsets[0] = (new_shape[0] - B->shape[2])/2.0f;
     offsets[1] = (new_shape[1] - B->shape[3])/2.0f;
 
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_scale(b, offsets, A, B, new_shape, mode, constant);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_scale(b, offsets, A, B, new_shape, mode, constant);
+        }
+    });
     _profile(_CPU_SCALE, 1);
 }
 
 void cpu_flip(Tensor *A, Tensor *B, int axis){
     // https://docs.scipy.org/doc/numpy/reference/generated/numpy.flip.html
     _profile(_CPU_FLIP, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_flip(b, true, A, B, axis);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_flip(b, true, A, B, axis);
+        }
+    });
     _profile(_CPU_FLIP, 1);
 }
 
@@ -255,47 +260,59 @@ void cpu_crop(Tensor *A, Tensor *B, vector<int> coords_from, vector<int> coords_
         offsets[1] = coords_from[1];
     }
 
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_crop(b, offsets, A, B, coords_from, coords_to, constant, inverse);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_crop(b, offsets, A, B, coords_from, coords_to, constant, inverse);
+        }
+    });
     _profile(_CPU_CROP, 1);
 }
 
 
 void cpu_crop_scale(Tensor *A, Tensor *B, vector<int> coords_from, vector<int> coords_to, int mode, float constant){
     _profile(_CPU_CROP_SCALE, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        cpu_single_crop_scale(b, A, B, coords_from, coords_to, mode, constant);
-    }
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            cpu_single_crop_scale(b, A, B, coords_from, coords_to, mode, constant);
+        }
+    });
     _profile(_CPU_CROP_SCALE, 1);
 }
 
 
 // CPU: Data augmentation (2D Optimized) ********************************************
+// The random parameters of the sample b come from the block b of a stream
+// reserved for the batch (see rand_reserve), whatever the thread
 void cpu_shift_random(Tensor *A, Tensor *B, vector<float> factor_x, vector<float> factor_y, int mode, float constant) {
     // https://docs.scipy.org/doc/scipy/reference/generated/scipy.ndimage.shift.html
 
     _profile(_CPU_SHIFT_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        int shift_y = (int)(A->shape[2] * uniform(factor_y[0], factor_y[1]));
-        int shift_x = (int)(A->shape[3] * uniform(factor_x[0], factor_x[1]));
-
-        cpu_single_shift(b, A, B, {shift_y, shift_x}, mode, constant);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+            int shift_y = (int)(A->shape[2] * rand_uniform(r[0], factor_y[0], factor_y[1]));
+            int shift_x = (int)(A->shape[3] * rand_uniform(r[1], factor_x[0], factor_x[1]));
+
+            cpu_single_shift(b, A, B, {shift_y, shift_x}, mode, constant);
+        }
+    });
     _profile(_CPU_SHIFT_RANDOM, 1);
 }
 
 void cpu_rotate_random(Tensor *A, Tensor *B, vector<float> factor, vector<int> offset_center, int mode, float constant){
     // https://docs.scipy.org/doc/scipy/reference/generated/scipy.ndimage.rotate.html
     _profile(_CPU_ROTATE_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        float angle =  uniform(factor[0], factor[1]);
-        cpu_single_rotate(b, A, B, angle, offset_center, mode, constant);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+            float angle =  rand_uniform(r[0], factor[0], factor[1]);
+            cpu_single_rotate(b, A, B, angle, offset_center, mode, constant);
+        }
+    });
     _profile(_CPU_ROTATE_RANDOM, 1);
 }
 
@@ -305,19 +322,23 @@ void cpu_scale_random(Tensor *A, Tensor *B, vector<float> factor, int mode, floa
     // If the factor is less than 1.0f, performs a downscale with padding
 
     _profile(_CPU_SCALE_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        float scale = uniform(factor[0], factor[1]);
-        int new_shape_y = (int)(A->shape[2] * scale);
-        int new_shape_x = (int)(A->shape[3] * scale);
-
-        // Center crop (if the if the crop is smaller than B)
-        int offsets[2] = {0, 0};
-        offsets[0] = (new_shape_y - A->shape[2])/2.0f;
-        offsets[1] = (new_shape_x - A->shape[3])/2.0f;
-
-        cpu_single_scale(b, offsets, A, B, {new_shape_y, new_shape_x}, mode, constant);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+            float scale = rand_uniform(r[0], factor[0], factor[1]);
+            int new_shape_y = (int)(A->shape[2] * scale);
+            int new_shape_x = (int)(A->shape[3] * scale);
+
+            // Center crop (if the if the crop is smaller than B)
+            int offsets[2] = {0, 0};
+            offsets[0] = (new_shape_y - A->shape[2])/2.0f;
+            offsets[1] = (new_shape_x - A->shape[3])/2.0f;
+
+            cpu_single_scale(b, offsets, A, B, {new_shape_y, new_shape_x}, mode, constant);
+        }
+    });
     _profile(_CPU_SCALE_RANDOM, 1);
 }
 
@@ -326,11 +347,15 @@ void cpu_flip_random(Tensor *A, Tensor *B, int axis){
 
 
     _profile(_CPU_FLIP_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-        bool apply = uniform(0.0f, 1.0f) >= 0.5f;
-        cpu_single_flip(b, apply, A, B, axis);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+            bool apply = rand_uniform(r[0], 0.0f, 1.0f) >= 0.5f;
+            cpu_single_flip(b, apply, A, B, axis);
+        }
+    });
     _profile(_CPU_FLIP_RANDOM, 1);
 }
 
@@ -339,49 +364,57 @@ void cpu_crop_random(Tensor *A, Tensor *B){
     // Performs a crop with padding (Keeps the original size)
 
     _profile(_CPU_CROP_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-
-        // Compute random coordinates
-        int w = B->shape[3];
-        int h = B->shape[2];
-        int x = (int)((A->shape[3]-w) * uniform(0.0f, 1.0f));
-        int y = (int)((A->shape[2]-h) * uniform(0.0f, 1.0f));
-
-        int coords_from_x = x;
-        int coords_to_x = x+w;
-        int coords_from_y = y;
-        int coords_to_y = y+h;
-
-        int offsets[2] = {0, 0};
-        offsets[0] = coords_from_y;
-        offsets[1] = coords_from_x;
-
-        cpu_single_crop(b, offsets, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, 0.0f, false);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+
+            // Compute random coordinates
+            int w = B->shape[3];
+            int h = B->shape[2];
+            int x = (int)((A->shape[3]-w) * rand_uniform(r[0], 0.0f, 1.0f));
+            int y = (int)((A->shape[2]-h) * rand_uniform(r[1], 0.0f, 1.0f));
+
+            int coords_from_x = x;
+            int coords_to_x = x+w;
+            int coords_from_y = y;
+            int coords_to_y = y+h;
+
+            int offsets[2] = {0, 0};
+            offsets[0] = coords_from_y;
+            offsets[1] = coords_from_x;
+
+            cpu_single_crop(b, offsets, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, 0.0f, false);
+        }
+    });
     _profile(_CPU_CROP_RANDOM, 1);
 }
 
 void cpu_crop_scale_random(Tensor *A, Tensor *B, vector<float> factor, int mode, float constant){
 
     _profile(_CPU_CROP_SCALE_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-
-        // Compute random coordinates
-        float scale = uniform(factor[0], factor[1]);
-        int h = (int)(A->shape[2] * scale);
-        int w = (int)(A->shape[3] * scale);
-        int y = (int)((A->shape[2]-h) * uniform(0.0f, 1.0f));
-        int x = (int)((A->shape[3]-w) * uniform(0.0f, 1.0f));
-
-        int coords_from_x = x;
-        int coords_to_x = x+w;
-        int coords_from_y = y;
-        int coords_to_y = y+h;
-
-        cpu_single_crop_scale(b, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, mode, constant);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+
+            // Compute random coordinates
+            float scale = rand_uniform(r[0], factor[0], factor[1]);
+            int h = (int)(A->shape[2] * scale);
+            int w = (int)(A->shape[3] * scale);
+            int y = (int)((A->shape[2]-h) * rand_uniform(r[1], 0.0f, 1.0f));
+            int x = (int)((A->shape[3]-w) * rand_uniform(r[2], 0.0f, 1.0f));
+
+            int coords_from_x = x;
+            int coords_to_x = x+w;
+            int coords_from_y = y;
+            int coords_to_y = y+h;
+
+            cpu_single_crop_scale(b, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, mode, constant);
+        }
+    });
     _profile(_CPU_CROP_SCALE_RANDOM, 1);
 }
 
@@ -390,22 +423,26 @@ void cpu_cutout_random(Tensor *A, Tensor *B, vector<float> factor_x, vector<floa
     // Performs a crop with padding (Keeps the original size)
 
     _profile(_CPU_CUTOUT_RANDOM, 0);
-#pragma omp parallel for
-    for(int b=0; b<B->shape[0]; b++) {
-
-        // Compute random coordinates
-        int h = (int)(A->shape[2] * uniform(factor_y[0], factor_y[1]));
-        int w = (int)(A->shape[3] * uniform(factor_x[0], factor_x[1]));
-        int y = (int)((A->shape[2]-h) * uniform(0.0f, 1.0f));
-        int x = (int)((A->shape[3]-w) * uniform(0.0f, 1.0f));
-
-        int coords_from_x = x;
-        int coords_to_x = x+w;
-        int coords_from_y = y;
-        int coords_to_y = y+h;
-
-        int offsets[2] = {0, 0};
-        cpu_single_crop(b, offsets, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, constant, true);
-    }
+    uint64_t key = rand_key(), first = rand_reserve(B->shape[0]);
+    cpu_parallel_for(0, B->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++) {
+            uint32_t r[4];
+            philox4x32(key, first + b, r);
+
+            // Compute random coordinates
+            int h = (int)(A->shape[2] * rand_uniform(r[0], factor_y[0], factor_y[1]));
+            int w = (int)(A->shape[3] * rand_uniform(r[1], factor_x[0], factor_x[1]));
+            int y = (int)((A->shape[2]-h) * rand_uniform(r[2], 0.0f, 1.0f));
+            int x = (int)((A->shape[3]-w) * rand_uniform(r[3], 0.0f, 1.0f));
+
+            int coords_from_x = x;
+            int coords_to_x = x+w;
+            int coords_from_y = y;
+            int coords_to_y = y+h;
+
+            int offsets[2] = {0, 0};
+            cpu_single_crop(b, offsets, A, B, {coords_from_y, coords_from_x}, {coords_to_y, coords_to_x}, constant, true);
+        }
+    });
     _profile(_CPU_CUTOUT_RANDOM, 0);
 }
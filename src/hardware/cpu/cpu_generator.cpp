@@ -8,43 +8,82 @@
 */
 
 
+#include <algorithm>
+#include <cmath>
+
 #include "eddl/random.h"
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+// The random fills use the counter-based generator (see philox4x32): the
+// element i takes the word i % 4 of the block i / 4 of a stream reserved for
+// the fill, so they run in parallel and the result does not depend on the
+// number of threads.
+#define RAND_CHUNK 256  // Blocks generated at once (on the stack)
+#define RAND_2POW_24 5.9604644775390625e-08f
+
+// [0, 1) and (0, 1] from the 24 high bits (the ones a float keeps)
+#define RAND_UNIFORM(x) ((float)((x) >> 8) * RAND_2POW_24)
+#define RAND_UNIFORM_NZ(x) ((float)(((x) >> 8) + 1) * RAND_2POW_24)
+
+// f(bits, dst, n) turns the n words into n floats
+template <typename F>
+static void rand_fill(float *ptr, long int size, F f) {
+    uint64_t key = rand_key();
+    long int blocks = (size + 3) / 4;
+    uint64_t first = rand_reserve(blocks);
+
+    cpu_parallel_for(0, blocks, cpu_grain(64), [&](long int ini, long int end) {
+        uint32_t bits[4 * RAND_CHUNK];
+        for (long int b = ini; b < end; b += RAND_CHUNK) {
+            long int nb = std::min((long int)RAND_CHUNK, end - b);
+            philox4x32_blocks(key, first + b, nb, bits);
+            f(bits, ptr + 4 * b, std::min(4 * nb, size - 4 * b));
+        }
+    });
+}
 
 void cpu_rand_uniform(Tensor * A, float v)
 {
     _profile(_CPU_RAND_UNIFORM, 0);
-    // #pragma omp parallel for # congruent random number generators are not compatible with parallel calls
-    for (int i = 0; i < A->size; ++i) A->ptr[i] = uniform() * v;
+    rand_fill(A->ptr, A->size, [&](const uint32_t *bits, float *y, long int n) {
+#pragma omp simd
+        for (long int i = 0; i < n; i++) y[i] = RAND_UNIFORM(bits[i]) * v;
+    });
     _profile(_CPU_RAND_UNIFORM, 1);
 }
 
 void cpu_rand_signed_uniform(Tensor * A, float v)
 {
     _profile(_CPU_RAND_SIGNED_UNIFORM, 0);
-    // #pragma omp parallel for # congruent random number generators are not compatible with parallel calls
-    for (int i = 0; i < A->size; ++i) A->ptr[i] = signed_uniform() * v;
+    rand_fill(A->ptr, A->size, [&](const uint32_t *bits, float *y, long int n) {
+#pragma omp simd
+        for (long int i = 0; i < n; i++) y[i] = (2.0f * RAND_UNIFORM(bits[i]) - 1.0f) * v;
+    });
     _profile(_CPU_RAND_SIGNED_UNIFORM, 1);
 }
 
 void cpu_rand_binary(Tensor * A, float v)
 {
     _profile(_CPU_BINARY, 0);
-    // #pragma omp parallel for # congruent random number generators are not compatible with parallel calls
-    for (int i = 0; i < A->size; ++i)
-        if (uniform() < v) A->ptr[i] = 1.0;
-        else A->ptr[i] = 0.0;
+    rand_fill(A->ptr, A->size, [&](const uint32_t *bits, float *y, long int n) {
+#pragma omp simd
+        for (long int i = 0; i < n; i++) y[i] = (RAND_UNIFORM(bits[i]) < v) ? 1.0f : 0.0f;
+    });
     _profile(_CPU_BINARY, 1);
 }
 
+// Box-Muller: each pair of words gives two values. fast_math is ignored, the
+// CPU no longer needs the table of fast_randn
 void cpu_rand_normal(Tensor * A, float m, float s, bool fast_math) {
     _profile(_CPU_RAND_NORMAL, 0);
-    int r = rand();
-
-    if (fast_math) {
-        for (int i = 0; i < A->size; ++i) A->ptr[i] = fast_randn(m, s, r++);
-    } else  {
-        for (int i = 0; i < A->size; ++i) A->ptr[i] = slow_randn(m, s);
-    }
-    _profile(_CPU_RAND_NORMAL, 0);
+    rand_fill(A->ptr, A->size, [&](const uint32_t *bits, float *y, long int n) {
+        for (long int i = 0; i < n; i += 2) {
+            float r = std::sqrt(-2.0f * std::log(RAND_UNIFORM_NZ(bits[i])));
+            float t = 2.0f * (float)M_PI * RAND_UNIFORM(bits[i + 1]);
+            y[i] = m + s * r * std::cos(t);
+            if (i + 1 < n) y[i + 1] = m + s * r * std::sin(t);
+        }
+    });
+    _profile(_CPU_RAND_NORMAL, 1);
 }
@@ -9,6 +9,7 @@
 
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
 
@@ -16,18 +17,25 @@ std::pair<unsigned int*, int> cpu_nonzero(Tensor *A){
     // This can be improved:
     // See: https://stackoverflow.com/questions/18971401/sparse-array-compression-using-simd-avx2/41958528#41958528
     auto* indices = new unsigned int[A->size];
-    unsigned int size = 0;
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-
-        if (A->ptr[i] != 0.0f){
-            #pragma omp critical
-            {
-                indices[size++] = i;
-            }
+    // Count by blocks, then each block writes from its offset (indices in order)
+    long int blocks = (A->size + CPU_GRAIN - 1) / CPU_GRAIN;
+    vector<unsigned int> count(blocks + 1, 0);
+    cpu_parallel_for(0, blocks, 1, [&](long int ini, long int end) {
+        for (long int b = ini; b < end; ++b)
+            for (long int i = b * CPU_GRAIN; i < std::min((long int)A->size, (b + 1) * CPU_GRAIN); ++i)
+                if (A->ptr[i] != 0.0f) count[b + 1]++;
+    });
+    for (long int b = 0; b < blocks; ++b) count[b + 1] += count[b];
+    unsigned int size = count[blocks];
+
+    cpu_parallel_for(0, blocks, 1, [&](long int ini, long int end) {
+        for (long int b = ini; b < end; ++b) {
+            unsigned int k = count[b];
+            for (long int i = b * CPU_GRAIN; i < std::min((long int)A->size, (b + 1) * CPU_GRAIN); ++i)
+                if (A->ptr[i] != 0.0f) indices[k++] = i;
         }
-    }
+    });
 
     // Copy data
     auto* new_data = new unsigned int[size];
@@ -39,12 +47,13 @@ std::pair<unsigned int*, int> cpu_nonzero(Tensor *A){
 
 
 void cpu_where(Tensor *condition, Tensor *A, Tensor *B, Tensor *C){
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        if((bool) condition->ptr[i]){
-            C->ptr[i] = A->ptr[i];
-        }else{
-            C->ptr[i] = B->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if((bool) condition->ptr[i]){
+                C->ptr[i] = A->ptr[i];
+            }else{
+                C->ptr[i] = B->ptr[i];
+            }
         }
-    }
+    });
 }
\ No newline at end of file
@@ -15,6 +15,7 @@
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
 #include "eddl/random.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
 
@@ -24,10 +25,11 @@ float cpu_norm(Tensor *A, string ord){
 
 
 void cpu_norm(Tensor *A, Tensor *B, ReduceDescriptor2 *rd, string ord){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_norm_(A->ptr, rd->index[i].size(), rd->index[i].data(), ord);
-    }
+    cpu_parallel_for(0, rd->index.size(), cpu_grain(rd->index.empty() ? 1 : rd->index[0].size()), [&](long int ini, long int end) {
+        for(int i=ini; i<end; i++) {
+            B->ptr[i] = cpu_norm_(A->ptr, rd->index[i].size(), rd->index[i].data(), ord);
+        }
+    });
 }
 
 float cpu_norm_(float *ptr, int size, int *map, string ord){
@@ -35,14 +37,13 @@ float cpu_norm_(float *ptr, int size, int *map, string ord){
 
     if(ord=="fro"){
 
-        // TODO: I don't like this approach
-        if(map == nullptr){
-            #pragma omp parallel for reduction(+:norm)
-            for (int i = 0; i < size; ++i){ norm += ::pow(ptr[i], 2); }  // Compiler trick: pow(x,2) == x*x
-        }else{
-            #pragma omp parallel for reduction(+:norm)
-            for (int i = 0; i < size; ++i){ norm += ::pow(ptr[map[i]], 2); }
-        }
+        // Fixed order (see cpu_parallel_reduce)
+        norm = cpu_parallel_reduce(0, size, 0.0f, [&](long int ini, long int end) {
+            float norm = 0.0f;
+            if (map == nullptr) for (long int i = ini; i < end; ++i) norm += ptr[i] * ptr[i];
+            else for (long int i = ini; i < end; ++i) norm += ptr[map[i]] * ptr[map[i]];
+            return norm;
+        }, [](float a, float b) { return a + b; });
 
     }else{
         msg("Not yet implemented", "cpu_norm");
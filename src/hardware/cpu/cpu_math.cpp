@@ -9,109 +9,125 @@
 
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 #include <unordered_map>
+#include <algorithm>
 
 // CPU: Math (in-place) ********************************************
 
 void cpu_abs(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::fabs(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::fabs(A->ptr[i]);
+    });
 }
 
 void cpu_acos(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::acosf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::acosf(A->ptr[i]);
+    });
 }
 
 void cpu_add(Tensor *A, Tensor *B, float v) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = A->ptr[i] + v;
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = A->ptr[i] + v;
+    });
 }
 
 
 void cpu_asin(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::asinf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::asinf(A->ptr[i]);
+    });
 }
 
 void cpu_atan(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::atanf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::atanf(A->ptr[i]);
+    });
 }
 
 void cpu_ceil(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::ceilf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::ceilf(A->ptr[i]);
+    });
 }
 
 void cpu_clamp(Tensor *A, Tensor *B, float min, float max){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i){
-        if (A->ptr[i] < min){
-            B->ptr[i] = min;
-        } else if(A->ptr[i] > max){
-            B->ptr[i] = max;
-        }else {
-            B->ptr[i] = A->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] < min){
+                B->ptr[i] = min;
+            } else if(A->ptr[i] > max){
+                B->ptr[i] = max;
+            }else {
+                B->ptr[i] = A->ptr[i];
+            }
         }
-    }
+    });
 }
 
 
 void cpu_cos(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::cosf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::cosf(A->ptr[i]);
+    });
 }
 
 void cpu_cosh(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::coshf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::coshf(A->ptr[i]);
+    });
 }
 
 void cpu_exp(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::expf(A->ptr[i]);
+    cpu_vexp(A->ptr, B->ptr, A->size);
 }
 
 void cpu_floor(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::floorf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::floorf(A->ptr[i]);
+    });
 }
 
 void cpu_inv(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = v/A->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = v/A->ptr[i];
+    });
 }
 
 void cpu_log(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::logf(A->ptr[i]);
+    cpu_vlog(A->ptr, B->ptr, A->size);
 }
 
 void cpu_log2(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::log2f(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::log2f(A->ptr[i]);
+    });
 }
 
 void cpu_log10(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::log10f(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::log10f(A->ptr[i]);
+    });
 }
 
 void cpu_logn(Tensor *A, Tensor *B, float n) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::logf(A->ptr[i])/::logf(n);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::logf(A->ptr[i])/::logf(n);
+    });
 }
 
 
 void cpu_mod(Tensor *A, Tensor *B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::fmod(A->ptr[i], v);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::fmod(A->ptr[i], v);
+    });
 }
 
 void cpu_mult(Tensor *A, Tensor *B, float v) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = A->ptr[i] * v;
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = A->ptr[i] * v;
+    });
 }
 
 void cpu_normalize(Tensor *A, Tensor *B, float min, float max){
@@ -120,79 +136,89 @@ void cpu_normalize(Tensor *A, Tensor *B, float min, float max){
     float max_ori = A->max();
     float min_ori = A->min();
 
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        B->ptr[i] = (max-min)/(max_ori-min_ori) * (A->ptr[i]-min_ori) + min;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = (max-min)/(max_ori-min_ori) * (A->ptr[i]-min_ori) + min;
+        }
+    });
 }
 
 void cpu_pow(Tensor *A, Tensor *B, float exp) {
     // To compute the power, std uses real floating-point number with the formurla: e^(y*log_(x))
     // Quite inefficient (x100 slower) in g++ except for pow_(x, 2) which is inlined as x*x
     // speed: 0.057887s
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::powf(A->ptr[i], exp);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::powf(A->ptr[i], exp);
+    });
 }
 
 void cpu_powb(Tensor *A, Tensor *B, float base) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::powf(base, A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::powf(base, A->ptr[i]);
+    });
 }
 
 void cpu_remainder(Tensor *A, Tensor *B, float v) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = fmod((v + fmod(A->ptr[i], v)), v);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = fmod((v + fmod(A->ptr[i], v)), v);
+    });
 }
 
 void cpu_round(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::roundf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::roundf(A->ptr[i]);
+    });
 }
 
 void cpu_rsqrt(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = 1.0f/::sqrtf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = 1.0f/::sqrtf(A->ptr[i]);
+    });
 }
 
 void cpu_sigmoid(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = 1.0f/(1.0f + ::expf(-A->ptr[i]));
+    cpu_vsigmoid(A->ptr, B->ptr, A->size);
 }
 
 void cpu_sign(Tensor *A, Tensor *B, float zero_sign){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        if(A->ptr[i] > 0.0f){
-            B->ptr[i] = 1.0f;
-        }else if(A->ptr[i] < 0.0f){
-            B->ptr[i] = -1.0f;
-        }else{
-            B->ptr[i] = zero_sign;  // 0.0f recommended
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if(A->ptr[i] > 0.0f){
+                B->ptr[i] = 1.0f;
+            }else if(A->ptr[i] < 0.0f){
+                B->ptr[i] = -1.0f;
+            }else{
+                B->ptr[i] = zero_sign;  // 0.0f recommended
+            }
         }
-    };
+    });
 }
 
 
 void cpu_sin(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::sinf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::sinf(A->ptr[i]);
+    });
 }
 
 void cpu_sinh(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::sinhf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::sinhf(A->ptr[i]);
+    });
 }
 
 void cpu_sqr(Tensor *A, Tensor *B) {
     // pow(x, 2) == x*x  To know more, read comments in pow_'s function
     // speed: 0.000497s
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = A->ptr[i] * A->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = A->ptr[i] * A->ptr[i];
+    });
 }
 
 void cpu_sqrt(Tensor *A, Tensor *B) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::sqrtf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::sqrtf(A->ptr[i]);
+    });
 }
 
 void cpu_tan(Tensor *A, Tensor *B){
@@ -208,13 +234,13 @@ void cpu_tan(Tensor *A, Tensor *B){
 }
 
 void cpu_tanh(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::tanhf(A->ptr[i]);
+    cpu_vtanh(A->ptr, B->ptr, A->size);
 }
 
 void cpu_trunc(Tensor *A, Tensor *B){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) B->ptr[i] = ::truncf(A->ptr[i]);
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) B->ptr[i] = ::truncf(A->ptr[i]);
+    });
 }
 
 
@@ -222,20 +248,24 @@ void cpu_trunc(Tensor *A, Tensor *B){
 // CPU: Math (static) ***************************
 
 void cpu_add(float scA, Tensor *A, float scB, Tensor *B, Tensor *C, int incC) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++)
-        if (incC) C->ptr[i] += scA * A->ptr[i] + scB * B->ptr[i];
-        else C->ptr[i] = scA * A->ptr[i] + scB * B->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        if (incC) {
+            for (long int i = ini; i < end; ++i) C->ptr[i] += scA * A->ptr[i] + scB * B->ptr[i];
+        } else {
+            for (long int i = ini; i < end; ++i) C->ptr[i] = scA * A->ptr[i] + scB * B->ptr[i];
+        }
+    });
 }
 
 
 void cpu_inc(Tensor *A, Tensor *B) {
 
 
-    #pragma omp parallel for
-    for (int i = 0; i < A->size; i++){
-        B->ptr[i] += A->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] += A->ptr[i];
+        }
+    });
 
 
 }
@@ -260,68 +290,108 @@ void cpu_mult2D(Tensor *A, int tA, Tensor *B, int tB, Tensor *C, int incC) {
     }
 }
 
+void cpu_mult2D_half(Tensor *A, int tA, Tensor *B, Tensor *C, int incC) {
+    // C=A*B with a 16-bit B: B is converted to float by panels of rows (that
+    // fit in cache) and accumulated over C in float
+    typedef Eigen::Map<MatrixXRMf, 0, Eigen::OuterStride<> > MapRMf;
+    typedef Eigen::Map<Eigen::MatrixXf, 0, Eigen::OuterStride<> > MapCMf;
+
+    int m = C->shape[0];
+    int n = C->shape[1];
+    int k = B->shape[0];
+    int kb = std::max(16, 65536 / std::max(1, n));
+
+    auto *B16 = reinterpret_cast<uint16_t *>(B->ptr);
+    float *panel = get_fmem((unsigned long int)std::min(k, kb) * n, "cpu_mult2D_half");
+    Eigen::Map<MatrixXRMf> Cm(C->ptr, m, n);
+
+    if (!incC) Cm.setZero();
+    for (int k0 = 0; k0 < k; k0 += kb) {
+        int kk = std::min(kb, k - k0);
+        cpu_half2float(B16 + (unsigned long int)k0 * n, panel, (unsigned long int)kk * n, B->dtype);
+        Eigen::Map<MatrixXRMf> Bp(panel, kk, n);
+
+        if (!tA) Cm.noalias() += MapRMf(A->ptr + k0, m, kk, Eigen::OuterStride<>(k)) * Bp;
+        else Cm.noalias() += MapCMf(A->ptr + (unsigned long int)k0 * m, m, kk, Eigen::OuterStride<>(m)) * Bp;
+    }
+
+    eddl_free(panel);
+}
+
 void cpu_el_div(Tensor *A, Tensor *B, Tensor *C, int incC) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++)
-        if (incC) C->ptr[i] += A->ptr[i] / B->ptr[i];
-        else C->ptr[i] = A->ptr[i] / B->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        if (incC) {
+            for (long int i = ini; i < end; ++i) C->ptr[i] += A->ptr[i] / B->ptr[i];
+        } else {
+            for (long int i = ini; i < end; ++i) C->ptr[i] = A->ptr[i] / B->ptr[i];
+        }
+    });
 }
 
 
 void cpu_el_mult(Tensor *A, Tensor *B, Tensor *C, int incC) {
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++)
-        if (incC) C->ptr[i] += A->ptr[i] * B->ptr[i];
-        else C->ptr[i] = A->ptr[i] * B->ptr[i];
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        if (incC) {
+            for (long int i = ini; i < end; ++i) C->ptr[i] += A->ptr[i] * B->ptr[i];
+        } else {
+            for (long int i = ini; i < end; ++i) C->ptr[i] = A->ptr[i] * B->ptr[i];
+        }
+    });
 }
 
 
 void cpu_sum2D_rowwise(Tensor *A, Tensor *B, Tensor *C) {
-#pragma omp parallel for
-    for (int i = 0; i < A->shape[0]; i++) {
-        int p=i*A->shape[1];
-        for (int j = 0; j < A->shape[1]; j++, p++)
-            C->ptr[p] = A->ptr[p] + B->ptr[j];
-    }
+    cpu_parallel_for(0, A->shape[0], cpu_grain(A->shape[1]), [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            int p=i*A->shape[1];
+            for (int j = 0; j < A->shape[1]; j++, p++)
+                C->ptr[p] = A->ptr[p] + B->ptr[j];
+        }
+    });
 }
 
 void cpu_sum2D_colwise(Tensor *A, Tensor *B, Tensor *C) {
 
-#pragma omp parallel for
-    for (int i = 0; i < A->shape[0]; i++) {
-        int p=i*A->shape[1];
-        for (int j = 0; j < A->shape[1]; j++, p++)
-            C->ptr[p] = A->ptr[p] + B->ptr[i];
-    }
+    cpu_parallel_for(0, A->shape[0], cpu_grain(A->shape[1]), [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            int p=i*A->shape[1];
+            for (int j = 0; j < A->shape[1]; j++, p++)
+                C->ptr[p] = A->ptr[p] + B->ptr[i];
+        }
+    });
 }
 
 
 void cpu_maximum(Tensor* A, Tensor* B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        B->ptr[i] = ::max(A->ptr[i], v);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = ::max(A->ptr[i], v);
+        }
+    });
 }
 
 void cpu_maximum(Tensor* A, Tensor* B, Tensor* C){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        C->ptr[i] = ::max(A->ptr[i], B->ptr[i]);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = ::max(A->ptr[i], B->ptr[i]);
+        }
+    });
 }
 
 void cpu_minimum(Tensor* A, Tensor* B, float v){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        B->ptr[i] = ::min(A->ptr[i], v);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = ::min(A->ptr[i], v);
+        }
+    });
 }
 
 void cpu_minimum(Tensor* A, Tensor* B, Tensor* C){
-#pragma omp parallel for
-    for (int i = 0; i < A->size; ++i) {
-        C->ptr[i] = ::min(A->ptr[i], B->ptr[i]);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            C->ptr[i] = ::min(A->ptr[i], B->ptr[i]);
+        }
+    });
 }
 
 
@@ -335,11 +405,7 @@ float cpu_max(Tensor *A) {
 
 
 void cpu_max(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        auto t = cpu_max(A->ptr, rd->index[i].size(), rd->index[i].data());
-        B->ptr[i] = std::get<0>(t);  // get max
-    }
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_MAX);
 }
 
 int cpu_argmax(Tensor *A) {
@@ -349,62 +415,41 @@ int cpu_argmax(Tensor *A) {
 
 
 void cpu_argmax(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        auto t = cpu_max(A->ptr, rd->index[i].size(), rd->index[i].data());
-        B->ptr[i] = std::get<1>(t);  // get argmax
-    }
+    cpu_parallel_for(0, rd->index.size(), 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            auto t = cpu_max(A->ptr, rd->index[i].size(), rd->index[i].data());
+            B->ptr[i] = std::get<1>(t);  // get argmax
+        }
+    });
 }
 
 void cpu_argmax_d(Tensor *D, Tensor *O, Tensor *PD){
     int reduction_size = PD->size/D->size;
-    #pragma omp parallel for
-    for (int i = 0; i < D->size; i++){
-        int argmax = (int)O->ptr[i];  // local
-        int offset = i*reduction_size;
-        PD->ptr[offset + argmax] += D->ptr[i];
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            int argmax = (int)O->ptr[i];  // local
+            int offset = i*reduction_size;
+            PD->ptr[offset + argmax] += D->ptr[i];
+        }
+    });
 }
 
 
-std::tuple<float, int> cpu_max(float *ptr, int size, int *map) {
-    float shared_max = MIN_FLOAT;
-    int shared_argmax = 0;
-
-    #pragma omp parallel
-    {
-        float max = MIN_FLOAT;
-        int argmax = 0;
-
-        // TODO: I don't like this approach
-        if(map == nullptr){
-            #pragma omp for nowait
-            for (int i = 0; i < size; ++i) {
-                if(ptr[i]>max){
-                    max = ptr[i];
-                    argmax = i;
-                }
-            }
-        }else{
-            #pragma omp for nowait
-            for (int i = 0; i < size; ++i) {
-                if(ptr[map[i]]>max){
-                    max = ptr[map[i]];
-                    argmax = i;
-                }
-            }
-        }
+// Reductions of a whole array: fixed blocks merged in order (see cpu_parallel_reduce),
+// ties keep the first position
+static float add(float a, float b) { return a + b; }
 
-        #pragma omp critical
-        {
-            if(max>shared_max){
-                shared_max = max;
-                shared_argmax = argmax;
-            }
+std::tuple<float, int> cpu_max(float *ptr, int size, int *map) {
+    typedef std::pair<float, int> Arg;
+    Arg r = cpu_parallel_reduce(0, size, Arg(MIN_FLOAT, 0), [&](long int ini, long int end) {
+        Arg a(MIN_FLOAT, ini);
+        for (long int i = ini; i < end; ++i) {
+            float v = (map == nullptr) ? ptr[i] : ptr[map[i]];
+            if (v > a.first) a = Arg(v, i);
         }
-    }
-
-    return std::make_tuple(shared_max, shared_argmax);
+        return a;
+    }, [](const Arg &a, const Arg &b) { return (b.first > a.first) ? b : a; });
+    return std::make_tuple(r.first, r.second);
 }
 
 
@@ -415,11 +460,7 @@ float cpu_min(Tensor *A) {
 
 
 void cpu_min(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        auto t = cpu_min(A->ptr, rd->index[i].size(), rd->index[i].data());
-        B->ptr[i] = std::get<0>(t);  // get min
-    }
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_MIN);
 }
 
 
@@ -430,52 +471,26 @@ int cpu_argmin(Tensor *A) {
 
 
 void cpu_argmin(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        auto t = cpu_min(A->ptr, rd->index[i].size(), rd->index[i].data());
-        B->ptr[i] = std::get<1>(t);  // get argmmin
-    }
+    cpu_parallel_for(0, rd->index.size(), 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            auto t = cpu_min(A->ptr, rd->index[i].size(), rd->index[i].data());
+            B->ptr[i] = std::get<1>(t);  // get argmmin
+        }
+    });
 }
 
 
 std::tuple<float, int> cpu_min(float *ptr, int size, int *map) {
-    float shared_min = MAX_FLOAT;
-    int shared_argmin = 0;
-
-    #pragma omp parallel
-    {
-        float min = MAX_FLOAT;
-        int argmin = 0;
-
-        // TODO: I don't like this approach
-        if(map == nullptr){
-            #pragma omp for nowait
-            for (int i = 0; i < size; ++i) {
-                if(ptr[i]<min){
-                    min = ptr[i];
-                    argmin = i;
-                }
-            }
-        }else{
-            #pragma omp for nowait
-            for (int i = 0; i < size; ++i) {
-                if(ptr[map[i]]<min){
-                    min = ptr[map[i]];
-                    argmin = i;
-                }
-            }
-        }
-
-        #pragma omp critical
-        {
-            if(min<shared_min){
-                shared_min = min;
-                shared_argmin = argmin;
-            }
+    typedef std::pair<float, int> Arg;
+    Arg r = cpu_parallel_reduce(0, size, Arg(MAX_FLOAT, 0), [&](long int ini, long int end) {
+        Arg a(MAX_FLOAT, ini);
+        for (long int i = ini; i < end; ++i) {
+            float v = (map == nullptr) ? ptr[i] : ptr[map[i]];
+            if (v < a.first) a = Arg(v, i);
         }
-    }
-
-    return std::make_tuple(shared_min, shared_argmin);
+        return a;
+    }, [](const Arg &a, const Arg &b) { return (b.first < a.first) ? b : a; });
+    return std::make_tuple(r.first, r.second);
 }
 
 
@@ -486,25 +501,16 @@ float cpu_sum(Tensor *A) {
 
 
 void cpu_sum(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_sum(A->ptr, rd->index[i].size(), rd->index[i].data());
-    }
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_SUM);
 }
 
 float cpu_sum(float *ptr, int size, int *map) {
-    float sum = 0.0f;
-
-    // TODO: I don't like this approach
-    if(map == nullptr){
-        #pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) { sum += ptr[i]; }
-    }else{
-        #pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) { sum += ptr[map[i]]; }
-    }
-
-    return sum;
+    return cpu_parallel_reduce(0, size, 0.0f, [&](long int ini, long int end) {
+        float sum = 0.0f;
+        if (map == nullptr) for (long int i = ini; i < end; ++i) sum += ptr[i];
+        else for (long int i = ini; i < end; ++i) sum += ptr[map[i]];
+        return sum;
+    }, add);
 }
 
 
@@ -514,25 +520,20 @@ float cpu_sum_abs(Tensor *A) {
 
 
 void cpu_sum_abs(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_sum_abs(A->ptr, rd->index[i].size(), rd->index[i].data());
-    }
+    cpu_parallel_for(0, rd->index.size(), 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = cpu_sum_abs(A->ptr, rd->index[i].size(), rd->index[i].data());
+        }
+    });
 }
 
 float cpu_sum_abs(float *ptr, int size, int *map) {
-    float sum = 0.0f;
-
-    // TODO: I don't like this approach
-    if(map == nullptr){
-#pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) { sum += ::fabs(ptr[i]); }
-    }else{
-#pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) { sum += ::fabs(ptr[map[i]]); }
-    }
-
-    return sum;
+    return cpu_parallel_reduce(0, size, 0.0f, [&](long int ini, long int end) {
+        float sum = 0.0f;
+        if (map == nullptr) for (long int i = ini; i < end; ++i) sum += ::fabs(ptr[i]);
+        else for (long int i = ini; i < end; ++i) sum += ::fabs(ptr[map[i]]);
+        return sum;
+    }, add);
 }
 
 
@@ -542,25 +543,16 @@ float cpu_prod(Tensor *A) {
 
 
 void cpu_prod(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_prod(A->ptr, rd->index[i].size(), rd->index[i].data());
-    }
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_PROD);
 }
 
 float cpu_prod(float *ptr, int size, int *map) {
-    float prod = 1.0f;
-
-    // TODO: I don't like this approach
-    if(map == nullptr){
-#pragma omp parallel for reduction(*:prod)
-        for (int i = 0; i < size; ++i) { prod *= ptr[i]; }
-    }else{
-#pragma omp parallel for reduction(*:prod)
-        for (int i = 0; i < size; ++i) { prod *= ptr[map[i]]; }
-    }
-
-    return prod;
+    return cpu_parallel_reduce(0, size, 1.0f, [&](long int ini, long int end) {
+        float prod = 1.0f;
+        if (map == nullptr) for (long int i = ini; i < end; ++i) prod *= ptr[i];
+        else for (long int i = ini; i < end; ++i) prod *= ptr[map[i]];
+        return prod;
+    }, [](float a, float b) { return a * b; });
 }
 
 float cpu_mean(Tensor *A) {
@@ -569,10 +561,7 @@ float cpu_mean(Tensor *A) {
 
 
 void cpu_mean(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_sum(A->ptr, rd->index[i].size(), rd->index[i].data()) / rd->index[i].size();
-    }
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_MEAN);
 }
 
 
@@ -582,29 +571,24 @@ float cpu_var(Tensor *A, bool unbiased){
 
 
 void cpu_var(Tensor *A, Tensor *B, ReduceDescriptor2 *rd, bool unbiased){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_var(A->ptr, rd->index[i].size(), rd->index[i].data(), unbiased);
+    cpu_reduce_axis(A->ptr, rd->ishape, rd->axis, B->ptr, CPU_RED_VAR);
+    if (unbiased) {
+        int n = rd->size_reduction;
+        long int nout = shape2size(rd->ishape) / n;
+        for (long int i = 0; i < nout; i++) B->ptr[i] *= n / (n - 1.0f);
     }
 }
 
 float cpu_var(float *ptr, int size, int *map, bool unbiased){
     float mean = cpu_sum(ptr, size, map) / size;
-    float sum = 0.0f;
-
-    if(map == nullptr) {
-        #pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) {
-            float tmp = ptr[i] - mean;
-            sum += tmp * tmp;
-        }
-    }else{
-        #pragma omp parallel for reduction(+:sum)
-        for (int i = 0; i < size; ++i) {
-            float tmp = ptr[map[i]] - mean;
+    float sum = cpu_parallel_reduce(0, size, 0.0f, [&](long int ini, long int end) {
+        float sum = 0.0f;
+        for (long int i = ini; i < end; ++i) {
+            float tmp = ((map == nullptr) ? ptr[i] : ptr[map[i]]) - mean;
             sum += tmp * tmp;
         }
-    }
+        return sum;
+    }, add);
     if(unbiased){return sum/(size-1.0f);}
     else {return sum/(size);}
 }
@@ -615,10 +599,9 @@ float cpu_std(Tensor *A, bool unbiased) {
 }
 
 void cpu_std(Tensor *A, Tensor *B, ReduceDescriptor2 *rd, bool unbiased){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = ::sqrtf(cpu_var(A->ptr, rd->index[i].size(), rd->index[i].data(), unbiased));
-    }
+    cpu_var(A, B, rd, unbiased);
+    long int nout = shape2size(rd->ishape) / rd->size_reduction;
+    for (long int i = 0; i < nout; i++) B->ptr[i] = ::sqrtf(B->ptr[i]);
 }
 
 
@@ -628,10 +611,11 @@ int cpu_mode(Tensor *A) {
 
 
 void cpu_mode(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-#pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_mode(A->ptr, rd->index[i].size(), rd->index[i].data());
-    }
+    cpu_parallel_for(0, rd->index.size(), 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = cpu_mode(A->ptr, rd->index[i].size(), rd->index[i].data());
+        }
+    });
 }
 
 int cpu_mode(float *ptr, int size, int *map) {
@@ -665,10 +649,11 @@ float cpu_median(Tensor *A) {
 
 
 void cpu_median(Tensor *A, Tensor *B, ReduceDescriptor2 *rd){
-    #pragma omp parallel for
-    for(int i=0; i<rd->index.size(); i++){
-        B->ptr[i] = cpu_median(A->ptr, rd->index[i].size(), rd->index[i].data());
-    }
+    cpu_parallel_for(0, rd->index.size(), 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = cpu_median(A->ptr, rd->index[i].size(), rd->index[i].data());
+        }
+    });
 }
 
 float cpu_median(float *ptr, int size, int *map) {
@@ -677,11 +662,13 @@ float cpu_median(float *ptr, int size, int *map) {
 
     // Copy data
     if(map == nullptr){
-        #pragma omp parallel for
-        for (int i = 0; i < size; ++i) { sorted_data[i] = ptr[i]; }
+        cpu_parallel_for(0, size, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int i = ini; i < end; ++i) { sorted_data[i] = ptr[i]; }
+        });
     }else{
-        #pragma omp parallel for
-        for (int i = 0; i < size; ++i) { sorted_data[i] = ptr[map[i]]; }
+        cpu_parallel_for(0, size, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int i = ini; i < end; ++i) { sorted_data[i] = ptr[map[i]]; }
+        });
     }
 
     // Sort data
@@ -700,6 +687,73 @@ float cpu_median(float *ptr, int size, int *map) {
     return median;
 }
 
+// Rows of the blocks that are summed apart in cpu_batchnorm_sums (rc == 1)
+#define BN_ROWS 64
+
+// Sums of each channel: s1[j] = sum(x * y), s2[j] = sum(x). The blocks do not
+// depend on the number of threads and they are merged in order, so the result
+// is always the same. The rows of a channels-last input (rc == 1) are split
+// in blocks of BN_ROWS, the channels of an (b, z, rc) input are summed apart
+static void cpu_batchnorm_sums(int b, int z, int rc, const float *x, const float *y, float *s1, float *s2)
+{
+    if (rc == 1) {
+        long int blocks = (b + BN_ROWS - 1) / BN_ROWS;
+        vector<float> part(blocks * 2 * z, 0.0f);
+        cpu_parallel_for(0, blocks, cpu_grain((long int)BN_ROWS * z), [&](long int ini, long int end) {
+            for (long int k = ini; k < end; k++) {
+                float *p1 = &part[k * 2 * z], *p2 = p1 + z;
+                for (long int i = k * BN_ROWS; i < std::min((long int)b, (k + 1) * BN_ROWS); i++) {
+                    const float *xi = x + i * z, *yi = y + i * z;
+                    for (int j = 0; j < z; j++) {
+                        p1[j] += xi[j] * yi[j];
+                        p2[j] += xi[j];
+                    }
+                }
+            }
+        });
+        for (int j = 0; j < z; j++) s1[j] = s2[j] = 0.0f;
+        for (long int k = 0; k < blocks; k++)
+            for (int j = 0; j < z; j++) {
+                s1[j] += part[k * 2 * z + j];
+                s2[j] += part[k * 2 * z + z + j];
+            }
+    } else {
+        cpu_parallel_for(0, z, cpu_grain((long int)b * rc), [&](long int ini, long int end) {
+            for (long int j = ini; j < end; j++) {
+                float a1 = 0.0f, a2 = 0.0f;
+                for (int i = 0; i < b; i++) {
+                    const float *xi = x + ((long int)i * z + j) * rc, *yi = y + ((long int)i * z + j) * rc;
+                    for (int l = 0; l < rc; l++) {
+                        a1 += xi[l] * yi[l];
+                        a2 += xi[l];
+                    }
+                }
+                s1[j] = a1;
+                s2[j] = a2;
+            }
+        });
+    }
+}
+
+// f(p, j) for each element p of channel j: rows of z channels (rc == 1) or of rc elements
+template<typename F>
+static void cpu_batchnorm_apply(int b, int z, int rc, const F &f)
+{
+    if (rc == 1) {
+        cpu_parallel_for(0, b, cpu_grain(z), [&](long int ini, long int end) {
+            for (long int i = ini; i < end; i++)
+                for (int j = 0; j < z; j++) f(i * z + j, j);
+        });
+    } else {
+        cpu_parallel_for(0, (long int)b * z, cpu_grain(rc), [&](long int ini, long int end) {
+            for (long int t = ini; t < end; t++) {
+                int j = t % z;
+                for (long int p = t * rc; p < (t + 1) * rc; p++) f(p, j);
+            }
+        });
+    }
+}
+
 void cpu_batchnorm_forward(int b, int z, int rc,
         float *input, float *output, float *opa,
         float *global_mean, float *global_variance,
@@ -707,116 +761,65 @@ void cpu_batchnorm_forward(int b, int z, int rc,
         float *mean, float *variance,
         bool trmode, float epsilon, float momentum)
 {
-    const int block_size = 256;
-    int rcz = rc * z;
     if (trmode) {
         // compute mean and variance
-        for (int j = 0; j < z; j++) mean[j] = variance[j] = 0.0;
-        #pragma omp parallel for
-        for (int k = 0; k < rcz; k += block_size)
-            for (int i = 0; i < b; i++) {
-                int p = k + i * rcz;
-                for (int l = 0; l < block_size && k + l < rcz; l++, p++) {
-                    int j = (k + l) / rc;
-                    mean[j] += input[p];
-                    variance[j] += input[p] * input[p];
-                }
-            }
+        cpu_batchnorm_sums(b, z, rc, input, input, variance, mean);
         float N = b * rc;
-        #pragma omp parallel for
-        for (int j = 0; j < z; j++) {
-            mean[j] = mean[j] / N;
-            variance[j] = variance[j] / N - mean[j] * mean[j];
-            // update global statistics
-            if (momentum != 0.0) {
-                global_mean[j] = momentum * global_mean[j] + (1.0 - momentum) * mean[j];
-                global_variance[j] = momentum * global_variance[j] + (1.0 - momentum) * variance[j];
+        cpu_parallel_for(0, z, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int j = ini; j < end; ++j) {
+                mean[j] = mean[j] / N;
+                variance[j] = variance[j] / N - mean[j] * mean[j];
+                // update global statistics
+                if (momentum != 0.0) {
+                    global_mean[j] = momentum * global_mean[j] + (1.0 - momentum) * mean[j];
+                    global_variance[j] = momentum * global_variance[j] + (1.0 - momentum) * variance[j];
+                }
+                variance[j] = sqrt(variance[j] + epsilon);
             }
-            variance[j] = sqrt(variance[j] + epsilon);
-        }
+        });
     } else {
         // just update variance
         mean = global_mean;
-        #pragma omp parallel for
-        for (int j = 0; j < z; j++) {
-            variance[j] = sqrt(global_variance[j] + epsilon);
-        }
+        cpu_parallel_for(0, z, CPU_GRAIN, [&](long int ini, long int end) {
+            for (long int j = ini; j < end; ++j) {
+                variance[j] = sqrt(global_variance[j] + epsilon);
+            }
+        });
     }
     // normalization
-    #pragma omp parallel for
-    for (int k = 0; k < rcz; k += block_size)
-        for (int i = 0; i < b; i++) {
-            int p = k + i * rcz;
-            for (int l = 0; l < block_size && k + l < rcz; l++, p++) {
-                int j = (k + l) / rc;
-                float o = (input[p] - mean[j]) / variance[j];
-                // affine transformation
-                if (affine_g != NULL) {
-                    opa[p] = o;
-                    output[p] = o * affine_g[j] + affine_b[j];
-                } else output[p] = o;
-            }
-        }
+    cpu_batchnorm_apply(b, z, rc, [&](long int p, int j) {
+        float o = (input[p] - mean[j]) / variance[j];
+        // affine transformation
+        if (affine_g != NULL) {
+            opa[p] = o;
+            output[p] = o * affine_g[j] + affine_b[j];
+        } else output[p] = o;
+    });
 }
 
 void cpu_batchnorm_backward(int b, int z, int rc, float *delta, float *opa, float *pdelta, float *gbn_g, float *gbn_b, float *bn_g, float *variance, float *mean1, float *mean2)
 {
-    const int block_size = 256;
-    int rcz = rc * z;
     float N = b * rc;
-    if (bn_g != NULL) { // affine
-        // compute mean
-        for (int j = 0; j < z; j++) mean1[j] = mean2[j] = 0.0;
-        #pragma omp parallel for
-        for (int k = 0; k < rcz; k += block_size)
-            for (int i = 0; i < b; i++) {
-                int p = k + i * rcz;
-                for (int l = 0; l < block_size && k + l < rcz; l++, p++) {
-                    int j = (k + l) / rc;
-                    mean1[j] += delta[p] * opa[p];
-                    mean2[j] += delta[p];
-                    delta[p] *= bn_g[j];
-                }
-            }
-        #pragma omp parallel for
-        for (int j = 0; j < z; j++) {
+    // compute mean
+    cpu_batchnorm_sums(b, z, rc, delta, opa, mean1, mean2); // step 1 & 2, step 4
+    cpu_parallel_for(0, z, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int j = ini; j < end; ++j) {
             mean1[j] /= N;
             mean2[j] /= N;
-            gbn_g[j] += mean1[j];
-            gbn_b[j] += mean2[j];
-            mean1[j] *= bn_g[j];
-            mean2[j] *= bn_g[j];
-        }
-    } else {
-        // compute mean
-        for (int j = 0; j < z; j++) mean1[j] = mean2[j] = 0.0;
-        #pragma omp parallel for
-        for (int k = 0; k < rcz; k += block_size)
-            for (int i = 0; i < b; i++) {
-                int p = k + i * rcz;
-                for (int l = 0; l < block_size && k + l < rcz; l++, p++) {
-                    int j = (k + l) / rc;
-                    mean1[j] += delta[p] * opa[p]; // step 1 & 2
-                    mean2[j] += delta[p]; // step 4
-                }
-            }
-        #pragma omp parallel for
-        for (int j = 0; j < z; j++) {
-            mean1[j] /= N;
-            mean2[j] /= N;
-        }
-    }
-    #pragma omp parallel for
-    for (int k = 0; k < rcz; k += block_size)
-        for (int i = 0; i < b; i++) {
-            int p = k + i * rcz;
-            for (int l = 0; l < block_size && k + l < rcz; l++, p++) {
-                int j = (k + l) / rc;
-                // opa[p] = opa[p] * mean1[j] + mean2[j]; // step 3 & 5
-                // delta[p] -= opa[p]; // step 6
-                // delta[p] /= variance[j]; // step 7
-                // pdelta[p] += delta[p];
-                pdelta[p] += (delta[p] - (opa[p] * mean1[j] + mean2[j])) / variance[j];
+            if (bn_g != NULL) { // affine
+                gbn_g[j] += mean1[j];
+                gbn_b[j] += mean2[j];
+                mean1[j] *= bn_g[j];
+                mean2[j] *= bn_g[j];
             }
         }
+    });
+    cpu_batchnorm_apply(b, z, rc, [&](long int p, int j) {
+        // opa[p] = opa[p] * mean1[j] + mean2[j]; // step 3 & 5
+        // delta[p] -= opa[p]; // step 6
+        // delta[p] /= variance[j]; // step 7
+        // pdelta[p] += delta[p];
+        float d = (bn_g != NULL) ? delta[p] * bn_g[j] : delta[p];
+        pdelta[p] += (d - (opa[p] * mean1[j] + mean2[j])) / variance[j];
+    });
 }
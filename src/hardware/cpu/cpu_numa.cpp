@@ -0,0 +1,223 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "eddl/system_info.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+#ifdef EDDL_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Max. nodes in the masks passed to mbind
+#define CPU_NUMA_MAX_NODES 64
+
+static std::atomic<bool> first_touch(false);
+static bool omp_pinned = false;  // The threads of the OpenMP team have been pinned
+
+
+// "0-3,8,10-11" => {0,1,2,3,8,10,11}
+static vector<int> parse_cpulist(const string &list) {
+    vector<int> cpus;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+        size_t dash = item.find('-');
+        int a = stoi(item.substr(0, dash));
+        int b = (dash == string::npos) ? a : stoi(item.substr(dash + 1));
+        for (int c = a; c <= b; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+// Cores of each node and the id of the node (the nodes without cores are skipped)
+static vector<vector<int>> read_nodes(vector<int> &ids) {
+    vector<vector<int>> nodes;
+
+#ifdef EDDL_LINUX
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool use_mask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    for (int n = 0; n < CPU_NUMA_MAX_NODES; n++) {
+        ifstream f("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+        if (!f.is_open()) continue;
+        string list;
+        getline(f, list);
+
+        vector<int> cpus;
+        for (int c : parse_cpulist(list))
+            if (!use_mask || ((c < CPU_SETSIZE) && CPU_ISSET(c, &allowed))) cpus.push_back(c);
+        if (cpus.empty()) continue;  // Memory only
+        nodes.push_back(cpus);
+        ids.push_back(n);
+    }
+#endif
+
+    // No information: one node with all the cores
+    if (nodes.empty()) {
+        nodes.resize(1);
+        int n = std::max(1, (int)thread::hardware_concurrency());
+        for (int c = 0; c < n; c++) nodes[0].push_back(c);
+        ids.assign(1, 0);
+    }
+    return nodes;
+}
+
+// Read once: cpu_numa_place runs on every reuse of a block, and a pinned thread
+// would only see its own core in the affinity mask
+static vector<vector<int>> numa_nodes(vector<int> &ids) {
+    static vector<int> node_ids;
+    static vector<vector<int>> nodes = read_nodes(node_ids);
+    ids = node_ids;
+    return nodes;
+}
+
+vector<vector<int>> cpu_numa_topology() {
+    vector<int> ids;
+    return numa_nodes(ids);
+}
+
+int cpu_numa_nodes() {
+    return cpu_numa_topology().size();
+}
+
+static bool pin_thread(const vector<int> &cpus) {
+#ifdef EDDL_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_pin_thread(int cpu) {
+    return pin_thread(vector<int>(1, cpu));
+}
+
+void cpu_omp_set_threads(int threads, const vector<int> &cpus) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+
+    // Not pinned: left to OMP_PROC_BIND/OMP_PLACES, unless pinned before (every core again)
+    if (cpus.empty() && !omp_pinned) return;
+    vector<int> all;
+    if (cpus.empty())
+        for (auto &n : cpu_numa_topology()) all.insert(all.end(), n.begin(), n.end());
+    omp_pinned = !cpus.empty();
+
+    // The team is kept by the runtime for the next regions of the same size.
+    // The calling thread is left as it is, as the worker 0 of the pool
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        if (t > 0) {
+            if (cpus.empty()) pin_thread(all);
+            else cpu_pin_thread(cpus[t]);
+        }
+    }
+#endif
+}
+
+void cpu_numa_set_first_touch(bool enable) {
+    first_touch = enable;
+}
+
+bool cpu_numa_first_touch() {
+    return first_touch;
+}
+
+void cpu_numa_touch(void *ptr, size_t bytes) {
+    // Same split than an elementwise kernel over the floats of the block
+    char *p = (char *)ptr;
+    long int n = bytes / sizeof(float);
+    cpu_parallel_for(0, n, CPU_GRAIN, [&](long int ini, long int end) {
+        memset(p + ini * sizeof(float), 0, (end - ini) * sizeof(float));
+    });
+    memset(p + n * sizeof(float), 0, bytes - n * sizeof(float));
+}
+
+#ifdef EDDL_LINUX
+// Whole pages inside [ptr, ptr + bytes) (the ones at the borders are shared with other data)
+static bool numa_mbind(void *ptr, size_t bytes, int mode, const unsigned long *mask) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t a = ((uintptr_t)ptr + page - 1) / page * page;
+    uintptr_t b = ((uintptr_t)ptr + bytes) / page * page;
+    if (b <= a) return true;
+    return syscall(SYS_mbind, a, b - a, mode, mask, CPU_NUMA_MAX_NODES + 1, MPOL_MF_MOVE) == 0;
+}
+#endif
+
+bool cpu_numa_place(void *ptr, size_t bytes) {
+#ifdef EDDL_LINUX
+    if (bytes < CPU_NUMA_MIN_BYTES) return false;
+
+    vector<int> ids;
+    if (numa_nodes(ids).size() < 2) return true;
+
+    shared_ptr<CPUPool> pool = cpu_pool();
+    long int n = bytes / sizeof(float);
+    long int nranges = pool->ranges(n, CPU_GRAIN);
+
+    // One call for each block of consecutive ranges in the same node
+    bool ok = true;
+    long int r = 0;
+    while (r < nranges) {
+        int g = pool->group(pool->owner(r, nranges));
+        long int s = r;
+        while ((r < nranges) && (pool->group(pool->owner(r, nranges)) == g)) r++;
+
+        unsigned long mask[CPU_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+        int id = ids[g % ids.size()];
+        mask[id / (8 * sizeof(unsigned long))] = 1UL << (id % (8 * sizeof(unsigned long)));
+        size_t ini = n * s / nranges * sizeof(float);
+        size_t end = n * r / nranges * sizeof(float);
+        ok &= numa_mbind((char *)ptr + ini, end - ini, MPOL_PREFERRED, mask);
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
+bool cpu_numa_interleave(void *ptr, size_t bytes) {
+#ifdef EDDL_LINUX
+    if (bytes < CPU_NUMA_MIN_BYTES) return false;
+
+    vector<int> ids;
+    if (numa_nodes(ids).size() < 2) return true;
+
+    unsigned long mask[CPU_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    for (int id : ids) mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+    return numa_mbind(ptr, bytes, MPOL_INTERLEAVE, mask);
+#else
+    return false;
+#endif
+}
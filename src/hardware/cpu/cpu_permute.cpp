@@ -0,0 +1,133 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#include <algorithm>
+
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include "eddl/utils.h"
+
+// CPU: Permutations ************************************************
+// The dimensions of size 1 are dropped and the ones that are consecutive both
+// in A and in B are merged, so NCHW => NHWC is a batch of N transposes of
+// (C x HW) and a permutation of two dims is a single transpose. Then:
+//   - If the innermost dim is the same in A and B, the permutation moves runs
+//     of that length.
+//   - Otherwise the dims that are contiguous in A and in B are walked by tiles
+//     (about PERMUTE_TILE^2 floats, both in cache) that are transposed in
+//     registers (cpu_vtranspose). The other dims index the tiles.
+// No address table is built.
+
+#define PERMUTE_TILE 64
+
+// Merged dims: size and stride in A and in B
+struct PermDim {
+    long int size;
+    long int astride;
+    long int bstride;
+};
+
+static vector<PermDim> permute_plan(const vector<int> &ishape, const vector<int> &dims) {
+    vector<int> oshape = permute_shape(ishape, dims);
+    vector<int> istride = shape2stride(ishape);
+    vector<int> ostride = shape2stride(oshape);
+
+    // Walk the dims in the order of B, merging d with the previous one when it
+    // comes next in A too (there can be dims of size 1 between them)
+    vector<PermDim> plan;
+    for (int k = 0; k < dims.size(); k++) {
+        int d = dims[k];
+        if (ishape[d] == 1) continue;
+        if (!plan.empty() && plan.back().astride == (long int)ishape[d] * istride[d]) {
+            plan.back().size *= ishape[d];
+            plan.back().astride = istride[d];
+            plan.back().bstride = ostride[k];
+        } else {
+            plan.push_back({ishape[d], istride[d], ostride[k]});
+        }
+    }
+    return plan;
+}
+
+void cpu_permute(const float *A, const vector<int> &ishape, const vector<int> &dims, float *B, bool inc) {
+    vector<PermDim> plan = permute_plan(ishape, dims);
+    long int size = shape2size(ishape);
+
+    // Contiguous dims of A and B (their strides are 1)
+    int ca = -1, cb = -1;
+    for (int d = 0; d < plan.size(); d++) {
+        if (plan[d].astride == 1) ca = d;
+        if (plan[d].bstride == 1) cb = d;
+    }
+
+    // Same order: copy
+    if (plan.size() <= 1) {
+        cpu_parallel_for(0, size, CPU_GRAIN, [&](long int ini, long int end) {
+            if (inc) for (long int i = ini; i < end; i++) B[i] += A[i];
+            else std::copy(A + ini, A + end, B + ini);
+        });
+        return;
+    }
+
+    // The other dims (and their strides) index the runs or the tiles
+    vector<PermDim> outer;
+    for (int d = 0; d < plan.size(); d++)
+        if (d != ca && d != cb) outer.push_back(plan[d]);
+    auto offsets = [&](long int t, long int &a, long int &b) {
+        a = b = 0;
+        for (int d = outer.size() - 1; d >= 0; d--) {
+            long int idx = t % outer[d].size;
+            t /= outer[d].size;
+            a += idx * outer[d].astride;
+            b += idx * outer[d].bstride;
+        }
+    };
+
+    // Runs
+    if (ca == cb) {
+        long int n = plan[ca].size;
+        cpu_parallel_for(0, size / n, cpu_grain(n), [&](long int ini, long int end) {
+            for (long int r = ini; r < end; r++) {
+                long int a, b;
+                offsets(r, a, b);
+                if (inc) for (long int i = 0; i < n; i++) B[b + i] += A[a + i];
+                else std::copy(A + a, A + a + n, B + b);
+            }
+        });
+        return;
+    }
+
+    // Tiles: rows of A along cb, columns of A along ca. A small dim gets a
+    // longer tile on the other one
+    long int nrows = plan[cb].size, ncols = plan[ca].size;
+    long int lda = plan[cb].astride, ldb = plan[ca].bstride;
+    long int trows = std::min(nrows, (long int)PERMUTE_TILE);
+    long int tcols = std::min(ncols, std::max((long int)PERMUTE_TILE, PERMUTE_TILE * PERMUTE_TILE / trows));
+    trows = std::min(nrows, std::max((long int)PERMUTE_TILE, PERMUTE_TILE * PERMUTE_TILE / tcols));
+    long int nr = (nrows + trows - 1) / trows, nc = (ncols + tcols - 1) / tcols;
+    long int tiles = size / (nrows * ncols) * nr * nc;
+
+    cpu_parallel_for(0, tiles, cpu_grain(trows * tcols), [&](long int ini, long int end) {
+        for (long int t = ini; t < end; t++) {
+            long int c = (t % nc) * tcols;
+            long int r = (t / nc % nr) * trows;
+            long int a, b;
+            offsets(t / nc / nr, a, b);
+            cpu_vtranspose(A + a + r * lda + c, lda, B + b + c * ldb + r, ldb,
+                           std::min(trows, nrows - r), std::min(tcols, ncols - c), inc);
+        }
+    });
+}
+
+void cpu_permute_back(const float *B, const vector<int> &ishape, const vector<int> &dims, float *A, bool inc) {
+    // The inverse permutation, from the shape of B
+    vector<int> inverse(dims.size());
+    for (int k = 0; k < dims.size(); k++) inverse[dims[k]] = k;
+    cpu_permute(B, permute_shape(ishape, dims), inverse, A, inc);
+}
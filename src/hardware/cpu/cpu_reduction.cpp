@@ -7,10 +7,339 @@
 * All rights reserved
 */
 
+#include <cmath>
 #include <stdexcept>
 
 #include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+
+/////////////////////////////////////////////////////////////////
+///// REDUCTION ENGINE
+/////////////////////////////////////////////////////////////////
+// The dims of the input are collapsed into alternating blocks of kept and
+// reduced dims ({b, c, h, w} over {0, 2, 3} => {b}, {c}, {h*w}), so there are
+// only two kinds of loop:
+//  - The innermost dim is reduced: each output reduces contiguous rows.
+//  - The innermost dim is kept: the outputs of a row are reduced together,
+//    adding rows of the input.
+// Both are vectorized in the inner loop. The outputs are split among the
+// threads, and when there are few outputs (i.e. the sum of a whole tensor)
+// the reduction itself is split and the partial results are merged in order.
+// The reduction follows the memory order (the max/min is the first one).
+
+struct RedPlan {
+    vector<long int> ksize, kstride;  // Kept dims (outermost first)
+    vector<long int> rsize, rstride;  // Reduced dims
+    long int nout, nred;
+    bool inner_red;  // The innermost dim (contiguous) is reduced
+};
+
+static RedPlan red_plan(const vector<int> &shape, const vector<int> &axis) {
+    RedPlan p;
+    vector<long int> stride(shape.size());
+    long int s = 1;
+    for (int i = shape.size() - 1; i >= 0; i--) {
+        stride[i] = s;
+        s *= shape[i];
+    }
+
+    // Merge consecutive dims of the same kind (size 1 dims are skipped)
+    int last = -1;
+    for (int i = 0; i < shape.size(); i++) {
+        if (shape[i] == 1) continue;
+        int red = find(axis.begin(), axis.end(), i) != axis.end();
+        vector<long int> &size = red ? p.rsize : p.ksize;
+        vector<long int> &str = red ? p.rstride : p.kstride;
+        if (red == last) {
+            size.back() *= shape[i];
+            str.back() = stride[i];
+        } else {
+            size.push_back(shape[i]);
+            str.push_back(stride[i]);
+        }
+        last = red;
+    }
+    if (p.rsize.empty()) {  // Nothing to reduce: rows of one element
+        p.rsize.push_back(1);
+        p.rstride.push_back(1);
+        last = 1;
+    }
+    p.inner_red = (last == 1);
+
+    p.nout = p.nred = 1;
+    for (auto k : p.ksize) p.nout *= k;
+    for (auto r : p.rsize) p.nred *= r;
+    return p;
+}
+
+// Offset of the element number i of a block of dims (row-major)
+static inline long int red_offset(long int i, const vector<long int> &size, const vector<long int> &stride) {
+    long int off = 0;
+    for (int d = size.size() - 1; d >= 0; d--) {
+        off += (i % size[d]) * stride[d];
+        i /= size[d];
+    }
+    return off;
+}
+
+static inline float red_identity(int op) {
+    if (op == CPU_RED_MAX) return -INFINITY;
+    if (op == CPU_RED_MIN) return INFINITY;
+    if (op == CPU_RED_PROD) return 1.0f;
+    return 0.0f;
+}
+
+// Contiguous run of n values into (v, i). off: offset of the run in the input
+static inline void red_run(const float *a, long int n, long int off, int op, float m, float &v, long int &i) {
+    if (op == CPU_RED_SUM) {
+        float s = 0.0f;
+        #pragma omp simd reduction(+:s)
+        for (long int j = 0; j < n; j++) s += a[j];
+        v += s;
+    } else if (op == CPU_RED_VAR) {
+        float s = 0.0f;
+        #pragma omp simd reduction(+:s)
+        for (long int j = 0; j < n; j++) s += (a[j] - m) * (a[j] - m);
+        v += s;
+    } else if (op == CPU_RED_PROD) {
+        float s = 1.0f;
+        #pragma omp simd reduction(*:s)
+        for (long int j = 0; j < n; j++) s *= a[j];
+        v *= s;
+    } else {
+        // Best value of the run, then the first position with it
+        float b = red_identity(op);
+        if (op == CPU_RED_MAX) {
+            #pragma omp simd reduction(max:b)
+            for (long int j = 0; j < n; j++) b = (a[j] > b) ? a[j] : b;
+        } else {
+            #pragma omp simd reduction(min:b)
+            for (long int j = 0; j < n; j++) b = (a[j] < b) ? a[j] : b;
+        }
+        if ((op == CPU_RED_MAX) ? (b > v) : (b < v)) {
+            long int j = 0;
+            while (a[j] != b) j++;
+            v = b;
+            i = off + j;
+        }
+    }
+}
+
+// Reduces the positions [r0, r1) of the outputs [o0, o1) into acc/idx (indexed from o0)
+static void red_kernel(const RedPlan &p, const float *A, int op, const float *mean,
+                       long int o0, long int o1, long int r0, long int r1, float *acc, long int *idx) {
+    if (p.inner_red) {
+        long int L = p.rsize.back();
+        for (long int o = o0; o < o1; o++) {
+            long int base = red_offset(o, p.ksize, p.kstride);
+            float m = (mean != nullptr) ? mean[o] : 0.0f;
+            long int r = r0;
+            while (r < r1) {
+                long int l0 = r % L;
+                long int n = std::min(L - l0, r1 - r);
+                long int off = base + red_offset(r - l0, p.rsize, p.rstride) + l0;
+                red_run(A + off, n, off, op, m, acc[o - o0], idx[o - o0]);
+                r += n;
+            }
+        }
+    } else {
+        long int K = p.ksize.back();
+        long int o = o0;
+        while (o < o1) {
+            // A piece of a row of outputs
+            long int k0 = o % K;
+            long int n = std::min(K - k0, o1 - o);
+            long int base = red_offset(o - k0, p.ksize, p.kstride) + k0;
+            float *ac = acc + (o - o0);
+            long int *ix = idx + (o - o0);
+            const float *m = (mean != nullptr) ? mean + o : nullptr;
+
+            for (long int r = r0; r < r1; r++) {
+                long int off = base + red_offset(r, p.rsize, p.rstride);
+                const float *a = A + off;
+                if (op == CPU_RED_SUM) {
+                    #pragma omp simd
+                    for (long int k = 0; k < n; k++) ac[k] += a[k];
+                } else if (op == CPU_RED_VAR) {
+                    #pragma omp simd
+                    for (long int k = 0; k < n; k++) ac[k] += (a[k] - m[k]) * (a[k] - m[k]);
+                } else if (op == CPU_RED_PROD) {
+                    #pragma omp simd
+                    for (long int k = 0; k < n; k++) ac[k] *= a[k];
+                } else if (op == CPU_RED_MAX) {
+                    for (long int k = 0; k < n; k++)
+                        if (a[k] > ac[k]) { ac[k] = a[k]; ix[k] = off + k; }
+                } else {
+                    for (long int k = 0; k < n; k++)
+                        if (a[k] < ac[k]) { ac[k] = a[k]; ix[k] = off + k; }
+                }
+            }
+            o += n;
+        }
+    }
+}
+
+// Reduction with the plan p. idx (optional): position in A of the max/min
+static void red_exec(const RedPlan &p, const float *A, int op, const float *mean, float *B, long int *idx) {
+    long int nout = p.nout, nred = p.nred;
+    vector<long int> tmp;
+    if (idx == nullptr) {
+        tmp.resize(nout);
+        idx = tmp.data();
+    }
+
+    int threads = cpu_split_threads();
+    if ((nout >= 2 * threads) || (nred < 2 * CPU_GRAIN)) {
+        // Outputs split among the threads
+        cpu_parallel_for(0, nout, cpu_grain(nred), [&](long int ini, long int end) {
+            for (long int o = ini; o < end; o++) {
+                B[o] = red_identity(op);
+                idx[o] = -1;
+            }
+            red_kernel(p, A, op, mean, ini, end, 0, nred, B + ini, idx + ini);
+        });
+    } else {
+        // Few outputs: the reduction is split too (partial results merged in order)
+        long int nchunks = std::min((long int)threads * CPU_POOL_SPLIT, nred / CPU_GRAIN);
+        vector<float> pv(nchunks * nout, red_identity(op));
+        vector<long int> pi(nchunks * nout, -1);
+        cpu_parallel_for(0, nchunks, 1, [&](long int ini, long int end) {
+            for (long int c = ini; c < end; c++)
+                red_kernel(p, A, op, mean, 0, nout, nred * c / nchunks, nred * (c + 1) / nchunks, &pv[c * nout], &pi[c * nout]);
+        });
+
+        for (long int o = 0; o < nout; o++) {
+            float v = red_identity(op);
+            long int i = -1;
+            for (long int c = 0; c < nchunks; c++) {
+                float w = pv[c * nout + o];
+                if ((op == CPU_RED_SUM) || (op == CPU_RED_VAR)) v += w;
+                else if (op == CPU_RED_PROD) v *= w;
+                else if ((op == CPU_RED_MAX) ? (w > v) : (w < v)) { v = w; i = pi[c * nout + o]; }
+            }
+            B[o] = v;
+            idx[o] = i;
+        }
+    }
+
+    // All -inf (max) or +inf (min): the first one
+    if ((op == CPU_RED_MAX) || (op == CPU_RED_MIN)) {
+        for (long int o = 0; o < nout; o++)
+            if (idx[o] < 0) idx[o] = red_offset(o, p.ksize, p.kstride);
+    }
+}
+
+void cpu_reduce_axis(const float *A, const vector<int> &shape, const vector<int> &axis, float *B, int op, float *arg) {
+    RedPlan p = red_plan(shape, axis);
+    vector<long int> idx;
+    if (arg != nullptr) idx.resize(p.nout);
+
+    if ((op == CPU_RED_MEAN) || (op == CPU_RED_VAR)) {
+        red_exec(p, A, CPU_RED_SUM, nullptr, B, nullptr);
+        float *mean = B;
+        vector<float> m;
+        if (op == CPU_RED_VAR) {  // Second pass around the mean
+            m.assign(B, B + p.nout);
+            for (auto &v : m) v /= p.nred;
+            mean = m.data();
+            red_exec(p, A, CPU_RED_VAR, mean, B, nullptr);
+        }
+        for (long int o = 0; o < p.nout; o++) B[o] /= p.nred;
+    } else {
+        red_exec(p, A, op, nullptr, B, arg != nullptr ? idx.data() : nullptr);
+    }
+
+    if (arg != nullptr)
+        for (long int o = 0; o < p.nout; o++) arg[o] = (float)idx[o];
+}
+
+void cpu_expand_axis(const float *B, const vector<int> &shape, const vector<int> &axis, float *A, float alpha, bool inc) {
+    RedPlan p = red_plan(shape, axis);
+
+    cpu_parallel_for(0, p.nout, cpu_grain(p.nred), [&](long int ini, long int end) {
+        if (p.inner_red) {
+            long int L = p.rsize.back();
+            for (long int o = ini; o < end; o++) {
+                long int base = red_offset(o, p.ksize, p.kstride);
+                float v = alpha * B[o];
+                for (long int r = 0; r < p.nred; r += L) {
+                    float *a = A + base + red_offset(r, p.rsize, p.rstride);
+                    if (inc) for (long int l = 0; l < L; l++) a[l] += v;
+                    else for (long int l = 0; l < L; l++) a[l] = v;
+                }
+            }
+        } else {
+            long int K = p.ksize.back();
+            long int o = ini;
+            while (o < end) {
+                long int k0 = o % K;
+                long int n = std::min(K - k0, end - o);
+                long int base = red_offset(o - k0, p.ksize, p.kstride) + k0;
+                const float *b = B + o;
+                for (long int r = 0; r < p.nred; r++) {
+                    float *a = A + base + red_offset(r, p.rsize, p.rstride);
+                    if (inc) for (long int k = 0; k < n; k++) a[k] += alpha * b[k];
+                    else for (long int k = 0; k < n; k++) a[k] = alpha * b[k];
+                }
+                o += n;
+            }
+        }
+    });
+}
 
+
+void cpu_reduce(Tensor *A, Tensor *B,string mode,vector<int> axis)
+{
+  _profile(_CPU_REDUCE, 0);
+  int op;
+  if (mode=="mean") op=CPU_RED_MEAN;
+  else if (mode=="variance") op=CPU_RED_VAR;
+  else if (mode=="sum") op=CPU_RED_SUM;
+  else if (mode=="max") op=CPU_RED_MAX;
+  else if (mode=="min") op=CPU_RED_MIN;
+  else {
+    throw std::invalid_argument("mode: " + mode + " not yet implemented");
+  }
+  cpu_reduce_axis(A->ptr, A->shape, axis, B->ptr, op);
+    _profile(_CPU_REDUCE, 1);
+}
+void cpu_reduce(Tensor *A, Tensor *B,string mode,MapReduceDescriptor *MD)
+{
+    cpu_reduce(A,B,mode,MD->axis);
+}
+
+
+void cpu_reduce_op(Tensor *A, Tensor *B,string op,vector<int> axis)
+{
+    _profile(_CPU_REDUCE_OP, 0);
+  int i;
+
+  // Reduction of A, then applied to B
+  Tensor *C=new Tensor(B->shape,B->device);
+  bool prod=(op=="mult")||(op=="div");
+  if (!prod && (op!="sum") && (op!="diff")) {
+    delete C;
+    throw std::invalid_argument("op: " + op + " not yet implemented");
+  }
+  cpu_reduce_axis(A->ptr, A->shape, axis, C->ptr, prod ? CPU_RED_PROD : CPU_RED_SUM);
+
+  if (op=="sum") for(i=0;i<B->size;i++) B->ptr[i]+=C->ptr[i];
+  else if (op=="diff") for(i=0;i<B->size;i++) B->ptr[i]-=C->ptr[i];
+  else if (op=="mult") for(i=0;i<B->size;i++) B->ptr[i]*=C->ptr[i];
+  else for(i=0;i<B->size;i++) B->ptr[i]/=C->ptr[i];
+
+  delete C;
+    _profile(_CPU_REDUCE_OP, 1);
+}
+
+void cpu_reduce_op(Tensor *A, Tensor *B,string op,MapReduceDescriptor *MD)
+{
+  cpu_reduce_op(A,B,op,MD->axis);
+}
+
+
+// With an index map (see get_reduction_map), for the FPGA emulation
 void cpu_reduce(Tensor *A, Tensor *B,string mode,int* map)
 {
   _profile(_CPU_REDUCE, 0);
@@ -44,11 +373,6 @@ void cpu_reduce(Tensor *A, Tensor *B,string mode,int* map)
   }
     _profile(_CPU_REDUCE, 1);
 }
-void cpu_reduce(Tensor *A, Tensor *B,string mode,MapReduceDescriptor *MD)
-{
-    cpu_reduce(A,B,mode,MD->ind);
-}
-
 
 void cpu_reduce_op(Tensor *A, Tensor *B,string op,int* map)
 {
@@ -56,23 +380,21 @@ void cpu_reduce_op(Tensor *A, Tensor *B,string op,int* map)
   int i,j,min,max,sum;
   int s=A->size/B->size;
 
+  // Sequential: the elements of A that go to the same element of B are not
+  // contiguous (as in cpu_reduce with a map)
   if (op=="sum") {
-    #pragma omp parallel for
     for(i=0;i<A->size;i++)
       B->ptr[map[i]]+=A->ptr[i];
   }
   else if (op=="diff"){
-    #pragma omp parallel for
     for(i=0;i<A->size;i++)
       B->ptr[map[i]]-=A->ptr[i];
   }
   else if (op=="mult"){
-    #pragma omp parallel for
     for(i=0;i<A->size;i++)
       B->ptr[map[i]]*=A->ptr[i];
   }
   else if (op=="div"){
-    #pragma omp parallel for
     for(i=0;i<A->size;i++)
       B->ptr[map[i]]/=A->ptr[i];
   }
@@ -82,11 +404,6 @@ void cpu_reduce_op(Tensor *A, Tensor *B,string op,int* map)
     _profile(_CPU_REDUCE_OP, 1);
 }
 
-void cpu_reduce_op(Tensor *A, Tensor *B,string op,MapReduceDescriptor *MD)
-{
-  cpu_reduce_op(A,B,op,MD->ind);
-}
-
 
 void cpu_reduce_sum2D(Tensor *A, Tensor *B, int axis, int incB) {
     _profile(_CPU_REDUCE_SUM2D, 0);
@@ -116,68 +433,21 @@ void cpu_reduction(ReduceDescriptor *RD){
 
     _profile(_CPU_REDUCTION, 0);
 
-      float val,sum;
-      int ind;
-      int d;
-      int i,j,k,l,s;
+      static const int ops[4] = {CPU_RED_MEAN, CPU_RED_SUM, CPU_RED_MAX, CPU_RED_MIN};
+      int nout=RD->I->size/RD->red_size;
 
-      // [MEAN]: Compute items to be reduced
-      if (RD->m==0) {
-          d=1;
-          for(i=0;i<RD->axis.size();i++){
-              d *= RD->I->shape[RD->axis[i]];
-          }
+      if (!RD->keepdims) {
+          cpu_reduce_axis(RD->I->ptr, RD->I->shape, RD->axis, RD->O->ptr, ops[RD->m], (RD->m>=2) ? RD->S->ptr : nullptr);
+      }
+      else {
+          // Reduced values, then copied to every position of its group
+          vector<float> val(nout), ind;
+          if (RD->m>=2) ind.resize(nout);
+          cpu_reduce_axis(RD->I->ptr, RD->I->shape, RD->axis, val.data(), ops[RD->m], (RD->m>=2) ? ind.data() : nullptr);
+          cpu_expand_axis(val.data(), RD->I->shape, RD->axis, RD->O->ptr, 1.0f, false);
+          if (RD->m>=2) cpu_expand_axis(ind.data(), RD->I->shape, RD->axis, RD->S->ptr, 1.0f, false);
       }
 
-      //reduce
-      for(i=0;i<RD->index.size();i++)
-      {
-          sum=0;
-
-          for(j=0;j<RD->index[i].size();j++) {
-
-              float v=RD->I->ptr[RD->index[i][j]];
-              if (RD->m==2) {
-                  if (j==0) {val=v;ind=RD->index[i][j];}
-                  else if (v>val) {
-                      val=v;
-                      ind=RD->index[i][j];
-                  }
-              }
-              else if (RD->m==3) {
-                if (j==0) {val=v;ind=RD->index[i][j];}
-                else if (v<val) {
-                    val=v;
-                    ind=RD->index[i][j];
-                }
-              }
-              else sum+=v;
-          }
-
-          // set in Output
-          if (RD->m<2) { // mean or sum
-              if (RD->m==0) sum/=d;
-              if (RD->keepdims) {
-                  for(j=0;j<RD->index[i].size();j++) {
-                      RD->O->ptr[RD->index[i][j]]=sum;
-                    }
-              }
-              else RD->O->ptr[i]=sum;
-          }
-          else { // max or min
-              if (RD->keepdims) {
-                  for(j=0;j<RD->index[i].size();j++) {
-                      RD->O->ptr[RD->index[i][j]]=val;
-                      RD->S->ptr[RD->index[i][j]]=ind;
-                  }
-              }
-              else {
-                  RD->O->ptr[i]=val;
-                  RD->S->ptr[i]=ind;
-              }
-          }
-
-      }// i
       _profile(_CPU_REDUCTION, 1);
   }
 
@@ -185,37 +455,28 @@ void cpu_reduction(ReduceDescriptor *RD){
 
   _profile(_CPU_REDUCTION_BACK, 0);
 
-      float val,sum;
-      int ind;
-      int d;
-      int i,j,k,l,s;
+      int i;
+      int nout=RD->I->size/RD->red_size;
 
-      if (RD->m==0) {
-          d=1;
-          for(i=0;i<RD->axis.size();i++){
-              d *= RD->I->shape[RD->axis[i]];
+      if (RD->m>=2) {
+          for(i=0;i<nout;i++) {
+              int p=RD->S->ptr[i];
+              RD->ID->ptr[p]+=RD->D->ptr[i];
           }
       }
-
-      for(i=0;i<RD->index.size();i++)
-        {
-            if (RD->m>=2) {
-                int p=RD->S->ptr[i];
-                RD->ID->ptr[p]+=RD->D->ptr[i];
-            }
-            else {
-              val=0;
-              if(RD->keepdims) {
-                for(j=0;j<RD->index[i].size();j++)
-                  val+=RD->D->ptr[RD->index[i][j]];
-              }
-              else val=RD->D->ptr[i];
-
-              if (RD->m==0) val/=d;
-              for(j=0;j<RD->index[i].size();j++)
-                RD->ID->ptr[RD->index[i][j]]+=val;
-            }
-        }//i
+      else {
+          // Delta of each group (summed over the group with keepdims), added to all its positions
+          vector<float> val;
+          float *d=RD->D->ptr;
+          if (RD->keepdims) {
+              val.resize(nout);
+              cpu_reduce_axis(RD->D->ptr, RD->I->shape, RD->axis, val.data(), CPU_RED_SUM);
+              d=val.data();
+          }
+          float alpha=1.0f;
+          if (RD->m==0) alpha=1.0f/(RD->I->size/nout);  // 1/d
+          cpu_expand_axis(d, RD->I->shape, RD->axis, RD->ID->ptr, alpha, true);
+      }
 
         _profile(_CPU_REDUCTION_BACK, 1);
     }
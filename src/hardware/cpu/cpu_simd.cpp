@@ -0,0 +1,756 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// CPU: Vectorized math ********************************************
+// exp and log are the polynomial approximations of Cephes (expf, logf), which
+// are within 1-2 ulp of libm:
+//   exp(x) = 2^n * exp(r), with n = round(x / ln2) and |r| <= ln2 / 2
+//   log(x) = e * ln2 + log(m), with x = 2^e * m and sqrt(0.5) <= m < sqrt(2)
+// tanh uses the Cephes polynomial for |x| < 0.625 (where 1 - 2 / (exp(2x) + 1)
+// loses the low bits) and sigmoid is 1 / (1 + exp(-x)).
+//
+// Each instruction set has its own copy of the kernels (compiled for it with
+// the target attribute), so the library itself is built for the baseline CPU.
+
+// Elements per OpenMP chunk
+#define SIMD_CHUNK 4096
+
+#define SIMD_EXP 0
+#define SIMD_LOG 1
+#define SIMD_TANH 2
+#define SIMD_SIGMOID 3
+
+// exp
+#define EXP_HI 88.72283935546875f  // ln(FLT_MAX)
+#define EXP_LO -104.0f             // Below: 0 (under the smallest denormal)
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_C1 0.693359375f        // ln2 = C1 - C2 (C1 is exact in 9 bits)
+#define EXP_C2 -2.12194440e-4f
+#define EXP_P0 1.9875691500E-4f
+#define EXP_P1 1.3981999507E-3f
+#define EXP_P2 8.3334519073E-3f
+#define EXP_P3 4.1665795894E-2f
+#define EXP_P4 1.6666665459E-1f
+#define EXP_P5 5.0000001201E-1f
+
+// log
+#define LOG_SQRTHF 0.707106781186547524f
+#define LOG_P0 7.0376836292E-2f
+#define LOG_P1 -1.1514610310E-1f
+#define LOG_P2 1.1676998740E-1f
+#define LOG_P3 -1.2420140846E-1f
+#define LOG_P4 1.4249322787E-1f
+#define LOG_P5 -1.6668057665E-1f
+#define LOG_P6 2.0000714765E-1f
+#define LOG_P7 -2.4999993993E-1f
+#define LOG_P8 3.3333331174E-1f
+
+// tanh
+#define TANH_SMALL 0.625f
+#define TANH_P0 -5.70498872745E-3f
+#define TANH_P1 2.06390887954E-2f
+#define TANH_P2 -5.37397155531E-2f
+#define TANH_P3 1.33314422036E-1f
+#define TANH_P4 -3.33332819422E-1f
+
+
+static void map_scalar(int fn, const float *x, float *y, long int n) {
+    switch (fn) {
+        case SIMD_EXP: for (long int i = 0; i < n; i++) y[i] = ::expf(x[i]); break;
+        case SIMD_LOG: for (long int i = 0; i < n; i++) y[i] = ::logf(x[i]); break;
+        case SIMD_TANH: for (long int i = 0; i < n; i++) y[i] = ::tanhf(x[i]); break;
+        case SIMD_SIGMOID: for (long int i = 0; i < n; i++) y[i] = 1.0f/(1.0f + ::expf(-x[i])); break;
+    }
+}
+
+#ifdef CPU_SIMD_X86
+
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// SSE4.1 (4 lanes) *************************************************
+
+static inline TARGET_SSE4 __m128 exp_sse4(__m128 x) {
+    __m128 xc = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP_LO)), _mm_set1_ps(EXP_HI));
+    __m128 fx = _mm_round_ps(_mm_mul_ps(xc, _mm_set1_ps(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128 r = _mm_sub_ps(xc, _mm_mul_ps(fx, _mm_set1_ps(EXP_C1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fx, _mm_set1_ps(EXP_C2)));
+
+    __m128 z = _mm_mul_ps(r, r);
+    __m128 p = _mm_set1_ps(EXP_P0);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P1));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P2));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P3));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P4));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P5));
+    p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, z), r), _mm_set1_ps(1.0f));
+
+    // 2^n in two steps (n goes from -150 to 128)
+    __m128i n = _mm_cvtps_epi32(fx);
+    __m128i n1 = _mm_srai_epi32(n, 1);
+    __m128i n2 = _mm_sub_epi32(n, n1);
+    __m128 s1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n1, _mm_set1_epi32(127)), 23));
+    __m128 s2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n2, _mm_set1_epi32(127)), 23));
+    __m128 y = _mm_mul_ps(_mm_mul_ps(p, s1), s2);
+
+    y = _mm_blendv_ps(y, _mm_set1_ps(INFINITY), _mm_cmpgt_ps(x, _mm_set1_ps(EXP_HI)));
+    y = _mm_blendv_ps(y, _mm_setzero_ps(), _mm_cmplt_ps(x, _mm_set1_ps(EXP_LO)));
+    return _mm_blendv_ps(y, x, _mm_cmpunord_ps(x, x));
+}
+
+static inline TARGET_SSE4 __m128 log_sse4(__m128 x) {
+    // Denormals are scaled by 2^23
+    __m128 den = _mm_cmplt_ps(x, _mm_set1_ps(FLT_MIN));
+    __m128 xs = _mm_blendv_ps(x, _mm_mul_ps(x, _mm_set1_ps(8388608.0f)), den);
+    __m128i xi = _mm_castps_si128(xs);
+
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(xi, 23), _mm_set1_epi32(126)));
+    e = _mm_sub_ps(e, _mm_and_ps(den, _mm_set1_ps(23.0f)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000)));
+
+    // m in [sqrt(0.5), sqrt(2)) - 1
+    __m128 lo = _mm_cmplt_ps(m, _mm_set1_ps(LOG_SQRTHF));
+    e = _mm_sub_ps(e, _mm_and_ps(lo, _mm_set1_ps(1.0f)));
+    m = _mm_add_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_and_ps(lo, m));
+
+    __m128 z = _mm_mul_ps(m, m);
+    __m128 p = _mm_set1_ps(LOG_P0);
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P1));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P2));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P3));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P4));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P5));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P6));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P7));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(LOG_P8));
+    p = _mm_mul_ps(_mm_mul_ps(p, m), z);
+
+    p = _mm_add_ps(p, _mm_mul_ps(e, _mm_set1_ps(EXP_C2)));
+    p = _mm_sub_ps(p, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    __m128 y = _mm_add_ps(m, p);
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(EXP_C1)));
+
+    y = _mm_blendv_ps(y, _mm_set1_ps(-INFINITY), _mm_cmpeq_ps(x, _mm_setzero_ps()));
+    y = _mm_blendv_ps(y, _mm_set1_ps(NAN), _mm_cmplt_ps(x, _mm_setzero_ps()));
+    y = _mm_blendv_ps(y, x, _mm_cmpeq_ps(x, _mm_set1_ps(INFINITY)));
+    return _mm_blendv_ps(y, x, _mm_cmpunord_ps(x, x));
+}
+
+static inline TARGET_SSE4 __m128 tanh_sse4(__m128 x) {
+    __m128 sign = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+    __m128 ax = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 ps = _mm_set1_ps(TANH_P0);
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(TANH_P1));
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(TANH_P2));
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(TANH_P3));
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(TANH_P4));
+    ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+
+    __m128 e = exp_sse4(_mm_add_ps(ax, ax));
+    __m128 pl = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(e, _mm_set1_ps(1.0f))));
+    pl = _mm_or_ps(pl, sign);
+
+    return _mm_blendv_ps(pl, ps, _mm_cmplt_ps(ax, _mm_set1_ps(TANH_SMALL)));
+}
+
+static inline TARGET_SSE4 __m128 sigmoid_sse4(__m128 x) {
+    __m128 e = exp_sse4(_mm_sub_ps(_mm_setzero_ps(), x));
+    return _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(e, _mm_set1_ps(1.0f)));
+}
+
+static inline TARGET_SSE4 __m128 apply_sse4(int fn, __m128 x) {
+    switch (fn) {
+        case SIMD_EXP: return exp_sse4(x);
+        case SIMD_LOG: return log_sse4(x);
+        case SIMD_TANH: return tanh_sse4(x);
+        default: return sigmoid_sse4(x);
+    }
+}
+
+static TARGET_SSE4 void map_sse4(int fn, const float *x, float *y, long int n) {
+    long int i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, apply_sse4(fn, _mm_loadu_ps(x + i)));
+    if (i < n) {
+        float buf[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm_storeu_ps(buf, apply_sse4(fn, _mm_loadu_ps(buf)));
+        std::memcpy(y + i, buf, (n - i) * sizeof(float));
+    }
+}
+
+// AVX2 + FMA (8 lanes) *********************************************
+
+static inline TARGET_AVX2 __m256 exp_avx2(__m256 x) {
+    __m256 xc = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_LO)), _mm256_set1_ps(EXP_HI));
+    __m256 fx = _mm256_round_ps(_mm256_mul_ps(xc, _mm256_set1_ps(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_C1), xc);
+    r = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_C2), r);
+
+    __m256 z = _mm256_mul_ps(r, r);
+    __m256 p = _mm256_set1_ps(EXP_P0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P5));
+    p = _mm256_add_ps(_mm256_fmadd_ps(p, z, r), _mm256_set1_ps(1.0f));
+
+    __m256i n = _mm256_cvtps_epi32(fx);
+    __m256i n1 = _mm256_srai_epi32(n, 1);
+    __m256i n2 = _mm256_sub_epi32(n, n1);
+    __m256 s1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n1, _mm256_set1_epi32(127)), 23));
+    __m256 s2 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n2, _mm256_set1_epi32(127)), 23));
+    __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, s1), s2);
+
+    y = _mm256_blendv_ps(y, _mm256_set1_ps(INFINITY), _mm256_cmp_ps(x, _mm256_set1_ps(EXP_HI), _CMP_GT_OQ));
+    y = _mm256_blendv_ps(y, _mm256_setzero_ps(), _mm256_cmp_ps(x, _mm256_set1_ps(EXP_LO), _CMP_LT_OQ));
+    return _mm256_blendv_ps(y, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+}
+
+static inline TARGET_AVX2 __m256 log_avx2(__m256 x) {
+    __m256 den = _mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_LT_OQ);
+    __m256 xs = _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(8388608.0f)), den);
+    __m256i xi = _mm256_castps_si256(xs);
+
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(xi, 23), _mm256_set1_epi32(126)));
+    e = _mm256_sub_ps(e, _mm256_and_ps(den, _mm256_set1_ps(23.0f)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(xi, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+
+    __m256 lo = _mm256_cmp_ps(m, _mm256_set1_ps(LOG_SQRTHF), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(lo, _mm256_set1_ps(1.0f)));
+    m = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_and_ps(lo, m));
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 p = _mm256_set1_ps(LOG_P0);
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P1));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P2));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P3));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P4));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P5));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P6));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P7));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(LOG_P8));
+    p = _mm256_mul_ps(_mm256_mul_ps(p, m), z);
+
+    p = _mm256_fmadd_ps(e, _mm256_set1_ps(EXP_C2), p);
+    p = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), p);
+    __m256 y = _mm256_add_ps(m, p);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(EXP_C1), y);
+
+    y = _mm256_blendv_ps(y, _mm256_set1_ps(-INFINITY), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    y = _mm256_blendv_ps(y, _mm256_set1_ps(NAN), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    y = _mm256_blendv_ps(y, x, _mm256_cmp_ps(x, _mm256_set1_ps(INFINITY), _CMP_EQ_OQ));
+    return _mm256_blendv_ps(y, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+}
+
+static inline TARGET_AVX2 __m256 tanh_avx2(__m256 x) {
+    __m256 sign = _mm256_and_ps(x, _mm256_set1_ps(-0.0f));
+    __m256 ax = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 ps = _mm256_set1_ps(TANH_P0);
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(TANH_P1));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(TANH_P2));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(TANH_P3));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(TANH_P4));
+    ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), x, x);
+
+    __m256 e = exp_avx2(_mm256_add_ps(ax, ax));
+    __m256 pl = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(e, _mm256_set1_ps(1.0f))));
+    pl = _mm256_or_ps(pl, sign);
+
+    return _mm256_blendv_ps(pl, ps, _mm256_cmp_ps(ax, _mm256_set1_ps(TANH_SMALL), _CMP_LT_OQ));
+}
+
+static inline TARGET_AVX2 __m256 sigmoid_avx2(__m256 x) {
+    __m256 e = exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), x));
+    return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_add_ps(e, _mm256_set1_ps(1.0f)));
+}
+
+static inline TARGET_AVX2 __m256 apply_avx2(int fn, __m256 x) {
+    switch (fn) {
+        case SIMD_EXP: return exp_avx2(x);
+        case SIMD_LOG: return log_avx2(x);
+        case SIMD_TANH: return tanh_avx2(x);
+        default: return sigmoid_avx2(x);
+    }
+}
+
+static TARGET_AVX2 void map_avx2(int fn, const float *x, float *y, long int n) {
+    long int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, apply_avx2(fn, _mm256_loadu_ps(x + i)));
+    if (i < n) {
+        float buf[8] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(buf, apply_avx2(fn, _mm256_loadu_ps(buf)));
+        std::memcpy(y + i, buf, (n - i) * sizeof(float));
+    }
+}
+
+// AVX-512F (16 lanes) **********************************************
+
+static inline TARGET_AVX512 __m512 exp_avx512(__m512 x) {
+    __m512 xc = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(EXP_LO)), _mm512_set1_ps(EXP_HI));
+    __m512 fx = _mm512_roundscale_ps(_mm512_mul_ps(xc, _mm512_set1_ps(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_C1), xc);
+    r = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_C2), r);
+
+    __m512 z = _mm512_mul_ps(r, r);
+    __m512 p = _mm512_set1_ps(EXP_P0);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P5));
+    p = _mm512_add_ps(_mm512_fmadd_ps(p, z, r), _mm512_set1_ps(1.0f));
+
+    __m512i n = _mm512_cvtps_epi32(fx);
+    __m512i n1 = _mm512_srai_epi32(n, 1);
+    __m512i n2 = _mm512_sub_epi32(n, n1);
+    __m512 s1 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n1, _mm512_set1_epi32(127)), 23));
+    __m512 s2 = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n2, _mm512_set1_epi32(127)), 23));
+    __m512 y = _mm512_mul_ps(_mm512_mul_ps(p, s1), s2);
+
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_HI), _CMP_GT_OQ), y, _mm512_set1_ps(INFINITY));
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_LO), _CMP_LT_OQ), y, _mm512_setzero_ps());
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), y, x);
+}
+
+static inline TARGET_AVX512 __m512 log_avx512(__m512 x) {
+    __mmask16 den = _mm512_cmp_ps_mask(x, _mm512_set1_ps(FLT_MIN), _CMP_LT_OQ);
+    __m512 xs = _mm512_mask_mul_ps(x, den, x, _mm512_set1_ps(8388608.0f));
+    __m512i xi = _mm512_castps_si512(xs);
+
+    __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(xi, 23), _mm512_set1_epi32(126)));
+    e = _mm512_mask_sub_ps(e, den, e, _mm512_set1_ps(23.0f));
+    __m512 m = _mm512_castsi512_ps(_mm512_or_epi32(_mm512_and_epi32(xi, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)));
+
+    __mmask16 lo = _mm512_cmp_ps_mask(m, _mm512_set1_ps(LOG_SQRTHF), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps(e, lo, e, _mm512_set1_ps(1.0f));
+    m = _mm512_mask_add_ps(_mm512_sub_ps(m, _mm512_set1_ps(1.0f)), lo, _mm512_sub_ps(m, _mm512_set1_ps(1.0f)), m);
+
+    __m512 z = _mm512_mul_ps(m, m);
+    __m512 p = _mm512_set1_ps(LOG_P0);
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P1));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P2));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P3));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P4));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P5));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P6));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P7));
+    p = _mm512_fmadd_ps(p, m, _mm512_set1_ps(LOG_P8));
+    p = _mm512_mul_ps(_mm512_mul_ps(p, m), z);
+
+    p = _mm512_fmadd_ps(e, _mm512_set1_ps(EXP_C2), p);
+    p = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), p);
+    __m512 y = _mm512_add_ps(m, p);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(EXP_C1), y);
+
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_EQ_OQ), y, _mm512_set1_ps(-INFINITY));
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ), y, _mm512_set1_ps(NAN));
+    y = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(INFINITY), _CMP_EQ_OQ), y, x);
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), y, x);
+}
+
+static inline TARGET_AVX512 __m512 tanh_avx512(__m512 x) {
+    __m512i xi = _mm512_castps_si512(x);
+    __m512i sign = _mm512_and_epi32(xi, _mm512_set1_epi32(0x80000000));
+    __m512 ax = _mm512_castsi512_ps(_mm512_and_epi32(xi, _mm512_set1_epi32(0x7fffffff)));
+
+    __m512 z = _mm512_mul_ps(x, x);
+    __m512 ps = _mm512_set1_ps(TANH_P0);
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(TANH_P1));
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(TANH_P2));
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(TANH_P3));
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(TANH_P4));
+    ps = _mm512_fmadd_ps(_mm512_mul_ps(ps, z), x, x);
+
+    __m512 e = exp_avx512(_mm512_add_ps(ax, ax));
+    __m512 pl = _mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_div_ps(_mm512_set1_ps(2.0f), _mm512_add_ps(e, _mm512_set1_ps(1.0f))));
+    pl = _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(pl), sign));
+
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(ax, _mm512_set1_ps(TANH_SMALL), _CMP_LT_OQ), pl, ps);
+}
+
+static inline TARGET_AVX512 __m512 sigmoid_avx512(__m512 x) {
+    __m512 e = exp_avx512(_mm512_sub_ps(_mm512_setzero_ps(), x));
+    return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_add_ps(e, _mm512_set1_ps(1.0f)));
+}
+
+static inline TARGET_AVX512 __m512 apply_avx512(int fn, __m512 x) {
+    switch (fn) {
+        case SIMD_EXP: return exp_avx512(x);
+        case SIMD_LOG: return log_avx512(x);
+        case SIMD_TANH: return tanh_avx512(x);
+        default: return sigmoid_avx512(x);
+    }
+}
+
+static TARGET_AVX512 void map_avx512(int fn, const float *x, float *y, long int n) {
+    long int i = 0;
+    for (; i + 16 <= n; i += 16) _mm512_storeu_ps(y + i, apply_avx512(fn, _mm512_loadu_ps(x + i)));
+    if (i < n) {
+        __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+        __m512 v = _mm512_mask_loadu_ps(_mm512_set1_ps(1.0f), tail, x + i);
+        _mm512_mask_storeu_ps(y + i, tail, apply_avx512(fn, v));
+    }
+}
+
+#endif  // CPU_SIMD_X86
+
+
+int cpu_simd_supported() {
+#ifdef CPU_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return CPU_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CPU_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return CPU_SIMD_SSE4;
+#endif
+    return CPU_SIMD_NONE;
+}
+
+// Chosen at startup
+static int simd_level = cpu_simd_supported();
+
+int cpu_simd_level() {
+    return simd_level;
+}
+
+int cpu_simd_set_level(int level) {
+    simd_level = std::max(CPU_SIMD_NONE, std::min(level, cpu_simd_supported()));
+    return simd_level;
+}
+
+string cpu_simd_name(int level) {
+    switch (level) {
+        case CPU_SIMD_SSE4: return "sse4.1";
+        case CPU_SIMD_AVX2: return "avx2";
+        case CPU_SIMD_AVX512: return "avx512";
+        default: return "none";
+    }
+}
+
+static void simd_map(int fn, const float *x, float *y, long int n) {
+    int level = simd_level;
+
+    // Inline when called from a worker of the pool (i.e. a softmax per row)
+    long int chunks = (n + SIMD_CHUNK - 1) / SIMD_CHUNK;
+    cpu_parallel_for(0, chunks, 1, [&](long int ini, long int end) {
+        long int c = ini * SIMD_CHUNK;
+        long int len = std::min(end * SIMD_CHUNK, n) - c;
+        switch (level) {
+#ifdef CPU_SIMD_X86
+            case CPU_SIMD_AVX512: map_avx512(fn, x + c, y + c, len); break;
+            case CPU_SIMD_AVX2: map_avx2(fn, x + c, y + c, len); break;
+            case CPU_SIMD_SSE4: map_sse4(fn, x + c, y + c, len); break;
+#endif
+            default: map_scalar(fn, x + c, y + c, len);
+        }
+    });
+}
+
+void cpu_vexp(const float *x, float *y, long int n) { simd_map(SIMD_EXP, x, y, n); }
+
+void cpu_vlog(const float *x, float *y, long int n) { simd_map(SIMD_LOG, x, y, n); }
+
+void cpu_vtanh(const float *x, float *y, long int n) { simd_map(SIMD_TANH, x, y, n); }
+
+void cpu_vsigmoid(const float *x, float *y, long int n) { simd_map(SIMD_SIGMOID, x, y, n); }
+
+
+// CPU: Tile transpose **********************************************
+// B[c * ldb + r] = A[r * lda + c], by blocks of 8x8 (AVX2) or 4x4 (SSE)
+// transposed in registers. AVX-512 machines use the AVX2 blocks (a 16x16
+// block does not fit in the tiles of the permutations of small dims).
+
+static void transpose_scalar(const float *A, long int lda, float *B, long int ldb, int rows, int cols, bool inc) {
+    for (int c = 0; c < cols; c++) {
+        const float *pa = A + c;
+        float *pb = B + c * ldb;
+        if (inc) for (int r = 0; r < rows; r++) pb[r] += pa[r * lda];
+        else for (int r = 0; r < rows; r++) pb[r] = pa[r * lda];
+    }
+}
+
+#ifdef CPU_SIMD_X86
+
+static inline TARGET_SSE4 void block_sse4(const float *A, long int lda, float *B, long int ldb, bool inc) {
+    __m128 r0 = _mm_loadu_ps(A);
+    __m128 r1 = _mm_loadu_ps(A + lda);
+    __m128 r2 = _mm_loadu_ps(A + 2 * lda);
+    __m128 r3 = _mm_loadu_ps(A + 3 * lda);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    if (inc) {
+        r0 = _mm_add_ps(r0, _mm_loadu_ps(B));
+        r1 = _mm_add_ps(r1, _mm_loadu_ps(B + ldb));
+        r2 = _mm_add_ps(r2, _mm_loadu_ps(B + 2 * ldb));
+        r3 = _mm_add_ps(r3, _mm_loadu_ps(B + 3 * ldb));
+    }
+    _mm_storeu_ps(B, r0);
+    _mm_storeu_ps(B + ldb, r1);
+    _mm_storeu_ps(B + 2 * ldb, r2);
+    _mm_storeu_ps(B + 3 * ldb, r3);
+}
+
+static TARGET_SSE4 void transpose_sse4(const float *A, long int lda, float *B, long int ldb, int rows, int cols, bool inc) {
+    int r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        int c = 0;
+        for (; c + 4 <= cols; c += 4) block_sse4(A + r * lda + c, lda, B + c * ldb + r, ldb, inc);
+        transpose_scalar(A + r * lda + c, lda, B + c * ldb + r, ldb, 4, cols - c, inc);
+    }
+    transpose_scalar(A + r * lda, lda, B + r, ldb, rows - r, cols, inc);
+}
+
+static inline TARGET_AVX2 void block_avx2(const float *A, long int lda, float *B, long int ldb, bool inc) {
+    __m256 r[8], t[8];
+    for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_ps(A + i * lda);
+
+    // Pairs of rows, then groups of 4 (inside each 128-bit lane), then the lanes
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 4; i++) {
+        t[i] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x20);
+        t[i + 4] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x31);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if (inc) t[i] = _mm256_add_ps(t[i], _mm256_loadu_ps(B + i * ldb));
+        _mm256_storeu_ps(B + i * ldb, t[i]);
+    }
+}
+
+static TARGET_AVX2 void transpose_avx2(const float *A, long int lda, float *B, long int ldb, int rows, int cols, bool inc) {
+    int r = 0;
+    for (; r + 8 <= rows; r += 8) {
+        int c = 0;
+        for (; c + 8 <= cols; c += 8) block_avx2(A + r * lda + c, lda, B + c * ldb + r, ldb, inc);
+        transpose_scalar(A + r * lda + c, lda, B + c * ldb + r, ldb, 8, cols - c, inc);
+    }
+    transpose_sse4(A + r * lda, lda, B + r, ldb, rows - r, cols, inc);
+}
+
+#endif  // CPU_SIMD_X86
+
+void cpu_vtranspose(const float *A, long int lda, float *B, long int ldb, int rows, int cols, bool inc) {
+    switch (simd_level) {
+#ifdef CPU_SIMD_X86
+        case CPU_SIMD_AVX512:
+        case CPU_SIMD_AVX2: transpose_avx2(A, lda, B, ldb, rows, cols, inc); break;
+        case CPU_SIMD_SSE4: transpose_sse4(A, lda, B, ldb, rows, cols, inc); break;
+#endif
+        default: transpose_scalar(A, lda, B, ldb, rows, cols, inc);
+    }
+}
+
+
+// CPU: float16 conversions ****************************************
+// F16C is not part of the levels, but every CPU with AVX2 has it. Both round
+// to nearest even like the scalar converters of cpu_core.cpp (only the payload
+// of the nans may differ)
+
+#ifdef CPU_SIMD_X86
+
+#define TARGET_F16C __attribute__((target("avx2,f16c")))
+
+static TARGET_F16C long int half2float_f16c(const uint16_t *src, float *dst, long int n) {
+    long int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    return i;
+}
+
+static TARGET_F16C long int float2half_f16c(const float *src, uint16_t *dst, long int n) {
+    long int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), h);
+    }
+    return i;
+}
+
+#endif  // CPU_SIMD_X86
+
+long int cpu_vhalf2float(const uint16_t *src, float *dst, long int n) {
+#ifdef CPU_SIMD_X86
+    if (simd_level >= CPU_SIMD_AVX2) return half2float_f16c(src, dst, n);
+#endif
+    return 0;
+}
+
+long int cpu_vfloat2half(const float *src, uint16_t *dst, long int n) {
+#ifdef CPU_SIMD_X86
+    if (simd_level >= CPU_SIMD_AVX2) return float2half_f16c(src, dst, n);
+#endif
+    return 0;
+}
+
+
+// CPU: int8 products **********************************************
+// The values are in [-127, 127] (see cpu_quantize_int8): maddubs multiplies
+// |a| (as unsigned) by b with the sign of a, and each pair of products (at
+// most 2 * 127 * 127) fits in int16. Blocks of 2 rows of A x 4 rows of B
+// keep their 8 sums in registers while they walk k
+
+static void gemm_int8_scalar(const int8_t *A, long int lda, const int8_t *B, long int ldb, int32_t *C, long int ldc, int m, int n, int k) {
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < n; j++) {
+            const int8_t *a = A + i * lda, *b = B + j * ldb;
+            int32_t acc = 0;
+            for (int p = 0; p < k; p++) acc += (int32_t)a[p] * b[p];
+            C[i * ldc + j] = acc;
+        }
+}
+
+#ifdef CPU_SIMD_X86
+
+static inline TARGET_AVX2 int32_t hsum_avx2(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static TARGET_AVX2 void gemm_int8_avx2(const int8_t *A, long int lda, const int8_t *B, long int ldb, int32_t *C, long int ldc, int m, int n, int k) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    int kv = k & ~31;
+
+    for (int j = 0; j < n; j += 4) {
+        int nr = std::min(4, n - j);
+        // The last block repeats its last row (the sums are not stored)
+        const int8_t *b[4];
+        for (int y = 0; y < 4; y++) b[y] = B + (j + std::min(y, nr - 1)) * ldb;
+
+        for (int i = 0; i < m; i += 2) {
+            int mr = std::min(2, m - i);
+            const int8_t *a[2] = {A + i * lda, A + (i + mr - 1) * lda};
+            __m256i acc[2][4];
+            for (int x = 0; x < 2; x++)
+                for (int y = 0; y < 4; y++) acc[x][y] = _mm256_setzero_si256();
+
+            for (int p = 0; p < kv; p += 32) {
+                __m256i vb[4];
+                for (int y = 0; y < 4; y++) vb[y] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b[y] + p));
+                for (int x = 0; x < 2; x++) {
+                    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a[x] + p));
+                    __m256i ua = _mm256_abs_epi8(va);
+                    for (int y = 0; y < 4; y++) {
+                        __m256i prod = _mm256_maddubs_epi16(ua, _mm256_sign_epi8(vb[y], va));
+                        acc[x][y] = _mm256_add_epi32(acc[x][y], _mm256_madd_epi16(prod, ones));
+                    }
+                }
+            }
+
+            for (int x = 0; x < mr; x++)
+                for (int y = 0; y < nr; y++) {
+                    int32_t sum = hsum_avx2(acc[x][y]);
+                    for (int p = kv; p < k; p++) sum += (int32_t)a[x][p] * b[y][p];
+                    C[(i + x) * ldc + j + y] = sum;
+                }
+        }
+    }
+}
+
+#define TARGET_VNNI __attribute__((target("avx512f,avx512bw,avx512vnni")))
+
+// dpbusd multiplies unsigned by signed bytes (4 products into each int32 sum):
+// a + 128 as unsigned, minus 128 * the sum of the row of B
+static TARGET_VNNI void gemm_int8_vnni(const int8_t *A, long int lda, const int8_t *B, long int ldb, int32_t *C, long int ldc, int m, int n, int k) {
+    const __m512i offset = _mm512_set1_epi8((char)0x80);
+    const __m512i ones = _mm512_set1_epi8(1);
+    int kv = k & ~63;
+
+    for (int j = 0; j < n; j += 4) {
+        int nr = std::min(4, n - j);
+        const int8_t *b[4];
+        int32_t bsum[4];
+        for (int y = 0; y < 4; y++) {
+            b[y] = B + (j + std::min(y, nr - 1)) * ldb;
+            __m512i s = _mm512_setzero_si512();
+            for (int p = 0; p < kv; p += 64) s = _mm512_dpbusd_epi32(s, ones, _mm512_loadu_si512(b[y] + p));
+            bsum[y] = _mm512_reduce_add_epi32(s);
+        }
+
+        for (int i = 0; i < m; i += 2) {
+            int mr = std::min(2, m - i);
+            const int8_t *a[2] = {A + i * lda, A + (i + mr - 1) * lda};
+            __m512i acc[2][4];
+            for (int x = 0; x < 2; x++)
+                for (int y = 0; y < 4; y++) acc[x][y] = _mm512_setzero_si512();
+
+            for (int p = 0; p < kv; p += 64) {
+                __m512i vb[4];
+                for (int y = 0; y < 4; y++) vb[y] = _mm512_loadu_si512(b[y] + p);
+                for (int x = 0; x < 2; x++) {
+                    __m512i ua = _mm512_xor_si512(_mm512_loadu_si512(a[x] + p), offset);
+                    for (int y = 0; y < 4; y++) acc[x][y] = _mm512_dpbusd_epi32(acc[x][y], ua, vb[y]);
+                }
+            }
+
+            for (int x = 0; x < mr; x++)
+                for (int y = 0; y < nr; y++) {
+                    int32_t sum = _mm512_reduce_add_epi32(acc[x][y]) - 128 * bsum[y];
+                    for (int p = kv; p < k; p++) sum += (int32_t)a[x][p] * b[y][p];
+                    C[(i + x) * ldc + j + y] = sum;
+                }
+        }
+    }
+}
+
+#endif  // CPU_SIMD_X86
+
+// Not one of the levels: AVX-512 with the VNNI and BW extensions
+static bool cpu_vnni_supported() {
+#ifdef CPU_SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw");
+#else
+    return false;
+#endif
+}
+
+static bool vnni = cpu_vnni_supported();
+
+void cpu_vgemm_int8(const int8_t *A, long int lda, const int8_t *B, long int ldb, int32_t *C, long int ldc, int m, int n, int k) {
+    switch (simd_level) {
+#ifdef CPU_SIMD_X86
+        case CPU_SIMD_AVX512:
+            if (vnni) { gemm_int8_vnni(A, lda, B, ldb, C, ldc, m, n, k); break; }
+            // Without VNNI, the AVX2 kernel
+        case CPU_SIMD_AVX2: gemm_int8_avx2(A, lda, B, ldb, C, ldc, m, n, k); break;
+#endif
+        default: gemm_int8_scalar(A, lda, B, ldb, C, ldc, m, n, k);
+    }
+}
@@ -0,0 +1,247 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
+#include <algorithm>
+#include "Eigen/Dense"
+
+// Yields of an idle thread before sleeping (the loops of a forward come in bursts)
+#define CPU_POOL_SPIN 1000
+
+// The thread is running a range of a loop (or a loop): inner loops are sequential
+static thread_local bool in_pool = false;
+
+
+CPUPool::CPUPool(int threads, const vector<int> &cpus, const vector<int> &groups) :
+        nthreads(std::max(1, threads)), cpus(cpus), groups(groups), job(nullptr), pending(0), generation(0), stop(false) {
+    for (int i = 0; i < nthreads; i++) queues.emplace_back(new Queue());
+    for (int i = 1; i < nthreads; i++) workers.emplace_back(&CPUPool::worker, this, i);
+}
+
+CPUPool::~CPUPool() {
+    {
+        lock_guard<mutex> lk(m);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers) t.join();
+}
+
+bool CPUPool::pop(int q, Range &r) {
+    Queue &Q = *queues[q];
+    lock_guard<mutex> lk(Q.m);
+    if (Q.ranges.empty()) return false;
+    r = Q.ranges.front();  // In order: the ranges of a thread are contiguous
+    Q.ranges.pop_front();
+    return true;
+}
+
+bool CPUPool::steal(int q, Range &r) {
+    // Same group first (its data is in the same node)
+    for (int local = 1; local >= 0; local--) {
+        for (int k = 1; k < nthreads; k++) {
+            int v = (q + k) % nthreads;
+            if ((group(v) == group(q)) != (bool)local) continue;
+            Queue &Q = *queues[v];
+            lock_guard<mutex> lk(Q.m);
+            if (!Q.ranges.empty()) {
+                r = Q.ranges.back();  // The end, far from the owner
+                Q.ranges.pop_back();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CPUPool::work(int q) {
+    Range r;
+    while (pop(q, r) || steal(q, r)) {
+        try {
+            (*job)(r.begin, r.end);
+        } catch (...) {
+            lock_guard<mutex> lk(error_m);
+            if (!error) error = current_exception();
+        }
+        pending.fetch_sub(1, memory_order_acq_rel);
+    }
+}
+
+void CPUPool::worker(int q) {
+    in_pool = true;
+    if (!cpus.empty()) cpu_pin_thread(cpus[q]);
+    unsigned long int seen = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> lk(m);
+            for (int s = 0; (s < CPU_POOL_SPIN) && !stop && (generation == seen); s++) {
+                lk.unlock();
+                this_thread::yield();
+                lk.lock();
+            }
+            cv.wait(lk, [&] { return stop || (generation != seen); });
+            if (stop) return;
+            seen = generation;
+        }
+        work(q);
+    }
+}
+
+long int CPUPool::ranges(long int n, long int grain) {
+    return std::min((n + grain - 1) / grain, (long int)nthreads * CPU_POOL_SPLIT);
+}
+
+void CPUPool::parallel_for(long int begin, long int end, long int grain, const Body &f) {
+    long int n = end - begin;
+    if (n <= 0) return;
+    if (grain < 1) grain = 1;
+
+    if ((nthreads == 1) || (n <= grain) || in_pool || !busy.try_lock()) {
+        f(begin, end);
+        return;
+    }
+
+    // Contiguous blocks of ranges for each thread
+    long int nranges = ranges(n, grain);
+    job = &f;
+    error = nullptr;
+    pending.store(nranges);
+    for (long int i = 0; i < nranges; i++) {
+        Queue &Q = *queues[owner(i, nranges)];
+        lock_guard<mutex> lk(Q.m);
+        Q.ranges.push_back({begin + n * i / nranges, begin + n * (i + 1) / nranges});
+    }
+    {
+        lock_guard<mutex> lk(m);
+        generation++;
+    }
+    cv.notify_all();
+
+    in_pool = true;
+    work(0);
+    while (pending.load(memory_order_acquire) > 0) this_thread::yield();
+    in_pool = false;
+
+    exception_ptr e = error;
+    error = nullptr;
+    busy.unlock();
+    if (e) rethrow_exception(e);
+}
+
+
+// The kernels read the pool without locking, pool_m only serializes its creation
+// and replacement. A replaced pool is freed by the last thread that was using
+// it (i.e. a DataLoader or staging thread in the middle of a loop)
+static mutex pool_m;
+static shared_ptr<CPUPool> pool;
+static bool pool_pin = false, pool_numa = false;
+static std::atomic<unsigned long int> pool_layout(0);
+
+shared_ptr<CPUPool> cpu_pool() {
+    shared_ptr<CPUPool> p = std::atomic_load(&pool);
+    if (p != nullptr) return p;
+
+    lock_guard<mutex> lk(pool_m);
+    p = std::atomic_load(&pool);
+    if (p == nullptr) {
+        p = make_shared<CPUPool>((int)thread::hardware_concurrency());
+        std::atomic_store(&pool, p);
+    }
+    return p;
+}
+
+void cpu_pool_set_threads(int threads, bool pin, bool numa) {
+    lock_guard<mutex> lk(pool_m);
+    threads = std::max(1, threads);
+    shared_ptr<CPUPool> old = std::atomic_load(&pool);
+    if ((old != nullptr) && (old->size() == threads) && (pool_pin == pin) && (pool_numa == numa)) return;
+
+    // A block of consecutive threads in each node (all the cores in one group without numa)
+    vector<vector<int>> nodes = cpu_numa_topology();
+    if (!numa) {
+        for (int i = 1; i < nodes.size(); i++) nodes[0].insert(nodes[0].end(), nodes[i].begin(), nodes[i].end());
+        nodes.resize(1);
+    }
+    vector<int> cpus, groups;
+    for (int t = 0; t < threads; t++) {
+        int g = (int)((long int)t * nodes.size() / threads);
+        int first = (int)((g * (long int)threads + nodes.size() - 1) / nodes.size());  // First thread of the group
+        groups.push_back(g);
+        cpus.push_back(nodes[g][(t - first) % nodes[g].size()]);
+    }
+    if (!pin) cpus.clear();
+    cpu_omp_set_threads(threads, cpus);
+
+    std::atomic_store(&pool, make_shared<CPUPool>(threads, cpus, groups));
+    pool_layout++;
+    pool_pin = pin;
+    pool_numa = numa;
+}
+
+unsigned long int cpu_pool_layout() {
+    return pool_layout;
+}
+
+int cpu_pool_threads() {
+    return cpu_pool()->size();
+}
+
+static std::atomic<bool> deterministic(false);
+
+void cpu_set_deterministic(bool enable) {
+    deterministic = enable;
+}
+
+bool cpu_deterministic() {
+    return deterministic;
+}
+
+void cpu_parallel_for(long int begin, long int end, long int grain, const CPUPool::Body &f) {
+    // Small loops and loops inside a loop do not even look at the pool
+    if ((end - begin <= grain) || in_pool) {
+        if (end > begin) f(begin, end);
+        return;
+    }
+    cpu_pool()->parallel_for(begin, end, grain, f);
+}
+
+// Loops of cpu_parallel_gemm_for that are running (from any thread) and the
+// threads of Eigen before the first one
+static mutex gemm_m;
+static int gemm_loops = 0, gemm_threads = 1;
+
+void cpu_parallel_gemm_for(long int begin, long int end, long int grain, const CPUPool::Body &f) {
+    // Not split: the GEMMs keep their threads
+    if ((end - begin <= grain) || in_pool || (cpu_pool_threads() == 1)) {
+        if (end > begin) f(begin, end);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lk(gemm_m);
+        if (gemm_loops++ == 0) {
+            gemm_threads = Eigen::nbThreads();
+            Eigen::setNbThreads(1);
+        }
+    }
+    exception_ptr e;
+    try {
+        cpu_pool()->parallel_for(begin, end, grain, f);
+    } catch (...) {
+        e = current_exception();
+    }
+    {
+        lock_guard<mutex> lk(gemm_m);
+        if (--gemm_loops == 0) Eigen::setNbThreads(gemm_threads);
+    }
+    if (e) rethrow_exception(e);
+}
@@ -13,139 +13,155 @@
 #include <iostream>
 
 #include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 void cpu_relu(Tensor *A, Tensor *B){
     _profile(_CPU_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
-        else B->ptr[i] = 0.0;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
+            else B->ptr[i] = 0.0;
+        }
+    });
     _profile(_CPU_RELU, 1);
 }
 
 void cpu_d_relu(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
-        else PD->ptr[i] += 0.0;
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
+            else PD->ptr[i] += 0.0;
+        }
+    });
     _profile(_CPU_D_RELU, 1);
 }
 
 void cpu_thresholded_relu(Tensor *A, Tensor *B,float param){
     _profile(_CPU_THRESHOLDED_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        if (A->ptr[i] > param) B->ptr[i] = A->ptr[i];
-        else B->ptr[i] = 0.0;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] > param) B->ptr[i] = A->ptr[i];
+            else B->ptr[i] = 0.0;
+        }
+    });
     _profile(_CPU_THRESHOLDED_RELU, 1);
 }
 
 void cpu_d_thresholded_relu(Tensor *D, Tensor *I, Tensor *PD,float param){
     _profile(_CPU_D_THRESHOLDED_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        if (I->ptr[i] > param) PD->ptr[i] += D->ptr[i];
-        else PD->ptr[i] += 0.0;
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (I->ptr[i] > param) PD->ptr[i] += D->ptr[i];
+            else PD->ptr[i] += 0.0;
+        }
+    });
     _profile(_CPU_D_THRESHOLDED_RELU, 1);
 }
 
 void cpu_leaky_relu(Tensor *A, Tensor *B,float param){
     _profile(_CPU_LEAKY_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
-        else B->ptr[i] = param*A->ptr[i];;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
+            else B->ptr[i] = param*A->ptr[i];;
+        }
+    });
     _profile(_CPU_LEAKY_RELU, 1);
 }
 
 void cpu_d_leaky_relu(Tensor *D, Tensor *I, Tensor *PD,float param){
     _profile(_CPU_D_LEAKY_RELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
-        else PD->ptr[i] += param*D->ptr[i];
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
+            else PD->ptr[i] += param*D->ptr[i];
+        }
+    });
     _profile(_CPU_D_LEAKY_RELU, 1);
 }
 
 void cpu_elu(Tensor *A, Tensor *B, float param){
     _profile(_CPU_ELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
-        else B->ptr[i] = param * (::expf(A->ptr[i]) - 1.0);
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] > 0.0) B->ptr[i] = A->ptr[i];
+            else B->ptr[i] = param * (::expf(A->ptr[i]) - 1.0);
+        }
+    });
     _profile(_CPU_ELU, 1);
 }
 
 void cpu_d_elu(Tensor *D, Tensor *I, Tensor *PD, float param){
     _profile(_CPU_D_ELU, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
-        else PD->ptr[i] += D->ptr[i] * (param * ::expf(I->ptr[i]));
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (I->ptr[i] > 0.0) PD->ptr[i] += D->ptr[i];
+            else PD->ptr[i] += D->ptr[i] * (param * ::expf(I->ptr[i]));
+        }
+    });
     _profile(_CPU_D_ELU, 1);
 }
 
 void cpu_softplus(Tensor *A, Tensor *B){
     _profile(_CPU_SOFTPLUS, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        B->ptr[i] = ::logf(1 + ::expf(A->ptr[i]));
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = ::logf(1 + ::expf(A->ptr[i]));
+        }
+    });
     _profile(_CPU_SOFTPLUS, 1);
 }
 
 void cpu_d_softplus(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_SOFTPLUS, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        PD->ptr[i] += D->ptr[i] * 1/(1 + ::expf(-I->ptr[i]));
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            PD->ptr[i] += D->ptr[i] * 1/(1 + ::expf(-I->ptr[i]));
+        }
+    });
     _profile(_CPU_D_SOFTPLUS, 1);
 }
 
 void cpu_softsign(Tensor *A, Tensor *B){
     _profile(_CPU_SOFTSIGN, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        B->ptr[i] = A->ptr[i] / (1 + ::fabs(A->ptr[i]));
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = A->ptr[i] / (1 + ::fabs(A->ptr[i]));
+        }
+    });
     _profile(_CPU_SOFTSIGN, 1);
 }
 
 void cpu_d_softsign(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_SOFTSIGN, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        float denom = 1 + ::fabs(I->ptr[i]);
-        PD->ptr[i] += D->ptr[i] * 1/(denom*denom);
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            float denom = 1 + ::fabs(I->ptr[i]);
+            PD->ptr[i] += D->ptr[i] * 1/(denom*denom);
+        }
+    });
     _profile(_CPU_D_SOFTSIGN, 1);
 }
 
 void cpu_linear(Tensor *A, Tensor *B, float param){
     _profile(_CPU_LINEAR, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        B->ptr[i] = param * A->ptr[i];
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            B->ptr[i] = param * A->ptr[i];
+        }
+    });
     _profile(_CPU_LINEAR, 1);
 }
 
 void cpu_d_linear(Tensor *D, Tensor *I, Tensor *PD, float param){
     _profile(_CPU_D_LINEAR, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++) {
-        PD->ptr[i] += D->ptr[i] * param;
-    }
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            PD->ptr[i] += D->ptr[i] * param;
+        }
+    });
     _profile(_CPU_D_LINEAR, 1);
 }
 
@@ -159,29 +175,30 @@ void cpu_d_linear(Tensor *D, Tensor *I, Tensor *PD, float param){
 
 void cpu_d_sigmoid(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_SIGMOID, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++)
-        PD->ptr[i] += D->ptr[i]*((1-I->ptr[i])*I->ptr[i]);
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) PD->ptr[i] += D->ptr[i]*((1-I->ptr[i])*I->ptr[i]);
+    });
     _profile(_CPU_D_SIGMOID, 1);
 }
 
 void cpu_hard_sigmoid(Tensor *A, Tensor *B){
     _profile(_CPU_HARD_SIGMOID, 0);
-#pragma omp parallel for
-    for (int i = 0; i < A->size; i++) {
-        if (A->ptr[i] > 2.5) B->ptr[i] = 1.0;
-        else if (A->ptr[i] < -2.5) B->ptr[i] = 0.0;
-        else B->ptr[i] = (0.2 * A->ptr[i]) + 0.5;
-    }
+    cpu_parallel_for(0, A->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            if (A->ptr[i] > 2.5) B->ptr[i] = 1.0;
+            else if (A->ptr[i] < -2.5) B->ptr[i] = 0.0;
+            else B->ptr[i] = (0.2 * A->ptr[i]) + 0.5;
+        }
+    });
     _profile(_CPU_HARD_SIGMOID, 1);
 }
 
 void cpu_d_hard_sigmoid(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_HARD_SIGMOID, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++)
-        if (I->ptr[i] < -2.5 || I->ptr[i] > 2.5) PD->ptr[i] += 0;
-        else PD->ptr[i] += D->ptr[i] * 0.2;
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) if (I->ptr[i] < -2.5 || I->ptr[i] > 2.5) PD->ptr[i] += 0;
+            else PD->ptr[i] += D->ptr[i] * 0.2;
+    });
     _profile(_CPU_D_HARD_SIGMOID, 1);
 }
 
@@ -196,9 +213,9 @@ void cpu_d_hard_sigmoid(Tensor *D, Tensor *I, Tensor *PD){
 
 void cpu_d_exp(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_EXP, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++)
-        PD->ptr[i] += D->ptr[i] * I->ptr[i];
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) PD->ptr[i] += D->ptr[i] * I->ptr[i];
+    });
     _profile(_CPU_D_EXP, 1);
 }
 
@@ -215,9 +232,9 @@ void cpu_d_exp(Tensor *D, Tensor *I, Tensor *PD){
 
 void cpu_d_tanh(Tensor *D, Tensor *I, Tensor *PD){
     _profile(_CPU_D_TANH, 0);
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++)
-        PD->ptr[i] += D->ptr[i]*(1-(I->ptr[i]*I->ptr[i]));
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) PD->ptr[i] += D->ptr[i]*(1-(I->ptr[i]*I->ptr[i]));
+    });
     _profile(_CPU_D_TANH, 1);
 }
 
@@ -243,9 +260,9 @@ void cpu_d_softmax(Tensor *D, Tensor *I, Tensor *PD) {
     _profile(_CPU_D_SOFTMAX, 0);
 
 
-#pragma omp parallel for
-    for (int i = 0; i < D->size; i++)
-        PD->ptr[i] += D->ptr[i] * (I->ptr[i] * (1.0 - I->ptr[i]));
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) PD->ptr[i] += D->ptr[i] * (I->ptr[i] * (1.0 - I->ptr[i]));
+    });
 
 
     _profile(_CPU_D_SOFTMAX, 1);
@@ -266,34 +283,35 @@ void cpu_full_softmax_batched_2d(Tensor *A, Tensor *B, bool stable){
     int n_batches = A->shape[0];
     int n_features = A->shape[1];
 
-    #pragma omp parallel for
-    for(int bi=0; bi<n_batches; bi++){
-        // Contiguous data
-        int start = bi*n_features;
-        int end = start+n_features;  // x < end or x <= end-1
+    cpu_parallel_for(0, n_batches, cpu_grain(n_features), [&](long int first, long int last) {
+        for (long int bi = first; bi < last; ++bi) {
+            // Contiguous data
+            int start = bi*n_features;
+            int end = start+n_features;  // x < end or x <= end-1
 
-        // Numerical stability (opt.)
-        // stable => first value, no stable => 0.0f
-        float max_value = CPU_LOWEST_FLOAT;
-        if(stable){
-            for(int j=start; j<end; j++){
-                if (A->ptr[j] > max_value) { max_value = A->ptr[j]; }
+            // Numerical stability (opt.)
+            // stable => first value, no stable => 0.0f
+            float max_value = CPU_LOWEST_FLOAT;
+            if(stable){
+                for(int j=start; j<end; j++){
+                    if (A->ptr[j] > max_value) { max_value = A->ptr[j]; }
+                }
             }
-        }
 
-        // Numerator
-        float denominator = CPU_EPS_FLOAT;
-        for(int j=start; j<end; j++){
-            float value = ::expf(A->ptr[j] - max_value);
-            B->ptr[j] = value;
-            denominator += value;
-        }
+            // Numerator
+            float denominator = CPU_EPS_FLOAT;
+            for(int j=start; j<end; j++){
+                float value = ::expf(A->ptr[j] - max_value);
+                B->ptr[j] = value;
+                denominator += value;
+            }
 
-        // Softmax
-        for(int j=start; j<end; j++){
-            B->ptr[j] /= denominator;
+            // Softmax
+            for(int j=start; j<end; j++){
+                B->ptr[j] /= denominator;
+            }
         }
-    }
+    });
 }
 
 
@@ -305,39 +323,46 @@ void cpu_full_softmax_nd(Tensor *A, Tensor *B, int axis, bool stable){
     int k_stride = (chuck_size-1)*A->stride[axis];
 
 
-    #pragma omp parallel for
-    for(int si=0; si<n_samples; si++) {  // n chucks
-            int start_b = si % inner_stride + si/inner_stride * sample_stride;
-            int end_b = start_b + k_stride;
+    cpu_parallel_for(0, n_samples, cpu_grain(chuck_size), [&](long int ini, long int end) {
+        for (long int si = ini; si < end; ++si) {  // n chucks
+                int start_b = si % inner_stride + si/inner_stride * sample_stride;
+                int end_b = start_b + k_stride;
 
-            // Case: Shape=(100, 3, 5, 5); Stride=(75, 25, 5, 1)
-            // Action: 1) Remove dimensions (virtually), 2) Jump from your axis stride
-            // Example: 1) axis=1 => 0, 25, 75...   |   2) axis=2 => 0, 5, 10, 15,...
-            // for(int i=0; i<batch_stride; i+=A->stride[axis]){ ... }
+                // Case: Shape=(100, 3, 5, 5); Stride=(75, 25, 5, 1)
+                // Action: 1) Remove dimensions (virtually), 2) Jump from your axis stride
+                // Example: 1) axis=1 => 0, 25, 75...   |   2) axis=2 => 0, 5, 10, 15,...
+                // for(int i=0; i<batch_stride; i+=A->stride[axis]){ ... }
 
 
-            // Numerical stability (opt.)
-            // stable => first value, no stable => 0.0f
-            float max_value = CPU_LOWEST_FLOAT;
-            if (stable) {
-                for (int i = start_b; i <= end_b; i += inner_stride) {
-                    if (A->ptr[i] > max_value) { max_value = A->ptr[i]; }
+                // Numerical stability (opt.)
+                // stable => first value, no stable => 0.0f
+                float max_value = CPU_LOWEST_FLOAT;
+                if (stable) {
+                    for (int i = start_b; i <= end_b; i += inner_stride) {
+                        if (A->ptr[i] > max_value) { max_value = A->ptr[i]; }
+                    }
                 }
-            }
 
-            // Numerator
-            float denominator = CPU_EPS_FLOAT;
-            for (int i = start_b; i <= end_b; i += inner_stride) {
-                float value = ::expf(A->ptr[i] - max_value);  // Highest number should be zero
-                B->ptr[i] = value;
-                denominator += value;
-            }
+                // Numerator
+                float denominator = CPU_EPS_FLOAT;
+                if (inner_stride == 1) {  // Contiguous: vectorized exp
+                    for (int i = start_b; i <= end_b; i++) B->ptr[i] = A->ptr[i] - max_value;
+                    cpu_vexp(B->ptr + start_b, B->ptr + start_b, chuck_size);
+                    for (int i = start_b; i <= end_b; i++) denominator += B->ptr[i];
+                } else {
+                    for (int i = start_b; i <= end_b; i += inner_stride) {
+                        float value = ::expf(A->ptr[i] - max_value);  // Highest number should be zero
+                        B->ptr[i] = value;
+                        denominator += value;
+                    }
+                }
 
-            // Softmax
-            for (int i = start_b; i <= end_b; i += inner_stride) {
-                B->ptr[i] /= denominator;
-            }
-    }
+                // Softmax
+                for (int i = start_b; i <= end_b; i += inner_stride) {
+                    B->ptr[i] /= denominator;
+                }
+        }
+    });
 }
 
 void cpu_d_full_softmax(Tensor *D, Tensor *I, Tensor *PD, int axis) {
@@ -356,24 +381,25 @@ void cpu_d_full_softmax_batched_2d(Tensor *D, Tensor *I, Tensor *PD) {
     int n_batches = D->shape[0];
     int n_features = D->shape[1];
 
-    #pragma omp parallel for
-    for(int bi=0; bi<n_batches; bi++){
-        // Contiguous data
-        int start = bi*n_features;
+    cpu_parallel_for(0, n_batches, cpu_grain(n_features), [&](long int ini, long int end) {
+        for (long int bi = ini; bi < end; ++bi) {
+            // Contiguous data
+            int start = bi*n_features;
 
-        // 1) Compute Jacobbian matrix: DS=[ NxN ]  // DjSi
-        // 2) Compute delta: D * DS = (1,n)x(n,n)=(1,n)
-        // 2.1) Dot product: PD[i] = Dj*DjSi = D0*D0Di + D1*D1Di + ... Dn*DnSi
-        for(int i=0; i<n_features; i++){  // Rows
-            for(int j=0; j<n_features; j++){  // Cols
+            // 1) Compute Jacobbian matrix: DS=[ NxN ]  // DjSi
+            // 2) Compute delta: D * DS = (1,n)x(n,n)=(1,n)
+            // 2.1) Dot product: PD[i] = Dj*DjSi = D0*D0Di + D1*D1Di + ... Dn*DnSi
+            for(int i=0; i<n_features; i++){  // Rows
+                for(int j=0; j<n_features; j++){  // Cols
 
-                // Derivative
-                float DjSi = SM->ptr[start+i] * (float)(i==j) - SM->ptr[start+j]*SM->ptr[start+i];
-                PD->ptr[start+i] += D->ptr[start+j] * DjSi;
+                    // Derivative
+                    float DjSi = SM->ptr[start+i] * (float)(i==j) - SM->ptr[start+j]*SM->ptr[start+i];
+                    PD->ptr[start+i] += D->ptr[start+j] * DjSi;
 
+                }
             }
         }
-    }
+    });
 }
 
 void cpu_d_full_softmax_nd(Tensor *D, Tensor *I, Tensor *PD, int axis) {
@@ -385,23 +411,24 @@ void cpu_d_full_softmax_nd(Tensor *D, Tensor *I, Tensor *PD, int axis) {
     int sample_stride = chuck_size*D->stride[axis];
     int k_stride = (chuck_size-1)*D->stride[axis];
 
-    #pragma omp parallel for
-    for(int si=0; si<n_samples; si++) {  // n chucks
-        int start_b = si % inner_stride + si/inner_stride * sample_stride;
-        int end_b = start_b + k_stride;
+    cpu_parallel_for(0, n_samples, cpu_grain(chuck_size), [&](long int ini, long int end) {
+        for (long int si = ini; si < end; ++si) {  // n chucks
+            int start_b = si % inner_stride + si/inner_stride * sample_stride;
+            int end_b = start_b + k_stride;
 
-        // 1) Compute Jacobbian matrix: DS=[ NxN ]  // DjSi
-        // 2) Compute delta: D * DS = (1,n)x(n,n)=(1,n)
-        // 2.1) Dot product: PD[i] = Dj*DjSi = D0*D0Di + D1*D1Di + ... Dn*DnSi
-        for (int i = start_b; i <= end_b; i += inner_stride) {  // Rows
-            for (int j = start_b; j <= end_b; j += inner_stride) {  // Cols
+            // 1) Compute Jacobbian matrix: DS=[ NxN ]  // DjSi
+            // 2) Compute delta: D * DS = (1,n)x(n,n)=(1,n)
+            // 2.1) Dot product: PD[i] = Dj*DjSi = D0*D0Di + D1*D1Di + ... Dn*DnSi
+            for (int i = start_b; i <= end_b; i += inner_stride) {  // Rows
+                for (int j = start_b; j <= end_b; j += inner_stride) {  // Cols
 
-                // Derivative
-                float DjSi = SM->ptr[i] * (float)(i==j) - SM->ptr[j]*SM->ptr[i];
-                PD->ptr[i] += D->ptr[j] * DjSi;
+                    // Derivative
+                    float DjSi = SM->ptr[i] * (float)(i==j) - SM->ptr[j]*SM->ptr[i];
+                    PD->ptr[i] += D->ptr[j] * DjSi;
 
+                }
             }
         }
-    }
+    });
 
 }
\ No newline at end of file
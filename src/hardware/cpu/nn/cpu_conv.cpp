@@ -10,77 +10,199 @@
 #include <cstdio>      /* printf, scanf, NULL */
 #include <cstdlib>     /* malloc, free, rand */
 #include <iostream>
+#include <algorithm>
 
 #include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+
+// The im2col matrix of a sample has a row for each output pixel and a column
+// for each (channel, kernel row, kernel col). It is never built whole: the
+// kernels work on tiles of output rows x channels of about CPU_CONV_TILE
+// floats, in a workspace of each range of the loop, so the memory does not
+// depend on the batch or on the kernel area.
+// With channels-last (see Net::set_layout) the input is stored (r,c,z) and
+// the tiles are transposed: the patch of each output pixel is a column of
+// (kernel row, kernel col, channel), so it is copied by runs of contiguous
+// channels, and the kernels are permuted to that order (see conv_kernels_cl).
+// A channels-last output is the transpose of the (pixels x nk) matrix, so
+// the same products are done with the transposed operands.
+// A grouped convolution is a convolution for each group: the kernels
+// [g*nk/groups, (g+1)*nk/groups) read the input channels [g*kz, (g+1)*kz).
+// The depthwise ones (kz == 1) use direct loops (see cpu_depthwise.cpp).
+
+// Strides of the channels and of the pixels of the input
+static inline void conv_strides(ConvolDescriptor *D, long int &cs, long int &ps)
+{
+  cs=D->channels_last_in ? 1 : (long int)D->ir*D->ic;
+  ps=D->channels_last_in ? D->iz : 1;
+}
 
+int conv_tiles(ConvolDescriptor *D, bool all_channels, int &rows, int &chans)
+{
+  int ksize=D->kr*D->kc;
 
-float get_pixel(int b,int px,int py,int pz,ConvolDescriptor *D,int isize,int irsize) {
-  // Check boundaries of the window
-  if (px<0) return 0.0;
-  if (py<0) return 0.0;
-  if (px>=D->ic) return 0.0;
-  if (py>=D->ir) return 0.0;
-
-  // Compute address from indices (row-major)
-  unsigned int address = (b*isize) + (pz*irsize) + (py*D->ic) + px;
-  return D->I->ptr[address];
+  // At least one output row of one channel
+  chans=all_channels ? D->kz : std::max(1, std::min(D->kz, CPU_CONV_TILE/(D->c*ksize)));
+  rows=std::max(1, std::min(D->r, CPU_CONV_TILE/(D->c*chans*ksize)));
+  return rows*D->c*chans*ksize;
 }
 
-void add_pixel(int b,int px,int py,int pz,ConvolDescriptor *D,int isize,int irsize,float val) {
-  // Check boundaries of the window
-  if (px<0) return;
-  if (py<0) return;
-  if (px>=D->ic) return;
-  if (py>=D->ir) return;
+// The weight gradient of a block of channels walks the whole batch. With
+// fewer blocks than threads the batch is split in chunks too: the first one
+// accumulates into gK and the others into partials, added to gK in the order
+// of the chunks. The chunks only depend on the threads of cpu_split_threads,
+// so the deterministic mode gets the same sums with any pool.
+int conv_grad_chunks(int batch, int tasks, long int gksize)
+{
+  int threads=cpu_split_threads();
+  if (tasks>=threads) return 1;
 
-  // Compute address from indices (row-major)
-  unsigned int address = (b*isize) + (pz*irsize) + (py*D->ic) + px;
-  D->ID->ptr[address]+=val;
+  long int chunks=std::min((long int)batch, (long int)(threads+tasks-1)/tasks);
+  chunks=std::min(chunks, 1+CPU_CONV_GRAD_PARTIALS/gksize);
+  return (int)std::max(1L, chunks);
 }
 
+void conv_grad_reduce(float *gK, const float *part, int chunks, long int gksize)
+{
+  cpu_parallel_for(0, gksize, cpu_grain(chunks), [&](long int ini, long int end) {
+    for(long int i=ini;i<end;i++)
+      for(int ch=1;ch<chunks;ch++) gK[i]+=part[(ch-1)*gksize+i];
+  });
+}
 
-void im2col(int b,ConvolDescriptor *D,float *ptrI,int col2im)
+// O = A*B, or O += A*B to accumulate
+template<typename TO, typename TA, typename TB>
+static inline void conv_gemm(TO &O,const TA &A,const TB &B,bool acc)
+{
+  if (acc) O.noalias()+=A*B;
+  else O.noalias()=A*B;
+}
+
+void im2col_tile(const float *I,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *P)
 {
   _profile(_CPU_IM2COL, 0);
-  int i,j,k;
-  int pz,py,px,y,x;
   int ksize=D->kr*D->kc;
-  int kr2=D->kr/2;
-  int kc2=D->kc/2;
-
-  if (kc2==0) kc2=-1;
-
-  int orsize=D->r*D->c;
-
-  int isize=D->ir*D->ic*D->iz;
-  int irsize=D->ir*D->ic;
-
-  k=0;
-  py=-D->padrt;
-  px=-D->padcl;
+  int n=(r1-r0)*D->c;
+  long int cs, ps;
+  conv_strides(D, cs, ps);
+
+  // Column (z,ky,kx): the pixels (y*sr-padrt+ky*dr, x*sc-padcl+kx*dc) of the channel z
+  for(int z=z0;z<z1;z++)
+  for(int k=0;k<ksize;k++,P+=n) {
+    int ky=k/D->kc, kx=k%D->kc;
+    const float *src=I+z*cs;
+    float *dst=P;
+    for(int y=r0;y<r1;y++,dst+=D->c) {
+      int py=y*D->sr-D->padrt+ky*D->dr;
+      if (py<0 || py>=D->ir) { std::fill(dst, dst+D->c, 0.0f); continue; }
+      for(int x=0;x<D->c;x++) {
+        int px=x*D->sc-D->padcl+kx*D->dc;
+        dst[x]=(px<0 || px>=D->ic) ? 0.0f : src[(py*D->ic+px)*ps];
+      }
+    }
+  }
+  _profile(_CPU_IM2COL, 1);
+}
 
+void col2im_tile(const float *P,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *ID)
+{
+  _profile(_CPU_IM2COL, 0);
+  int ksize=D->kr*D->kc;
+  int n=(r1-r0)*D->c;
+  long int cs, ps;
+  conv_strides(D, cs, ps);
+
+  for(int z=z0;z<z1;z++)
+  for(int k=0;k<ksize;k++,P+=n) {
+    int ky=k/D->kc, kx=k%D->kc;
+    float *dst=ID+z*cs;
+    const float *src=P;
+    for(int y=r0;y<r1;y++,src+=D->c) {
+      int py=y*D->sr-D->padrt+ky*D->dr;
+      if (py<0 || py>=D->ir) continue;
+      for(int x=0;x<D->c;x++) {
+        int px=x*D->sc-D->padcl+kx*D->dc;
+        if (px>=0 && px<D->ic) dst[(py*D->ic+px)*ps]+=src[x];
+      }
+    }
+  }
+  _profile(_CPU_IM2COL, 1);
+}
 
-  for(j=0;j<D->matI.rows();j++) {
-    k=j;
+// Tile of a channels-last input: column p of the output pixel p of the rows
+// [r0, r1), with the channels [z0, z1) of each (ky,kx) contiguous, row-major
+// ((r1-r0)*c x kr*kc*(z1-z0))
+void im2col_tile_cl(const float *I,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *P)
+{
+  _profile(_CPU_IM2COL, 0);
+  int ksize=D->kr*D->kc;
+  int zn=z1-z0;
+
+  for(int y=r0;y<r1;y++)
+  for(int x=0;x<D->c;x++)
+  for(int k=0;k<ksize;k++,P+=zn) {
+    int py=y*D->sr-D->padrt+(k/D->kc)*D->dr;
+    int px=x*D->sc-D->padcl+(k%D->kc)*D->dc;
+    if (py<0 || py>=D->ir || px<0 || px>=D->ic) std::fill(P, P+zn, 0.0f);
+    else std::copy(I+((long int)py*D->ic+px)*D->iz+z0, I+((long int)py*D->ic+px)*D->iz+z1, P);
+  }
+  _profile(_CPU_IM2COL, 1);
+}
 
-    for(i=0;i<D->matI.cols();i++,k+=orsize) {
-      pz=i/ksize;
-      y=py+(i%ksize)/D->kc;
-      x=px+(i%D->kc);
+void col2im_tile_cl(const float *P,ConvolDescriptor *D,int r0,int r1,int z0,int z1,float *ID)
+{
+  _profile(_CPU_IM2COL, 0);
+  int ksize=D->kr*D->kc;
+  int zn=z1-z0;
+
+  for(int y=r0;y<r1;y++)
+  for(int x=0;x<D->c;x++)
+  for(int k=0;k<ksize;k++,P+=zn) {
+    int py=y*D->sr-D->padrt+(k/D->kc)*D->dr;
+    int px=x*D->sc-D->padcl+(k%D->kc)*D->dc;
+    if (py<0 || py>=D->ir || px<0 || px>=D->ic) continue;
+    float *dst=ID+((long int)py*D->ic+px)*D->iz+z0;
+    for(int z=0;z<zn;z++) dst[z]+=P[z];
+  }
+  _profile(_CPU_IM2COL, 1);
+}
 
-      if(col2im)
-      add_pixel(b,x,y,pz,D,isize,irsize,ptrI[k]);
-      else
-      ptrI[k]=get_pixel(b,x,y,pz,D,isize,irsize);
+// Kernels (nk x kz x kr x kc) in the order of the channels-last tiles of
+// blocks of chans channels: the block [z0, z1) of the kernel o keeps its
+// offset o*kz*ksize + z0*ksize, stored (kr, kc, z1-z0). Back to the kernel
+// order with inverse
+void conv_kernels_cl(ConvolDescriptor *D,int chans,const float *K,float *Kp,bool inverse)
+{
+  int ksize=D->kr*D->kc;
 
+  cpu_parallel_for(0, D->nk, cpu_grain((long int)D->kz*ksize), [&](long int ini, long int end) {
+    for(int o=ini;o<end;o++)
+    for(int z0=0;z0<D->kz;z0+=chans) {
+      int zn=std::min(D->kz, z0+chans)-z0;
+      long int off=((long int)o*D->kz+z0)*ksize;
+      for(int z=0;z<zn;z++)
+      for(int k=0;k<ksize;k++) {
+        if (inverse) Kp[off+z*ksize+k]=K[off+k*zn+z];
+        else Kp[off+k*zn+z]=K[off+z*ksize+k];
+      }
     }
-    px+=D->sc;
-    if (px>=D->ic+D->padcl-kc2-1) {
-      px=-D->padcl;
-      py+=D->sr;
-    }
+  });
+}
+
+// The kernels of a channels-last input, permuted again only when they have
+// changed (the layer marks them, see LConv::weights_changed)
+static float *conv_kernels_cl_cached(ConvolDescriptor *D,int chans)
+{
+  if (D->ptrKcl==nullptr) {
+    D->ptrKcl=get_fmem(D->K->size, "conv_kernels_cl_cached");
+    D->Kcl_stale=true;
   }
-    _profile(_CPU_IM2COL, 1);
+  if (D->Kcl_stale) {
+    conv_kernels_cl(D, chans, D->K->ptr, D->ptrKcl, false);
+    D->Kcl_stale=false;
+  }
+  return D->ptrKcl;
 }
 
 
@@ -88,39 +210,83 @@ void cpu_conv2D(ConvolDescriptor *D)
 {
   _profile(_CPU_CONV2D, 0);
   int osize=D->z*D->r*D->c;
-  int isize=D->r*D->c*D->kc*D->kr*D->kz;//r*c,kr*kc*kz
-
-  float *ptrO=D->O->ptr;
-  float *ptrI=D->ptrI;
-
-
-  // Map memory to Eigen
-  Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(D->K->ptr, D->kr * D->kc * D->kz, D->nk);
-
-  #pragma omp parallel for
-  for(int b=0;b<D->I->shape[0];b++){
-
-    float *ptrO=D->O->ptr+(b*osize);
-    float *ptrI=D->ptrI+(b*isize);
-
-    Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(ptrI,D->r*D->c,D->kz*D->kr*D->kc);
-    Eigen::Map<Eigen::MatrixXf> matO=Eigen::Map<Eigen::MatrixXf>(ptrO,D->r*D->c,D->z);
-
-    im2col(b,D,ptrI,0);
+  int ksize=D->kr*D->kc;
 
-    matO=matI*matK;
-  }// batch
+  if (D->winograd) cpu_winograd_conv2D(D);
+  else if (D->depthwise) cpu_depthwise_conv2D(D);
+  else {
+    int nkg=D->nk/D->groups;
+    bool cl=D->channels_last_in;
+
+    int rows, chans;
+    int wsize=conv_tiles(D, false, rows, chans);
+    int tiles=(D->r+rows-1)/rows;
+
+    // Map memory to Eigen
+    float *ptrK=cl ? conv_kernels_cl_cached(D, chans) : D->K->ptr;
+    Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(ptrK, ksize * D->kz, D->nk);
+
+    // Tiles of output rows, the channels are accumulated
+    cpu_parallel_gemm_for(0, D->I->shape[0]*tiles, 1, [&](long int ini, long int end) {
+      float *P=get_fmem(wsize, "cpu_conv2D");
+
+      for(int t=ini;t<end;t++){
+        int b=t/tiles;
+        int r0=(t%tiles)*rows, r1=std::min(D->r, r0+rows);
+        int n=(r1-r0)*D->c;
+
+        const float *ptrI=D->I->ptr+(b*D->iz*D->ir*D->ic);
+        Eigen::Map<Eigen::MatrixXf> matO=Eigen::Map<Eigen::MatrixXf>(D->O->ptr+(b*osize),D->r*D->c,D->z);
+        Eigen::Map<Eigen::MatrixXf> matOT=Eigen::Map<Eigen::MatrixXf>(D->O->ptr+(b*osize),D->z,D->r*D->c);
+
+        for(int g=0;g<D->groups;g++)
+        for(int z0=0;z0<D->kz;z0+=chans) {
+          int z1=std::min(D->kz, z0+chans);
+          Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+          Eigen::Map<Eigen::MatrixXf> matIT=Eigen::Map<Eigen::MatrixXf>(P,(z1-z0)*ksize,n);
+          auto matKz=matK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg);
+
+          if (cl) im2col_tile_cl(ptrI,D,r0,r1,g*D->kz+z0,g*D->kz+z1,P);
+          else im2col_tile(ptrI,D,r0,r1,g*D->kz+z0,g*D->kz+z1,P);
+
+          if (D->channels_last_out) {
+            auto matOz=matOT.block(g*nkg,r0*D->c,nkg,n);
+            if (cl) conv_gemm(matOz, matKz.transpose(), matIT, z0>0);
+            else conv_gemm(matOz, matKz.transpose(), matI.transpose(), z0>0);
+          }
+          else {
+            auto matOz=matO.block(r0*D->c,g*nkg,n,nkg);
+            if (cl) conv_gemm(matOz, matIT.transpose(), matKz, z0>0);
+            else conv_gemm(matOz, matI, matKz, z0>0);
+          }
+        }
+      }// tiles
+
+      eddl_free(P);
+    });
+  }
 
   //bias
-  if (D->use_bias) {
-    #pragma omp parallel for
-    for(int b=0;b<D->O->shape[0];b++) {
-      float *ptrO=D->O->ptr+(b*osize);
-      for(int z=0;z<D->O->shape[1];z++)
-      for(int r=0;r<D->O->shape[2];r++)
-      for(int c=0;c<D->O->shape[3];c++,ptrO++)
-      (*ptrO)+=D->bias->ptr[z];
-    }
+  if (D->use_bias && D->channels_last_out) {
+    cpu_parallel_for(0, D->O->shape[0], cpu_grain(osize), [&](long int ini, long int end) {
+      for(int b=ini;b<end;b++) {
+        float *ptrO=D->O->ptr+(b*osize);
+        for(int p=0;p<D->r*D->c;p++)
+        for(int z=0;z<D->z;z++,ptrO++)
+        (*ptrO)+=D->bias->ptr[z];
+      }
+    });
+  }
+  else if (D->use_bias) {
+    cpu_parallel_for(0, D->O->shape[0], cpu_grain(osize), [&](long int ini, long int end) {
+      for(int b=ini;b<end;b++) {
+        float *ptrO=D->O->ptr+(b*osize);
+        for(int z=0;z<D->O->shape[1];z++)
+        for(int r=0;r<D->O->shape[2];r++)
+        for(int c=0;c<D->O->shape[3];c++,ptrO++)
+        (*ptrO)+=D->bias->ptr[z];
+      }
+    });
   }
     _profile(_CPU_CONV2D, 1);
 
@@ -131,28 +297,90 @@ void cpu_conv2D_grad(ConvolDescriptor *D)
   _profile(_CPU_CONV2D_GRAD, 0);
   //return;
   int osize=D->z*D->r*D->c;
-  int isize=D->r*D->c*D->kc*D->kr*D->kz;//r*c,kr*kc*kz
-
-
-  // Map memory to Eigen
-  Eigen::Map<Eigen::MatrixXf> matgK=Eigen::Map<Eigen::MatrixXf>(D->gK->ptr, D->kr * D->kc * D->kz, D->nk);
-
-  //#pragma omp parallel for
-  for(int b=0;b<D->I->shape[0];b++){
-
-    float *ptrD=D->D->ptr+(b*osize);
-    float *ptrI=D->ptrI+(b*isize);
-
-    Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(ptrI,D->r*D->c,D->kz*D->kr*D->kc);
-    Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(ptrD,D->r*D->c,D->z);
+  int ksize=D->kr*D->kc;
 
-    matgK+=matI.transpose()*matD;
-  }// batch
+  if (D->winograd) cpu_winograd_conv2D_grad(D);
+  else if (D->depthwise) cpu_depthwise_conv2D_grad(D);
+  else {
+    int nkg=D->nk/D->groups;
+
+    int rows, chans;
+    int wsize=conv_tiles(D, false, rows, chans);
+    int blocks=(D->kz+chans-1)/chans;
+    int tasks=D->groups*blocks;
+    long int gksize=D->gK->size;
+    int batch=D->I->shape[0];
+    int chunks=conv_grad_chunks(batch, tasks, gksize);
+    float *part=(chunks>1) ? get_fmem((chunks-1)*gksize, "cpu_conv2D_grad") : nullptr;
+    bool cl=D->channels_last_in;
+
+    // The tiles of a channels-last input give the gradient in the permuted order
+    if (cl && (D->ptrgKcl==nullptr)) D->ptrgKcl=get_fmem(gksize, "cpu_conv2D_grad");
+    float *gKp=cl ? D->ptrgKcl : D->gK->ptr;
+    if (cl) conv_kernels_cl(D, chans, D->gK->ptr, gKp, false);
+
+    // Each block of channels (of a group) updates its own block of gK (or of
+    // the partial of its chunk), in the order of the batch
+    cpu_parallel_gemm_for(0, tasks*chunks, 1, [&](long int ini, long int end) {
+      float *P=get_fmem(wsize, "cpu_conv2D_grad");
+
+      for(int t=ini;t<end;t++){
+        int k=t%tasks, ch=t/tasks;
+        int g=k/blocks;
+        int z0=(k%blocks)*chans, z1=std::min(D->kz, z0+chans);
+        float *ptrgK=(ch==0) ? gKp : part+(ch-1)*gksize;
+        Eigen::Map<Eigen::MatrixXf> matgK=Eigen::Map<Eigen::MatrixXf>(ptrgK, ksize * D->kz, D->nk);
+        auto matgKz=matgK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg);
+        if (ch>0) matgKz.setZero();
+
+        for(int b=ch*batch/chunks;b<(ch+1)*batch/chunks;b++)
+        for(int r0=0;r0<D->r;r0+=rows) {
+          int r1=std::min(D->r, r0+rows);
+          int n=(r1-r0)*D->c;
+
+          Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+          Eigen::Map<Eigen::MatrixXf> matIT=Eigen::Map<Eigen::MatrixXf>(P,(z1-z0)*ksize,n);
+          Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),D->r*D->c,D->z);
+          Eigen::Map<Eigen::MatrixXf> matDT=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),D->z,D->r*D->c);
+
+          if (cl) im2col_tile_cl(D->I->ptr+(b*D->iz*D->ir*D->ic),D,r0,r1,g*D->kz+z0,g*D->kz+z1,P);
+          else im2col_tile(D->I->ptr+(b*D->iz*D->ir*D->ic),D,r0,r1,g*D->kz+z0,g*D->kz+z1,P);
+
+          if (D->channels_last_out) {
+            auto matDz=matDT.block(g*nkg,r0*D->c,nkg,n).transpose();
+            if (cl) matgKz.noalias()+=matIT*matDz;
+            else matgKz.noalias()+=matI.transpose()*matDz;
+          }
+          else {
+            auto matDz=matD.block(r0*D->c,g*nkg,n,nkg);
+            if (cl) matgKz.noalias()+=matIT*matDz;
+            else matgKz.noalias()+=matI.transpose()*matDz;
+          }
+        }
+      }// blocks x chunks
+
+      eddl_free(P);
+    });
+
+    if (chunks>1) {
+      conv_grad_reduce(gKp, part, chunks, gksize);
+      eddl_free(part);
+    }
+    if (cl) conv_kernels_cl(D, chans, gKp, D->gK->ptr, true);
+  }
 
   //bias
 
   //#pragma omp parallel for
-  if (D->use_bias) {
+  if (D->use_bias && D->channels_last_out) {
+    for(int b=0;b<D->D->shape[0];b++) {
+      float *ptrD=D->D->ptr+(b*osize);
+      for(int p=0;p<D->r*D->c;p++)
+      for(int z=0;z<D->z;z++,ptrD++)
+      D->gbias->ptr[z]+=(*ptrD);
+    }
+  }
+  else if (D->use_bias) {
     for(int b=0;b<D->D->shape[0];b++) {
       float *ptrD=D->D->ptr+(b*osize);
       for(int z=0;z<D->D->shape[1];z++)
@@ -169,40 +397,287 @@ void cpu_conv2D_back(ConvolDescriptor *D)
 {
   _profile(_CPU_CONV2D_BACK, 0);
   int osize=D->z*D->r*D->c;
-  int isize=D->r*D->c*D->kc*D->kr*D->kz;//r*c,kr*kc*kz
+  int ksize=D->kr*D->kc;
 
-  float *ptrD=D->D->ptr;
-  float *ptrI=D->ptrI;
+  if (D->winograd) cpu_winograd_conv2D_back(D);
+  else if (D->depthwise) cpu_depthwise_conv2D_back(D);
+  else {
+    int nkg=D->nk/D->groups;
+    bool cl=D->channels_last_in;
+
+    int rows, chans;
+    int wsize=conv_tiles(D, false, rows, chans);
+
+    // Map memory to Eigen
+    float *ptrK=cl ? conv_kernels_cl_cached(D, chans) : D->K->ptr;
+    Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(ptrK, ksize * D->kz, D->nk);
+
+    // The patches of the tiles of a sample overlap: whole samples in each range
+    cpu_parallel_gemm_for(0, D->I->shape[0], 1, [&](long int ini, long int end) {
+      float *P=get_fmem(wsize, "cpu_conv2D_back");
+
+      for(int b=ini;b<end;b++){
+        Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),D->r*D->c,D->z);
+        Eigen::Map<Eigen::MatrixXf> matDT=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),D->z,D->r*D->c);
+        float *ptrID=D->ID->ptr+(b*D->iz*D->ir*D->ic);
+
+        for(int g=0;g<D->groups;g++)
+        for(int r0=0;r0<D->r;r0+=rows)
+        for(int z0=0;z0<D->kz;z0+=chans) {
+          int r1=std::min(D->r, r0+rows), z1=std::min(D->kz, z0+chans);
+          int n=(r1-r0)*D->c;
+          Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+          Eigen::Map<Eigen::MatrixXf> matIT=Eigen::Map<Eigen::MatrixXf>(P,(z1-z0)*ksize,n);
+          auto matKz=matK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg);
+
+          if (D->channels_last_out) {
+            auto matDz=matDT.block(g*nkg,r0*D->c,nkg,n);
+            if (cl) matIT.noalias()=matKz*matDz;
+            else matI.noalias()=matDz.transpose()*matKz.transpose();
+          }
+          else {
+            auto matDz=matD.block(r0*D->c,g*nkg,n,nkg);
+            if (cl) matIT.noalias()=matKz*matDz.transpose();
+            else matI.noalias()=matDz*matKz.transpose();
+          }
+
+          if (cl) col2im_tile_cl(P,D,r0,r1,g*D->kz+z0,g*D->kz+z1,ptrID);
+          else col2im_tile(P,D,r0,r1,g*D->kz+z0,g*D->kz+z1,ptrID);
+        }
+      }// batch
+
+      eddl_free(P);
+    });
+  }
+    _profile(_CPU_CONV2D_BACK, 1);
+}
+
+
+// The vol2col matrix of a sample is the im2col one of the volumes: a row for
+// each output voxel and a column for each (channel, kernel depth, kernel row,
+// kernel col). The tiles are of output planes rows (depth*rows, each one of c
+// voxels) x channels, as in 2D. With groups, the channels are those of a group
+// (kz) and the input of the tile starts at its first channel.
+
+static int conv3D_tiles(ConvolDescriptor3D *D, int &rows, int &chans)
+{
+  int ksize=D->kd*D->kr*D->kc;
+
+  // At least one output row of one channel
+  chans=std::max(1, std::min(D->kz, CPU_CONV_TILE/(D->c*ksize)));
+  rows=std::max(1, std::min(D->d*D->r, CPU_CONV_TILE/(D->c*chans*ksize)));
+  return rows*D->c*chans*ksize;
+}
+
+// Tile of the vol2col matrix of a sample: output rows [q0, q1) (q = depth*r + row)
+// x channels [z0, z1), column-major ((q1-q0)*c x (z1-z0)*kd*kr*kc)
+static void vol2col_tile(const float *I,ConvolDescriptor3D *D,int q0,int q1,int z0,int z1,float *P)
+{
+  int ksize=D->kd*D->kr*D->kc;
+  int n=(q1-q0)*D->c;
+  long int vsize=(long int)D->id*D->ir*D->ic;
+
+  // Column (z,kw,ky,kx): the voxels (w*sd-paddf+kw*dd, y*sr-padrt+ky*dr, x*sc-padcl+kx*dc) of the channel z
+  for(int z=z0;z<z1;z++)
+  for(int k=0;k<ksize;k++,P+=n) {
+    int kw=k/(D->kr*D->kc), ky=(k/D->kc)%D->kr, kx=k%D->kc;
+    const float *src=I+z*vsize;
+    float *dst=P;
+    for(int q=q0;q<q1;q++,dst+=D->c) {
+      int pw=(q/D->r)*D->sd-D->paddf+kw*D->dd;
+      int py=(q%D->r)*D->sr-D->padrt+ky*D->dr;
+      if (pw<0 || pw>=D->id || py<0 || py>=D->ir) { std::fill(dst, dst+D->c, 0.0f); continue; }
+      const float *row=src+((long int)pw*D->ir+py)*D->ic;
+      for(int x=0;x<D->c;x++) {
+        int px=x*D->sc-D->padcl+kx*D->dc;
+        dst[x]=(px<0 || px>=D->ic) ? 0.0f : row[px];
+      }
+    }
+  }
+}
+
+static void col2vol_tile(const float *P,ConvolDescriptor3D *D,int q0,int q1,int z0,int z1,float *ID)
+{
+  int ksize=D->kd*D->kr*D->kc;
+  int n=(q1-q0)*D->c;
+  long int vsize=(long int)D->id*D->ir*D->ic;
+
+  for(int z=z0;z<z1;z++)
+  for(int k=0;k<ksize;k++,P+=n) {
+    int kw=k/(D->kr*D->kc), ky=(k/D->kc)%D->kr, kx=k%D->kc;
+    float *dst=ID+z*vsize;
+    const float *src=P;
+    for(int q=q0;q<q1;q++,src+=D->c) {
+      int pw=(q/D->r)*D->sd-D->paddf+kw*D->dd;
+      int py=(q%D->r)*D->sr-D->padrt+ky*D->dr;
+      if (pw<0 || pw>=D->id || py<0 || py>=D->ir) continue;
+      float *row=dst+((long int)pw*D->ir+py)*D->ic;
+      for(int x=0;x<D->c;x++) {
+        int px=x*D->sc-D->padcl+kx*D->dc;
+        if (px>=0 && px<D->ic) row[px]+=src[x];
+      }
+    }
+  }
+}
+
+void cpu_conv3D(ConvolDescriptor3D *D)
+{
+  _profile(_CPU_CONV3D, 0);
+  int vol=D->d*D->r*D->c;
+  int ksize=D->kd*D->kr*D->kc;
+  long int isize=(long int)D->iz*D->id*D->ir*D->ic, osize=(long int)D->z*vol;
+  long int gsize=(long int)D->kz*D->id*D->ir*D->ic;
+  int nkg=D->nk/D->groups;
 
   // Map memory to Eigen
-  Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(D->K->ptr, D->kr * D->kc * D->kz, D->nk);
+  Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(D->K->ptr, ksize * D->kz, D->nk);
 
-  #pragma omp parallel for
-  for(int b=0;b<D->I->shape[0];b++){
+  int rows, chans;
+  int wsize=conv3D_tiles(D, rows, chans);
+  int tiles=(D->d*D->r+rows-1)/rows;
 
-    float *ptrD=D->D->ptr+(b*osize);
-    float *ptrI=D->ptrI+(b*isize);
+  // Tiles of output rows, the channels of each group are accumulated into its filters
+  cpu_parallel_gemm_for(0, D->I->shape[0]*tiles, 1, [&](long int ini, long int end) {
+    float *P=get_fmem(wsize, "cpu_conv3D");
 
-    Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(ptrI,D->r*D->c,D->kz*D->kr*D->kc);
-    Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(ptrD,D->r*D->c,D->z);
+    for(int t=ini;t<end;t++){
+      int b=t/tiles;
+      int q0=(t%tiles)*rows, q1=std::min(D->d*D->r, q0+rows);
+      int n=(q1-q0)*D->c;
 
-    matI=matD*matK.transpose();
+      Eigen::Map<Eigen::MatrixXf> matO=Eigen::Map<Eigen::MatrixXf>(D->O->ptr+(b*osize),vol,D->z);
 
-    im2col(b,D,ptrI,1);
+      for(int g=0;g<D->groups;g++)
+      for(int z0=0;z0<D->kz;z0+=chans) {
+        int z1=std::min(D->kz, z0+chans);
+        Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+        auto matOq=matO.block(q0*D->c,g*nkg,n,nkg);
+        auto matKz=matK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg);
 
-  }// batch
-    _profile(_CPU_CONV2D_BACK, 1);
-}
+        vol2col_tile(D->I->ptr+(b*isize)+g*gsize,D,q0,q1,z0,z1,P);
 
+        if (z0==0) matOq.noalias()=matI*matKz;
+        else matOq.noalias()+=matI*matKz;
+      }
+    }// tiles
 
-void cpu_conv3D(ConvolDescriptor3D *D){
+    eddl_free(P);
+  });
 
+  //bias
+  if (D->use_bias) {
+    cpu_parallel_for(0, D->O->shape[0], cpu_grain(osize), [&](long int ini, long int end) {
+      for(int b=ini;b<end;b++) {
+        float *ptrO=D->O->ptr+(b*osize);
+        for(int z=0;z<D->z;z++)
+        for(int p=0;p<vol;p++,ptrO++)
+        (*ptrO)+=D->bias->ptr[z];
+      }
+    });
+  }
+  _profile(_CPU_CONV3D, 1);
 }
 
-void cpu_conv3D_grad(ConvolDescriptor3D *D){
+void cpu_conv3D_grad(ConvolDescriptor3D *D)
+{
+  _profile(_CPU_CONV3D_GRAD, 0);
+  int vol=D->d*D->r*D->c;
+  int ksize=D->kd*D->kr*D->kc;
+  long int isize=(long int)D->iz*D->id*D->ir*D->ic, osize=(long int)D->z*vol;
+
+  int rows, chans;
+  int wsize=conv3D_tiles(D, rows, chans);
+  int cblocks=(D->kz+chans-1)/chans;
+  int blocks=D->groups*cblocks;
+  long int gsize=(long int)D->kz*D->id*D->ir*D->ic;
+  int nkg=D->nk/D->groups;
+  long int gksize=D->gK->size;
+  int batch=D->I->shape[0];
+  int chunks=conv_grad_chunks(batch, blocks, gksize);
+  float *part=(chunks>1) ? get_fmem((chunks-1)*gksize, "cpu_conv3D_grad") : nullptr;
+
+  // Each block of channels of a group updates its own block of gK (or of the
+  // partial of its chunk, see conv_grad_chunks), in the order of the batch
+  cpu_parallel_gemm_for(0, blocks*chunks, 1, [&](long int ini, long int end) {
+    float *P=get_fmem(wsize, "cpu_conv3D_grad");
+
+    for(int t=ini;t<end;t++){
+      int k=t%blocks, ch=t/blocks;
+      int g=k/cblocks;
+      int z0=(k%cblocks)*chans, z1=std::min(D->kz, z0+chans);
+      float *ptrgK=(ch==0) ? D->gK->ptr : part+(ch-1)*gksize;
+      Eigen::Map<Eigen::MatrixXf> matgK=Eigen::Map<Eigen::MatrixXf>(ptrgK, ksize * D->kz, D->nk);
+      auto matgKz=matgK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg);
+      if (ch>0) matgKz.setZero();
+
+      for(int b=ch*batch/chunks;b<(ch+1)*batch/chunks;b++)
+      for(int q0=0;q0<D->d*D->r;q0+=rows) {
+        int q1=std::min(D->d*D->r, q0+rows);
+        int n=(q1-q0)*D->c;
+
+        Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+        Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),vol,D->z);
+
+        vol2col_tile(D->I->ptr+(b*isize)+g*gsize,D,q0,q1,z0,z1,P);
+        matgKz.noalias()+=matI.transpose()*matD.block(q0*D->c,g*nkg,n,nkg);
+      }
+    }// blocks x chunks
+
+    eddl_free(P);
+  });
+
+  if (chunks>1) {
+    conv_grad_reduce(D->gK->ptr, part, chunks, gksize);
+    eddl_free(part);
+  }
 
+  //bias
+  if (D->use_bias) {
+    for(int b=0;b<D->D->shape[0];b++) {
+      float *ptrD=D->D->ptr+(b*osize);
+      for(int z=0;z<D->z;z++)
+      for(int p=0;p<vol;p++,ptrD++)
+      D->gbias->ptr[z]+=(*ptrD);
+    }
+  }
+  _profile(_CPU_CONV3D_GRAD, 1);
 }
 
-void cpu_conv3D_back(ConvolDescriptor3D *D){
+void cpu_conv3D_back(ConvolDescriptor3D *D)
+{
+  _profile(_CPU_CONV3D_BACK, 0);
+  int vol=D->d*D->r*D->c;
+  int ksize=D->kd*D->kr*D->kc;
+  long int isize=(long int)D->iz*D->id*D->ir*D->ic, osize=(long int)D->z*vol;
+  long int gsize=(long int)D->kz*D->id*D->ir*D->ic;
+  int nkg=D->nk/D->groups;
+
+  // Map memory to Eigen
+  Eigen::Map<Eigen::MatrixXf> matK=Eigen::Map<Eigen::MatrixXf>(D->K->ptr, ksize * D->kz, D->nk);
+
+  int rows, chans;
+  int wsize=conv3D_tiles(D, rows, chans);
+
+  // The patches of the tiles of a sample overlap: whole samples in each range
+  cpu_parallel_gemm_for(0, D->I->shape[0], 1, [&](long int ini, long int end) {
+    float *P=get_fmem(wsize, "cpu_conv3D_back");
+
+    for(int b=ini;b<end;b++){
+      Eigen::Map<Eigen::MatrixXf> matD=Eigen::Map<Eigen::MatrixXf>(D->D->ptr+(b*osize),vol,D->z);
+
+      for(int g=0;g<D->groups;g++)
+      for(int q0=0;q0<D->d*D->r;q0+=rows)
+      for(int z0=0;z0<D->kz;z0+=chans) {
+        int q1=std::min(D->d*D->r, q0+rows), z1=std::min(D->kz, z0+chans);
+        int n=(q1-q0)*D->c;
+        Eigen::Map<Eigen::MatrixXf> matI=Eigen::Map<Eigen::MatrixXf>(P,n,(z1-z0)*ksize);
+
+        matI.noalias()=matD.block(q0*D->c,g*nkg,n,nkg)*matK.block(z0*ksize,g*nkg,(z1-z0)*ksize,nkg).transpose();
+        col2vol_tile(P,D,q0,q1,z0,z1,D->ID->ptr+(b*isize)+g*gsize);
+      }
+    }// batch
 
+    eddl_free(P);
+  });
+  _profile(_CPU_CONV3D_BACK, 1);
 }
@@ -0,0 +1,282 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+
+// Depthwise convolution: groups == input channels, so the output channel o
+// only reads the input channel o / (nk / groups) with a kr x kc kernel. The
+// im2col matrix would have a column for each kernel element and a GEMM with
+// a single row, so the kernels loop directly over the rows of the images:
+// for each kernel element, the output row is an axpy of the input row (a
+// contiguous one with stride 1 and the NCHW layout). The borders are clipped
+// once for each kernel element instead of checking each pixel.
+// With channels-last input and output the channels of a pixel are the
+// contiguous ones, so the kernels walk the pixels and each kernel element is
+// an axpy over the channels, with the kernels transposed to (kr, kc, nk).
+
+// Outputs [a, b) whose input o*s - pad + k is inside [0, in)
+static inline void dw_range(int k, int pad, int s, int in, int out, int &a, int &b) {
+    int lo = pad - k, hi = in - 1 + pad - k;
+    a = (lo > 0) ? (lo + s - 1) / s : 0;
+    b = (hi < 0) ? 0 : std::min(out, hi / s + 1);
+}
+
+// y[i*ys] += w * x[i*xs]
+static inline void dw_axpy(float w, const float *x, long int xs, float *y, long int ys, int n) {
+    if (xs == 1 && ys == 1) {
+        #pragma omp simd
+        for (int i = 0; i < n; i++) y[i] += w * x[i];
+    }
+    else for (int i = 0; i < n; i++) y[i * ys] += w * x[i * xs];
+}
+
+// sum(x[i*xs] * y[i*ys])
+static inline float dw_dot(const float *x, long int xs, const float *y, long int ys, int n) {
+    float s = 0.0f;
+    if (xs == 1 && ys == 1) {
+        #pragma omp simd reduction(+:s)
+        for (int i = 0; i < n; i++) s += x[i] * y[i];
+    }
+    else for (int i = 0; i < n; i++) s += x[i * xs] * y[i * ys];
+    return s;
+}
+
+// Strides of the channels and of the pixels of the input and of the output
+struct DWStrides {
+    long int ics, ips, ocs, ops;
+
+    DWStrides(ConvolDescriptor *D) {
+        ics = D->channels_last_in ? 1 : (long int)D->ir * D->ic;
+        ips = D->channels_last_in ? D->iz : 1;
+        ocs = D->channels_last_out ? 1 : (long int)D->r * D->c;
+        ops = D->channels_last_out ? D->nk : 1;
+    }
+};
+
+// f(ky, kx, y, xa, xb, py, px): the output pixels (y, [xa, xb)) read the input
+// pixels (py, [px, px + (xb-xa)*sc)) with the kernel element (ky, kx) (dilated)
+template<typename F>
+static inline void dw_walk(ConvolDescriptor *D, const F &f) {
+    for (int ky = 0; ky < D->kr; ky++) {
+        int ya, yb;
+        dw_range(ky * D->dr, D->padrt, D->sr, D->ir, D->r, ya, yb);
+        for (int kx = 0; kx < D->kc; kx++) {
+            int xa, xb;
+            dw_range(kx * D->dc, D->padcl, D->sc, D->ic, D->c, xa, xb);
+            if (xb <= xa) continue;
+            for (int y = ya; y < yb; y++)
+                f(ky, kx, y, xa, xb, y * D->sr - D->padrt + ky * D->dr, xa * D->sc - D->padcl + kx * D->dc);
+        }
+    }
+}
+
+// Channels-last ***************************************************
+
+// Kernels (nk x kr x kc) => (kr x kc x nk), and back adding to K with inverse
+static void dw_kernels_t(ConvolDescriptor *D, const float *K, float *Kt, bool inverse) {
+    int ksize = D->kr * D->kc;
+    for (int o = 0; o < D->nk; o++)
+        for (int k = 0; k < ksize; k++) {
+            if (inverse) Kt[(long int)o * ksize + k] += K[(long int)k * D->nk + o];
+            else Kt[(long int)k * D->nk + o] = K[(long int)o * ksize + k];
+        }
+}
+
+// f(k, y, x, py, px): the output pixel (y, x) reads the input pixel (py, px)
+// with the kernel element k, for the output rows [ya, yb)
+template<typename F>
+static inline void dw_walk_cl(ConvolDescriptor *D, int ya, int yb, const F &f) {
+    for (int y = ya; y < yb; y++)
+        for (int ky = 0; ky < D->kr; ky++) {
+            int py = y * D->sr - D->padrt + ky * D->dr;
+            if (py < 0 || py >= D->ir) continue;
+            for (int kx = 0; kx < D->kc; kx++) {
+                int xa, xb;
+                dw_range(kx * D->dc, D->padcl, D->sc, D->ic, D->c, xa, xb);
+                for (int x = xa; x < xb; x++)
+                    f(ky * D->kc + kx, y, x, py, x * D->sc - D->padcl + kx * D->dc);
+            }
+        }
+}
+
+// y[o] += w[o] * x[o / m] for the channels o in [a, b)
+static inline void dw_axpy_cl(const float *w, const float *x, float *y, int a, int b, int m) {
+    if (m == 1) {
+        #pragma omp simd
+        for (int o = a; o < b; o++) y[o] += w[o] * x[o];
+    }
+    else for (int o = a; o < b; o++) y[o] += w[o] * x[o / m];
+}
+
+// y[o / m] += w[o] * x[o] for the channels o in [a, b)
+static inline void dw_axpy_cl_t(const float *w, const float *x, float *y, int a, int b, int m) {
+    if (m == 1) {
+        #pragma omp simd
+        for (int o = a; o < b; o++) y[o] += w[o] * x[o];
+    }
+    else for (int o = a; o < b; o++) y[o / m] += w[o] * x[o];
+}
+
+static void dw_conv2D_cl(ConvolDescriptor *D) {
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    int batch = D->I->shape[0];
+    std::vector<float> Kt((long int)ksize * D->nk);
+    dw_kernels_t(D, D->K->ptr, Kt.data(), false);
+
+    cpu_parallel_for(0, batch * D->r, cpu_grain((long int)D->c * D->nk * ksize), [&](long int ini, long int end) {
+        for (int t = ini; t < end; t++) {
+            int b = t / D->r, row = t % D->r;
+            const float *in = D->I->ptr + b * isize;
+            float *out = D->O->ptr + b * osize;
+
+            std::fill(out + (long int)row * D->c * D->nk, out + (long int)(row + 1) * D->c * D->nk, 0.0f);
+            dw_walk_cl(D, row, row + 1, [&](int k, int y, int x, int py, int px) {
+                dw_axpy_cl(Kt.data() + (long int)k * D->nk, in + ((long int)py * D->ic + px) * D->iz,
+                           out + ((long int)y * D->c + x) * D->nk, 0, D->nk, m);
+            });
+        }
+    });
+}
+
+static void dw_conv2D_grad_cl(ConvolDescriptor *D) {
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    long int gksize = D->gK->size;
+
+    // The rows of the batch are split in chunks (see conv_grad_chunks), each
+    // one accumulates its own transposed gK, added in the order of the chunks
+    int tasks = D->I->shape[0] * D->r;
+    int chunks = conv_grad_chunks(tasks, 1, gksize);
+    float *gKt = get_fmem(chunks * gksize, "cpu_depthwise_conv2D_grad");
+
+    cpu_parallel_for(0, chunks, 1, [&](long int ini, long int end) {
+        for (int ch = ini; ch < end; ch++) {
+            float *gk = gKt + ch * gksize;
+            std::fill(gk, gk + gksize, 0.0f);
+            for (int t = ch * tasks / chunks; t < (ch + 1) * tasks / chunks; t++) {
+                int b = t / D->r, row = t % D->r;
+                const float *in = D->I->ptr + b * isize;
+                const float *delta = D->D->ptr + b * osize;
+                dw_walk_cl(D, row, row + 1, [&](int k, int y, int x, int py, int px) {
+                    dw_axpy_cl(delta + ((long int)y * D->c + x) * D->nk, in + ((long int)py * D->ic + px) * D->iz,
+                               gk + (long int)k * D->nk, 0, D->nk, m);
+                });
+            }
+        }
+    });
+
+    if (chunks > 1) conv_grad_reduce(gKt, gKt + gksize, chunks, gksize);
+    dw_kernels_t(D, gKt, D->gK->ptr, true);
+    eddl_free(gKt);
+}
+
+static void dw_conv2D_back_cl(ConvolDescriptor *D) {
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    int batch = D->I->shape[0];
+    std::vector<float> Kt((long int)ksize * D->nk);
+    dw_kernels_t(D, D->K->ptr, Kt.data(), false);
+
+    // The pixels of a sample overlap: blocks of input channels of a sample for
+    // each thread, at least CPU_DW_CHANNELS of them
+    int blocks = std::max(1, std::min(D->iz / CPU_DW_CHANNELS, (cpu_split_threads() + batch - 1) / batch));
+
+    cpu_parallel_for(0, batch * blocks, 1, [&](long int ini, long int end) {
+        for (int t = ini; t < end; t++) {
+            int b = t / blocks;
+            int z0 = (t % blocks) * D->iz / blocks, z1 = (t % blocks + 1) * D->iz / blocks;
+            const float *delta = D->D->ptr + b * osize;
+            float *id = D->ID->ptr + b * isize;
+
+            dw_walk_cl(D, 0, D->r, [&](int k, int y, int x, int py, int px) {
+                dw_axpy_cl_t(Kt.data() + (long int)k * D->nk, delta + ((long int)y * D->c + x) * D->nk,
+                             id + ((long int)py * D->ic + px) * D->iz, z0 * m, z1 * m, m);
+            });
+        }
+    });
+}
+
+// Any layout ******************************************************
+
+void cpu_depthwise_conv2D(ConvolDescriptor *D) {
+    if (D->channels_last_in && D->channels_last_out) { dw_conv2D_cl(D); return; }
+    DWStrides s(D);
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    int batch = D->I->shape[0];
+
+    cpu_parallel_for(0, batch * D->nk, cpu_grain((long int)D->r * D->c * ksize), [&](long int ini, long int end) {
+        for (int t = ini; t < end; t++) {
+            int b = t / D->nk, o = t % D->nk;
+            const float *in = D->I->ptr + b * isize + (o / m) * s.ics;
+            float *out = D->O->ptr + b * osize + o * s.ocs;
+            const float *k = D->K->ptr + (long int)o * ksize;
+
+            for (long int p = 0; p < (long int)D->r * D->c; p++) out[p * s.ops] = 0.0f;
+            dw_walk(D, [&](int ky, int kx, int y, int xa, int xb, int py, int px) {
+                dw_axpy(k[ky * D->kc + kx], in + ((long int)py * D->ic + px) * s.ips, D->sc * s.ips,
+                        out + ((long int)y * D->c + xa) * s.ops, s.ops, xb - xa);
+            });
+        }
+    });
+}
+
+void cpu_depthwise_conv2D_grad(ConvolDescriptor *D) {
+    if (D->channels_last_in && D->channels_last_out) { dw_conv2D_grad_cl(D); return; }
+    DWStrides s(D);
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    int batch = D->I->shape[0];
+
+    // Each kernel is accumulated over the batch in order
+    cpu_parallel_for(0, D->nk, cpu_grain((long int)batch * D->r * D->c * ksize), [&](long int ini, long int end) {
+        for (int o = ini; o < end; o++) {
+            float *gk = D->gK->ptr + (long int)o * ksize;
+            for (int b = 0; b < batch; b++) {
+                const float *in = D->I->ptr + b * isize + (o / m) * s.ics;
+                const float *delta = D->D->ptr + b * osize + o * s.ocs;
+                dw_walk(D, [&](int ky, int kx, int y, int xa, int xb, int py, int px) {
+                    gk[ky * D->kc + kx] += dw_dot(delta + ((long int)y * D->c + xa) * s.ops, s.ops,
+                                                  in + ((long int)py * D->ic + px) * s.ips, D->sc * s.ips, xb - xa);
+                });
+            }
+        }
+    });
+}
+
+void cpu_depthwise_conv2D_back(ConvolDescriptor *D) {
+    if (D->channels_last_in && D->channels_last_out) { dw_conv2D_back_cl(D); return; }
+    DWStrides s(D);
+    int m = D->nk / D->groups, ksize = D->kr * D->kc;
+    long int isize = (long int)D->iz * D->ir * D->ic, osize = (long int)D->z * D->r * D->c;
+    int batch = D->I->shape[0];
+
+    // Each input channel adds the deltas of its m output channels
+    cpu_parallel_for(0, batch * D->iz, cpu_grain((long int)m * D->r * D->c * ksize), [&](long int ini, long int end) {
+        for (int t = ini; t < end; t++) {
+            int b = t / D->iz, zi = t % D->iz;
+            float *id = D->ID->ptr + b * isize + zi * s.ics;
+
+            for (int o = zi * m; o < (zi + 1) * m; o++) {
+                const float *delta = D->D->ptr + b * osize + o * s.ocs;
+                const float *k = D->K->ptr + (long int)o * ksize;
+                dw_walk(D, [&](int ky, int kx, int y, int xa, int xb, int py, int px) {
+                    dw_axpy(k[ky * D->kc + kx], delta + ((long int)y * D->c + xa) * s.ops, s.ops,
+                            id + ((long int)py * D->ic + px) * s.ips, D->sc * s.ips, xb - xa);
+                });
+            }
+        }
+    });
+}
@@ -13,166 +13,306 @@
 #include <cstdlib>     /* malloc, free, rand */
 #include <iostream>
 #include <limits>       // std::numeric_limits
+#include <algorithm>
 
 #include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
-float get_pixel(int b,int px,int py,int pz,PoolDescriptor *D,int isize,int irsize) {
+// Address of the pixel (b,pz,py,px) of the input, -1 outside of it. The
+// input is stored (b,z,r,c) or (b,r,c,z) (channels-last)
+static inline long int pool_address(int b,int px,int py,int pz,PoolDescriptor *D) {
   // Check boundaries of the window
-  if (px<0) return 0.0;
-  if (py<0) return 0.0;
-  if (px>=D->ic) return 0.0;
-  if (py>=D->ir) return 0.0;
+  if (px<0) return -1;
+  if (py<0) return -1;
+  if (px>=D->ic) return -1;
+  if (py>=D->ir) return -1;
 
   // Compute address from indices (row-major)
-  unsigned int address = (b*isize) + (pz*irsize) + (py*D->ic) + px;
-  return D->I->ptr[address];
+  long int isize = (long int)D->ir*D->ic*D->iz;
+  if (D->channels_last) return b*isize + ((long int)py*D->ic + px)*D->iz + pz;
+  return b*isize + (long int)pz*D->ir*D->ic + py*D->ic + px;
 }
 
-void add_pixel(int b,int px,int py,int pz,PoolDescriptor *D,int isize,int irsize,float val) {
-  // Check boundaries of the window
-  if (px<0) return;
-  if (py<0) return;
-  if (px>=D->ic) return;
-  if (py>=D->ir) return;
+static inline float get_pixel(int b,int px,int py,int pz,PoolDescriptor *D) {
+  long int address = pool_address(b, px, py, pz, D);
+  return (address<0) ? 0.0f : D->I->ptr[address];
+}
 
-  // Compute address from indices (row-major)
-  unsigned int address = (b*isize) + (pz*irsize) + (py*D->ic) + px;
-  D->ID->ptr[address]+=val;
+static inline void add_pixel(int b,int px,int py,int pz,PoolDescriptor *D,float val) {
+  long int address = pool_address(b, px, py, pz, D);
+  if (address>=0) D->ID->ptr[address]+=val;
+}
+
+// Depth and top-left corner of the window of the output t of a sample (in the
+// order of the output, so the channels are the innermost dim when channels-last)
+static inline void pool_window(int t,PoolDescriptor *D,int &k,int &i,int &j) {
+  int rc = D->r*D->c, q;
+  if (D->channels_last) { k = t % D->z; q = t / D->z; }
+  else { k = t / rc; q = t % rc; }
+  i = (q / D->c)*D->sr - D->padrt;
+  j = (q % D->c)*D->sc - D->padcl;
+}
+
+// Channels-last: the outputs of a pixel are its z contiguous channels, so
+// each window is walked once for all of them, reading runs of channels.
+// f(in, y, x): the window element (y, x) of the input pixels in (nullptr in
+// the padding), in the order of the window
+template<typename F>
+static inline void pool_walk_cl(PoolDescriptor *D,int b,int q,const F &f) {
+  long int isize = (long int)D->ir*D->ic*D->iz;
+  int i = (q / D->c)*D->sr - D->padrt, j = (q % D->c)*D->sc - D->padcl;
+  for(int y=i; y<i+D->kr; y++)
+  for(int x=j; x<j+D->kc; x++) {
+    bool inside = (y>=0 && y<D->ir && x>=0 && x<D->ic);
+    f(inside ? D->I->ptr + b*isize + ((long int)y*D->ic + x)*D->iz : nullptr, y, x);
+  }
+}
+
+static void mpool2D_cl(PoolDescriptor *D){
+    int rc = D->r*D->c;
+
+    cpu_parallel_for(0, D->I->shape[0]*rc, cpu_grain((long int)D->kr * D->kc * D->z), [&](long int ini, long int end) {
+        for(int t=ini; t<end; t++){  // Pixels of the batch
+            float *out = D->O->ptr + (long int)t*D->z;
+            float *ix = D->indX->ptr + (long int)t*D->z, *iy = D->indY->ptr + (long int)t*D->z;
+            float lowest = CPU_LOWEST_FLOAT;
+            std::fill(out, out+D->z, lowest);
+
+            pool_walk_cl(D, t / rc, t % rc, [&](const float *in, int y, int x) {
+                #pragma omp simd
+                for(int k=0; k<D->z; k++) {
+                    float v = in ? in[k] : 0.0f;
+                    bool gt = v>out[k];
+                    out[k] = gt ? v : out[k];
+                    ix[k] = gt ? (float)x : ix[k];
+                    iy[k] = gt ? (float)y : iy[k];
+                }
+            });
+        }
+    });
+}
+
+static void avgpool2D_cl(PoolDescriptor *D){
+    int rc = D->r*D->c;
+    float ksize = (float)(D->kr*D->kc);
+
+    cpu_parallel_for(0, D->I->shape[0]*rc, cpu_grain((long int)D->kr * D->kc * D->z), [&](long int ini, long int end) {
+        for(int t=ini; t<end; t++){  // Pixels of the batch
+            float *out = D->O->ptr + (long int)t*D->z;
+            std::fill(out, out+D->z, 0.0f);
+
+            pool_walk_cl(D, t / rc, t % rc, [&](const float *in, int y, int x) {
+                if (in == nullptr) return;
+                #pragma omp simd
+                for(int k=0; k<D->z; k++) out[k] += in[k];
+            });
+            for(int k=0; k<D->z; k++) out[k] /= ksize;
+        }
+    });
+}
+
+static void avgpool2D_back_cl(PoolDescriptor *D){
+    int rc = D->r*D->c;
+    float ksize = (float)(D->kr*D->kc);
+
+    // The windows of a sample may overlap: whole samples in each range
+    cpu_parallel_for(0, D->I->shape[0], 1, [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++){
+            for(int q=0; q<rc; q++) {
+                const float *delta = D->D->ptr + ((long int)b*rc + q)*D->z;
+                pool_walk_cl(D, b, q, [&](const float *in, int y, int x) {
+                    if (in == nullptr) return;
+                    float *id = D->ID->ptr + (in - D->I->ptr);
+                    #pragma omp simd
+                    for(int k=0; k<D->z; k++) id[k] += delta[k]/ksize;
+                });
+            }
+        }
+    });
 }
 
 void cpu_mpool2D(PoolDescriptor *D){
     _profile(_CPU_MPOOL2D, 0);
-    int isize = D->ir*D->ic*D->iz;
-    int irsize = D->ir*D->ic;
-
-    #pragma omp parallel for default(none) shared(D, isize, irsize)
-    for(int b=0; b<D->I->shape[0]; b++){  // Batches
-        int p=b*D->size;  // Kernel's index (opt. shared variable)
-
-        for(int k=0; k<D->iz; k++) { // Depth: front-back
-            for(int i=-D->padrt; i<=D->ir+D->padrb-D->kr; i+=D->sr) {  // rows: top-bottom
-                for(int j=-D->padcl; j<=D->ic+D->padcr-D->kc; j+=D->sc, p++) { // cols: left-right
-
-                    // Get max value in window
-                    float max = CPU_LOWEST_FLOAT;
-                    for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
-                        for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
-
-                            // Get value W[ki,kj] value in window
-                            float v = get_pixel(b,j+kj,i+ki, k, D, isize, irsize);
-                            if (v>max) {
-                                max = v;
-                                D->indX->ptr[p] = j+kj;
-                                D->indY->ptr[p] = i+ki;
-                            }
-
-                        } // kernel cols
-                    }  // kernel rows
-
-                    // Set output value
-                    D->O->ptr[p] = max;
-
-                } // cols
-            } // rows
-        } // depth
-    } // batch
+    if (D->channels_last) {
+        mpool2D_cl(D);
+        _profile(_CPU_MPOOL2D, 1);
+        return;
+    }
+
+    cpu_parallel_for(0, D->I->shape[0], cpu_grain((long int)D->size * D->kr * D->kc), [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++){  // Batches
+            for(int t=0; t<D->size; t++) {  // Outputs of the sample
+                int p=b*D->size+t;  // Kernel's index
+                int k, i, j;
+                pool_window(t, D, k, i, j);
+
+                // Get max value in window
+                float max = CPU_LOWEST_FLOAT;
+                for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
+                    for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
+
+                        // Get value W[ki,kj] value in window
+                        float v = get_pixel(b,j+kj,i+ki, k, D);
+                        if (v>max) {
+                            max = v;
+                            D->indX->ptr[p] = j+kj;
+                            D->indY->ptr[p] = i+ki;
+                        }
+
+                    } // kernel cols
+                }  // kernel rows
+
+                // Set output value
+                D->O->ptr[p] = max;
+            } // outputs
+        } // batch
+    });
     _profile(_CPU_MPOOL2D, 1);
 }
 
 void cpu_mpool2D_back(PoolDescriptor *D){
     _profile(_CPU_MPOOL2D_BACK, 0);
-    int isize = D->ir*D->ic*D->iz;
-    int irsize = D->ir*D->ic;
-
-    #pragma omp parallel for default(none) shared(D, isize, irsize)
-    for(int b=0; b<D->I->shape[0]; b++){  // Batches (ob=ib)
-        int p=b*D->size; // Kernel's index (opt. shared variable)
-
-        for(int k=0; k<D->iz; k++) { // Depth: front-back (oz=iz)
-            for(int i=-D->padrt; i<=D->ir+D->padrb-D->kr; i+=D->sr) {  // rows: top-bottom
-                for(int j=-D->padcl; j<=D->ic+D->padcr-D->kc; j+=D->sc, p++) { // cols: left-right
 
-                    int x = D->indX->ptr[p];  // previous: j+kj
-                    int y = D->indY->ptr[p];  // previous: i+ki
-                    add_pixel(b, x, y, k, D, isize, irsize, D->D->ptr[p]);  // Set input's delta
-
-                } // cols
-            } // rows
-        } // depth
-    } // batch
+    cpu_parallel_for(0, D->I->shape[0], cpu_grain(D->size), [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++){  // Batches (ob=ib)
+            for(int t=0; t<D->size; t++) {  // Outputs of the sample
+                int p=b*D->size+t;  // Kernel's index
+                int k, i, j;
+                pool_window(t, D, k, i, j);
+
+                int x = D->indX->ptr[p];  // previous: j+kj
+                int y = D->indY->ptr[p];  // previous: i+ki
+                add_pixel(b, x, y, k, D, D->D->ptr[p]);  // Set input's delta
+            } // outputs
+        } // batch
+    });
     _profile(_CPU_MPOOL2D_BACK, 1);
 }
 
+// The windows are clipped to the input volume, so the padding never wins. The
+// position of the max of each output is kept as (indX = col, indY = depth*ir + row)
 void cpu_mpool3D(PoolDescriptor3D *D){
-
+    _profile(_CPU_MPOOL3D, 0);
+    long int isize = (long int)D->id*D->ir*D->ic, osize = (long int)D->d*D->r*D->c;
+
+    cpu_parallel_for(0, D->I->shape[0]*D->z, cpu_grain(osize * D->kd * D->kr * D->kc), [&](long int ini, long int end) {
+        for(int t=ini; t<end; t++){  // Channels of the batch
+            const float *in = D->I->ptr + t*isize;
+            long int p = t*osize;  // Kernel's index
+
+            for(int w=0; w<D->d; w++)
+            for(int i=0; i<D->r; i++)
+            for(int j=0; j<D->c; j++, p++) {
+                int w0 = w*D->sd - D->paddf, i0 = i*D->sr - D->padrt, j0 = j*D->sc - D->padcl;
+                int w1 = std::min(w0+D->kd, D->id), i1 = std::min(i0+D->kr, D->ir), j1 = std::min(j0+D->kc, D->ic);
+                w0 = std::max(w0, 0); i0 = std::max(i0, 0); j0 = std::max(j0, 0);
+
+                // Get max value in window
+                float max = CPU_LOWEST_FLOAT;
+                int x = -1, y = -1;
+                for(int kw=w0; kw<w1; kw++)  // depth (kernel): front-back
+                for(int ki=i0; ki<i1; ki++) {  // rows (kernel): top-bottom
+                    const float *row = in + ((long int)kw*D->ir + ki)*D->ic;
+                    for(int kj=j0; kj<j1; kj++) {  // cols (kernel): left-right
+                        if (row[kj]>max) {
+                            max = row[kj];
+                            x = kj;
+                            y = kw*D->ir + ki;
+                        }
+                    }
+                }
+
+                // Set output value (0 for a window inside of the padding)
+                D->O->ptr[p] = (x<0) ? 0.0f : max;
+                D->indX->ptr[p] = x;
+                D->indY->ptr[p] = y;
+            } // outputs
+        } // channels
+    });
+    _profile(_CPU_MPOOL3D, 1);
 }
 
 void cpu_mpool3D_back(PoolDescriptor3D *D){
-
+    _profile(_CPU_MPOOL3D_BACK, 0);
+    long int isize = (long int)D->id*D->ir*D->ic, osize = (long int)D->d*D->r*D->c;
+
+    // The windows of a channel may overlap: whole channels in each range
+    cpu_parallel_for(0, D->I->shape[0]*D->z, cpu_grain(osize), [&](long int ini, long int end) {
+        for(int t=ini; t<end; t++){  // Channels of the batch
+            float *id = D->ID->ptr + t*isize;
+
+            for(long int p=t*osize; p<(t+1)*osize; p++) {
+                int x = D->indX->ptr[p];  // previous: col
+                int y = D->indY->ptr[p];  // previous: depth*ir + row
+                if (x>=0) id[(long int)y*D->ic + x] += D->D->ptr[p];  // Set input's delta
+            }
+        } // channels
+    });
+    _profile(_CPU_MPOOL3D_BACK, 1);
 }
 
 
 void cpu_avgpool2D(PoolDescriptor *D){
     _profile(_CPU_AVGPOOL2D, 0);
-    int isize = D->ir*D->ic*D->iz;
-    int irsize = D->ir*D->ic;
+    if (D->channels_last) {
+        avgpool2D_cl(D);
+        _profile(_CPU_AVGPOOL2D, 1);
+        return;
+    }
     int ksize = D->kr*D->kc;
 
-    #pragma omp parallel for default(none) shared(D, isize, irsize, ksize)
-    for(int b=0; b<D->I->shape[0]; b++){  // Batches
-        int p=b*D->size; // Kernel's index (opt. shared variable)
-
-        for(int k=0; k<D->iz; k++) { // Depth: front-back
-            for(int i=-D->padrt; i<=D->ir+D->padrb-D->kr; i+=D->sr) {  // rows: top-bottom
-                for(int j=-D->padcl; j<=D->ic+D->padcr-D->kc; j+=D->sc, p++) { // cols: left-right
-
-                    // Sum values window
-                    float sum = 0.0f;
-                    for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
-                        for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
-
-                            // Get value W[ki,kj] value in window
-                            float v = get_pixel(b,j+kj,i+ki, k, D, isize, irsize);
-                            sum += v;
-
-                        } // kernel cols
-                    }  // kernel rows
-
-                    // Set output value
-                    D->O->ptr[p]= sum/(float)ksize;
-
-                } // cols
-            } // rows
-        } // depth
-    } // batch
+    cpu_parallel_for(0, D->I->shape[0], cpu_grain((long int)D->size * ksize), [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++){  // Batches
+            for(int t=0; t<D->size; t++) {  // Outputs of the sample
+                int p=b*D->size+t;  // Kernel's index
+                int k, i, j;
+                pool_window(t, D, k, i, j);
+
+                // Sum values window
+                float sum = 0.0f;
+                for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
+                    for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
+
+                        // Get value W[ki,kj] value in window
+                        float v = get_pixel(b,j+kj,i+ki, k, D);
+                        sum += v;
+
+                    } // kernel cols
+                }  // kernel rows
+
+                // Set output value
+                D->O->ptr[p]= sum/(float)ksize;
+            } // outputs
+        } // batch
+    });
     _profile(_CPU_AVGPOOL2D, 1);
 }
 
 void cpu_avgpool2D_back(PoolDescriptor *D){
     _profile(_CPU_AVGPOOL2D_BACK, 0);
-    int isize = D->ir*D->ic*D->iz;
-    int irsize = D->ir*D->ic;
+    if (D->channels_last) {
+        avgpool2D_back_cl(D);
+        _profile(_CPU_AVGPOOL2D_BACK, 1);
+        return;
+    }
     int ksize = D->kr*D->kc;
 
-    #pragma omp parallel for default(none) shared(D, isize, irsize, ksize)
-    for(int b=0; b<D->I->shape[0]; b++){  // Batches
-        int p=b*D->size; // Kernel's index (opt. shared variable)
-
-        for(int k=0; k<D->iz; k++) { // Depth: front-back
-            for(int i=-D->padrt; i<=D->ir+D->padrb-D->kr; i+=D->sr) {  // rows: top-bottom
-                for(int j=-D->padcl; j<=D->ic+D->padcr-D->kc; j+=D->sc,p++) { // cols: left-right
-
-                    // Walk kernel window to equally distribute the delta among all the elements
-                    for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
-                        for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
-                            add_pixel(b, j + kj, i + ki, k, D, isize, irsize, D->D->ptr[p]/(float)ksize);
-                        } // kernel cols
-                    }  // kernel rows
-
-                } // cols
-            } // rows
-        } // depth
-    } // batch
+    cpu_parallel_for(0, D->I->shape[0], cpu_grain((long int)D->size * ksize), [&](long int ini, long int end) {
+        for(int b=ini; b<end; b++){  // Batches
+            for(int t=0; t<D->size; t++) {  // Outputs of the sample
+                int p=b*D->size+t;  // Kernel's index
+                int k, i, j;
+                pool_window(t, D, k, i, j);
+
+                // Walk kernel window to equally distribute the delta among all the elements
+                for(int ki=0; ki<D->kr; ki++){  // rows (kernel): top-bottom
+                    for(int kj=0; kj<D->kc; kj++) { // cols (kernel): left-right
+                        add_pixel(b, j + kj, i + ki, k, D, D->D->ptr[p]/(float)ksize);
+                    } // kernel cols
+                }  // kernel rows
+            } // outputs
+        } // batch
+    });
     _profile(_CPU_AVGPOOL2D_BACK, 1);
 }
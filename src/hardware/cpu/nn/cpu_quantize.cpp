@@ -0,0 +1,151 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+// Int8 inference: symmetric quantization (zero point 0) in [-127, 127],
+// int32 accumulation and one scale per output channel for the weights
+
+
+static inline int8_t quantize(float x, float inv){
+    float q = std::nearbyint(x * inv);
+    if (q > 127.0f) q = 127.0f;
+    else if (q < -127.0f) q = -127.0f;
+    return (int8_t)q;
+}
+
+void cpu_quantize_int8(const float *src, int8_t *dst, unsigned long int n, float scale){
+    float inv = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+
+    cpu_parallel_for(0, n, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; i++) dst[i] = quantize(src[i], inv);
+    });
+}
+
+void cpu_dense_int8(Tensor *A, float a_scale, const int8_t *Wq, const float *Wq_scale, Tensor *C){
+    // C = A*W, with Wq the transposed W (outputs x inputs), by blocks of rows
+    // of A x outputs (the tasks of a block of outputs share it in cache)
+    int m = A->shape[0];
+    int k = A->shape[1];
+    int n = C->shape[1];
+    int mb = (m + CPU_INT8_BLOCK - 1) / CPU_INT8_BLOCK;
+    int nb = (n + CPU_INT8_BLOCK - 1) / CPU_INT8_BLOCK;
+
+    std::vector<int8_t> Aq((unsigned long int)m * k);
+    std::vector<int32_t> acc((unsigned long int)m * n);
+    cpu_quantize_int8(A->ptr, Aq.data(), Aq.size(), a_scale);
+
+    cpu_parallel_for(0, mb * nb, 1, [&](long int ini, long int end) {
+        for (int t = ini; t < end; t++) {
+            int i0 = (t % mb) * CPU_INT8_BLOCK, i1 = std::min(m, i0 + CPU_INT8_BLOCK);
+            int j0 = (t / mb) * CPU_INT8_BLOCK, j1 = std::min(n, j0 + CPU_INT8_BLOCK);
+            cpu_vgemm_int8(Aq.data() + (unsigned long int)i0 * k, k, Wq + (unsigned long int)j0 * k, k,
+                           acc.data() + (unsigned long int)i0 * n + j0, n, i1 - i0, j1 - j0, k);
+
+            for (int i = i0; i < i1; i++)
+                for (int j = j0; j < j1; j++) {
+                    unsigned long int ij = (unsigned long int)i * n + j;
+                    C->ptr[ij] = (float)acc[ij] * a_scale * Wq_scale[j];
+                }
+        }
+    });
+}
+
+void cpu_conv2D_int8(ConvolDescriptor *D, float i_scale, const int8_t *Kq, const float *Kq_scale){
+    // The input is quantized once to channels-last (r,c,z), so the patches are
+    // runs of kz channels (as in im2col_tile_cl), and the kernels are permuted
+    // to the same (kr,kc,z) order. Each tile of output rows of a group is then
+    // one int8 product of kernels x patches
+    int batch = D->I->shape[0];
+    int rcsize = D->ir * D->ic;
+    int isize = D->iz * rcsize;
+    int orsize = D->r * D->c;
+    int osize = D->z * orsize;
+    int kk = D->kr * D->kc;
+    int ksize = kk * D->kz;
+    int nkg = D->nk / D->groups;
+    float inv = (i_scale > 0.0f) ? 1.0f / i_scale : 0.0f;
+
+    std::vector<int8_t> Iq((unsigned long int)batch * isize);
+    if (D->channels_last_in) {
+        cpu_quantize_int8(D->I->ptr, Iq.data(), Iq.size(), i_scale);
+    } else {
+        // By blocks of pixels (the threads write apart)
+        int blocks = (rcsize + 63) / 64;
+        cpu_parallel_for(0, batch * blocks, cpu_grain((long int)64 * D->iz), [&](long int ini, long int end) {
+            for (int t = ini; t < end; t++) {
+                int b = t / blocks;
+                int p0 = (t % blocks) * 64, p1 = std::min(rcsize, p0 + 64);
+                const float *I = D->I->ptr + (unsigned long int)b * isize;
+                int8_t *Q = Iq.data() + (unsigned long int)b * isize;
+                for (int z = 0; z < D->iz; z++)
+                    for (int p = p0; p < p1; p++) Q[(unsigned long int)p * D->iz + z] = quantize(I[(unsigned long int)z * rcsize + p], inv);
+            }
+        });
+    }
+
+    std::vector<int8_t> Kp((unsigned long int)D->nk * ksize);
+    for (int o = 0; o < D->nk; o++)
+        for (int z = 0; z < D->kz; z++)
+            for (int k = 0; k < kk; k++)
+                Kp[(unsigned long int)o * ksize + k * D->kz + z] = Kq[(unsigned long int)o * ksize + z * kk + k];
+
+    // Tiles of output rows with all the channels of a group
+    int rows, chans;
+    conv_tiles(D, true, rows, chans);
+    int tiles = (D->r + rows - 1) / rows;
+
+    cpu_parallel_for(0, batch * tiles, 1, [&](long int ini, long int end) {
+        std::vector<int8_t> P((unsigned long int)rows * D->c * ksize);
+        std::vector<int32_t> acc((unsigned long int)nkg * rows * D->c);
+
+        for (int t = ini; t < end; t++) {
+            int b = t / tiles;
+            int r0 = (t % tiles) * rows, r1 = std::min(D->r, r0 + rows);
+            int n = (r1 - r0) * D->c;
+            // Output o of the pixel p at ptrO[o * os + p * ps] (channels-last: (r,c,z))
+            long int os = D->channels_last_out ? 1 : orsize, ps = D->channels_last_out ? D->nk : 1;
+            float *ptrO = D->O->ptr + (b * osize) + r0 * D->c * ps;
+            const int8_t *I = Iq.data() + (unsigned long int)b * isize;
+
+            for (int g = 0; g < D->groups; g++) {
+                // The patch of the pixel p in P[p*ksize] (0 out of the image)
+                int8_t *dst = P.data();
+                for (int y = r0; y < r1; y++)
+                    for (int x = 0; x < D->c; x++)
+                        for (int k = 0; k < kk; k++, dst += D->kz) {
+                            int py = y * D->sr - D->padrt + (k / D->kc) * D->dr;
+                            int px = x * D->sc - D->padcl + (k % D->kc) * D->dc;
+                            if (py < 0 || py >= D->ir || px < 0 || px >= D->ic) memset(dst, 0, D->kz);
+                            else memcpy(dst, I + ((unsigned long int)py * D->ic + px) * D->iz + g * D->kz, D->kz);
+                        }
+
+                // acc[o * n + p]: kernels of the group x patches
+                cpu_vgemm_int8(Kp.data() + (unsigned long int)g * nkg * ksize, ksize, P.data(), ksize, acc.data(), n, nkg, n, ksize);
+
+                for (int o = g * nkg; o < (g + 1) * nkg; o++) {
+                    const int32_t *a = acc.data() + (unsigned long int)(o - g * nkg) * n;
+                    float s = i_scale * Kq_scale[o];
+                    float bias = D->use_bias ? D->bias->ptr[o] : 0.0f;
+                    float *out = ptrO + o * os;
+                    for (int p = 0; p < n; p++) out[p * ps] = (float)a[p] * s + bias;
+                }
+            }
+        }
+    });
+}
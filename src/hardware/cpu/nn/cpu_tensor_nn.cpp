@@ -8,23 +8,26 @@
 */
 
 #include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 void cpu_repeat_nn(Tensor *A, Tensor *B, vector<int> size){
     _profile(_CPU_REPEAT_NN, 0);
     // TODO: Should be for N dimensions, not 2 (...and generic, not just NN)
-#pragma omp parallel for
-    for(int i=0; i<B->size; i++){
-        // Get row/col of Tensor B
-        int row_b = i/B->shape[2+1];  // (batch, channels, rows), cols
-        int col_b = i%B->shape[2+1]; // (batch, channels, rows), cols
-
-        // Translate row/col of Tensor B to Tensor A
-        int row_a = row_b/size[0];
-        int col_a = col_b/size[1];
-        int offset_a = row_a*A->shape[2+1] + col_a;
-
-        B->ptr[i] = A->ptr[offset_a];
-    }
+    cpu_parallel_for(0, B->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            // Get row/col of Tensor B
+            int row_b = i/B->shape[2+1];  // (batch, channels, rows), cols
+            int col_b = i%B->shape[2+1]; // (batch, channels, rows), cols
+
+            // Translate row/col of Tensor B to Tensor A
+            int row_a = row_b/size[0];
+            int col_a = col_b/size[1];
+            int offset_a = row_a*A->shape[2+1] + col_a;
+
+            B->ptr[i] = A->ptr[offset_a];
+        }
+    });
     _profile(_CPU_REPEAT_NN, 1);
 
 }
@@ -34,56 +37,93 @@ void cpu_d_repeat_nn(Tensor *D, Tensor *A, vector<int> size){
     // TODO: Should be for N dimensions, not 2 (...and generic, not just NN)
     ////#pragma omp parallel for
 
-#pragma omp parallel for
-    for(int i=0; i<D->size; i++){
-        // Get row/col of Tensor B
-        int row_d = i/D->shape[2+1];  // (batch, channels, rows), cols
-        int col_d = i%D->shape[2+1];  // (batch, channels, rows), cols
+    cpu_parallel_for(0, D->size, CPU_GRAIN, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; ++i) {
+            // Get row/col of Tensor B
+            int row_d = i/D->shape[2+1];  // (batch, channels, rows), cols
+            int col_d = i%D->shape[2+1];  // (batch, channels, rows), cols
 
-        // Translate row/col of Tensor B to Tensor A
-        int row_a = row_d/size[0];
-        int col_a = col_d/size[1];
-        int offset_a = row_a*A->shape[2+1] + col_a;
+            // Translate row/col of Tensor B to Tensor A
+            int row_a = row_d/size[0];
+            int col_a = col_d/size[1];
+            int offset_a = row_a*A->shape[2+1] + col_a;
 
-        A->ptr[offset_a] += D->ptr[i];
-    }
+            A->ptr[offset_a] += D->ptr[i];
+        }
+    });
     _profile(_CPU_D_REPEAT_NN, 1);
 
 }
 
 
+// The batch stays in place
+static vector<int> batch_dims(PermuteDescriptor *pd) {
+    vector<int> dims = {0};
+    for (auto d : pd->dims) dims.push_back(d + 1);
+    return dims;
+}
+
+// The descriptor is a strided view of one sample: walk it by runs (see SelDescriptor::build_view)
 void cpu_select_nn(Tensor *A, Tensor *B, SelDescriptor *sd){
-    #pragma omp parallel for
-    for (int b = 0; b < B->shape[0]; b++) {
-        for (int i = 0; i < B->stride[0]; i++) {
-            B->ptr[b*B->stride[0] + i] = A->ptr[b*A->stride[0] + sd->cpu_addresses[i]];
-        }
+    auto *pd = dynamic_cast<PermuteDescriptor*>(sd);
+    if (pd != nullptr) {
+        cpu_permute(A->ptr, A->shape, batch_dims(pd), B->ptr);
+        return;
     }
+
+    int rs = sd->run_size;
+    int runs = B->stride[0] / rs;
+    cpu_parallel_for(0, B->shape[0] * runs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int k = ini; k < end; ++k) {
+            int b = k / runs;
+            float *pa = A->ptr + b*A->stride[0] + sd->run_address(k % runs);
+            float *pb = B->ptr + k * rs;
+            for (int i = 0; i < rs; i++) pb[i] = pa[i];
+        }
+    });
 }
 
 void cpu_select_back_nn(Tensor *A, Tensor *B, SelDescriptor *sd){
-    #pragma omp parallel for
-    for (int b = 0; b < A->shape[0]; b++) {
-        for (int i = 0; i < A->stride[0]; i++) {  // walk stride
-            B->ptr[b*B->stride[0] + sd->cpu_addresses[i]] += A->ptr[b*A->stride[0] + i];  // delta_parent += delta
-        }
+    auto *pd = dynamic_cast<PermuteDescriptor*>(sd);
+    if (pd != nullptr) {
+        cpu_permute_back(A->ptr, B->shape, batch_dims(pd), B->ptr);
+        return;
     }
+
+    int rs = sd->run_size;
+    int runs = A->stride[0] / rs;
+    cpu_parallel_for(0, A->shape[0] * runs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int k = ini; k < end; ++k) {  // walk stride
+            int b = k / runs;
+            float *pa = A->ptr + k * rs;
+            float *pb = B->ptr + b*B->stride[0] + sd->run_address(k % runs);
+            for (int i = 0; i < rs; i++) pb[i] += pa[i];  // delta_parent += delta
+        }
+    });
 }
 
 void cpu_set_select_nn(Tensor *A, Tensor *B, SelDescriptor *sd){
-   #pragma omp parallel for
-    for (int b = 0; b < B->shape[0]; b++) {
-        for (int i = 0; i < B->stride[0]; i++) {
-            A->ptr[b*A->stride[0] + sd->cpu_addresses[i]] = B->ptr[b*B->stride[0] + i];
+    int rs = sd->run_size;
+    int runs = B->stride[0] / rs;
+    cpu_parallel_for(0, B->shape[0] * runs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int k = ini; k < end; ++k) {
+            int b = k / runs;
+            float *pa = A->ptr + b*A->stride[0] + sd->run_address(k % runs);
+            float *pb = B->ptr + k * rs;
+            for (int i = 0; i < rs; i++) pa[i] = pb[i];
         }
-    }
+    });
 }
 
 void cpu_set_select_back_nn(Tensor *A, Tensor *B, SelDescriptor *sd){
-   #pragma omp parallel for
-    for (int b = 0; b < B->shape[0]; b++) {
-        for (int i = 0; i < B->stride[0]; i++) {
-            B->ptr[b*B->stride[0] + i] += A->ptr[b*A->stride[0] + sd->cpu_addresses[i]];
+    int rs = sd->run_size;
+    int runs = B->stride[0] / rs;
+    cpu_parallel_for(0, B->shape[0] * runs, cpu_grain(rs), [&](long int ini, long int end) {
+        for (long int k = ini; k < end; ++k) {
+            int b = k / runs;
+            float *pa = A->ptr + b*A->stride[0] + sd->run_address(k % runs);
+            float *pb = B->ptr + k * rs;
+            for (int i = 0; i < rs; i++) pb[i] += pa[i];
         }
-    }
+    });
 }
\ No newline at end of file
@@ -0,0 +1,367 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#include <algorithm>
+
+#include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+// CPU: Winograd convolution ****************************************
+// F(mxm,3x3): each tile of m x m outputs is computed from the (m+2)x(m+2)
+// input tile d and the 3x3 kernel g as Y = A^T [(G g G^T) .* (B^T d B)] A.
+// Summed over the input channels, the products at each of the (m+2)^2
+// positions of the tiles are a GEMM (tiles x kz) * (kz x nk).
+// F(2x2,3x3) does 16 products for 4 outputs (36 with im2col) and
+// F(4x4,3x3) 36 for 16 outputs (144).
+//
+// The gradients are the transposed transforms:
+//   - Input: a forward pass over the delta with the kernels flipped and
+//     their channels swapped.
+//   - Kernels: G^T [(A dY A^T) .* (B^T d B)] G summed over the tiles.
+//
+// Workspace: D->ptrW holds the transformed kernels (or their gradient, see
+// ConvolDescriptor::build). The tiles of a sample are transformed by blocks
+// of about CPU_WINOGRAD_TILE floats in a workspace of each range, so the
+// memory does not depend on the batch.
+
+static const float wino2_BT[4 * 4] = {
+    1,  0, -1,  0,
+    0,  1,  1,  0,
+    0, -1,  1,  0,
+    0,  1,  0, -1
+};
+static const float wino2_G[4 * 3] = {
+    1.0f,  0.0f, 0.0f,
+    0.5f,  0.5f, 0.5f,
+    0.5f, -0.5f, 0.5f,
+    0.0f,  0.0f, 1.0f
+};
+static const float wino2_AT[2 * 4] = {
+    1, 1,  1,  0,
+    0, 1, -1, -1
+};
+
+static const float wino4_BT[6 * 6] = {
+    4,  0, -5,  0, 1, 0,
+    0, -4, -4,  1, 1, 0,
+    0,  4, -4, -1, 1, 0,
+    0, -2, -1,  2, 1, 0,
+    0,  2, -1, -2, 1, 0,
+    0,  4,  0, -5, 0, 1
+};
+static const float wino4_G[6 * 3] = {
+     1.0f / 4,         0,        0,
+    -1.0f / 6, -1.0f / 6, -1.0f / 6,
+    -1.0f / 6,  1.0f / 6, -1.0f / 6,
+    1.0f / 24, 1.0f / 12,  1.0f / 6,
+    1.0f / 24, -1.0f / 12, 1.0f / 6,
+            0,         0,        1
+};
+static const float wino4_AT[4 * 6] = {
+    1, 1,  1, 1,  1, 0,
+    0, 1, -1, 2, -2, 0,
+    0, 1,  1, 4,  4, 0,
+    0, 1, -1, 8, -8, 1
+};
+
+// Y = L X L^T, with L (P x Q) and X (Q x Q)
+template<int P, int Q>
+static inline void wino_sandwich(const float *L, const float *X, float *Y) {
+    float T[P * Q];
+    for (int i = 0; i < P; i++)
+        for (int j = 0; j < Q; j++) {
+            float s = 0.0f;
+            for (int k = 0; k < Q; k++) s += L[i * Q + k] * X[k * Q + j];
+            T[i * Q + j] = s;
+        }
+    for (int i = 0; i < P; i++)
+        for (int j = 0; j < P; j++) {
+            float s = 0.0f;
+            for (int k = 0; k < Q; k++) s += T[i * Q + k] * L[j * Q + k];
+            Y[i * P + j] = s;
+        }
+}
+
+// Y = L^T X L, with L (P x Q) and X (P x P)
+template<int P, int Q>
+static inline void wino_sandwich_t(const float *L, const float *X, float *Y) {
+    float T[Q * P];
+    for (int i = 0; i < Q; i++)
+        for (int j = 0; j < P; j++) {
+            float s = 0.0f;
+            for (int k = 0; k < P; k++) s += L[k * Q + i] * X[k * P + j];
+            T[i * P + j] = s;
+        }
+    for (int i = 0; i < Q; i++)
+        for (int j = 0; j < Q; j++) {
+            float s = 0.0f;
+            for (int k = 0; k < P; k++) s += T[i * P + k] * L[k * Q + j];
+            Y[i * Q + j] = s;
+        }
+}
+
+template<int M>
+struct Winograd {
+    static const int A = M + 2;
+    static const float *BT() { return (M == 2) ? wino2_BT : wino4_BT; }
+    static const float *G() { return (M == 2) ? wino2_G : wino4_G; }
+    static const float *AT() { return (M == 2) ? wino2_AT : wino4_AT; }
+
+    // Kernels (nk x kz x 3 x 3) => U[pos] (kz x nk), or (nk x kz) flipped for the back
+    static void kernels(const float *K, int nk, int kz, bool back, float *U) {
+        long int n = (long int)nk * kz;
+        cpu_parallel_for(0, n, cpu_grain(A * A * 9), [&](long int ini, long int end) {
+            for (long int i = ini; i < end; i++) {
+                int co = i / kz, ci = i % kz;
+                float g[9], u[A * A];
+                for (int k = 0; k < 9; k++) g[k] = K[i * 9 + (back ? 8 - k : k)];
+                wino_sandwich<A, 3>(G(), g, u);
+                long int o = back ? (long int)ci * nk + co : i;
+                for (int p = 0; p < A * A; p++) U[p * n + o] = u[p];
+            }
+        });
+    }
+
+    // Input (z x h x w, or h x w x z if cl) => V[pos] (tiles x z) for the
+    // tiles [t0, t1). The tile t = ty*tw+tx starts at the row ty*M-padt and
+    // the column tx*M-padl
+    static void input(const float *in, int z, int h, int w, bool cl, int padt, int padl, int tw, int t0, int t1, float *V) {
+        long int T = t1 - t0, n = T * z;
+        long int cs = cl ? 1 : (long int)h * w, ps = cl ? z : 1;
+        float d[A * A], v[A * A];
+        for (int ci = 0; ci < z; ci++) {
+            const float *src = in + ci * cs;
+            for (int t = t0; t < t1; t++) {
+                int ty = t / tw, tx = t % tw;
+                for (int i = 0; i < A; i++) {
+                    int y = ty * M - padt + i;
+                    for (int j = 0; j < A; j++) {
+                        int x = tx * M - padl + j;
+                        d[i * A + j] = (y >= 0 && y < h && x >= 0 && x < w) ? src[(y * w + x) * ps] : 0.0f;
+                    }
+                }
+                wino_sandwich<A, A>(BT(), d, v);
+                long int o = (long int)ci * T + t - t0;
+                for (int p = 0; p < A * A; p++) V[p * n + o] = v[p];
+            }
+        }
+    }
+
+    // Products R[pos] (tiles x z) of the tiles [t0, t1) => output (z x h x w,
+    // or h x w x z if cl), written or added
+    static void output(const float *R, int z, int tw, int t0, int t1, float *out, int h, int w, bool cl, bool inc) {
+        long int T = t1 - t0, n = T * z;
+        long int cs = cl ? 1 : (long int)h * w, ps = cl ? z : 1;
+        float m[A * A], y[M * M];
+        for (int co = 0; co < z; co++) {
+            float *dst = out + co * cs;
+            for (int t = t0; t < t1; t++) {
+                int ty = t / tw, tx = t % tw;
+                long int o = (long int)co * T + t - t0;
+                for (int p = 0; p < A * A; p++) m[p] = R[p * n + o];
+                wino_sandwich<M, A>(AT(), m, y);
+                int ni = std::min(M, h - ty * M), nj = std::min(M, w - tx * M);
+                for (int i = 0; i < ni; i++)
+                    for (int j = 0; j < nj; j++) {
+                        float &r = dst[((ty * M + i) * w + tx * M + j) * ps];
+                        r = inc ? r + y[i * M + j] : y[i * M + j];
+                    }
+            }
+        }
+    }
+
+    // Delta of the output (z x h x w, or h x w x z if cl) => R[pos] (tiles x z)
+    // for the tiles [t0, t1), the transpose of output()
+    static void output_t(const float *delta, int z, int h, int w, bool cl, int tw, int t0, int t1, float *R) {
+        long int T = t1 - t0, n = T * z;
+        long int cs = cl ? 1 : (long int)h * w, ps = cl ? z : 1;
+        float dy[M * M], m[A * A];
+        for (int co = 0; co < z; co++) {
+            const float *src = delta + co * cs;
+            for (int t = t0; t < t1; t++) {
+                int ty = t / tw, tx = t % tw;
+                for (int i = 0; i < M; i++)
+                    for (int j = 0; j < M; j++) {
+                        int y = ty * M + i, x = tx * M + j;
+                        dy[i * M + j] = (y < h && x < w) ? src[(y * w + x) * ps] : 0.0f;
+                    }
+                wino_sandwich_t<M, A>(AT(), dy, m);
+                long int o = (long int)co * T + t - t0;
+                for (int p = 0; p < A * A; p++) R[p * n + o] = m[p];
+            }
+        }
+    }
+
+    // Gradients of the transformed kernels dU[pos] (kz x nk) => gK (nk x kz x 3 x 3), added
+    static void kernels_t(const float *dU, int nk, int kz, float *gK) {
+        long int n = (long int)nk * kz;
+        cpu_parallel_for(0, n, cpu_grain(A * A * 9), [&](long int ini, long int end) {
+            for (long int i = ini; i < end; i++) {
+                float du[A * A], dg[9];
+                for (int p = 0; p < A * A; p++) du[p] = dU[p * n + i];
+                wino_sandwich_t<A, 3>(G(), du, dg);
+                for (int k = 0; k < 9; k++) gK[i * 9 + k] += dg[k];
+            }
+        });
+    }
+};
+
+// Products of the transformed input V[pos] (T x zi) and kernels U[pos] (zi x zo)
+static void wino_gemm(int A2, const float *V, const float *U, float *R, long int T, int zi, int zo) {
+    for (int p = 0; p < A2; p++) {
+        Eigen::Map<const Eigen::MatrixXf> matV(V + p * T * zi, T, zi);
+        Eigen::Map<const Eigen::MatrixXf> matU(U + (long int)p * zi * zo, zi, zo);
+        Eigen::Map<Eigen::MatrixXf> matR(R + p * T * zo, T, zo);
+        matR.noalias() = matV * matU;
+    }
+}
+
+// Tiles of the output and of the input
+static void wino_tiles(ConvolDescriptor *D, int &th, int &tw, int &thb, int &twb) {
+    int m = D->winograd;
+    th = (D->r + m - 1) / m;   tw = (D->c + m - 1) / m;
+    thb = (D->ir + m - 1) / m; twb = (D->ic + m - 1) / m;
+}
+
+// Blocks of the tiles of a sample, about the same size, so that their
+// transforms (A2 x tiles x (zi + zo)) take at most CPU_WINOGRAD_TILE floats
+static int wino_blocks(int A2, int zsum, int tiles, int &blocks) {
+    long int tb = std::max(1L, std::min((long int)tiles, (long int)CPU_WINOGRAD_TILE / ((long int)A2 * zsum)));
+    blocks = (tiles + tb - 1) / tb;
+    return (tiles + blocks - 1) / blocks;
+}
+
+unsigned long int cpu_winograd_size(ConvolDescriptor *D) {
+    unsigned long int A2 = (D->winograd + 2) * (D->winograd + 2);
+    return A2 * D->kz * D->nk;
+}
+
+template<int M>
+static void wino_conv2D(ConvolDescriptor *D) {
+    const int A2 = Winograd<M>::A * Winograd<M>::A;
+    int th, tw, thb, twb, blocks;
+    wino_tiles(D, th, tw, thb, twb);
+    int tb = wino_blocks(A2, D->kz + D->nk, th * tw, blocks);
+    float *U = D->ptrW;
+
+    Winograd<M>::kernels(D->K->ptr, D->nk, D->kz, false, U);
+
+    cpu_parallel_gemm_for(0, D->I->shape[0] * blocks, 1, [&](long int ini, long int end) {
+        float *V = get_fmem((long int)A2 * tb * (D->kz + D->nk), "cpu_winograd_conv2D");
+
+        for (int t = ini; t < end; t++) {
+            int b = t / blocks;
+            int t0 = (t % blocks) * tb, t1 = std::min(th * tw, t0 + tb);
+            long int T = t1 - t0;
+            float *R = V + A2 * T * D->kz;
+            Winograd<M>::input(D->I->ptr + (long int)b * D->iz * D->ir * D->ic, D->kz, D->ir, D->ic,
+                               D->channels_last_in, D->padrt, D->padcl, tw, t0, t1, V);
+            wino_gemm(A2, V, U, R, T, D->kz, D->nk);
+            Winograd<M>::output(R, D->nk, tw, t0, t1, D->O->ptr + (long int)b * D->z * D->r * D->c, D->r, D->c,
+                                D->channels_last_out, false);
+        }
+
+        eddl_free(V);
+    });
+}
+
+template<int M>
+static void wino_conv2D_grad(ConvolDescriptor *D) {
+    const int A2 = Winograd<M>::A * Winograd<M>::A;
+    int th, tw, thb, twb, blocks;
+    wino_tiles(D, th, tw, thb, twb);
+    int tb = wino_blocks(A2, D->kz + D->nk, th * tw, blocks);
+    long int usize = cpu_winograd_size(D);
+    int tasks = D->I->shape[0] * blocks;
+    int chunks = conv_grad_chunks(tasks, 1, usize);
+    float *part = (chunks > 1) ? get_fmem((chunks - 1) * usize, "cpu_winograd_conv2D_grad") : nullptr;
+
+    // The blocks of the batch are split in chunks (see conv_grad_chunks), each
+    // one accumulates its own dU, added in the order of the chunks
+    cpu_parallel_gemm_for(0, chunks, 1, [&](long int ini, long int end) {
+        float *V = get_fmem((long int)A2 * tb * (D->kz + D->nk), "cpu_winograd_conv2D_grad");
+
+        for (int ch = ini; ch < end; ch++) {
+            float *dU = (ch == 0) ? D->ptrW : part + (ch - 1) * usize;
+            std::fill(dU, dU + usize, 0.0f);
+
+            for (int t = ch * tasks / chunks; t < (ch + 1) * tasks / chunks; t++) {
+                int b = t / blocks;
+                int t0 = (t % blocks) * tb, t1 = std::min(th * tw, t0 + tb);
+                long int T = t1 - t0;
+                float *R = V + A2 * T * D->kz;
+                Winograd<M>::input(D->I->ptr + (long int)b * D->iz * D->ir * D->ic, D->kz, D->ir, D->ic,
+                                   D->channels_last_in, D->padrt, D->padcl, tw, t0, t1, V);
+                Winograd<M>::output_t(D->D->ptr + (long int)b * D->z * D->r * D->c, D->nk, D->r, D->c,
+                                      D->channels_last_out, tw, t0, t1, R);
+
+                for (int p = 0; p < A2; p++) {
+                    Eigen::Map<Eigen::MatrixXf> matdU(dU + (long int)p * D->kz * D->nk, D->kz, D->nk);
+                    Eigen::Map<Eigen::MatrixXf> matV(V + p * T * D->kz, T, D->kz);
+                    Eigen::Map<Eigen::MatrixXf> matR(R + p * T * D->nk, T, D->nk);
+                    matdU.noalias() += matV.transpose() * matR;
+                }
+            }
+        }
+
+        eddl_free(V);
+    });
+
+    if (chunks > 1) {
+        conv_grad_reduce(D->ptrW, part, chunks, usize);
+        eddl_free(part);
+    }
+
+    Winograd<M>::kernels_t(D->ptrW, D->nk, D->kz, D->gK->ptr);
+}
+
+template<int M>
+static void wino_conv2D_back(ConvolDescriptor *D) {
+    const int A2 = Winograd<M>::A * Winograd<M>::A;
+    int th, tw, thb, twb, blocks;
+    wino_tiles(D, th, tw, thb, twb);
+    int tb = wino_blocks(A2, D->kz + D->nk, thb * twb, blocks);
+    float *U = D->ptrW;
+
+    // Delta of the output padded with kr-1-padrt rows and kc-1-padcl cols
+    Winograd<M>::kernels(D->K->ptr, D->nk, D->kz, true, U);
+
+    cpu_parallel_gemm_for(0, D->I->shape[0] * blocks, 1, [&](long int ini, long int end) {
+        float *V = get_fmem((long int)A2 * tb * (D->kz + D->nk), "cpu_winograd_conv2D_back");
+
+        for (int t = ini; t < end; t++) {
+            int b = t / blocks;
+            int t0 = (t % blocks) * tb, t1 = std::min(thb * twb, t0 + tb);
+            long int T = t1 - t0;
+            float *R = V + A2 * T * D->nk;
+            Winograd<M>::input(D->D->ptr + (long int)b * D->z * D->r * D->c, D->nk, D->r, D->c,
+                               D->channels_last_out, 2 - D->padrt, 2 - D->padcl, twb, t0, t1, V);
+            wino_gemm(A2, V, U, R, T, D->nk, D->kz);
+            Winograd<M>::output(R, D->kz, twb, t0, t1, D->ID->ptr + (long int)b * D->iz * D->ir * D->ic, D->ir, D->ic,
+                                D->channels_last_in, true);
+        }
+
+        eddl_free(V);
+    });
+}
+
+void cpu_winograd_conv2D(ConvolDescriptor *D) {
+    if (D->winograd == 4) wino_conv2D<4>(D);
+    else wino_conv2D<2>(D);
+}
+
+void cpu_winograd_conv2D_grad(ConvolDescriptor *D) {
+    if (D->winograd == 4) wino_conv2D_grad<4>(D);
+    else wino_conv2D_grad<2>(D);
+}
+
+void cpu_winograd_conv2D_back(ConvolDescriptor *D) {
+    if (D->winograd == 4) wino_conv2D_back<4>(D);
+    else wino_conv2D_back<2>(D);
+}
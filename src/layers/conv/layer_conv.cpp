@@ -11,8 +11,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "eddl/layers/conv/layer_conv.h"
+#include "eddl/layers/core/layer_core.h"
 
 using namespace std;
 
@@ -54,6 +57,12 @@ LConv::LConv(Layer *parent, ConvolDescriptor *D, string name, int dev, int mem)
     cd->acc_gK = nullptr;
     cd->acc_gbias = nullptr;
 
+    epilogue = FUSED_NONE;
+    epilogue_k = 0.0f;
+
+    qrange = 0.0f;
+    quantized = false;
+
     parent->addchild(this);
     addparent(parent);
 }
@@ -74,7 +83,7 @@ void LConv::mem_delta(){
         parent[0]->mem_delta();
         cd->ID = parent[0]->delta;
 
-        delta = Tensor::zeros(cd->O->shape, cd->O->device);
+        delta = alloc_delta(cd->O->shape, cd->O->device);
         cd->D = delta;
 
         if(this->verbosity_level >= 2) {
@@ -84,10 +93,17 @@ void LConv::mem_delta(){
 }
 
 void LConv::forward() {
-    tensorNN::Conv2D(this->cd);
+    // The weights of a shared layer are updated through the original one
+    if (orig != nullptr) cd->Kcl_stale = true;
+    if (quantized && (mode == TSMODE)) tensorNN::Conv2D_int8(this->cd, qrange / 127.0f, Kq.data(), Kq_scale.data());
+    else tensorNN::Conv2D(this->cd);
+    if (epilogue != FUSED_NONE) fused_epilogue_forward(epilogue, epilogue_k, output, nullptr);
 }
 
 void LConv::backward() {
+    // Delta of the activation => delta of the convolution
+    if (epilogue != FUSED_NONE) fused_epilogue_backward(epilogue, epilogue_k, output, delta);
+
     //get gradients with provided delta
     if (trainable) { tensorNN::Conv2D_grad(this->cd); }
 
@@ -98,21 +114,25 @@ void LConv::backward() {
 
     // Regularizer
     if (trainable) if(reg!= nullptr) {reg->apply(cd->K);}
+    if (trainable) cd->Kcl_stale = true;  // The optimizer will update K
 }
 
 void LConv::initialize() {
     init->apply(params[0]);  // Conv
     params[1]->fill_(0.0f); // Bias
+    cd->Kcl_stale = true;
 }
 
 void LConv::update_weights(Tensor* w, Tensor* bias) {
     Tensor::copy( w, cd->K );
     if ( bias != nullptr ) Tensor::copy( bias, cd->bias );
+    cd->Kcl_stale = true;
 }
 
 void LConv::accumulate_accumulated_gradients(Tensor* gw, Tensor* gbias) {
     cd->K->add_( gw );
     if ( gbias != nullptr ) cd->bias->add_( gbias );
+    cd->Kcl_stale = true;
 }
 
 void LConv::reset_accumulated_gradients() {
@@ -126,6 +146,7 @@ void LConv::apply_accumulated_gradients() {
 
     // Regularizer
     if(reg!= nullptr) {reg->apply(cd->K);}
+    cd->Kcl_stale = true;
 }
 
 Layer *LConv::share(int c, int bs, vector<Layer *> p) {
@@ -135,6 +156,8 @@ Layer *LConv::share(int c, int bs, vector<Layer *> p) {
     n->isshared=true;
     n->trainable = trainable;
     n->do_deletes = false;
+    n->epilogue = epilogue;
+    n->epilogue_k = epilogue_k;
 
     //share params
     for (int i = 0; i < n->params.size(); i++) delete n->params[i];
@@ -180,6 +203,8 @@ Layer *LConv::clone(int c, int bs, vector<Layer *> p, int todev) {
     LConv *n = new LConv(p[0], cd->filters, cd->kernel_size, cd->strides, cd->padding, cd->pads, cd->groups, cd->dilation_rate, cd->use_bias,  this->name, todev, this->mem_level);
     n->trainable = trainable;
     n->do_deletes = false;
+    n->epilogue = epilogue;
+    n->epilogue_k = epilogue_k;
 
     n->orig = this;
 
@@ -215,3 +240,40 @@ void LConv::enable_distributed() {
     acc_gradients.push_back(cd->acc_gK);
     acc_gradients.push_back(cd->acc_gbias);
 }
+
+void LConv::weights_changed() {
+    cd->Kcl_stale = true;
+}
+
+void LConv::calibrate() {
+    qrange = std::max(qrange, std::max(fabsf(input->max()), fabsf(input->min())));
+}
+
+void LConv::quantize(bool enable) {
+    Kq.clear();
+    Kq_scale.clear();
+    quantized = false;
+
+    if (!enable) {
+        qrange = 0.0f;
+        return;
+    }
+    if (!cd->K->isCPU()) msg("Int8 inference is only supported on CPU", "LConv::quantize");
+    if (qrange <= 0.0f) msg("The layer " + name + " has not been calibrated", "LConv::quantize");
+
+    // Symmetric, one scale per filter
+    int ksize = cd->kz * cd->kr * cd->kc;
+    Kq.resize(cd->K->size);
+    Kq_scale.resize(cd->nk);
+    for (int o = 0; o < cd->nk; o++) {
+        float *k = cd->K->ptr + (unsigned long int)o * ksize;
+        float m = 0.0f;
+        for (int i = 0; i < ksize; i++) m = std::max(m, fabsf(k[i]));
+        Kq_scale[o] = (m > 0.0f) ? m / 127.0f : 1.0f;
+
+        for (int i = 0; i < ksize; i++)
+            Kq[(unsigned long int)o * ksize + i] = (int8_t)std::nearbyint(k[i] / Kq_scale[o]);
+    }
+
+    quantized = true;
+}
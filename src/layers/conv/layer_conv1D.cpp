@@ -102,7 +102,7 @@ void LConv1D::mem_delta(){
         cd->ID = parent[0]->delta;
 
         // Show delta with the output shape of the Conv1D
-        delta = Tensor::zeros(output->shape, output->device);
+        delta = alloc_delta(output->shape, output->device);
         // Reshape delta for convol descriptor
         if (cd->D != nullptr) delete cd->D;
         cd->D = new Tensor(cd->O->shape, delta);
@@ -25,9 +25,7 @@ LConv3D::LConv3D(Layer *parent, const vector<int> &ks, const vector<int> &st,
              const vector<int> &p, string name, int dev, int mem) : LConv3D(parent, new ConvolDescriptor3D(ks, st, p, mem), name, dev, mem) {}
 
 LConv3D::LConv3D(Layer *parent, int filters, const vector<int> &kernel_size, const vector<int> &strides, string padding,
-             int groups, const vector<int> &dilation_rate, bool use_bias, string name, int dev, int mem) : LConv3D(parent, new ConvolDescriptor3D(filters, kernel_size, strides, padding, use_bias, mem), name, dev, mem) {
-    // TODO: Implement (Fix initialization)
-};
+             int groups, const vector<int> &dilation_rate, bool use_bias, string name, int dev, int mem) : LConv3D(parent, new ConvolDescriptor3D(filters, kernel_size, strides, padding, groups, dilation_rate, use_bias, mem), name, dev, mem) {};
 
 LConv3D::LConv3D(Layer *parent, ConvolDescriptor3D *D, string name, int dev, int mem) : LinLayer(name, dev, mem) {
     if (parent->output->ndim != 5) msg("LConv3D only works over 5D tensors", "LConv3D::LConv3D");
@@ -78,7 +76,7 @@ void LConv3D::mem_delta(){
         parent[0]->mem_delta();
         cd->ID = parent[0]->delta;
 
-        delta = Tensor::zeros(cd->O->shape, cd->O->device);
+        delta = alloc_delta(cd->O->shape, cd->O->device);
         cd->D = delta;
 
         if(this->verbosity_level >= 2) {
@@ -128,7 +126,7 @@ void LConv3D::apply_accumulated_gradients() {
 }
 
 Layer *LConv3D::share(int c, int bs, vector<Layer *> p) {
-    LConv3D *n = new LConv3D(p[0], cd->ksize, cd->stride, cd->pad,  "share_"+to_string(c)+this->name, dev,mem_level);
+    LConv3D *n = new LConv3D(p[0], new ConvolDescriptor3D(cd->ksize, cd->stride, cd->pad, mem_level, cd->groups, cd->dilation_rate), "share_"+to_string(c)+this->name, dev,mem_level);
     n->orig = this;
     n->isshared=true;
     n->trainable = trainable;
@@ -179,7 +177,7 @@ Layer *LConv3D::share(int c, int bs, vector<Layer *> p) {
 
 Layer *LConv3D::clone(int c, int bs, vector<Layer *> p, int todev) {
 
-    LConv3D *n = new LConv3D(p[0], cd->ksize, cd->stride, cd->pad,  name, todev, this->mem_level);
+    LConv3D *n = new LConv3D(p[0], new ConvolDescriptor3D(cd->ksize, cd->stride, cd->pad, this->mem_level, cd->groups, cd->dilation_rate), name, todev, this->mem_level);
     n->trainable = trainable;
     n->do_deletes = false;
 
@@ -11,8 +11,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "eddl/layers/core/layer_core.h"
+#include "eddl/tensor/nn/tensor_nn.h"
 
 using namespace std;
 
@@ -42,6 +45,13 @@ LDense::LDense(Layer *parent, int ndim, bool use_bias, string name, int dev, int
     distributed_training = false;
     acc_gW = nullptr;
     acc_gbias = nullptr;
+    epilogue = FUSED_NONE;
+    epilogue_k = 0.0f;
+    W16 = nullptr;
+    W16f = nullptr;
+    W16_stale = false;
+    qrange = 0.0f;
+    quantized = false;
 
     parent->addchild(this);
     addparent(parent);
@@ -49,18 +59,34 @@ LDense::LDense(Layer *parent, int ndim, bool use_bias, string name, int dev, int
 
 LDense::~LDense(){
     // input, output, delta, params[], and gradients[], acc_gradients[] => deleted in ~Layer()
+    delete W16;
+    delete W16f;
 }
 
 void LDense::forward() {
-    Tensor::mult2D(input, 0, W, 0, output, 0);
-    if (use_bias) Tensor::sum2D_rowwise(output, bias, output);
+    if (quantized && (mode == TSMODE)) tensorNN::Dense_int8(input, qrange / 127.0f, Wq.data(), Wq_scale.data(), output);
+    else if ((W16 != nullptr) && (mode == TSMODE)) {
+        if (W16_stale) {
+            Tensor::copy(W, W16);
+            if (W16f != nullptr) Tensor::copy(W16, W16f);
+            W16_stale = false;
+        }
+        Tensor::mult2D(input, 0, (W16f != nullptr) ? W16f : W16, 0, output, 0);
+    }
+    else Tensor::mult2D(input, 0, W, 0, output, 0);
+    if (epilogue != FUSED_NONE) fused_epilogue_forward(epilogue, epilogue_k, output, use_bias ? bias : nullptr);
+    else if (use_bias) Tensor::sum2D_rowwise(output, bias, output);
 }
 
 void LDense::backward() {
+    // Delta of the activation => delta of the product
+    if (epilogue != FUSED_NONE) fused_epilogue_backward(epilogue, epilogue_k, output, delta);
+
     //get gradients with provided delta
     if (trainable) {
         Tensor::mult2D(input, 1, delta, 0, gW, 1);
         if (use_bias) Tensor::reduce_sum2D(delta, gbias, 0, 1);
+        W16_stale = true;  // The optimizer will update W
     }
 
     //1: note that increment parent delta
@@ -73,6 +99,7 @@ void LDense::backward() {
 void LDense::update_weights(Tensor* w, Tensor* bias) {
     Tensor::copy( w, this->W );
     if ( bias != nullptr ) Tensor::copy( bias, this->bias );
+    W16_stale = true;
 }
 
 void LDense::accumulate_accumulated_gradients(Tensor* gw, Tensor* gbias) {
@@ -81,6 +108,7 @@ void LDense::accumulate_accumulated_gradients(Tensor* gw, Tensor* gbias) {
 
     // Regularizer
     if(reg != nullptr) { reg->apply(this->W); }
+    W16_stale = true;
 }
 
 void LDense::reset_accumulated_gradients() {
@@ -94,6 +122,59 @@ void LDense::apply_accumulated_gradients() {
 
     // Regularizer
     if(reg != nullptr) { reg->apply(this->W); }
+    W16_stale = true;
+}
+
+void LDense::set_weights_dtype(int dtype) {
+    // W16 is converted again by the forward when W changes (see weights_changed).
+    // Small weights keep the 16-bit values expanded to float, so the forward
+    // does not convert them on every batch
+    delete W16;
+    delete W16f;
+    W16 = nullptr;
+    W16f = nullptr;
+    W16_stale = false;
+    if (dtype == DTYPE_FLOAT32) return;
+
+    W16 = W->astype(dtype);
+    if (W->size <= LDENSE_HALF_CACHE) W16f = W16->astype(DTYPE_FLOAT32);
+}
+
+void LDense::weights_changed() {
+    W16_stale = true;
+}
+
+void LDense::calibrate() {
+    qrange = std::max(qrange, std::max(fabsf(input->max()), fabsf(input->min())));
+}
+
+void LDense::quantize(bool enable) {
+    Wq.clear();
+    Wq_scale.clear();
+    quantized = false;
+
+    if (!enable) {
+        qrange = 0.0f;
+        return;
+    }
+    if (!W->isCPU()) msg("Int8 inference is only supported on CPU", "LDense::quantize");
+    if (qrange <= 0.0f) msg("The layer " + name + " has not been calibrated", "LDense::quantize");
+
+    // Symmetric, one scale per output (column of W)
+    int in = W->shape[0];
+    int out = W->shape[1];
+    Wq.resize((unsigned long int)in * out);
+    Wq_scale.resize(out);
+    for (int j = 0; j < out; j++) {
+        float m = 0.0f;
+        for (int i = 0; i < in; i++) m = std::max(m, fabsf(W->ptr[i * out + j]));
+        Wq_scale[j] = (m > 0.0f) ? m / 127.0f : 1.0f;
+
+        for (int i = 0; i < in; i++)
+            Wq[(unsigned long int)j * in + i] = (int8_t)std::nearbyint(W->ptr[i * out + j] / Wq_scale[j]);
+    }
+
+    quantized = true;
 }
 
 
@@ -103,6 +184,8 @@ Layer *LDense::share(int c, int bs, vector<Layer *> p) {
     n->isshared = true;
     n->trainable = trainable;
     n->do_deletes = false;
+    n->epilogue = epilogue;
+    n->epilogue_k = epilogue_k;
 
     //share params
     for (int i = 0; i < n->params.size(); i++) delete n->params[i];
@@ -148,6 +231,8 @@ Layer *LDense::clone(int c, int bs, vector<Layer *> p, int todev) {
     n->orig = this;
     n->trainable = trainable;
     n->do_deletes = false;
+    n->epilogue = epilogue;
+    n->epilogue_k = epilogue_k;
 
     if (n->reg != nullptr) delete n->reg;
     n->reg = reg;
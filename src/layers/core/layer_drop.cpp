@@ -25,6 +25,7 @@ LDropout::LDropout(Layer *parent, float df, bool iw, string name, int dev, int m
     // df: drop factor is the probability to delete (drop) an activation
     this->df = df;
     this->iw=iw;
+    isrecomputable=false;  // A new mask would be drawn
 
     input = parent->output;
     output = new Tensor(input->shape, dev);
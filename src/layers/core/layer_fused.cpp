@@ -0,0 +1,246 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+
+#include "eddl/layers/core/layer_core.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+using namespace std;
+
+// Elements of each tile: the registers of a tile stay in cache between ops
+#define FUSED_TILE 256
+
+int LFused::total_layers = 0;
+
+LFused::LFused(vector<Layer *> parent, vector<FusedOp> ops, string name, int dev, int mem) : MLayer(name, dev, mem) {
+    if(name.empty()) this->name = "fused" + to_string(++total_layers);
+    if (parent.empty() || ops.empty()) msg("Nothing to fuse", "LFused::LFused");
+    if (dev != DEV_CPU) msg("Fused layers only run on CPU", "LFused::LFused");
+
+    for (int i = 0; i < ops.size(); i++) {
+        int r = parent.size() + i;
+        if ((ops[i].a < 0) || (ops[i].a >= r) || (ops[i].b >= r)) msg("Wrong register", "LFused::LFused");
+    }
+
+    this->ops = ops;
+
+    input = parent[0]->output;
+    output = new Tensor(input->shape, dev);
+
+    for (int i = 0; i < parent.size(); ++i) {
+        if (parent[i]->output->size != output->size) msg("Incompatible shapes", "LFused::LFused");
+        parent[i]->addchild(this);
+        addparent(parent[i]);
+    }
+}
+
+static void fused_forward(const FusedOp &op, const float *a, const float *b, float *y, int n) {
+    float k = op.k;
+    switch (op.op) {
+        case FUSED_ADD: for (int i = 0; i < n; i++) y[i] = a[i] + b[i]; break;
+        case FUSED_SUB: for (int i = 0; i < n; i++) y[i] = a[i] - b[i]; break;
+        case FUSED_MULT: for (int i = 0; i < n; i++) y[i] = a[i] * b[i]; break;
+        case FUSED_DIV: for (int i = 0; i < n; i++) y[i] = a[i] / b[i]; break;
+        case FUSED_ADDK: for (int i = 0; i < n; i++) y[i] = a[i] + k; break;
+        case FUSED_MULTK: for (int i = 0; i < n; i++) y[i] = a[i] * k; break;
+        case FUSED_KSUB: for (int i = 0; i < n; i++) y[i] = k - a[i]; break;
+        case FUSED_DIVK: for (int i = 0; i < n; i++) y[i] = a[i] / k; break;
+        case FUSED_KDIV: for (int i = 0; i < n; i++) y[i] = k / a[i]; break;
+        case FUSED_RELU: for (int i = 0; i < n; i++) y[i] = (a[i] > 0.0f) ? a[i] : 0.0f; break;
+        case FUSED_LEAKY_RELU: for (int i = 0; i < n; i++) y[i] = (a[i] > 0.0f) ? a[i] : k * a[i]; break;
+        case FUSED_SIGMOID: for (int i = 0; i < n; i++) y[i] = 1.0f / (1.0f + ::expf(-a[i])); break;
+        case FUSED_TANH: for (int i = 0; i < n; i++) y[i] = ::tanhf(a[i]); break;
+        case FUSED_EXP: for (int i = 0; i < n; i++) y[i] = ::expf(a[i]); break;
+        case FUSED_LOG: for (int i = 0; i < n; i++) y[i] = ::logf(a[i]); break;
+        case FUSED_SQRT: for (int i = 0; i < n; i++) y[i] = ::sqrtf(a[i]); break;
+        case FUSED_ABS: for (int i = 0; i < n; i++) y[i] = ::fabsf(a[i]); break;
+        default: msg("Unknown op", "LFused::forward");
+    }
+}
+
+// Adds the gradients of the operands (ga, gb) given the one of the result (g)
+static void fused_backward(const FusedOp &op, const float *a, const float *b, const float *y, const float *g,
+                           float *ga, float *gb, int n) {
+    float k = op.k;
+    switch (op.op) {
+        case FUSED_ADD:
+            for (int i = 0; i < n; i++) ga[i] += g[i];
+            for (int i = 0; i < n; i++) gb[i] += g[i];
+            break;
+        case FUSED_SUB:
+            for (int i = 0; i < n; i++) ga[i] += g[i];
+            for (int i = 0; i < n; i++) gb[i] -= g[i];
+            break;
+        case FUSED_MULT:
+            for (int i = 0; i < n; i++) ga[i] += g[i] * b[i];
+            for (int i = 0; i < n; i++) gb[i] += g[i] * a[i];
+            break;
+        case FUSED_DIV:
+            for (int i = 0; i < n; i++) ga[i] += g[i] / b[i];
+            for (int i = 0; i < n; i++) gb[i] -= g[i] * a[i] / (b[i] * b[i]);
+            break;
+        case FUSED_ADDK: for (int i = 0; i < n; i++) ga[i] += g[i]; break;
+        case FUSED_MULTK: for (int i = 0; i < n; i++) ga[i] += g[i] * k; break;
+        case FUSED_KSUB: for (int i = 0; i < n; i++) ga[i] -= g[i]; break;
+        case FUSED_DIVK: for (int i = 0; i < n; i++) ga[i] += g[i] / k; break;
+        case FUSED_KDIV: for (int i = 0; i < n; i++) ga[i] -= g[i] * y[i] / a[i]; break;
+        case FUSED_RELU: for (int i = 0; i < n; i++) if (a[i] > 0.0f) ga[i] += g[i]; break;
+        case FUSED_LEAKY_RELU: for (int i = 0; i < n; i++) ga[i] += (a[i] > 0.0f) ? g[i] : k * g[i]; break;
+        case FUSED_SIGMOID: for (int i = 0; i < n; i++) ga[i] += g[i] * ((1.0f - y[i]) * y[i]); break;
+        case FUSED_TANH: for (int i = 0; i < n; i++) ga[i] += g[i] * (1.0f - y[i] * y[i]); break;
+        case FUSED_EXP: for (int i = 0; i < n; i++) ga[i] += g[i] * y[i]; break;
+        case FUSED_LOG: for (int i = 0; i < n; i++) ga[i] += g[i] / a[i]; break;
+        case FUSED_SQRT: for (int i = 0; i < n; i++) ga[i] += g[i] / y[i] / 2.0f; break;
+        case FUSED_ABS:
+            for (int i = 0; i < n; i++) {
+                if (a[i] > 0.0f) ga[i] += g[i];
+                else if (a[i] < 0.0f) ga[i] -= g[i];
+            }
+            break;
+        default: msg("Unknown op", "LFused::backward");
+    }
+}
+
+void fused_epilogue_forward(int op, float k, Tensor *O, Tensor *bias) {
+    if (!O->isCPU()) msg("Fused activations only run on CPU", "fused_epilogue_forward");
+    FusedOp f = {op, 0, -1, k};
+    int cols = (bias != nullptr) ? bias->size : FUSED_TILE;
+    long int n = O->size;
+
+    // Rows of the bias (or tiles), the activation runs while they are in cache
+    cpu_parallel_for(0, (n + cols - 1) / cols, cpu_grain(cols), [&](long int ini, long int end) {
+        for (long int r = ini; r < end; r++) {
+            float *y = O->ptr + r * cols;
+            int len = (int)std::min((long int)cols, n - r * cols);
+            if (bias != nullptr)
+                for (int j = 0; j < len; j++) y[j] += bias->ptr[j];
+            fused_forward(f, y, nullptr, y, len);
+        }
+    });
+}
+
+void fused_epilogue_backward(int op, float k, Tensor *O, Tensor *D) {
+    if (!O->isCPU()) msg("Fused activations only run on CPU", "fused_epilogue_backward");
+    FusedOp f = {op, 0, -1, k};
+    long int n = O->size;
+
+    // The input of the activation is gone: its derivative is taken from the
+    // output (relu and leaky_relu with k >= 0 keep the sign)
+    cpu_parallel_for(0, (n + FUSED_TILE - 1) / FUSED_TILE, cpu_grain(FUSED_TILE), [&](long int ini, long int end) {
+        float g[FUSED_TILE];
+        for (long int t = ini; t < end; t++) {
+            long int start = t * FUSED_TILE;
+            int len = (int)std::min((long int)FUSED_TILE, n - start);
+            const float *y = O->ptr + start;
+            float *d = D->ptr + start;
+
+            std::copy(d, d + len, g);
+            std::fill(d, d + len, 0.0f);
+            fused_backward(f, y, nullptr, y, g, d, nullptr, len);
+        }
+    });
+}
+
+void LFused::forward() {
+    int nin = parent.size();
+    int nops = ops.size();
+    long int n = output->size;
+    long int ntiles = (n + FUSED_TILE - 1) / FUSED_TILE;
+
+    // Registers of the tiles of each range
+    cpu_parallel_for(0, ntiles, cpu_grain(FUSED_TILE), [&](long int ini, long int end) {
+        vector<float> buf(nops * FUSED_TILE);
+        vector<const float *> reg(nin + nops);
+
+        for (long int t = ini; t < end; t++) {
+            long int start = t * FUSED_TILE;
+            int len = (int)std::min((long int)FUSED_TILE, n - start);
+
+            for (int i = 0; i < nin; i++) reg[i] = parent[i]->output->ptr + start;
+            for (int i = 0; i < nops; i++) {
+                // The last op writes the output, the rest only a register of the tile
+                float *y = (i == nops - 1) ? output->ptr + start : &buf[i * FUSED_TILE];
+                const float *b = (ops[i].b >= 0) ? reg[ops[i].b] : nullptr;
+                fused_forward(ops[i], reg[ops[i].a], b, y, len);
+                reg[nin + i] = y;
+            }
+        }
+    });
+}
+
+void LFused::backward() {
+    int nin = parent.size();
+    int nops = ops.size();
+    int nregs = nin + nops;
+    long int n = output->size;
+    long int ntiles = (n + FUSED_TILE - 1) / FUSED_TILE;
+
+    cpu_parallel_for(0, ntiles, cpu_grain(FUSED_TILE), [&](long int ini, long int end) {
+        vector<float> buf(nops * FUSED_TILE);
+        vector<float> grad(nregs * FUSED_TILE);
+        vector<const float *> reg(nregs);
+
+        for (long int t = ini; t < end; t++) {
+            long int start = t * FUSED_TILE;
+            int len = (int)std::min((long int)FUSED_TILE, n - start);
+
+            // The intermediate results are not kept: run the tile again
+            for (int i = 0; i < nin; i++) reg[i] = parent[i]->output->ptr + start;
+            for (int i = 0; i < nops; i++) {
+                float *y = &buf[i * FUSED_TILE];
+                const float *b = (ops[i].b >= 0) ? reg[ops[i].b] : nullptr;
+                fused_forward(ops[i], reg[ops[i].a], b, y, len);
+                reg[nin + i] = y;
+            }
+
+            std::fill(grad.begin(), grad.begin() + (nregs - 1) * FUSED_TILE, 0.0f);
+            std::copy(delta->ptr + start, delta->ptr + start + len, &grad[(nregs - 1) * FUSED_TILE]);
+
+            for (int i = nops - 1; i >= 0; i--) {
+                const FusedOp &op = ops[i];
+                float *gb = (op.b >= 0) ? &grad[op.b * FUSED_TILE] : nullptr;
+                const float *b = (op.b >= 0) ? reg[op.b] : nullptr;
+                fused_backward(op, reg[op.a], b, reg[nin + i], &grad[(nin + i) * FUSED_TILE],
+                               &grad[op.a * FUSED_TILE], gb, len);
+            }
+
+            for (int i = 0; i < nin; i++) {
+                float *pd = parent[i]->delta->ptr + start;
+                const float *g = &grad[i * FUSED_TILE];
+                for (int j = 0; j < len; j++) pd[j] += g[j];
+            }
+        }
+    });
+}
+
+Layer *LFused::share(int c, int bs, vector<Layer *> p) {
+    LFused *n = new LFused(p, this->ops, "share_"+to_string(c)+this->name, this->dev, this->mem_level);
+    n->orig = this;
+    return n;
+}
+
+Layer *LFused::clone(int c, int bs, vector<Layer *> p, int todev) {
+    LFused *n = new LFused(p, this->ops, "clone_"+to_string(c)+this->name, todev, this->mem_level);
+    n->orig = this;
+    return n;
+}
+
+string LFused::plot(int c) {
+    string s;
+
+    s = name + " [label=" + "\"" + name + "\",style=filled,fontsize=12,fillcolor=LightBlue,shape=box]";
+
+    return s;
+}
@@ -22,6 +22,7 @@ LDataAugmentation::LDataAugmentation(Layer *parent, string name, int dev, int me
     input = parent->output;
     // output = new Tensor(input->shape, dev);  // Build this on child
     delta = parent->delta;
+    isrecomputable=false;
 }
 
 LDataAugmentation::~LDataAugmentation(){
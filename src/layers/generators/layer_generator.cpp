@@ -18,7 +18,7 @@
 using namespace std;
 
 GeneratorLayer::GeneratorLayer(string name, int dev, int mem) : LinLayer(name, dev, mem) {
-
+    isrecomputable=false;
 }
 
 
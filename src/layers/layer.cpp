@@ -14,6 +14,8 @@
 
 #include "eddl/layers/layer.h"
 #include "eddl/layers/operators/layer_operators.h"
+#include "eddl/net/net.h"
+#include "eddl/utils.h"
 
 using namespace std;
 
@@ -37,6 +39,14 @@ Layer::Layer(string name, int dev, int mem) {
     trainable=true;
     iscloned=false;
     isdecoder=false;
+    isrecomputable=true;
+    checkpoint=false;
+    channels_last=false;
+
+    this->delta_slab = nullptr;
+    this->delta_slab_size = 0;
+    this->delta_step = -1;
+    this->delta_alloc = false;
 
     this->do_deletes = true;
 
@@ -92,6 +102,7 @@ void Layer::initialize() {
     for (int i = 0; i != params.size(); i++) {
         init->apply(params[i]);
     }
+    weights_changed();
 }
 
 void Layer::clamp(float min, float max){
@@ -122,9 +133,24 @@ void Layer::mem_delta_parent(){
 void Layer::mem_delta(){
     // Reserve space for the delta
     if(this->delta == nullptr)
-        this->delta = Tensor::zeros(this->output->shape, this->output->device);
+        this->delta = alloc_delta(this->output->shape, this->output->device);
+
+
+}
+
+Tensor *Layer::alloc_delta(const vector<int> &shape, int dev){
+    this->delta_alloc = true;
 
+    // Memory of the planner, only at the step it was planned for: other deltas
+    // share it outside of that lifetime. The tensor does not own it
+    if(this->delta_slab != nullptr && this->net != nullptr && this->net->mem_plan_step == this->delta_step &&
+       shape2size(shape) <= this->delta_slab_size){
+        auto *t = new Tensor(shape, this->delta_slab, dev);
+        t->fill_(0.0f);
+        return t;
+    }
 
+    return Tensor::zeros(shape, dev);
 }
 
 void Layer::free_delta(){
@@ -205,6 +231,7 @@ void Layer::load(std::ifstream &ifs, string format){
         Tensor::copy(t,params[i]);
         delete t;
     }
+    weights_changed();
 }
 
 void Layer::info() {
@@ -244,6 +271,7 @@ void Layer::copy(Layer *l2){
     for(int i=0;i<params.size();i++){
         Tensor::copy(params[i],l2->params[i]);
     }
+    l2->weights_changed();
 }
 
 ////////////////////////////////////
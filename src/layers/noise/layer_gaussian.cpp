@@ -22,6 +22,7 @@ int LGaussianNoise::total_layers = 0;
 LGaussianNoise::LGaussianNoise(Layer *parent, float stdev, string name, int dev, int mem) : LinLayer(name, dev, mem) {
     if(name.empty()) this->name = "gaussiannoise" + to_string(++total_layers);
     this->stdev = stdev;
+    isrecomputable=false;
 
     // TODO: Implement
     input = parent->output;
@@ -24,6 +24,7 @@ int LBatchNorm::total_layers = 0;
 LBatchNorm::LBatchNorm(Layer *parent, float momentum, float epsilon, bool affine, string name, int dev, int mem) : LinLayer(name, dev, mem) {
     input=parent->output;
     isnorm=true;
+    isrecomputable=false;  // The running statistics would be updated twice
 
     shape.push_back(input->shape[1]);
 
@@ -161,7 +162,7 @@ void LBatchNorm::forward() {
     if (input->isCPU() || input->isGPU()) {
         tensorNN::BatchNormForward(input, output, opa, mean, variance,
                 affine ? bn_g : NULL, affine ? bn_b : NULL,
-                bn_mean, bn_var, mode == TRMODE, epsilon, momentum);
+                bn_mean, bn_var, mode == TRMODE, epsilon, momentum, channels_last);
     } else
 #endif
     {
@@ -238,7 +239,7 @@ void LBatchNorm::backward(){
     if (input->isCPU() || input->isGPU()) {
         tensorNN::BatchNormBackward(delta, opa, parent[0]->delta,
             affine ? gbn_g : NULL, affine ? gbn_b : NULL, affine ? bn_g : NULL,
-            bn_var, work1, work2);
+            bn_var, work1, work2, channels_last);
     } else
 #endif
     {
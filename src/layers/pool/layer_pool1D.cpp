@@ -69,7 +69,7 @@ void LPool1D::mem_delta(){
         parent[0]->mem_delta();
         pd->ID = parent[0]->delta;
 
-        delta = Tensor::zeros(output->shape, output->device);
+        delta = alloc_delta(output->shape, output->device);
         pd->D = new Tensor(pd->O->shape, delta);
 
         if(this->verbosity_level >= 2) {
@@ -48,7 +48,7 @@ void LPool3D::mem_delta(){
         parent[0]->mem_delta();
         pd->ID = parent[0]->delta;
 
-        delta = Tensor::zeros(pd->O->shape, pd->O->device);
+        delta = alloc_delta(pd->O->shape, pd->O->device);
         pd->D = delta;
 
         if(this->verbosity_level >= 2) {
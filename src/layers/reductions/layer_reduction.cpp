@@ -32,7 +32,7 @@ void ReductionLayer::mem_delta(){
         parent[0]->mem_delta();
         RD->ID = parent[0]->delta;
 
-        delta = Tensor::zeros(RD->O->shape, RD->O->device);
+        delta = alloc_delta(RD->O->shape, RD->O->device);
         RD->D = delta;
 
         if(this->verbosity_level >= 2) {
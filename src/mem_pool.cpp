@@ -0,0 +1,223 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "eddl/mem_pool.h"
+#include "eddl/utils.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+#define MEM_POOL_MIN_BLOCK 64
+#define MEM_POOL_DEFAULT_MAX_CACHED (1UL << 30)  // 1GB
+
+struct MemPool {
+    std::mutex mtx;
+    bool enabled = true;
+    size_t max_cached = MEM_POOL_DEFAULT_MAX_CACHED;
+    MemPoolStats stats;
+
+    std::map<size_t, std::vector<void *>> free_blocks;  // size class => cached blocks
+    std::unordered_map<void *, size_t> used_blocks;     // ptr => size class
+    std::unordered_map<void *, unsigned long int> placed;  // ptr => cpu_pool_layout() its pages are placed for (NUMA)
+};
+
+// The pool is never destroyed: tensors living in static objects can be released
+// after the static destructors of this translation unit have run.
+static MemPool * get_pool(){
+    static MemPool *pool = new MemPool();
+    return pool;
+}
+
+static void update_peak(MemPoolStats &stats){
+    size_t total = stats.bytes_in_use + stats.bytes_cached;
+    if (total > stats.peak_bytes) stats.peak_bytes = total;
+}
+
+size_t mem_pool_size_class(size_t size){
+    if (size <= MEM_POOL_MIN_BLOCK) return MEM_POOL_MIN_BLOCK;
+
+    // Four classes per power of two: 2^k * {1.25, 1.5, 1.75, 2} (max. waste 25%)
+    size_t pow2 = MEM_POOL_MIN_BLOCK;
+    while ((pow2 << 1) < size) pow2 <<= 1;
+    size_t step = pow2 >> 2;
+    return (size + step - 1) / step * step;
+}
+
+void * mem_pool_malloc(size_t size, const std::string &str_info){
+    MemPool *pool = get_pool();
+    size_t bytes = mem_pool_size_class(size);
+    bool enabled;
+    void *cached = nullptr;
+    bool move_pages = false;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        enabled = pool->enabled;
+
+        auto it = pool->free_blocks.find(bytes);
+        if (enabled && it != pool->free_blocks.end() && !it->second.empty()) {
+            cached = it->second.back();
+            it->second.pop_back();
+            pool->used_blocks[cached] = bytes;
+            pool->stats.hits++;
+            pool->stats.bytes_cached -= bytes;
+            pool->stats.bytes_in_use += bytes;
+
+            // The threads of the pool have changed since the block was placed:
+            // move its pages to the nodes of the ones that will work on them now
+            if ((bytes >= CPU_NUMA_MIN_BYTES) && cpu_numa_first_touch()) {
+                unsigned long int layout = cpu_pool_layout();
+                auto p = pool->placed.find(cached);
+                if ((p != pool->placed.end()) && (p->second == layout)) return cached;
+                pool->placed[cached] = layout;
+                move_pages = true;
+            }
+        }
+    }
+
+    if (cached != nullptr) {
+        if (move_pages) cpu_numa_place(cached, bytes);
+        return cached;
+    }
+
+    // Disabled: neither rounded nor tracked, so eddl_free gives it back to the system
+    if (!enabled) return eddl_system_malloc(size, str_info);
+
+    // Cache miss. Allocate outside the lock (it may throw)
+    void *ptr = nullptr;
+    try {
+        ptr = eddl_system_malloc(bytes, str_info);
+    } catch (std::runtime_error &e) {
+        // Out of memory: give the cached blocks back and try once more
+        if (mem_pool_trim(0) == 0) throw;
+        ptr = eddl_system_malloc(bytes, str_info);
+    }
+
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    pool->used_blocks[ptr] = bytes;
+    if ((bytes >= CPU_NUMA_MIN_BYTES) && cpu_numa_first_touch()) pool->placed[ptr] = cpu_pool_layout();  // First touch
+    pool->stats.misses++;
+    pool->stats.bytes_in_use += bytes;
+    update_peak(pool->stats);
+    return ptr;
+}
+
+bool mem_pool_free(void *ptr){
+    MemPool *pool = get_pool();
+    bool release = false;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        auto it = pool->used_blocks.find(ptr);
+        if (it == pool->used_blocks.end()) return false;  // Not allocated by the pool
+
+        size_t bytes = it->second;
+        pool->used_blocks.erase(it);
+        pool->stats.bytes_in_use -= bytes;
+
+        if (pool->enabled && pool->stats.bytes_cached + bytes <= pool->max_cached) {
+            pool->free_blocks[bytes].push_back(ptr);
+            pool->stats.bytes_cached += bytes;
+        } else {
+            release = true;
+            pool->placed.erase(ptr);
+        }
+    }
+
+    if (release) eddl_system_free(ptr);
+    return true;
+}
+
+size_t mem_pool_trim(size_t max_bytes){
+    MemPool *pool = get_pool();
+    std::vector<void *> to_release;
+    size_t released = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+
+        // Release the biggest blocks first
+        for (auto it = pool->free_blocks.rbegin(); it != pool->free_blocks.rend(); ++it) {
+            std::vector<void *> &blocks = it->second;
+            while (!blocks.empty() && pool->stats.bytes_cached > max_bytes) {
+                to_release.push_back(blocks.back());
+                pool->placed.erase(blocks.back());
+                blocks.pop_back();
+                pool->stats.bytes_cached -= it->first;
+                released += it->first;
+            }
+            if (pool->stats.bytes_cached <= max_bytes) break;
+        }
+    }
+
+    for (void *ptr : to_release) eddl_system_free(ptr);
+    return released;
+}
+
+void mem_pool_enable(bool enable){
+    MemPool *pool = get_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        pool->enabled = enable;
+    }
+    if (!enable) mem_pool_trim(0);
+}
+
+bool mem_pool_is_enabled(){
+    MemPool *pool = get_pool();
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    return pool->enabled;
+}
+
+void mem_pool_set_max_cached(size_t max_bytes){
+    MemPool *pool = get_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        pool->max_cached = max_bytes;
+    }
+    mem_pool_trim(max_bytes);
+}
+
+size_t mem_pool_get_max_cached(){
+    MemPool *pool = get_pool();
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    return pool->max_cached;
+}
+
+MemPoolStats mem_pool_stats(){
+    MemPool *pool = get_pool();
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    return pool->stats;
+}
+
+void mem_pool_reset_stats(){
+    MemPool *pool = get_pool();
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    pool->stats.hits = 0;
+    pool->stats.misses = 0;
+    pool->stats.peak_bytes = pool->stats.bytes_in_use + pool->stats.bytes_cached;
+}
+
+void mem_pool_show_stats(){
+    MemPoolStats stats = mem_pool_stats();
+    unsigned long long requests = stats.hits + stats.misses;
+
+    printf("Memory pool:\n");
+    printf("  %-20s: %llu (%.2f%%)\n", "hits", stats.hits, requests > 0 ? 100.0 * stats.hits / requests : 0.0);
+    printf("  %-20s: %llu\n", "misses", stats.misses);
+    printf("  %-20s: %s\n", "in use", bytes2human(stats.bytes_in_use).c_str());
+    printf("  %-20s: %s\n", "cached", bytes2human(stats.bytes_cached).c_str());
+    printf("  %-20s: %s\n", "peak", bytes2human(stats.peak_bytes).c_str());
+}
@@ -18,7 +18,8 @@
 
 CompServ::CompServ()
 {
-
+    pin_threads = false;
+    numa = false;
 }
 
 // for local
@@ -34,13 +35,15 @@ CompServ::CompServ(int t, const vector<int> g, const vector<int> &f, int lsb, in
     for (auto _ : f) this->local_fpgas.push_back(_);
 
     this->lsb = lsb;
+    pin_threads = false;
+    numa = false;
 
     if (lsb < 0) {
       throw std::runtime_error("Error creating CS with lsb<0 in CompServ::CompServ");
     }
 
     mem_level = mem;
-    if ((mem < 0) || (mem > 2)) {
+    if ((mem < 0) || (mem > 3)) {
       fprintf(stderr,"Error creating CS with incorrect memory saving level param in CompServ::CompServ");
       exit(EXIT_FAILURE);
     }
@@ -48,6 +51,7 @@ CompServ::CompServ(int t, const vector<int> g, const vector<int> &f, int lsb, in
       if (mem==0) fprintf(stderr,"CS with full memory setup\n");
       if (mem==1) fprintf(stderr,"CS with mid memory setup\n");
       if (mem==2) fprintf(stderr,"CS with low memory setup\n");
+      if (mem==3) fprintf(stderr,"CS with recompute memory setup\n");
     }
 }
 
@@ -61,6 +65,8 @@ CompServ * CompServ::share() {
   n->lsb = this->lsb;
   n->isshared = true;
   n->mem_level = this->mem_level;
+  n->pin_threads = this->pin_threads;
+  n->numa = this->numa;
 
   return n;
 }
@@ -0,0 +1,180 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include "eddl/net/dataloader.h"
+#include "eddl/utils.h"
+#include "eddl/random.h"
+
+
+using namespace std;
+
+// Shape stored in the header of a bin file
+static vector<int> bin_shape(const string &filename) {
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs.good()) msg("File not found: " + filename, "DataLoader");
+
+  int ndim;
+  ifs.read(reinterpret_cast<char *>(&ndim), sizeof(int));
+  if (ndim < 0) ifs.read(reinterpret_cast<char *>(&ndim), sizeof(int));  // 16-bit data
+
+  vector<int> shape(std::max(ndim, 0));
+  ifs.read(reinterpret_cast<char *>(shape.data()), shape.size() * sizeof(int));
+  if (!ifs.good() || shape.empty()) msg("Wrong header in " + filename, "DataLoader");
+
+  return shape;
+}
+
+
+DataLoader::DataLoader(const vector<string> &in_files, const vector<string> &out_files, int batch_size, int chunk_size, bool shuffle) {
+  if (in_files.empty()) msg("No input files", "DataLoader");
+  if (batch_size <= 0) msg("Wrong batch size", "DataLoader");
+
+  this->in_files = in_files;
+  this->out_files = out_files;
+  this->batch_size = batch_size;
+  this->shuffle = shuffle;
+
+  // Every file must have the same rows
+  num_samples = -1;
+  for (int k = 0; k < 2; k++) {
+    const vector<string> &files = (k == 0) ? in_files : out_files;
+    vector<vector<int>> &shapes = (k == 0) ? in_shapes : out_shapes;
+    for (int i = 0; i < files.size(); i++) {
+      vector<int> shape = bin_shape(files[i]);
+      if (num_samples < 0) num_samples = shape[0];
+      else if (shape[0] != num_samples) msg("different number of samples in " + files[i], "DataLoader");
+      shapes.push_back(vector<int>(shape.begin() + 1, shape.end()));
+    }
+  }
+
+  // Chunks hold full batches
+  this->chunk_size = std::max(1, (chunk_size + batch_size - 1) / batch_size) * batch_size;
+  num_chunks = (num_samples + this->chunk_size - 1) / this->chunk_size;
+  num_batches = num_samples / batch_size;
+
+  next_chunk = 0;
+  pos = 0;
+
+  reset();
+}
+
+DataLoader::~DataLoader() {
+  delete_chunk(current);
+
+  // Wait for the chunk being read
+  if (prefetch.valid()) {
+    try {
+      Chunk chunk = prefetch.get();
+      delete_chunk(chunk);
+    } catch (...) {}
+  }
+}
+
+DataLoader::Chunk DataLoader::load_chunk(int c) {
+  int start = c * chunk_size;
+  int end = std::min(start + chunk_size, num_samples);
+
+  Chunk chunk;
+  for (int i = 0; i < in_files.size(); i++)
+    chunk.first.push_back(Tensor::load_partial(in_files[i], start, end));
+  for (int i = 0; i < out_files.size(); i++)
+    chunk.second.push_back(Tensor::load_partial(out_files[i], start, end));
+
+  return chunk;
+}
+
+void DataLoader::delete_chunk(Chunk &chunk) {
+  for (int i = 0; i < chunk.first.size(); i++) delete chunk.first[i];
+  for (int i = 0; i < chunk.second.size(); i++) delete chunk.second[i];
+  chunk.first.clear();
+  chunk.second.clear();
+}
+
+void DataLoader::start_prefetch() {
+  if (next_chunk >= num_chunks) return;
+
+  int c = order[next_chunk++];
+  prefetch = std::async(std::launch::async, &DataLoader::load_chunk, this, c);
+}
+
+void DataLoader::reset() {
+  // Drop the chunks of the previous epoch
+  delete_chunk(current);
+  rows.clear();
+  pos = 0;
+
+  if (prefetch.valid()) {
+    Chunk chunk = prefetch.get();
+    delete_chunk(chunk);
+  }
+
+  order.resize(num_chunks);
+  for (int i = 0; i < num_chunks; i++) order[i] = i;
+  if (shuffle)
+    for (int i = num_chunks - 1; i > 0; i--) std::swap(order[i], order[rand_int(i + 1)]);
+
+  next_chunk = 0;
+  start_prefetch();
+}
+
+bool DataLoader::next_batch(vector<Tensor *> X, vector<Tensor *> Y) {
+  if ((X.size() != in_files.size()) || (Y.size() != out_files.size()))
+    msg("Tensor list does not match with the files of the loader", "DataLoader::next_batch");
+
+  // Move to the next chunk (the last one may not fill a batch)
+  while (pos + batch_size > rows.size()) {
+    delete_chunk(current);
+    rows.clear();
+    pos = 0;
+
+    if (!prefetch.valid()) {
+      reset();
+      return false;
+    }
+
+    current = prefetch.get();
+    start_prefetch();
+
+    rows.resize(current.first[0]->shape[0]);
+    for (int i = 0; i < rows.size(); i++) rows[i] = i;
+    if (shuffle)
+      for (int i = rows.size() - 1; i > 0; i--) std::swap(rows[i], rows[rand_int(i + 1)]);
+  }
+
+  for (int i = 0; i < X.size(); i++)
+    Tensor::select(current.first[i], X[i], rows, pos, pos + batch_size);
+  for (int i = 0; i < Y.size(); i++)
+    Tensor::select(current.second[i], Y[i], rows, pos, pos + batch_size);
+  pos += batch_size;
+
+  return true;
+}
+
+void DataLoader::new_batch(vector<Tensor *> &X, vector<Tensor *> &Y) {
+  X.clear();
+  Y.clear();
+
+  for (int i = 0; i < in_shapes.size(); i++) {
+    vector<int> shape = in_shapes[i];
+    shape.insert(shape.begin(), batch_size);
+    X.push_back(new Tensor(shape, DEV_CPU));
+  }
+  for (int i = 0; i < out_shapes.size(); i++) {
+    vector<int> shape = out_shapes[i];
+    shape.insert(shape.begin(), batch_size);
+    Y.push_back(new Tensor(shape, DEV_CPU));
+  }
+}
@@ -69,6 +69,15 @@ Net::Net() {
     decsize=1;
     do_compserv_delete = true;
     do_optimizer_delete = true;
+    recompute_state = RECOMPUTE_OFF;
+    recompute_segment = -1;
+    recompute_arena = nullptr;
+    recompute_arena_size = 0;
+    mem_plan_state = MEM_PLAN_OFF;
+    mem_plan_step = -1;
+    mem_plan_arena = nullptr;
+    mem_plan_arena_size = 0;
+    mem_plan_unplanned_size = 0;
 }
 
 Net::Net(vlayer in, vlayer out):Net() {
@@ -94,9 +103,6 @@ Net::Net(vlayer in, vlayer out):Net() {
         fiterr.push_back(0.0);
         fiterr.push_back(0.0);
     }
-
-
-    build_randn_table();
 }
 
 
@@ -104,6 +110,9 @@ Net::~Net(){
     // IF CPU : net = snets[0]
     // IF GPU: net , snets[0]= clone on GPU
 
+    // Wait for the batch being staged (if any)
+    stage_reset();
+
     if (this->has_to_close_flog_tr && this->flog_tr != nullptr) {
         fclose(this->flog_tr);
         this->flog_tr = nullptr;
@@ -173,8 +182,22 @@ Net::~Net(){
       }
     }
 
+    // Layers replaced by the fused ones. The output of the last layer of each
+    // chain is the one of the fused layer (already deleted)
+    for (auto l : fused) {
+        l->output = nullptr;
+        delete l;
+    }
+    fused.clear();
+
     if (rnet!=nullptr) { delete rnet; rnet = nullptr;}
 
+    // Layers are gone, the recomputed outputs only pointed to the arena
+    if (recompute_arena != nullptr) { eddl_free(recompute_arena); recompute_arena = nullptr; }
+
+    // Same for the planned deltas
+    if (mem_plan_arena != nullptr) { eddl_free(mem_plan_arena); mem_plan_arena = nullptr; }
+
     if (this->do_compserv_delete && this->cs != nullptr) {
         delete this->cs;
         this->cs = nullptr;
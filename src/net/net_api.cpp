@@ -15,11 +15,14 @@
 #include <string>
 #include <chrono>
 #include <stdexcept>
+#include <algorithm>
 #include "eddl/layers/core/layer_core.h"
 #include "eddl/net/net.h"
+#include "eddl/net/dataloader.h"
 #include "eddl/random.h"
 #include "eddl/system_info.h"
 #include "eddl/utils.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
 #ifdef cFPGA
@@ -155,13 +158,14 @@ void Net::run_snets(void *(*F)(void *t))
 
   if((snets[0]->dev != DEV_CPU) && (comp > 1))
   {
-    #pragma omp parallel for
-    for (int i = 0; i < comp; i++) {
-      // Thread params
-      td[i].net = snets[i];
-      // Call function
-      F(&td[i]);
-    }
+    cpu_parallel_for(0, comp, 1, [&](long int ini, long int end) {
+      for (int i = ini; i < end; i++) {
+        // Thread params
+        td[i].net = snets[i];
+        // Call function
+        F(&td[i]);
+      }
+    });
   }
   else
   {
@@ -249,6 +253,7 @@ void Net::set_parameters(const vector<vtensor>& params){
             new_param->toDevice(this->dev);  // Send to the same device as the net
             Tensor::copy(new_param, this->layers[i]->params[j]);
         }
+        this->layers[i]->weights_changed();
 
     }
 }
@@ -794,10 +799,11 @@ void Net::fit(vtensor tin, vtensor tout, int batch, int epochs) {
     resize(batch);
 
 
-    // Create array to store batch indices (later random)
-    vind sind;
+    // Create arrays to store batch indices (later random)
+    vind sind, next_sind;
     for (i = 0; i < batch_size; i++)
         sind.push_back(0);
+    next_sind = sind;
 
 
     // Start training
@@ -817,8 +823,18 @@ void Net::fit(vtensor tin, vtensor tout, int batch, int epochs) {
       // For each batch
       for (j = 0; j < num_batches; j++) {
 
-        // Set random indices
-        for (k = 0; k < batch_size; k++) sind[k] = rand() % n;
+        // Set random indices (already set if the batch was prefetched)
+        if ((j == 0) || !input_overlap) {
+          for (k = 0; k < batch_size; k++) sind[k] = rand_int(n);
+        } else {
+          sind.swap(next_sind);
+        }
+
+        // Gather the next batch while this one trains
+        if (input_overlap && (j + 1 < num_batches)) {
+          for (k = 0; k < batch_size; k++) next_sind[k] = rand_int(n);
+          prefetch_batch(tin, tout, next_sind);
+        }
 
         // Train batch
         tr_batches++;
@@ -1124,6 +1140,66 @@ void Net::prepare_recurrent(vtensor tin, vtensor tout, int &inl, int &outl, vten
     prepare_recurrent_enc(tin, tout, inl, outl, xt, xtd, yt, tinr,toutr);
 }
 
+void Net::fit(DataLoader *loader, int epochs) {
+  int i, j;
+
+  if (isrecurrent) msg("Recurrent nets are not supported", "Net.fit");
+
+  // Check current optimizer
+  if (optimizer == nullptr)
+  msg("Net is not build", "Net.fit");
+
+  // Check if number of input/output network layers matches with the files of the loader
+  if (loader->in_files.size() != lin.size())
+  msg("input files do not match with defined input layers", "Net.fit");
+  if (loader->out_files.size() != lout.size())
+  msg("output files do not match with defined output layers", "Net.fit");
+
+  // Set batch size
+  resize(loader->batch_size);
+
+  // The loader fills X and Y, already shuffled
+  vtensor X, Y;
+  loader->new_batch(X, Y);
+
+  vind sind;
+  for (i = 0; i < batch_size; i++)
+      sind.push_back(i);
+
+  // Start training
+  setmode(TRMODE);
+
+  // Train network
+  fprintf(stdout, "%d epochs of %d batches of size %d\n", epochs, loader->num_batches, batch_size);
+  for (i = 0; i < epochs; i++) {
+    high_resolution_clock::time_point e1 = high_resolution_clock::now();
+    fprintf(stdout, "Epoch %d\n", i + 1);
+
+    reset_loss();
+
+    // For each batch (next_batch starts the next epoch when it returns false)
+    for (j = 0; loader->next_batch(X, Y); j++) {
+      tr_batches++;
+
+      train_batch(X, Y, sind);
+
+      print_loss(j+1);
+
+      high_resolution_clock::time_point e2 = high_resolution_clock::now();
+      duration<double> epoch_time_span = e2 - e1;
+      fprintf(stdout, "%1.4f secs/batch\r", epoch_time_span.count()/(j+1));
+      fflush(stdout);
+    }
+    high_resolution_clock::time_point e2 = high_resolution_clock::now();
+    duration<double> epoch_time_span = e2 - e1;
+    fprintf(stdout, "\n%1.4f secs/epoch\n", epoch_time_span.count());
+  }
+  fflush(stdout);
+
+  for (i = 0; i < X.size(); i++) delete X[i];
+  for (i = 0; i < Y.size(); i++) delete Y[i];
+}
+
 void Net::fit_recurrent(vtensor tin, vtensor tout, int batch, int epochs) {
   int i, j, k, n;
 
@@ -1179,22 +1255,24 @@ void Net::train_batch(vtensor X, vtensor Y, vind sind, int eval) {
 
   // Check indices
   if (sind.size() == 0) msg("error void index","Net::train_batch");
-  // Split data for each network
-  for (int i = 0; i < comp; i++) {
-    int start = i * thread_batch_size;
-    int end = start + Xs[i][0]->shape[0];
-
-    // Copy samples
-    for (int j = 0; j < X.size(); j++) {
-      Tensor::select(X[j], Xs[i][j], sind, start, end);
-      Tensor::copy(Xs[i][j], snets[i]->lin[j]->input);
-    }
+  // Split data for each network (unless it was already gathered by prefetch_batch)
+  if (!stage_load(X, Y, sind)) {
+    for (int i = 0; i < comp; i++) {
+      int start = i * thread_batch_size;
+      int end = start + Xs[i][0]->shape[0];
+
+      // Copy samples
+      for (int j = 0; j < X.size(); j++) {
+        Tensor::select(X[j], Xs[i][j], sind, start, end);
+        Tensor::copy(Xs[i][j], snets[i]->lin[j]->input);
+      }
 
-    // Copy targets
-    for (int j = 0; j < Y.size(); j++) {
-      Tensor::select(Y[j], Ys[i][j], sind, start, end);
-      snets[i]->lout[j]->check_target();
-      Tensor::copy(Ys[i][j], snets[i]->lout[j]->target);
+      // Copy targets
+      for (int j = 0; j < Y.size(); j++) {
+        Tensor::select(Y[j], Ys[i][j], sind, start, end);
+        snets[i]->lout[j]->check_target();
+        Tensor::copy(Ys[i][j], snets[i]->lout[j]->target);
+      }
     }
   }
 
@@ -1368,3 +1446,30 @@ vtensor Net::predict(vtensor tin) {
 }
 
 //////
+
+void Net::calibrate(vtensor tin, int bs) {
+  // Observes the ranges of the inputs of the layers in TSMODE, to quantize
+  // them later (see Net::quantize). Previous ranges and int8 weights are dropped
+  if (isrecurrent) msg("Recurrent nets can not be quantized", "Net.calibrate");
+  if (tin.size() != lin.size()) msg("input tensor list does not match with defined input layers", "Net.calibrate");
+
+  quantize(false);
+  setmode(TSMODE);
+
+  int n = tin[0]->shape[0];
+  for (int b = 0; b < n; b += bs) {
+    string rows = to_string(b) + ":" + to_string(std::min(n, b + bs));
+
+    vtensor batch;
+    for (int i = 0; i < tin.size(); i++) {
+      vector<string> indices(tin[i]->ndim, ":");
+      indices[0] = rows;
+      batch.push_back(tin[i]->select(indices));
+    }
+
+    forward(batch);
+    for (int j = 0; j < layers.size(); j++) layers[j]->calibrate();
+
+    for (int i = 0; i < batch.size(); i++) delete batch[i];
+  }
+}
@@ -19,6 +19,8 @@
 #include "eddl/random.h"
 
 #include "eddl/layers/core/layer_core.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
 
 #ifdef cGPU
 #include "eddl/hardware/gpu/gpu_tensor.h"
@@ -107,6 +109,8 @@ void Net::bts() {
 void Net::toCPU(int t){
     CompServ *cs=new CompServ(t, {}, {},0);
 
+    stage_reset();
+
     for (int i = 0; i < snets.size(); i++) {
         for (unsigned int j = 0; j < Xs[i].size(); ++j) delete Xs[i][j];
         for (unsigned int j = 0; j < Ys[i].size(); ++j) delete Ys[i][j];
@@ -122,6 +126,8 @@ void Net::toCPU(int t){
 void Net::toGPU(vector<int> g,int lsb,int mem){
     CompServ *cs=new CompServ(0, g, {},lsb,mem);
 
+    stage_reset();
+
     for (int i = 0; i < snets.size(); i++) {
         for (unsigned int j = 0; j < Xs[i].size(); ++j) delete Xs[i][j];
         for (unsigned int j = 0; j < Ys[i].size(); ++j) delete Ys[i][j];
@@ -148,6 +154,9 @@ void Net::build(Optimizer *opt, vloss lo, vmetrics me, CompServ *cs,
     }
   }
 
+  if (fusion && cs->local_gpus.empty() && cs->local_fpgas.empty()) fuse_pointwise();
+  if (channels_last && cs->local_gpus.empty() && cs->local_fpgas.empty()) set_layout();
+
   make_graph(opt, lo, me, initialize);
   this->do_optimizer_delete = do_optimizer_delete;
 
@@ -223,6 +232,8 @@ void Net::set_compserv(CompServ *cs, bool do_compserv_delete){
     mem_level=cs->mem_level;
     for(int i=0;i<layers.size();i++)
         layers[i]->set_mem_level(mem_level);
+    recompute_reset();
+    mem_plan_reset();
 
     if (cs->type == "local") {
 
@@ -239,6 +250,19 @@ void Net::set_compserv(CompServ *cs, bool do_compserv_delete){
 
                 Eigen::initParallel();
                 Eigen::setNbThreads(nthreads);
+                cpu_pool_set_threads(nthreads, cs->pin_threads, cs->numa);
+                cpu_numa_set_first_touch(cs->numa);
+
+                // The weights are read by all the threads (GEMMs), the rest
+                // goes to the node of the threads that work on each part
+                if (cs->numa) {
+                    for (auto l : layers) {
+                        for (auto t : l->params) cpu_numa_interleave(t->ptr, t->size * sizeof(float));
+                        for (auto t : l->gradients) cpu_numa_interleave(t->ptr, t->size * sizeof(float));
+                        if (l->output != nullptr) cpu_numa_place(l->output->ptr, l->output->size * sizeof(float));
+                        if (l->delta != nullptr) cpu_numa_place(l->delta->ptr, l->delta->size * sizeof(float));
+                    }
+                }
 
                 snets.push_back(this);
 
@@ -413,6 +437,16 @@ void Net::resize(int b)
     m = batch_size % c;
   }
 
+  // Delta and output shapes change with the batch
+  stage_reset();
+  recompute_reset();
+  mem_plan_reset();
+  for (i = 0; i < snets.size(); i++)
+    if (snets[i] != this) {
+      snets[i]->recompute_reset();
+      snets[i]->mem_plan_reset();
+    }
+
   for (j = 0; j < layers.size(); j++)
       layers[j]->resize(batch_size);
 
@@ -457,6 +491,22 @@ void Net::setTrainable(string lname, bool val)
   }//layers
 }
 
+void Net::set_weights_dtype(int dtype)
+{
+  if (snets.empty() || (snets[0]->dev != DEV_CPU)) msg("16-bit weights are only supported on CPU", "Net::set_weights_dtype");
+
+  for(int i=0;i<snets.size();i++)
+    for(int j=0;j<snets[i]->layers.size();j++)
+      snets[i]->layers[j]->set_weights_dtype(dtype);
+}
+void Net::quantize(bool enable)
+{
+  if (snets.empty() || (snets[0]->dev != DEV_CPU)) msg("Int8 inference is only supported on CPU", "Net::quantize");
+
+  for(int i=0;i<snets.size();i++)
+    for(int j=0;j<snets[i]->layers.size();j++)
+      snets[i]->layers[j]->quantize(enable);
+}
 
 void Net::removeLayer(string lname)
 {
@@ -46,25 +46,36 @@ void Net::do_reset_grads() {
 }
 
 void Net::do_forward() {
+  if (recompute_state == RECOMPUTE_TODO) recompute_build();
 
   for (int i = 0; i < vfts.size(); i++)
     vfts[i]->forward();
 
+  // The arena keeps the outputs of the last segment
+  if (recompute_state == RECOMPUTE_READY) recompute_segment = recompute_layers.size() - 1;
 }
 
 void Net::do_backward() {
   for (int i = 0; i < vbts.size(); i++) {
-    if (!vbts[i]->trainable) return;
+    if (!vbts[i]->trainable) break;
 
+    if (recompute_state == RECOMPUTE_READY) recompute(vbts[i]);
+
+    mem_plan_step = i + 1;
     vbts[i]->mem_delta_parent();
 
-     vbts[i]->backward();
+    vbts[i]->backward();
 
     if(vbts[i]->mem_level) { vbts[i]->free_delta(); }
   }
+
+  mem_plan_check();
 }
 
 void Net::do_delta() {
+  if (mem_plan_state == MEM_PLAN_TODO) mem_plan_build();
+
+  mem_plan_step = 0;
   for (int i = 0; i < lout.size(); i++) {
     lout[i]->mem_delta();
     if (losses.size()>=(i+1)) {
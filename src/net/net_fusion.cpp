@@ -0,0 +1,269 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "eddl/net/net.h"
+#include "eddl/layers/core/layer_core.h"
+#include "eddl/layers/conv/layer_conv.h"
+#include "eddl/layers/merge/layer_merge.h"
+#include "eddl/layers/operators/layer_operators.h"
+#include "eddl/utils.h"
+
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////
+///// POINTWISE FUSION
+/////////////////////////////////////////////////////////////////
+// Every pointwise layer reads its inputs and writes its output once, so a
+// chain of them (Add -> ReLu, x * k + b -> Sigmoid,...) makes several passes
+// over memory and keeps all the intermediate outputs. When the net is built
+// with fusion enabled, each chain is replaced by a single LFused layer that
+// runs all its ops tile by tile and only writes the output of the chain (the
+// backward runs the tile again instead of keeping the intermediate results).
+//
+// A layer can be inside a chain (not at its end) when its only child is also
+// fusible and it is not an output of the net or a checkpoint. The fused layer
+// takes the name, the output tensor and the children of the last layer of the
+// chain, so the handles to it keep working. Only for CPU.
+//
+// Before that, an activation whose parent is a Dense or a Conv (read only by
+// the activation) goes into that layer as an epilogue: it runs on the output
+// while it is in cache (with the bias, in Dense) and the backward scales the
+// delta by its derivative. The producer takes the output tensor and the
+// children of the activation.
+
+
+// Appends the ops of the layer l (its parents are in the registers in) and
+// returns the register of the result (-1: l can not be fused)
+static int fusion_ops(Layer *l, const vector<int> &in, int nin, vector<FusedOp> &ops) {
+    auto push = [&](int op, int a, int b, float k) {
+        ops.push_back({op, a, b, k});
+        return nin + (int)ops.size() - 1;
+    };
+
+    if (auto *a = dynamic_cast<LActivation *>(l)) {
+        if (a->delta_bp) return -1;
+        if (a->act == "relu") return push(FUSED_RELU, in[0], -1, 0.0f);
+        if (a->act == "leaky_relu") return push(FUSED_LEAKY_RELU, in[0], -1, a->params[0]);
+        if (a->act == "sigmoid") return push(FUSED_SIGMOID, in[0], -1, 0.0f);
+        if (a->act == "tanh") return push(FUSED_TANH, in[0], -1, 0.0f);
+        if (a->act == "exp") return push(FUSED_EXP, in[0], -1, 0.0f);
+        if (a->act == "linear") return push(FUSED_MULTK, in[0], -1, a->params[0]);
+        return -1;
+    }
+    if (auto *o = dynamic_cast<LSum *>(l)) {
+        if (o->binary) return push(FUSED_ADD, in[0], in[1], 0.0f);
+        return push(FUSED_ADDK, in[0], -1, o->val);
+    }
+    if (auto *o = dynamic_cast<LDiff *>(l)) {
+        if (o->binary) return push(FUSED_SUB, in[0], in[1], 0.0f);
+        if (o->left) return push(FUSED_ADDK, in[0], -1, -o->val);
+        return push(FUSED_KSUB, in[0], -1, o->val);
+    }
+    if (auto *o = dynamic_cast<LMult *>(l)) {
+        if (o->binary) return push(FUSED_MULT, in[0], in[1], 0.0f);
+        return push(FUSED_MULTK, in[0], -1, o->val);
+    }
+    if (auto *o = dynamic_cast<LDiv *>(l)) {
+        if (o->binary) return push(FUSED_DIV, in[0], in[1], 0.0f);
+        if (o->left) return push(FUSED_DIVK, in[0], -1, o->val);
+        return push(FUSED_KDIV, in[0], -1, o->val);
+    }
+    if (dynamic_cast<LExp *>(l)) return push(FUSED_EXP, in[0], -1, 0.0f);
+    if (dynamic_cast<LLog *>(l)) return push(FUSED_LOG, in[0], -1, 0.0f);
+    if (dynamic_cast<LSqrt *>(l)) return push(FUSED_SQRT, in[0], -1, 0.0f);
+    if (dynamic_cast<LAbs *>(l)) return push(FUSED_ABS, in[0], -1, 0.0f);
+    if (dynamic_cast<LAdd *>(l)) {
+        if (in.size() < 2) return -1;
+        int r = push(FUSED_ADD, in[0], in[1], 0.0f);
+        for (int i = 2; i < in.size(); i++) r = push(FUSED_ADD, r, in[i], 0.0f);
+        return r;
+    }
+
+    return -1;
+}
+
+static bool fusible(Net *net, Layer *l) {
+    int ind;
+
+    if ((l->net != net) || (l->orig != nullptr) || l->isshared || l->isrecurrent) return false;
+    if ((l->dev != DEV_CPU) || l->parent.empty() || isIn(l, net->lin, ind)) return false;
+    // No broadcasting
+    for (auto p : l->parent)
+        if (p->output->shape != l->output->shape) return false;
+
+    vector<FusedOp> ops;
+    return fusion_ops(l, vector<int>(l->parent.size(), 0), 0, ops) >= 0;
+}
+
+// The output of l is only read by the next layer of the chain
+static bool fusion_inner(Net *net, Layer *l) {
+    int ind;
+
+    if ((l->child.size() != 1) || l->checkpoint || isIn(l, net->lout, ind)) return false;
+    if (!isIn(l->child[0], net->layers, ind)) return false;
+    return fusible(net, l) && fusible(net, l->child[0]);
+}
+
+// Layers of the chain that ends at l, in forward order
+static void fusion_chain(Net *net, Layer *l, vlayer &chain) {
+    int ind;
+
+    for (auto p : l->parent)
+        if (!isIn(p, chain, ind) && fusion_inner(net, p)) fusion_chain(net, p, chain);
+    chain.push_back(l);
+}
+
+// Activation that can run as the epilogue of its parent (FUSED_NONE: none)
+static int epilogue_op(Net *net, Layer *l, float &k) {
+  int ind;
+
+  auto *a = dynamic_cast<LActivation *>(l);
+  if ((a == nullptr) || a->delta_bp || (l->parent.size() != 1) || !fusible(net, l)) return FUSED_NONE;
+
+  Layer *p = l->parent[0];
+  if ((p->net != net) || (p->orig != nullptr) || p->isshared || (p->dev != DEV_CPU)) return FUSED_NONE;
+  if ((p->child.size() != 1) || p->checkpoint || isIn(p, net->lout, ind) || p->output->isshared) return FUSED_NONE;
+
+  auto *d = dynamic_cast<LDense *>(p);
+  auto *c = dynamic_cast<LConv *>(p);
+  if (((d == nullptr) || (d->epilogue != FUSED_NONE)) && ((c == nullptr) || (c->epilogue != FUSED_NONE)))
+    return FUSED_NONE;
+
+  // The derivative is taken from the output
+  k = 0.0f;
+  if (a->act == "relu") return FUSED_RELU;
+  if (a->act == "sigmoid") return FUSED_SIGMOID;
+  if (a->act == "tanh") return FUSED_TANH;
+  if ((a->act == "leaky_relu") && (a->params[0] >= 0.0f)) {
+    k = a->params[0];
+    return FUSED_LEAKY_RELU;
+  }
+  return FUSED_NONE;
+}
+
+static void fuse_epilogues(Net *net) {
+  int i, ind;
+
+  vlayer acts;
+  for (auto l : net->layers) {
+    float k;
+    if (epilogue_op(net, l, k) != FUSED_NONE) acts.push_back(l);
+  }
+
+  for (auto a : acts) {
+    float k;
+    int op = epilogue_op(net, a, k);
+    Layer *p = a->parent[0];
+
+    // The producer writes the output tensor of the activation (its children
+    // and the handles to it read that one)
+    delete p->output;
+    p->output = a->output;
+    if (auto *d = dynamic_cast<LDense *>(p)) {
+      d->epilogue = op;
+      d->epilogue_k = k;
+    }
+    if (auto *c = dynamic_cast<LConv *>(p)) {
+      c->cd->O = a->output;
+      c->epilogue = op;
+      c->epilogue_k = k;
+    }
+
+    p->child = a->child;
+    p->lout = a->lout;
+    for (auto c : a->child)
+      for (i = 0; i < c->parent.size(); i++)
+        if (c->parent[i] == a) c->parent[i] = p;
+
+    for (i = 0; i < net->lout.size(); i++)
+      if (net->lout[i] == a) net->lout[i] = p;
+
+    if (isIn(a, net->layers, ind)) net->layers.erase(net->layers.begin() + ind);
+    net->fused.push_back(a);
+  }
+}
+
+void Net::fuse_pointwise() {
+  int i, ind;
+
+  for (auto l : layers)
+    if (l->isrecurrent || l->isdecoder) return;
+  if (isencoder) return;
+
+  fuse_epilogues(this);
+
+  vlayer ends;
+  for (auto l : layers)
+    if (fusible(this, l) && !fusion_inner(this, l)) ends.push_back(l);
+
+  for (auto last : ends) {
+    vlayer chain;
+    fusion_chain(this, last, chain);
+    if (chain.size() < 2) continue;
+
+    // Parents of the chain in registers 0..ext.size()-1
+    vlayer ext;
+    for (auto l : chain)
+      for (auto p : l->parent)
+        if (!isIn(p, chain, ind) && !isIn(p, ext, ind)) ext.push_back(p);
+
+    vector<FusedOp> ops;
+    map<Layer *, int> reg;
+    for (i = 0; i < ext.size(); i++) reg[ext[i]] = i;
+    for (auto l : chain) {
+      vector<int> in;
+      for (auto p : l->parent) in.push_back(reg[p]);
+      reg[l] = fusion_ops(l, in, ext.size(), ops);
+    }
+
+    // Unlink the chain from its parents (the fused layer links itself)
+    for (auto p : ext) {
+      for (i = p->child.size() - 1; i >= 0; i--)
+        if (isIn(p->child[i], chain, ind)) {
+          p->child.erase(p->child.begin() + i);
+          p->lout--;
+        }
+    }
+
+    auto *f = new LFused(ext, ops, last->name, last->dev, last->mem_level);
+    f->net = this;
+    f->checkpoint = last->checkpoint;
+    f->verbosity_level = last->verbosity_level;
+
+    // Same output tensor (and children) than the last layer of the chain
+    delete f->output;
+    f->output = last->output;
+    f->child = last->child;
+    f->lout = last->lout;
+    for (auto c : last->child)
+      for (i = 0; i < c->parent.size(); i++)
+        if (c->parent[i] == last) c->parent[i] = f;
+
+    for (i = 0; i < lout.size(); i++)
+      if (lout[i] == last) lout[i] = f;
+
+    for (i = 0; i < layers.size(); i++)
+      if (layers[i] == last) layers[i] = f;
+
+    for (auto l : chain) {
+      if (l != last) {
+        if (isIn(l, layers, ind)) layers.erase(layers.begin() + ind);
+        delete l->output;
+        l->output = nullptr;
+      }
+      fused.push_back(l);
+    }
+  }
+}
@@ -0,0 +1,106 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "eddl/net/net.h"
+#include "eddl/layers/core/layer_core.h"
+#include "eddl/layers/conv/layer_conv.h"
+#include "eddl/layers/merge/layer_merge.h"
+#include "eddl/layers/normalization/layer_normalization.h"
+#include "eddl/layers/pool/layer_pool.h"
+#include "eddl/utils.h"
+
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////
+///// CHANNELS-LAST LAYOUT
+/////////////////////////////////////////////////////////////////
+// The tensors keep their NCHW shape, but when the net is built with
+// channels-last enabled the outputs (and the deltas) of some layers are
+// stored (b,r,c,z): the channels of a pixel are contiguous, so the batchnorm
+// does not permute its data and the pooling and the im2col of the next
+// convolution read whole pixels.
+//
+// A convolution reads and writes both layouts (the flags of its descriptor),
+// the pooling, the batchnorm and the elementwise layers (pointwise
+// activations, Add and the fused layers) keep the layout of their parents.
+// So a layer is stored channels-last when it can be (CPU, 4D, not an output
+// of the net), all its parents are (but for the convolutions) and all its
+// children read it (they are channels-last too or convolutions). Only for
+// CPU.
+
+
+// The layer l can work with channels-last data
+static bool layout_capable(Net *net, Layer *l) {
+    int ind;
+
+    if ((l->net != net) || (l->orig != nullptr) || l->isshared || l->isrecurrent) return false;
+    if ((l->dev != DEV_CPU) || l->parent.empty() || isIn(l, net->lout, ind)) return false;
+    if (l->output->ndim != 4) return false;
+
+    if (dynamic_cast<LConv *>(l)) return true;
+    if (dynamic_cast<LPool *>(l)) return true;
+    if (dynamic_cast<LBatchNorm *>(l)) return true;
+    if (dynamic_cast<LAdd *>(l) || dynamic_cast<LFused *>(l)) {
+        // No broadcasting
+        for (auto p : l->parent)
+            if (p->output->shape != l->output->shape) return false;
+        return true;
+    }
+    if (auto *a = dynamic_cast<LActivation *>(l)) {
+        if (a->delta_bp) return false;
+        return (a->act != "softmax") && (a->act != "softmax_deprecated");
+    }
+
+    return false;
+}
+
+// The layer l keeps its layout: the parents (but of a convolution) and the
+// children (but the convolutions) must have the same one
+static bool layout_consistent(Net *net, Layer *l) {
+    int ind;
+
+    if (!dynamic_cast<LConv *>(l))
+        for (auto p : l->parent)
+            if (!p->channels_last) return false;
+    for (auto c : l->child)
+        if (!c->channels_last && !(dynamic_cast<LConv *>(c) && isIn(c, net->layers, ind))) return false;
+    return true;
+}
+
+void Net::set_layout() {
+  for (auto l : layers)
+    if (l->isrecurrent || l->isdecoder) return;
+  if (isencoder) return;
+
+  // Mark all the capable layers and unmark the inconsistent ones until none is left
+  for (auto l : layers) l->channels_last = layout_capable(this, l);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto l : layers)
+      if (l->channels_last && !layout_consistent(this, l)) {
+        l->channels_last = false;
+        changed = true;
+      }
+  }
+
+  for (auto l : layers) {
+    if (auto *c = dynamic_cast<LConv *>(l)) {
+      c->cd->channels_last_in = l->parent[0]->channels_last;
+      c->cd->channels_last_out = l->channels_last;
+    }
+    else if (auto *p = dynamic_cast<LPool *>(l)) p->pd->channels_last = l->channels_last;
+  }
+}
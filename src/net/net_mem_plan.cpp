@@ -0,0 +1,203 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+#include "eddl/net/net.h"
+#include "eddl/utils.h"
+
+
+using namespace std;
+
+// Offsets inside the arena are aligned to 64 bytes
+#define MEM_PLAN_ALIGN 16
+
+/////////////////////////////////////////////////////////////////
+///// DELTA MEMORY PLANNER (mem_level > 0)
+/////////////////////////////////////////////////////////////////
+// The backward is a sequence of steps: step 0 books the deltas of the outputs
+// (do_delta) and step i+1 books the deltas of the parents of vbts[i] and runs
+// its backward. The delta of a layer is written by the backward of its
+// children and read for the last time by its own backward, after which it is
+// freed. So each delta lives from the step that books it to the step of its
+// own backward (both included), and deltas whose lifetimes do not overlap can
+// share memory.
+//
+// The plan is built from the graph before the first backward (and again after
+// a batch size change). The steps that book each delta are taken from the
+// mem_delta of the layers (some of them book the deltas of their parents with
+// their own), running them in the order of vbts without the backward. Then the
+// deltas are packed into a single arena (greedy by size).
+//
+// A layer only takes its memory of the arena when its delta is booked at the
+// planned step (see Layer::alloc_delta). Otherwise (i.e. the backward took a
+// different path) it gets memory of its own, so a block is never reused before
+// the last reader of the previous delta. Deltas that survive the backward or
+// that are shared with other layers (reshapes, DA, noise,...) are left out.
+//
+// Outputs keep their own memory: the backward reads all of them, and so does
+// the user after a batch (getOutput, metrics,...).
+
+
+void Net::mem_plan_reset() {
+  // Release the deltas that are still in the arena
+  for (int i = 0; i < layers.size(); i++) {
+    Layer *l = layers[i];
+    if ((l->delta_slab != nullptr) && (l->delta != nullptr) && (l->delta->ptr == l->delta_slab)) l->free_delta();
+    l->delta_slab = nullptr;
+    l->delta_slab_size = 0;
+    l->delta_step = -1;
+  }
+
+  if (mem_plan_arena != nullptr) {
+    eddl_free(mem_plan_arena);
+    mem_plan_arena = nullptr;
+  }
+  mem_plan_arena_size = 0;
+  mem_plan_unplanned_size = 0;
+  mem_plan_step = -1;
+
+  // Only CPU nets that free their deltas during the backward
+  if ((dev == DEV_CPU) && (mem_level > 0) && (!isrecurrent)) mem_plan_state = MEM_PLAN_TODO;
+  else mem_plan_state = MEM_PLAN_OFF;
+}
+
+void Net::mem_plan_build() {
+  int n = layers.size();
+  vector<int> first(n, -1), last(n, -1);
+  vector<unsigned long int> size(n, 0);
+  vector<bool> skip(n, false);
+
+  for (int i = 0; i < n; i++) {
+    layers[i]->delta_alloc = false;
+    // Not booked by the backward
+    if (layers[i]->delta != nullptr) skip[i] = true;
+  }
+
+  auto record = [&](int step) {
+    unordered_map<Tensor *, int> owner;
+    for (int i = 0; i < n; i++) {
+      Tensor *d = layers[i]->delta;
+      if (d == nullptr) continue;
+
+      // Views of other deltas or the same tensor in two layers
+      if (d->isshared) skip[i] = true;
+      auto it = owner.find(d);
+      if (it != owner.end()) {
+        skip[i] = true;
+        skip[it->second] = true;
+      } else {
+        owner[d] = i;
+      }
+
+      if (first[i] < 0) first[i] = step;
+      last[i] = step;
+      size[i] = std::max(size[i], (unsigned long int)d->size);
+    }
+  };
+
+  // Booking of the deltas, as done by do_delta and do_backward
+  mem_plan_step = -1;
+  for (int i = 0; i < lout.size(); i++) lout[i]->mem_delta();
+  record(0);
+
+  for (int i = 0; i < vbts.size(); i++) {
+    if (!vbts[i]->trainable) break;
+
+    vbts[i]->mem_delta_parent();
+    record(i + 1);
+
+    if (vbts[i]->mem_level) vbts[i]->free_delta();
+  }
+
+  // Deltas that survive the backward (they are booked again by the next one)
+  for (int i = 0; i < n; i++) {
+    if (skip[i] || (layers[i]->delta == nullptr)) continue;
+    skip[i] = true;
+    layers[i]->free_delta();
+  }
+
+  struct Block {
+    Layer *layer;
+    int first, last;
+    unsigned long int size, offset;
+  };
+
+  vector<Block> blocks;
+  mem_plan_unplanned_size = 0;
+  for (int i = 0; i < n; i++) {
+    // Only the deltas that take their memory from alloc_delta
+    if ((first[i] < 0) || skip[i] || !layers[i]->delta_alloc) continue;
+
+    unsigned long int s = (size[i] + MEM_PLAN_ALIGN - 1) / MEM_PLAN_ALIGN * MEM_PLAN_ALIGN;
+    blocks.push_back({layers[i], first[i], last[i], s, 0});
+    mem_plan_unplanned_size += s;
+  }
+
+  // Greedy by size: biggest blocks first, each one at the lowest offset that
+  // does not collide with an already placed block alive at the same step
+  std::stable_sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) { return a.size > b.size; });
+
+  vector<Block *> placed;
+  mem_plan_arena_size = 0;
+  for (auto &b : blocks) {
+    vector<Block *> overlap;
+    for (auto p : placed)
+      if ((p->first <= b.last) && (b.first <= p->last)) overlap.push_back(p);
+    std::sort(overlap.begin(), overlap.end(), [](const Block *x, const Block *y) { return x->offset < y->offset; });
+
+    unsigned long int offset = 0;
+    for (auto p : overlap) {
+      if (offset + b.size <= p->offset) break;
+      offset = std::max(offset, p->offset + p->size);
+    }
+
+    b.offset = offset;
+    placed.push_back(&b);
+    mem_plan_arena_size = std::max(mem_plan_arena_size, offset + b.size);
+  }
+
+  if (mem_plan_arena_size > 0) {
+    mem_plan_arena = get_fmem(mem_plan_arena_size, "Net::mem_plan_build");
+    for (auto &b : blocks) {
+      b.layer->delta_slab = mem_plan_arena + b.offset;
+      b.layer->delta_slab_size = b.size;
+      b.layer->delta_step = b.first;
+    }
+  }
+
+  if (verbosity_level >= 1) {
+    cout << "Delta memory plan of " << name << ": " << blocks.size() << " deltas, ";
+    cout << bytes2human(mem_plan_arena_size * sizeof(float)) << " (instead of ";
+    cout << bytes2human(mem_plan_unplanned_size * sizeof(float)) << ")" << endl;
+  }
+
+  mem_plan_state = MEM_PLAN_READY;
+}
+
+void Net::mem_plan_check() {
+  mem_plan_step = -1;
+  if (mem_plan_state != MEM_PLAN_READY) return;
+
+  // A delta of the arena that was not freed by the backward (i.e. a layer was
+  // frozen) would be overwritten by the next one => plan again
+  for (int i = 0; i < layers.size(); i++) {
+    Layer *l = layers[i];
+    if ((l->delta_slab != nullptr) && (l->delta != nullptr) && (l->delta->ptr == l->delta_slab)) {
+      if (verbosity_level >= 1) cout << "Delta memory plan of " << name << " discarded" << endl;
+      mem_plan_reset();
+      return;
+    }
+  }
+}
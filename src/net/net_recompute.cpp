@@ -0,0 +1,173 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "eddl/net/net.h"
+#include "eddl/utils.h"
+
+
+using namespace std;
+
+// Offsets inside the arena are aligned to 64 bytes
+#define RECOMPUTE_ALIGN 16
+
+/////////////////////////////////////////////////////////////////
+///// ACTIVATION RECOMPUTATION (mem_level 3)
+/////////////////////////////////////////////////////////////////
+// The forward order is split in segments that end at a checkpoint: the layers
+// marked by the user (see eddl::Checkpoint) or, if there are none, one layer
+// every sqrt(N). The outputs that are only read inside their own segment are
+// moved to a single arena, shared by all the segments, so after the forward
+// only the outputs of the last segment are there. During the backward, the
+// segment needed by each layer is recomputed (running again the forward of
+// its layers) before its backward.
+//
+// Outputs are moved once (when the plan is built) and never reallocated, so
+// the pointers that other tensors keep to them stay valid. An output is kept
+// in its own memory when:
+// - it is an input or an output of the net, or a checkpoint
+// - the layer has no parents or its forward is not repeatable (dropout, noise,
+//   DA, batchnorm: see Layer::isrecomputable)
+// - it is a view of other tensor or there are views of it (reshapes,...)
+// - it is read by a layer of another segment
+
+
+static bool recompute_keep(Net *net, Layer *l, map<Layer *, int> &seg) {
+  int ind;
+
+  if (isIn(l, net->lin, ind) || isIn(l, net->lout, ind)) return true;
+  if (l->checkpoint || !l->isrecomputable || l->isrecurrent) return true;
+  if (l->parent.empty() || (l->output == nullptr) || l->output->isshared) return true;
+
+  for (int i = 0; i < l->child.size(); i++) {
+    Layer *c = l->child[i];
+    auto it = seg.find(c);
+    if (it == seg.end() || it->second != seg[l]) return true;
+    if ((c->output == nullptr) || c->output->isshared) return true;
+  }
+
+  return false;
+}
+
+void Net::recompute_reset() {
+  // Give the recomputed outputs their own memory back
+  for (int s = 0; s < recompute_layers.size(); s++)
+    for (int i = 0; i < recompute_layers[s].size(); i++)
+      recompute_layers[s][i]->output->updateData(nullptr);
+
+  if (recompute_arena != nullptr) {
+    eddl_free(recompute_arena);
+    recompute_arena = nullptr;
+  }
+  recompute_arena_size = 0;
+
+  recompute_layers.clear();
+  recompute_need.clear();
+  recompute_segment = -1;
+
+  if ((dev == DEV_CPU) && (mem_level == 3) && (!isrecurrent)) recompute_state = RECOMPUTE_TODO;
+  else recompute_state = RECOMPUTE_OFF;
+}
+
+void Net::recompute_build() {
+  // Segments
+  bool marked = false;
+  for (int i = 0; i < layers.size(); i++)
+    if (layers[i]->checkpoint) marked = true;
+
+  int n = vfts.size();
+  int k = std::max(1, (int)ceil(sqrt((double)n)));
+
+  map<Layer *, int> seg;
+  int s = 0;
+  for (int i = 0; i < n; i++) {
+    seg[vfts[i]] = s;
+    if (marked ? vfts[i]->checkpoint : ((i + 1) % k == 0)) s++;
+  }
+
+  // Recomputed layers of each (non-empty) segment
+  map<int, int> group;
+  unsigned long int kept_size = 0;
+  for (int i = 0; i < n; i++) {
+    Layer *l = vfts[i];
+    if (recompute_keep(this, l, seg)) {
+      if ((l->output != nullptr) && !l->output->isshared) kept_size += l->output->size;
+      continue;
+    }
+
+    if (group.find(seg[l]) == group.end()) {
+      group[seg[l]] = recompute_layers.size();
+      recompute_layers.push_back(vlayer());
+    }
+    recompute_layers[group[seg[l]]].push_back(l);
+  }
+
+  // The backward of a layer reads its output and the outputs of its parents
+  for (int i = 0; i < n; i++) {
+    Layer *l = vfts[i];
+    vlayer rl = l->parent;
+    rl.push_back(l);
+    for (int j = 0; j < rl.size(); j++) {
+      auto it = seg.find(rl[j]);
+      if ((it == seg.end()) || recompute_keep(this, rl[j], seg)) continue;
+      recompute_need[l] = group[it->second];
+    }
+  }
+
+  // Arena: the segments overlap, the outputs inside a segment do not
+  vector<vector<unsigned long int>> offset(recompute_layers.size());
+  unsigned long int recomputed_size = 0;
+  recompute_arena_size = 0;
+  for (int g = 0; g < recompute_layers.size(); g++) {
+    unsigned long int size = 0;
+    for (int i = 0; i < recompute_layers[g].size(); i++) {
+      offset[g].push_back(size);
+      size += (recompute_layers[g][i]->output->size + RECOMPUTE_ALIGN - 1) / RECOMPUTE_ALIGN * RECOMPUTE_ALIGN;
+    }
+    recomputed_size += size;
+    recompute_arena_size = std::max(recompute_arena_size, size);
+  }
+
+  if (recompute_arena_size > 0) {
+    recompute_arena = get_fmem(recompute_arena_size, "Net::recompute_build");
+    for (int g = 0; g < recompute_layers.size(); g++)
+      for (int i = 0; i < recompute_layers[g].size(); i++) {
+        Tensor *o = recompute_layers[g][i]->output;
+        o->deleteData();
+        o->updateData(recompute_arena + offset[g][i]);
+      }
+  }
+
+  if (verbosity_level >= 1) {
+    int count = 0;
+    for (int g = 0; g < recompute_layers.size(); g++) count += recompute_layers[g].size();
+    cout << "Recompute plan of " << name << ": " << recompute_layers.size() << " segments, ";
+    cout << count << " outputs recomputed, " << bytes2human((kept_size + recompute_arena_size) * sizeof(float));
+    cout << " of outputs (instead of " << bytes2human((kept_size + recomputed_size) * sizeof(float)) << ")" << endl;
+  }
+
+  recompute_segment = -1;
+  recompute_state = RECOMPUTE_READY;
+}
+
+void Net::recompute(Layer *l) {
+  auto it = recompute_need.find(l);
+  if ((it == recompute_need.end()) || (it->second == recompute_segment)) return;
+
+  vlayer &rl = recompute_layers[it->second];
+  for (int i = 0; i < rl.size(); i++)
+    rl[i]->forward();
+
+  recompute_segment = it->second;
+}
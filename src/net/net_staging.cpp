@@ -0,0 +1,131 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "eddl/net/net.h"
+#include "eddl/utils.h"
+
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////
+///// INPUT STAGING (double-buffered Xs/Ys)
+/////////////////////////////////////////////////////////////////
+// train_batch gathers the samples of the batch (Tensor::select into Xs/Ys)
+// before copying them to the inputs of the snets. prefetch_batch does that
+// gather on a background thread, in one of two staging slots shaped as Xs/Ys,
+// so the next batch is assembled while the current one is training. Then
+// train_batch takes its samples from the slot that matches its data and
+// indices (waiting for it if needed) and only copies them to the snets.
+//
+// Only CPU data is staged: the gather of GPU data would run device code on
+// another thread.
+
+
+void Net::stage_reset() {
+  for (int s = 0; s < 2; s++) {
+    if (stage_ready[s].valid()) {
+      try { stage_ready[s].get(); } catch (...) {}
+    }
+
+    for (int i = 0; i < stage_x[s].size(); i++)
+      for (int j = 0; j < stage_x[s][i].size(); j++) delete stage_x[s][i][j];
+    for (int i = 0; i < stage_y[s].size(); i++)
+      for (int j = 0; j < stage_y[s][i].size(); j++) delete stage_y[s][i][j];
+
+    stage_x[s].clear();
+    stage_y[s].clear();
+    stage_src_x[s].clear();
+    stage_src_y[s].clear();
+    stage_sind[s].clear();
+  }
+}
+
+void Net::prefetch_batch(vtensor X, vtensor Y, vind sind) {
+  if (!input_overlap || isrecurrent || snets.empty()) return;
+  if ((X.size() != lin.size()) || (Y.size() != lout.size()) || sind.empty()) return;
+  for (int j = 0; j < X.size(); j++) if (!X[j]->isCPU()) return;
+  for (int j = 0; j < Y.size(); j++) if (!Y[j]->isCPU()) return;
+
+  if (batch_size != sind.size()) resize(sind.size());
+
+  // Slots are used in turns: a batch staged two prefetches ago that was not
+  // trained yet will not be (it is dropped)
+  int s = stage_turn;
+  stage_turn = 1 - stage_turn;
+  if (stage_ready[s].valid()) {
+    try { stage_ready[s].get(); } catch (...) {}
+  }
+
+  // Same shapes than Xs/Ys
+  int comp = snets.size();
+  if (batch_size < comp) return;
+  bool valid = (stage_x[s].size() == comp);
+  for (int i = 0; valid && (i < comp); i++) {
+    if ((stage_x[s][i].size() != Xs[i].size()) || (stage_y[s][i].size() != Ys[i].size())) { valid = false; break; }
+    for (int j = 0; j < Xs[i].size(); j++) if (stage_x[s][i][j]->shape != Xs[i][j]->shape) valid = false;
+    for (int j = 0; j < Ys[i].size(); j++) if (stage_y[s][i][j]->shape != Ys[i][j]->shape) valid = false;
+  }
+  if (!valid) {
+    for (int i = 0; i < stage_x[s].size(); i++)
+      for (int j = 0; j < stage_x[s][i].size(); j++) delete stage_x[s][i][j];
+    for (int i = 0; i < stage_y[s].size(); i++)
+      for (int j = 0; j < stage_y[s][i].size(); j++) delete stage_y[s][i][j];
+
+    stage_x[s].assign(comp, vtensor());
+    stage_y[s].assign(comp, vtensor());
+    for (int i = 0; i < comp; i++) {
+      for (int j = 0; j < Xs[i].size(); j++) stage_x[s][i].push_back(new Tensor(Xs[i][j]->shape));
+      for (int j = 0; j < Ys[i].size(); j++) stage_y[s][i].push_back(new Tensor(Ys[i][j]->shape));
+    }
+  }
+
+  stage_src_x[s] = X;
+  stage_src_y[s] = Y;
+  stage_sind[s] = sind;
+
+  int thread_batch_size = batch_size / comp;
+  Mtensor &xs = stage_x[s];
+  Mtensor &ys = stage_y[s];
+  vind &ind = stage_sind[s];
+  stage_ready[s] = std::async(std::launch::async, [X, Y, &xs, &ys, &ind, comp, thread_batch_size]() {
+    for (int i = 0; i < comp; i++) {
+      int start = i * thread_batch_size;
+      for (int j = 0; j < X.size(); j++)
+        Tensor::select(X[j], xs[i][j], ind, start, start + xs[i][j]->shape[0]);
+      for (int j = 0; j < Y.size(); j++)
+        Tensor::select(Y[j], ys[i][j], ind, start, start + ys[i][j]->shape[0]);
+    }
+  });
+}
+
+bool Net::stage_load(vtensor &X, vtensor &Y, vind &sind) {
+  for (int s = 0; s < 2; s++) {
+    if (!stage_ready[s].valid()) continue;
+    if ((stage_src_x[s] != X) || (stage_src_y[s] != Y) || (stage_sind[s] != sind)) continue;
+
+    stage_ready[s].get();  // Rethrows the errors of the gather
+
+    for (int i = 0; i < snets.size(); i++) {
+      for (int j = 0; j < X.size(); j++)
+        Tensor::copy(stage_x[s][i][j], snets[i]->lin[j]->input);
+      for (int j = 0; j < Y.size(); j++) {
+        snets[i]->lout[j]->check_target();
+        Tensor::copy(stage_y[s][i][j], snets[i]->lout[j]->target);
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
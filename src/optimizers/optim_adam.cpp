@@ -87,6 +87,28 @@ void Adam::applygrads(int batch) {
     for (int i = 0; i < layers.size(); i++)
       if (layers[i]->trainable) {
         for (int j = 0; j < layers[i]->get_trainable_params_count(); j++, p++) {
+            if (layers[i]->params[j]->isCPU()) {
+                // Same steps, fused (see tensor_expr.h): 3 passes instead of 10
+                auto g = Tensor::expr(layers[i]->gradients[j]);
+                auto m = Tensor::expr(mT[p]);
+                auto v = Tensor::expr(vT[p]);
+                float c1 = 1 - pow(beta_1, t);
+                float c2 = 1 - pow(beta_2, t);
+
+                mT[p]->assign(beta_1 * m + (1 - beta_1) * g);
+                vT[p]->assign(beta_2 * v + (1 - beta_2) * sqr(g));
+
+                if (layers[i]->acc_gradients.size() > 0) {
+                    mCap[p]->assign((m / c1) / sqrt(v / c2 + epsilon));
+                    Tensor::add(-lr, mCap[p], 1.0, layers[i]->params[j], layers[i]->params[j], 0);
+                    Tensor::add(-lr, mCap[p], 1.0, layers[i]->acc_gradients[j], layers[i]->acc_gradients[j], 0);
+                } else {
+                    auto w = Tensor::expr(layers[i]->params[j]);
+                    layers[i]->params[j]->assign(w - lr * ((m / c1) / sqrt(v / c2 + epsilon)));
+                }
+                continue;
+            }
+
             Tensor::add(beta_1,mT[p],(1-beta_1),layers[i]->gradients[j],mT[p],0);
             layers[i]->gradients[j]->sqr_();
             Tensor::add(beta_2,vT[p],(1-beta_2),layers[i]->gradients[j],vT[p],0);
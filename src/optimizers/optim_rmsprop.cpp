@@ -75,6 +75,24 @@ void RMSProp::applygrads(int batch) {
     for (int i = 0; i < layers.size(); i++)
       if (layers[i]->trainable) {
         for (int j = 0; j < layers[i]->get_trainable_params_count(); j++, p++) {
+            if (layers[i]->params[j]->isCPU()) {
+                // Same steps, fused (see tensor_expr.h)
+                auto g = Tensor::expr(layers[i]->gradients[j]);
+                auto g1 = Tensor::expr(gT1[p]);
+
+                gT[p]->assign(g / sqrt(rho * sqr(g1) + (1.0f - rho) * sqr(g) + epsilon));
+                Tensor::copy(layers[i]->gradients[j], gT1[p]);
+
+                auto w = Tensor::expr(layers[i]->params[j]);
+                auto u = Tensor::expr(gT[p]);
+                layers[i]->params[j]->assign(w - lr * u);
+                if (layers[i]->acc_gradients.size() > 0) {
+                    auto acc = Tensor::expr(layers[i]->acc_gradients[j]);
+                    layers[i]->acc_gradients[j]->assign(acc - lr * u);
+                }
+                continue;
+            }
+
             Tensor::copy(layers[i]->gradients[j],gT[p]);
             gT[p]->sqr_();
             gT[p]->mult_(1.0f-rho);
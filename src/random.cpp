@@ -6,6 +6,7 @@
 * Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
 * All rights reserved
 */
+#include <atomic>
 #include <cstdio>
 #include <cmath>
 #include <random>
@@ -23,14 +24,24 @@ static bool random_table_generated = false;
 
 // Default seed
 static std::random_device rd;  //Will be used to obtain a seed for the random number engine
-static std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
 
 
 float uniform(float min, float max) {
-    // rand() may not generate numbers uniformly and is therefore discouraged
-    // Talk: https://channel9.msdn.com/Events/GoingNative/2013/rand-Considered-Harmful
-    std::uniform_real_distribution<float> distr(min, max);
-    return distr(gen);
+    // One block of the stream of the fills (see rand_reserve): thread safe and
+    // reproducible with rand_seed
+    uint32_t bits[4];
+    philox4x32(rand_key(), rand_reserve(1), bits);
+    return rand_uniform(bits[0], min, max);
+}
+
+float rand_uniform(uint32_t bits, float min, float max) {
+    return min + (max - min) * ((float)(bits >> 8) * 5.9604644775390625e-08f);  // 24 bits / 2^24
+}
+
+int rand_int(int n) {
+    uint32_t bits[4];
+    philox4x32(rand_key(), rand_reserve(1), bits);
+    return (int)(((uint64_t)bits[0] * (uint64_t)n) >> 32);
 }
 
 float signed_uniform() {
@@ -68,3 +79,56 @@ float fast_randn(float mean, float sd, int seed) {
     if (posTable < 0) posTable = -posTable;
     return (RTable[posTable] * sd) + mean;
 }
+
+
+// Philox4x32-10 ****************************************************
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u  // Key schedule (golden ratio, sqrt(3) - 1)
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+static inline void philox_block(uint32_t k0, uint32_t k1, uint64_t counter, uint32_t *out) {
+    uint32_t c0 = (uint32_t)counter, c1 = (uint32_t)(counter >> 32), c2 = 0, c3 = 0;
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+void philox4x32(uint64_t key, uint64_t counter, uint32_t out[4]) {
+    philox_block((uint32_t)key, (uint32_t)(key >> 32), counter, out);
+}
+
+void philox4x32_blocks(uint64_t key, uint64_t counter, long int n, uint32_t *out) {
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+#pragma omp simd
+    for (long int i = 0; i < n; i++) philox_block(k0, k1, counter + i, out + 4 * i);
+}
+
+// Random key by default
+static std::atomic<uint64_t> stream_key(((uint64_t)rd() << 32) | rd());
+static std::atomic<uint64_t> stream_counter(0);
+
+uint64_t rand_key() {
+    return stream_key;
+}
+
+uint64_t rand_reserve(uint64_t blocks) {
+    return stream_counter.fetch_add(blocks);
+}
+
+void rand_seed(uint64_t seed) {
+    stream_key = seed;
+    stream_counter = 0;
+}
@@ -189,6 +189,15 @@ void build_gather_node(string node_name, string input, string output, LEmbedding
 // Not an ONNX operator. Built from unsqueeze and identity operators.
 void handle_copy_states(LCopyStates *layer, onnx::GraphProto *graph);
 
+// OPSET: 13, 10. QuantizeLinear + DequantizeLinear over the input of an int8 layer (returns the output name)
+string build_quantized_input_nodes(string layer_name, string input, float scale, onnx::GraphProto *graph);
+
+// OPSET: 13 (per-axis). DequantizeLinear of the int8 weights of a layer into "<layer_name>_W"
+void build_quantized_weights_nodes(string layer_name, vector<int> dims, const vector<int8_t> &q, const vector<float> &scale, onnx::GraphProto *graph);
+
+// OPSET: 13, 6. Cast of the 16-bit weights of a layer (see setWeightsDtype) into "<layer_name>_W"
+void build_half_weights_nodes(string layer_name, Tensor *W, int dtype, onnx::GraphProto *graph);
+
 #endif
 
 #ifdef cPROTO
@@ -309,6 +318,15 @@ void set_graph(onnx::ModelProto *model, Net *net, bool gradients)
   onnx::OperatorSetIdProto *opset = model->add_opset_import();
   opset->set_version(11);
 
+  // Int8 layers need DequantizeLinear with per-channel scales (opset 13)
+  for (Layer *l : net->layers)
+  {
+    LDense *dense = dynamic_cast<LDense *>(l);
+    LConv *conv = dynamic_cast<LConv *>(l);
+    if ((dense != nullptr && dense->quantized) || (conv != nullptr && conv->quantized))
+      opset->set_version(13);
+  }
+
   // Check whether the model is encoder, decoder or both.
   bool is_encoder = false;
   bool is_decoder = false;
@@ -628,15 +646,27 @@ void build_node_from_layer(Layer *layer, onnx::GraphProto *graph, bool gradients
 
 void build_conv_node(LConv *layer, onnx::GraphProto *graph, bool gradients)
 {
+  // Int8 layers: quantized input and weights (the nodes must go before the Conv)
+  bool quantized = layer->quantized && !gradients;
+  string qinput;
+  if (quantized)
+  {
+    qinput = build_quantized_input_nodes(layer->name, layer->parent[0]->name, layer->qrange / 127.0f, graph);
+    build_quantized_weights_nodes(layer->name, layer->cd->K->shape, layer->Kq, layer->Kq_scale, graph);
+  }
+
   // Add an empty node to the graph
   onnx::NodeProto *node = graph->add_node();
   node->set_op_type("Conv");
   node->set_name(layer->name);
   // Set the inputs of the node from the parents of the layer
-  for (Layer *parentl : layer->parent)
-  {
-    node->add_input(parentl->name);
-  }
+  if (quantized)
+    node->add_input(qinput);
+  else
+    for (Layer *parentl : layer->parent)
+    {
+      node->add_input(parentl->name);
+    }
   // Set the input params names of the conv op
   node->add_input(layer->name + "_W");
   if (layer->cd->use_bias)
@@ -649,8 +679,7 @@ void build_conv_node(LConv *layer, onnx::GraphProto *graph, bool gradients)
   onnx::AttributeProto *conv_dilations = node->add_attribute();
   conv_dilations->set_name("dilations");
   conv_dilations->set_type(onnx::AttributeProto::INTS);
-  vector<int> vdilations{1, 1};
-  for (int i : vdilations)
+  for (int i : {layer->cd->dr, layer->cd->dc})
   {
     conv_dilations->add_ints(i);
   }
@@ -659,7 +688,7 @@ void build_conv_node(LConv *layer, onnx::GraphProto *graph, bool gradients)
   onnx::AttributeProto *conv_group = node->add_attribute();
   conv_group->set_name("group");
   conv_group->set_type(onnx::AttributeProto::INT);
-  conv_group->set_i(1);
+  conv_group->set_i(layer->cd->groups);
 
   // Attr kernel_shape
   onnx::AttributeProto *conv_kernel_shape = node->add_attribute();
@@ -688,12 +717,15 @@ void build_conv_node(LConv *layer, onnx::GraphProto *graph, bool gradients)
   if (!gradients)
   {
     // Weights input
-    onnx::TensorProto *conv_w = graph->add_initializer();
-    conv_w->set_name(layer->name + "_W");
-    conv_w->set_data_type(onnx::TensorProto::FLOAT);
-    conv_w->mutable_dims()->Add(layer->cd->K->shape.begin(), layer->cd->K->shape.end());          // Set the shape of the weights
-    conv_w->mutable_float_data()->Add(layer->cd->K->ptr, layer->cd->K->ptr + layer->cd->K->size); // Set the weights values
-    //conv_w->mutable_raw_data()->assign( reinterpret_cast<const char*>(layer->cd->K->ptr), sizeof(float) * layer->cd->K->size );
+    if (!quantized)
+    {
+      onnx::TensorProto *conv_w = graph->add_initializer();
+      conv_w->set_name(layer->name + "_W");
+      conv_w->set_data_type(onnx::TensorProto::FLOAT);
+      conv_w->mutable_dims()->Add(layer->cd->K->shape.begin(), layer->cd->K->shape.end());          // Set the shape of the weights
+      conv_w->mutable_float_data()->Add(layer->cd->K->ptr, layer->cd->K->ptr + layer->cd->K->size); // Set the weights values
+      //conv_w->mutable_raw_data()->assign( reinterpret_cast<const char*>(layer->cd->K->ptr), sizeof(float) * layer->cd->K->size );
+    }
 
     // Bias input
     if (layer->cd->use_bias)
@@ -752,13 +784,13 @@ void build_conv1D_node(LConv1D *layer, onnx::GraphProto *graph, bool gradients)
   onnx::AttributeProto *conv_dilations = node->add_attribute();
   conv_dilations->set_name("dilations");
   conv_dilations->set_type(onnx::AttributeProto::INTS);
-  conv_dilations->add_ints(1);
+  conv_dilations->add_ints(layer->cd->dr);
 
   //Attr group
   onnx::AttributeProto *conv_group = node->add_attribute();
   conv_group->set_name("group");
   conv_group->set_type(onnx::AttributeProto::INT);
-  conv_group->set_i(1);
+  conv_group->set_i(layer->cd->groups);
 
   // Attr kernel_shape
   onnx::AttributeProto *conv_kernel_shape = node->add_attribute();
@@ -826,15 +858,27 @@ void build_conv1D_node(LConv1D *layer, onnx::GraphProto *graph, bool gradients)
 
 void build_gemm_node(LDense *layer, onnx::GraphProto *graph, bool gradients)
 {
+  // Int8 layers: quantized input and weights, stored transposed (outputs x inputs)
+  bool quantized = layer->quantized && !gradients;
+  string qinput;
+  if (quantized)
+  {
+    qinput = build_quantized_input_nodes(layer->name, layer->parent[0]->name, layer->qrange / 127.0f, graph);
+    build_quantized_weights_nodes(layer->name, {layer->W->shape[1], layer->W->shape[0]}, layer->Wq, layer->Wq_scale, graph);
+  }
+
   // Add an empty node to the graph
   onnx::NodeProto *node = graph->add_node();
   node->set_op_type("Gemm");
   node->set_name(layer->name);
   // Set the inputs of the node from the parents of the layer
-  for (Layer *parentl : layer->parent)
-  {
-    node->add_input(parentl->name);
-  }
+  if (quantized)
+    node->add_input(qinput);
+  else
+    for (Layer *parentl : layer->parent)
+    {
+      node->add_input(parentl->name);
+    }
   // Set the input params names of the Gemm(Dense) op
   node->add_input(layer->name + "_W");
   if (layer->use_bias)
@@ -864,18 +908,25 @@ void build_gemm_node(LDense *layer, onnx::GraphProto *graph, bool gradients)
   onnx::AttributeProto *dense_transB = node->add_attribute();
   dense_transB->set_name("transB");
   dense_transB->set_type(onnx::AttributeProto::INT);
-  dense_transB->set_i(0);
+  dense_transB->set_i(quantized);
 
   // Check if we are exporting weights or accumulated gradients
   if (!gradients)
   {
     // Weights input
-    onnx::TensorProto *weight = graph->add_initializer();
-    weight->set_name(layer->name + "_W");
-    weight->set_data_type(onnx::TensorProto::FLOAT);
-    weight->mutable_dims()->Add(layer->W->shape.begin(), layer->W->shape.end());      // Set the shape of the weights
-    weight->mutable_float_data()->Add(layer->W->ptr, layer->W->ptr + layer->W->size); // Set the weights values
-    //weight->mutable_raw_data()->assign( reinterpret_cast<const char*>(layer->W->ptr), sizeof(float) * layer->W->size );
+    if (!quantized && layer->W16 != nullptr)
+    {
+      build_half_weights_nodes(layer->name, layer->W, layer->W16->dtype, graph);
+    }
+    else if (!quantized)
+    {
+      onnx::TensorProto *weight = graph->add_initializer();
+      weight->set_name(layer->name + "_W");
+      weight->set_data_type(onnx::TensorProto::FLOAT);
+      weight->mutable_dims()->Add(layer->W->shape.begin(), layer->W->shape.end());      // Set the shape of the weights
+      weight->mutable_float_data()->Add(layer->W->ptr, layer->W->ptr + layer->W->size); // Set the weights values
+      //weight->mutable_raw_data()->assign( reinterpret_cast<const char*>(layer->W->ptr), sizeof(float) * layer->W->size );
+    }
     if (layer->use_bias)
     {
       // Bias input
@@ -2053,6 +2104,99 @@ void build_resize_node(LScale *layer, onnx::GraphProto *graph)
   scales->add_float_data(layer->new_shape[1] / layer->input->getShape()[3]); // H
 }
 
+string build_quantized_input_nodes(string layer_name, string input, float scale, onnx::GraphProto *graph)
+{
+  // Symmetric int8 (zero point 0)
+  onnx::TensorProto *x_scale = graph->add_initializer();
+  x_scale->set_name(layer_name + "_x_scale");
+  x_scale->set_data_type(onnx::TensorProto::FLOAT);
+  x_scale->add_float_data(scale);
+
+  onnx::TensorProto *x_zero_point = graph->add_initializer();
+  x_zero_point->set_name(layer_name + "_x_zero_point");
+  x_zero_point->set_data_type(onnx::TensorProto::INT8);
+  x_zero_point->add_int32_data(0);
+
+  onnx::NodeProto *node_q = graph->add_node();
+  node_q->set_op_type("QuantizeLinear");
+  node_q->set_name(layer_name + "_QuantizeLinear");
+  node_q->add_input(input);
+  node_q->add_input(layer_name + "_x_scale");
+  node_q->add_input(layer_name + "_x_zero_point");
+  node_q->add_output(layer_name + "_x_quantized");
+
+  onnx::NodeProto *node_dq = graph->add_node();
+  node_dq->set_op_type("DequantizeLinear");
+  node_dq->set_name(layer_name + "_x_DequantizeLinear");
+  node_dq->add_input(layer_name + "_x_quantized");
+  node_dq->add_input(layer_name + "_x_scale");
+  node_dq->add_input(layer_name + "_x_zero_point");
+  node_dq->add_output(layer_name + "_x");
+
+  return layer_name + "_x";
+}
+
+void build_quantized_weights_nodes(string layer_name, vector<int> dims, const vector<int8_t> &q, const vector<float> &scale, onnx::GraphProto *graph)
+{
+  // Int8 values (stored in int32_data, as the ONNX spec asks for int8 tensors)
+  onnx::TensorProto *w_quantized = graph->add_initializer();
+  w_quantized->set_name(layer_name + "_W_quantized");
+  w_quantized->set_data_type(onnx::TensorProto::INT8);
+  w_quantized->mutable_dims()->Add(dims.begin(), dims.end());
+  for (int8_t v : q)
+    w_quantized->add_int32_data(v);
+
+  // One scale (and zero point) per output channel: the first dimension
+  onnx::TensorProto *w_scale = graph->add_initializer();
+  w_scale->set_name(layer_name + "_W_scale");
+  w_scale->set_data_type(onnx::TensorProto::FLOAT);
+  w_scale->add_dims(scale.size());
+  w_scale->mutable_float_data()->Add(scale.begin(), scale.end());
+
+  onnx::TensorProto *w_zero_point = graph->add_initializer();
+  w_zero_point->set_name(layer_name + "_W_zero_point");
+  w_zero_point->set_data_type(onnx::TensorProto::INT8);
+  w_zero_point->add_dims(scale.size());
+  for (int i = 0; i < scale.size(); i++)
+    w_zero_point->add_int32_data(0);
+
+  onnx::NodeProto *node = graph->add_node();
+  node->set_op_type("DequantizeLinear");
+  node->set_name(layer_name + "_W_DequantizeLinear");
+  node->add_input(layer_name + "_W_quantized");
+  node->add_input(layer_name + "_W_scale");
+  node->add_input(layer_name + "_W_zero_point");
+  node->add_output(layer_name + "_W");
+
+  onnx::AttributeProto *axis = node->add_attribute();
+  axis->set_name("axis");
+  axis->set_type(onnx::AttributeProto::INT);
+  axis->set_i(0);
+}
+
+void build_half_weights_nodes(string layer_name, Tensor *W, int dtype, onnx::GraphProto *graph)
+{
+  // 16-bit values (2 bytes each in raw_data), converted from W so they are up to date
+  Tensor *W16 = W->astype(dtype);
+  onnx::TensorProto *w_half = graph->add_initializer();
+  w_half->set_name(layer_name + "_W_half");
+  w_half->set_data_type((dtype == DTYPE_BFLOAT16) ? onnx::TensorProto::BFLOAT16 : onnx::TensorProto::FLOAT16);
+  w_half->mutable_dims()->Add(W->shape.begin(), W->shape.end());
+  w_half->mutable_raw_data()->assign(reinterpret_cast<const char *>(W16->ptr), sizeof(uint16_t) * W16->size);
+  delete W16;
+
+  onnx::NodeProto *node = graph->add_node();
+  node->set_op_type("Cast");
+  node->set_name(layer_name + "_W_Cast");
+  node->add_input(layer_name + "_W_half");
+  node->add_output(layer_name + "_W");
+
+  onnx::AttributeProto *to = node->add_attribute();
+  to->set_name("to");
+  to->set_type(onnx::AttributeProto::INT);
+  to->set_i(onnx::TensorProto::FLOAT);
+}
+
 void build_identity_node(string node_name, string input, string output, onnx::GraphProto *graph)
 {
   // Add an empty node to the graph
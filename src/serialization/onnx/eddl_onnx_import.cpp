@@ -10,6 +10,7 @@
 #include "eddl/layers/reductions/layer_reductions.h"
 #include "eddl/layers/da/layer_da.h"
 #include "eddl/tensor/tensor.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
 #include "eddl/utils.h"
 #include <map>
 #include <set>
@@ -90,7 +91,9 @@ enum ONNX_LAYERS
   RMEAN,            // OPSET: 13, 11, 1
   RSUM,             // OPSET: 11, 1
   ARGMAX,           // OPSET: 13, 12, 11, 1
-  RESIZE            // OPSET: 13
+  RESIZE,           // OPSET: 13
+  QUANTIZE,         // OPSET: 13, 10 (Only for the inputs of int8 Conv and Gemm)
+  DEQUANTIZE        // OPSET: 13, 10 (Inputs and weights of int8 Conv and Gemm)
   //POW,            // OPSET: 13, 12, 7 (TODO: Implement LPow)
 };
 
@@ -225,6 +228,8 @@ map<string, ONNX_LAYERS> create_enum_map()
   map_layers["ReduceSum"] = ONNX_LAYERS::RSUM;
   map_layers["ArgMax"] = ONNX_LAYERS::ARGMAX;
   map_layers["Resize"] = ONNX_LAYERS::RESIZE;
+  map_layers["QuantizeLinear"] = ONNX_LAYERS::QUANTIZE;
+  map_layers["DequantizeLinear"] = ONNX_LAYERS::DEQUANTIZE;
 
   return map_layers;
 }
@@ -331,7 +336,25 @@ vector<float> parseTensorValues(onnx::TensorProto t)
     }
     break;
   case onnx::TensorProto::FLOAT16:
-    break;
+  case onnx::TensorProto::BFLOAT16:
+  { // The 16-bit patterns, in raw_data or one in each int32_data
+    vector<uint16_t> aux_values;
+    if (t.has_raw_data())
+    {
+      TryConvertingTensorRawValues(t, aux_values);
+    }
+    else
+    {
+      for (int i = 0; i < t.int32_data_size(); i++)
+      {
+        aux_values.push_back(t.int32_data(i));
+      }
+    }
+    int dtype = (data_type == onnx::TensorProto::BFLOAT16) ? DTYPE_BFLOAT16 : DTYPE_FLOAT16;
+    values.resize(aux_values.size());
+    cpu_half2float(aux_values.data(), values.data(), aux_values.size(), dtype);
+  }
+  break;
   case onnx::TensorProto::DOUBLE:
     for (int i = 0; i < t.double_data_size(); i++)
     {
@@ -356,9 +379,6 @@ vector<float> parseTensorValues(onnx::TensorProto t)
   case onnx::TensorProto::COMPLEX128:
     //TODO: Make this
     break;
-  case onnx::TensorProto::BFLOAT16:
-    //TODO: Make this
-    break;
 
   default:
     cerr << "Vector type not recognized" << endl;
@@ -386,6 +406,59 @@ void get_initializers_maps(vector<onnx::TensorProto> tensors, map<string, vector
   return;
 }
 
+// Replaces the DequantizeLinear nodes of initializers (int8 weights) by new initializers with the float values
+void dequantize_initializers(vector<onnx::NodeProto> &nodes, map<string, vector<float>> &values_map, map<string, vector<int>> &dims_map)
+{
+  for (onnx::NodeProto &node : nodes)
+  {
+    if (node.op_type() != "DequantizeLinear" || !values_map.count(node.input(0)))
+      continue;
+
+    int axis = 1;
+    for (int j = 0; j < node.attribute_size(); j++)
+      if (node.attribute(j).name() == "axis")
+        axis = node.attribute(j).i();
+
+    vector<float> &q = values_map[node.input(0)];
+    vector<int> &dims = dims_map[node.input(0)];
+    vector<float> &scale = values_map[node.input(1)];
+    vector<float> zero_point(scale.size(), 0.0f);
+    if (node.input_size() > 2)
+      zero_point = values_map[node.input(2)];
+
+    // Per-tensor or per-axis (one scale for each index of dims[axis])
+    if (axis < 0)
+      axis += dims.size();
+    int inner = 1;
+    for (int i = axis + 1; i < dims.size(); i++)
+      inner *= dims[i];
+
+    vector<float> values(q.size());
+    for (int i = 0; i < q.size(); i++)
+    {
+      int c = (scale.size() > 1) ? (i / inner) % dims[axis] : 0;
+      values[i] = (q[i] - zero_point[c]) * scale[c];
+    }
+
+    values_map[node.output(0)] = values;
+    dims_map[node.output(0)] = dims;
+  }
+}
+
+// Replaces the Cast nodes of initializers (16-bit weights) by new initializers with the float values
+void cast_initializers(vector<onnx::NodeProto> &nodes, map<string, vector<float>> &values_map, map<string, vector<int>> &dims_map)
+{
+  for (onnx::NodeProto &node : nodes)
+  {
+    if (node.op_type() != "Cast" || !values_map.count(node.input(0)))
+      continue;
+
+    // parseTensorValues already converted them to float
+    values_map[node.output(0)] = values_map[node.input(0)];
+    dims_map[node.output(0)] = dims_map[node.input(0)];
+  }
+}
+
 // Parses one TensorProto pointer (Input or output) to eddl Tensor pointer
 vector<int> parse_IO_tensor(onnx::TypeProto::Tensor tensor, bool recurrent_net)
 {
@@ -671,6 +744,11 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
   map<string, vector<int>> map_init_dims;     // Key: Input Name - Value: Dims
   // Initialize the maps
   get_initializers_maps(initializers, map_init_values, map_init_dims);
+  dequantize_initializers(nodes, map_init_values, map_init_dims);
+  cast_initializers(nodes, map_init_values, map_init_dims);
+
+  // Largest |value| of the quantized inputs of int8 layers (Key: Input Name)
+  map<string, float> map_qrange;
 
   /*
    * The methodology is the following:
@@ -885,6 +963,8 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
       vector<float> *bias;
       bool use_bias = node->input_size() > 2;
       bool conv1d = false;
+      int groups = 1;
+      vector<int> dilation_rate;
 
       for (int j = 0; j < node->attribute_size(); j++)
       { // Set the attributes
@@ -903,10 +983,17 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
           else if (!attribute.s().compare("SAME_UPPER"))
             auto_pad_option = "same";
         }
-        //else if (!attr_name.compare("dilations")) { It isn't implemented in eddl
-        //}
-        //else if (!attr_name.compare("group")) { It isn't implemented in eddl
-        //}
+        else if (!attr_name.compare("dilations"))
+        {
+          for (int h = 0; h < attribute.ints_size(); h++)
+          {
+            dilation_rate.push_back(attribute.ints(h));
+          }
+        }
+        else if (!attr_name.compare("group"))
+        {
+          groups = attribute.i();
+        }
         else if (!attr_name.compare("kernel_shape"))
         {
           for (int h = 0; h < attribute.ints_size(); h++)
@@ -966,11 +1053,13 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
       string name = node->name();
       ConvolDescriptor *cd;
 
-      // TODO: REVIEW!!!!
-    int groups = 1;
-    vector<int> dilation_rate = {1, 1};
-        //auto_pad_option == "custom";
-        //cd->pad = pads;
+      dilation_rate.resize(2, 1); // Conv1D or not set
+        // Explicit pads (none by default)
+        if (auto_pad_option.empty())
+        {
+          auto_pad_option = "custom";
+          pads.resize(4, 0);
+        }
         cd = new ConvolDescriptor(filters, kernel_shape, strides, auto_pad_option, pads, groups, dilation_rate, use_bias, mem);
 
       if (conv1d)
@@ -991,6 +1080,14 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
       Tensor *weights_tensor = new Tensor(dims, NEW_FROM_VECTOR_PTR(weights), dev);
       Tensor::copy(weights_tensor, cd->K);
       delete weights_tensor;
+
+      // Int8 layer
+      LConv *conv = dynamic_cast<LConv *>(actual_layer);
+      if (conv != nullptr && map_qrange.count(parent_name))
+      {
+        conv->qrange = map_qrange[parent_name];
+        conv->quantize(true);
+      }
     }
     break;
 
@@ -1077,6 +1174,13 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
         Tensor::copy(bias_tensor, dense->bias);
         delete bias_tensor;
       }
+
+      // Int8 layer
+      if (map_qrange.count(parent_name))
+      {
+        dense->qrange = map_qrange[parent_name];
+        dense->quantize(true);
+      }
       actual_layer = dense;
     }
     break;
@@ -2312,6 +2416,37 @@ Net *build_net_onnx(onnx::ModelProto model, int mem, int log_level)
       log_string("Cast layer detected", log_level, LOG_LEVEL::DEBUG);
       string parent_name;
       parent_name = node->input(0);
+      if (map_init_values.count(parent_name))
+      { // Weights, already converted (see cast_initializers)
+        nodeQueue.pop();
+        continue;
+      }
+      actual_layer = output_node_map[parent_name];
+    }
+    break;
+
+    case ONNX_LAYERS::QUANTIZE:
+    {
+      // Skipped: it only gives the input range of the int8 layer that reads it
+      log_string("QuantizeLinear layer detected", log_level, LOG_LEVEL::DEBUG);
+      string parent_name = node->input(0);
+      float scale = map_init_values[node->input(1)][0];
+      map_qrange[node->output(0)] = scale * 127.0f;
+      actual_layer = output_node_map[parent_name];
+    }
+    break;
+
+    case ONNX_LAYERS::DEQUANTIZE:
+    {
+      log_string("DequantizeLinear layer detected", log_level, LOG_LEVEL::DEBUG);
+      string parent_name = node->input(0);
+      if (map_init_values.count(parent_name))
+      { // Weights, already dequantized (see dequantize_initializers)
+        nodeQueue.pop();
+        continue;
+      }
+      if (map_qrange.count(parent_name))
+        map_qrange[node->output(0)] = map_qrange[parent_name];
       actual_layer = output_node_map[parent_name];
     }
     break;
@@ -2952,6 +3087,8 @@ map<string, vector<Tensor *>> get_tensors_from_onnx(onnx::ModelProto model)
   //  Key: Input Name . Value: Weights
   //  Key: Input Name . Value: Dims
   vector<onnx::NodeProto> nodes = get_graph_nodes(graph);
+  dequantize_initializers(nodes, map_init_values, map_init_dims);
+  cast_initializers(nodes, map_init_values, map_init_dims);
 
   map<string, ONNX_LAYERS> map_layers = create_enum_map();
   int dev = DEV_CPU;
@@ -2995,7 +3132,11 @@ map<string, vector<Tensor *>> get_tensors_from_onnx(onnx::ModelProto model)
       vector<float> *weights = &(map_init_values[weights_name]);
       vector<int> dims = map_init_dims[weights_name];
 
-      dense_tensors.push_back(new Tensor(dims, NEW_FROM_VECTOR_PTR(weights), dev));
+      Tensor *weights_tensor = new Tensor(dims, NEW_FROM_VECTOR_PTR(weights), dev);
+      for (int j = 0; j < node.attribute_size(); j++)
+        if (node.attribute(j).name() == "transB" && node.attribute(j).i())
+          weights_tensor->permute_({1, 0});
+      dense_tensors.push_back(weights_tensor);
 
       if (node.input_size() > 2)
       {
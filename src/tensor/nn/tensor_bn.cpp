@@ -118,12 +118,19 @@ namespace tensorNN {
             Tensor *mean, Tensor *variance,
             Tensor *bn_g, Tensor *bn_b,
             Tensor *bn_mean, Tensor *bn_var,
-            bool trmode, float epsilon, float momentum)
+            bool trmode, float epsilon, float momentum, bool channels_last)
     {
 
         if (input->isCPU()) {
-            cpu_batchnorm_forward(input->shape[0], input->shape[1],
-                input->ndim == 2 ? 1 : input->shape[2] * input->shape[3],
+            // Channels-last: (b*r*c, z) as a 2D input
+            int rc = input->ndim == 2 ? 1 : input->shape[2] * input->shape[3];
+            if (channels_last) cpu_batchnorm_forward(input->shape[0] * rc, input->shape[1], 1,
+                input->ptr, output->ptr, opa->ptr,
+                mean->ptr, variance->ptr,
+                bn_g != NULL ? bn_g->ptr : NULL,
+                bn_b != NULL ? bn_b->ptr : NULL,
+                bn_mean->ptr, bn_var->ptr, trmode, epsilon, momentum);
+            else cpu_batchnorm_forward(input->shape[0], input->shape[1], rc,
                 input->ptr, output->ptr, opa->ptr,
                 mean->ptr, variance->ptr,
                 bn_g != NULL ? bn_g->ptr : NULL,
@@ -144,11 +151,17 @@ namespace tensorNN {
 
     void BatchNormBackward(Tensor *delta, Tensor *opa, Tensor *pdelta, Tensor *gbn_g,
             Tensor *gbn_b, Tensor *bn_g, Tensor *bn_var,
-            Tensor *work1, Tensor *work2)
+            Tensor *work1, Tensor *work2, bool channels_last)
     {
         if (delta->isCPU()) {
-            cpu_batchnorm_backward(delta->shape[0], delta->shape[1],
-                delta->ndim == 2 ? 1 : delta->shape[2] * delta->shape[3],
+            int rc = delta->ndim == 2 ? 1 : delta->shape[2] * delta->shape[3];
+            if (channels_last) cpu_batchnorm_backward(delta->shape[0] * rc, delta->shape[1], 1,
+                delta->ptr, opa->ptr, pdelta->ptr,
+                gbn_g != NULL ? gbn_g->ptr : NULL,
+                gbn_b != NULL ? gbn_b->ptr : NULL,
+                bn_g != NULL ? bn_g->ptr : NULL,
+                bn_var->ptr, work1->ptr, work2->ptr);
+            else cpu_batchnorm_backward(delta->shape[0], delta->shape[1], rc,
                 delta->ptr, opa->ptr, pdelta->ptr,
                 gbn_g != NULL ? gbn_g->ptr : NULL,
                 gbn_b != NULL ? gbn_b->ptr : NULL,
@@ -0,0 +1,49 @@
+/*
+* EDDL Library - European Distributed Deep Learning Library.
+* Version: 0.9
+* copyright (c) 2020, Universidad Politécnica de Valencia (UPV), PRHLT Research Centre
+* Date: November 2020
+* Author: PRHLT Research Centre, UPV, (rparedes@prhlt.upv.es), (jon@prhlt.upv.es)
+* All rights reserved
+*/
+#include "eddl/tensor/nn/tensor_nn.h"
+#include "eddl/hardware/cpu/nn/cpu_tensor_nn.h"
+
+
+namespace tensorNN{
+
+
+void Dense_int8(Tensor *A, float a_scale, const int8_t *Wq, const float *Wq_scale, Tensor *C) {
+    /////////////////////////////////////////////////////////////////////
+    //// Dense_int8
+    //// C = A*W, with A quantized on the fly (a_scale) and Wq the
+    //// transposed W quantized per output (Wq_scale). Only 2D tensors
+    /////////////////////////////////////////////////////////////////////
+    if ((A->ndim != 2) || (C->ndim != 2)) msg("Only 2D tensors", "Tensor::Dense_int8");
+    if (A->shape[0] != C->shape[0]) msg("Incompatible dims", "Tensor::Dense_int8");
+
+    if (A->isCPU()) {
+        cpu_dense_int8(A, a_scale, Wq, Wq_scale, C);
+    }
+    else {
+        msg("Int8 inference is only supported on CPU", "Tensor::Dense_int8");
+    }
+}
+
+void Conv2D_int8(ConvolDescriptor *D, float i_scale, const int8_t *Kq, const float *Kq_scale) {
+    /////////////////////////////////////////////////////////////////////
+    //// Conv2D_int8
+    //// Same as Conv2D with the input quantized on the fly (i_scale)
+    //// and the filters quantized per filter (Kq_scale)
+    /////////////////////////////////////////////////////////////////////
+    if ((D->I->ndim != 4)) msg("Tensors are not 4D", "Tensor::Conv2D_int8");
+
+    if (D->I->isCPU()) {
+        cpu_conv2D_int8(D, i_scale, Kq, Kq_scale);
+    }
+    else {
+        msg("Int8 inference is only supported on CPU", "Tensor::Conv2D_int8");
+    }
+}
+
+}
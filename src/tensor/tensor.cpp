@@ -423,11 +423,35 @@ void Tensor::toDevice(int dev){
 }
 
 Tensor* Tensor::clone(){
+    if (this->dtype != DTYPE_FLOAT32) return this->astype(this->dtype);
+
     auto* t_new = new Tensor(this->shape, this->device);
     Tensor::copy(this, t_new);
     return t_new;
 }
 
+Tensor* Tensor::astype(int dtype){
+    if (!this->isCPU()) msg("Only CPU tensors", "Tensor::astype");
+    if ((dtype != DTYPE_FLOAT32) && (dtype != DTYPE_FLOAT16) && (dtype != DTYPE_BFLOAT16))
+        msg("Unknown dtype " + to_string(dtype), "Tensor::astype");
+
+    Tensor* t_new;
+    if (dtype == DTYPE_FLOAT32) {
+        t_new = new Tensor(this->shape, DEV_CPU);
+    } else {
+        // Two 16-bit values per float
+        t_new = new Tensor();
+        t_new->updateShape(this->shape);
+        t_new->updateSize();
+        t_new->updateStrides();
+        t_new->dtype = dtype;
+        t_new->ptr = get_fmem((t_new->size + 1) / 2, "Tensor::astype");
+    }
+
+    Tensor::copy(this, t_new);
+    return t_new;
+}
+
 void Tensor::reallocate(Tensor* old_t){
     Tensor::reallocate(old_t, {});
 }
@@ -53,6 +53,14 @@ void Tensor::fill(Tensor* A, float v){
 
 
 void Tensor::permute_(const vector<int>& dims){
+    // Moving dimensions of size 1 does not move the data
+    PermuteDescriptor sd(dims, DEV_CPU);
+    sd.build(this->shape);
+    if (sd.contiguous) {
+        reshape_(sd.oshape);
+        return;
+    }
+
     Tensor* temp = Tensor::permute(this, dims);
 
     // Update attributes
@@ -337,7 +345,11 @@ void Tensor::copy(Tensor *A, Tensor *B) {
 
 
     if ((A->isCPU()) && (B->isCPU())) {
-        cpu_copy(A, B);
+        if ((A->dtype != DTYPE_FLOAT32) || (B->dtype != DTYPE_FLOAT32)) cpu_copy_dtype(A, B);
+        else cpu_copy(A, B);
+    }
+    else if ((A->dtype != DTYPE_FLOAT32) || (B->dtype != DTYPE_FLOAT32)) {
+        msg("16-bit tensors are only supported on CPU", "Tensor::copy");
     }
 #ifdef cGPU
         else if ((A->isGPU())&&(B->isGPU())) {
@@ -651,6 +663,25 @@ Tensor* Tensor::select(const vector<string>& indices){
     return t;
 }
 
+Tensor* Tensor::view(const vector<string>& indices){
+    if (this->isFPGA()) msg("Views are not supported in FPGA", "Tensor::view");
+
+    // Only the strided view is needed (no address table)
+    auto *sd = new SelDescriptor(indices, DEV_CPU);
+    sd->build(this->shape);
+
+    if (!sd->contiguous) {
+        delete sd;
+        msg("The selection is not contiguous in memory (use select instead)", "Tensor::view");
+    }
+
+    // Shares the memory of this tensor
+    auto* t = new Tensor(sd->oshape, this->ptr + sd->offset, this->device);
+
+    delete sd;
+    return t;
+}
+
 void Tensor::select(Tensor *A, Tensor* B, SelDescriptor *sd){
     if (A->isCPU() && B->isCPU()) {
         cpu_select(A, B, sd);
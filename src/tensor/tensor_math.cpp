@@ -2648,7 +2648,12 @@ void Tensor::mult2D(Tensor *A, int tA, Tensor *B, int tB, Tensor *C, int incC) {
 
 
 
-    if (A->isCPU()) {
+    if ((A->dtype != DTYPE_FLOAT32) || (C->dtype != DTYPE_FLOAT32)) msg("Only B can be a 16-bit tensor", "Tensor::mult2D");
+    if (B->dtype != DTYPE_FLOAT32) {
+        if (!B->isCPU() || tB) msg("16-bit B is only supported on CPU and not transposed", "Tensor::mult2D");
+        cpu_mult2D_half(A, tA, B, C, incC);
+    }
+    else if (A->isCPU()) {
         cpu_mult2D(A, tA, B, tB, C, incC);
     }
 
@@ -105,13 +105,13 @@ void reduce(Tensor *A, Tensor *B,string mode,vector<int> axis,int* map)
 
   PROFILING_HEADER_EXTERN(reduce);
 
-  if (map == nullptr) {
+  if ((map == nullptr) && !A->isCPU()) {
     map = get_reduction_map(A, axis);
     map_was_null = true;
   }
 
   if (A->isCPU()) {
-      cpu_reduce(A,B,mode,map);
+      cpu_reduce(A,B,mode,axis);
     }
   #ifdef cGPU
   else if (A->isGPU()) {
@@ -124,7 +124,7 @@ void reduce(Tensor *A, Tensor *B,string mode,vector<int> axis,int* map)
   }
   #endif
 
-  eddl_free(map);
+  if (map_was_null) eddl_free(map);
 
   PROFILING_FOOTER(reduce);
 }
@@ -174,14 +174,14 @@ void reduce_mean(Tensor *A, Tensor *B,MapReduceDescriptor *MD){
   reduce(A,B,"mean",MD);
 }
 void reduce_variance(Tensor *A, Tensor *B,MapReduceDescriptor *MD){
-  reduce(A,B,"mean",MD);
+  reduce(A,B,"variance",MD);
 }
 void reduce_max(Tensor *A, Tensor *B,MapReduceDescriptor *MD){
-  reduce(A,B,"mean",MD);
+  reduce(A,B,"max",MD);
 }
 void reduce_min(Tensor *A, Tensor *B,MapReduceDescriptor *MD)
 {
-  reduce(A,B,"mean",MD);
+  reduce(A,B,"min",MD);
 }
 
 
@@ -207,11 +207,14 @@ void reduce_op(Tensor *A, Tensor *B,string op,vector<int> axis,int* map)
         j++;
        }
     }
-  if (map==nullptr)
+  bool map_was_null = false;
+  if ((map==nullptr) && !A->isCPU()) {
     map=get_reduction_map(A,axis);
+    map_was_null = true;
+  }
 
   if (A->isCPU()) {
-      cpu_reduce_op(A,B,op,map);
+      cpu_reduce_op(A,B,op,axis);
     }
   #ifdef cGPU
   else if (A->isGPU()) {
@@ -224,6 +227,8 @@ void reduce_op(Tensor *A, Tensor *B,string op,vector<int> axis,int* map)
   }
   #endif
 
+  if (map_was_null) eddl_free(map);
+
   PROFILING_FOOTER(reduce_op);
 }
 
@@ -38,7 +38,7 @@
 using namespace std;
 
 // ********* LOAD FUNCTIONS *********
-Tensor* Tensor::load(const string& filename, string format){
+Tensor* Tensor::load(const string& filename, string format, bool mmap){
     // Infer format from filename
     if(format.empty()){
         format = get_extension(filename);
@@ -49,6 +49,10 @@ Tensor* Tensor::load(const string& filename, string format){
         msg("Numpy files need a source type to be specified: 'Tensor::loadt<type>(filename)'");
     }
 
+    if(mmap && (format=="bin" || format=="fp16" || format=="bf16")){
+        return Tensor::load_from_mmap(filename);
+    }
+
     // Default type to be ignored
     // Ignore IDE warnings (some times they have problems with templates)
     return Tensor::load<float>(filename, std::move(format));
@@ -58,7 +62,7 @@ Tensor* Tensor::load(const string& filename, string format){
 Tensor* Tensor::loadfs(std::ifstream &ifs, const string& format) {
 
     // Choose format
-    if (format=="bin") {
+    if (format=="bin" || format=="fp16" || format=="bf16") {
         return Tensor::load_from_bin(ifs, 0, -1);
     }else{
         msg("Format not implemented: *.'" + format + "'", "Tensor::load"); // Exits
@@ -69,41 +73,58 @@ Tensor* Tensor::loadfs(std::ifstream &ifs, const string& format) {
 
 Tensor* Tensor::load_from_bin(std::ifstream &ifs, int start_row, int end_row){
     int r_ndim;
+    int r_dtype = DTYPE_FLOAT32;
 
-    // Load number of dimensions
+    // Load number of dimensions (16-bit data is tagged with -dtype before it)
     ifs.read(reinterpret_cast<char *>(&r_ndim),  sizeof(int));
+    if (r_ndim < 0) {
+        r_dtype = -r_ndim;
+        if ((r_dtype != DTYPE_FLOAT16) && (r_dtype != DTYPE_BFLOAT16)) msg("Unknown data type in binary file", "Tensor::load_from_bin");
+        ifs.read(reinterpret_cast<char *>(&r_ndim),  sizeof(int));
+    }
+    int r_elem = (r_dtype == DTYPE_FLOAT32) ? sizeof(float) : sizeof(uint16_t);
 
     // Load dimensions
     vector<int> r_shape(r_ndim);
     ifs.read(reinterpret_cast<char *>(r_shape.data()), r_ndim * sizeof(int));
 
-    // Compute total size
-    int r_size = 1;
+    // Compute total size (files of more than 2^31 elements)
+    long int r_size = 1;
     for(int i=0; i<r_ndim; i++){ r_size *= r_shape[i]; }
 
-    // Compute stride
-    vector<int> tmp_stride = shape2stride(r_shape);
+    // Elements per row
+    long int row_size = (r_ndim > 0 && r_shape[0] > 0) ? r_size / r_shape[0] : 0;
 
     // Compute offsets and positions to read
-    int start_offset = start_row * tmp_stride[0];
-    int n_read;
+    std::streamoff start_offset = (std::streamoff)start_row * row_size;
+    long int n_read;
 
     if(end_row<0){
         n_read = r_size;
     }else{
+        if (start_row < 0 || end_row < start_row || (r_ndim > 0 && end_row > r_shape[0]))
+            msg("Rows [" + std::to_string(start_row) + ", " + std::to_string(end_row) + ") out of range", "Tensor::load_from_bin");
+
         // Compute bytes to read
         int n_rows = end_row - start_row;
-        n_read = n_rows * tmp_stride[0];
+        n_read = (long int)n_rows * row_size;
 
         // Set new shape
         r_shape[0] = n_rows;
 
         // Set cursor's position
-        ifs.seekg(start_offset*sizeof(float), std::ifstream::cur);
+        ifs.seekg(start_offset * r_elem, std::ifstream::cur);
     }
 
     auto *t1 = new Tensor(r_shape, DEV_CPU);
-    ifs.read(reinterpret_cast<char*>(t1->ptr), n_read * sizeof(float));
+    if (r_dtype == DTYPE_FLOAT32) {
+        ifs.read(reinterpret_cast<char*>(t1->ptr), n_read * sizeof(float));
+    } else {
+        // Always loaded as float
+        vector<uint16_t> r_data(n_read);
+        ifs.read(reinterpret_cast<char*>(r_data.data()), n_read * sizeof(uint16_t));
+        cpu_half2float(r_data.data(), t1->ptr, n_read, r_dtype);
+    }
     // Load content (row-major)
     /*
     auto *r_ptr = new float[r_size];
@@ -118,6 +139,50 @@ Tensor* Tensor::load_from_bin(std::ifstream &ifs, int start_row, int end_row){
 
 
 
+Tensor* Tensor::load_from_mmap(const string &filename){
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.good()){
+        msg("File not found. Check the file name and try again.", "Tensor::load_from_mmap");
+    }
+
+    // Header
+    int r_ndim;
+    ifs.read(reinterpret_cast<char *>(&r_ndim),  sizeof(int));
+    if (r_ndim < 0) {
+        // 16-bit data cannot be used in place
+        ifs.seekg(0, std::ifstream::beg);
+        return Tensor::load_from_bin(ifs, 0, -1);
+    }
+
+    vector<int> r_shape(r_ndim);
+    ifs.read(reinterpret_cast<char *>(r_shape.data()), r_ndim * sizeof(int));
+    if (!ifs.good()) msg("Incomplete header", "Tensor::load_from_mmap");
+
+    unsigned long int r_size = 1;
+    for(int i=0; i<r_ndim; i++){ r_size *= r_shape[i]; }
+
+    size_t offset = (r_ndim + 1) * sizeof(int);
+    ifs.seekg(0, std::ifstream::end);
+    if ((size_t)ifs.tellg() < offset + r_size * sizeof(float)) msg("The file is smaller than expected", "Tensor::load_from_mmap");
+
+    // The data follows the header (aligned to 4 bytes, enough for floats)
+    auto *r_ptr = (float *)eddl_mmap(filename, offset, r_size * sizeof(float));
+    if (r_ptr == nullptr) {
+        // Empty tensors or no mmap support
+        ifs.seekg(0, std::ifstream::beg);
+        return Tensor::load_from_bin(ifs, 0, -1);
+    }
+    ifs.close();
+
+    // The tensor owns the mapping: it is released by deleteData (eddl_free)
+    auto *t1 = new Tensor();
+    t1->updateShape(r_shape);
+    t1->updateSize();
+    t1->updateStrides();
+    t1->updateData(r_ptr, nullptr, false);
+    return t1;
+}
+
 Tensor* Tensor::load_from_img(const string &filename, const string &format){
     Tensor* t = nullptr;
 
@@ -189,7 +254,7 @@ Tensor* Tensor::load_partial(const string& filename, int start_row, int end_row)
 
     // Load tensor
     Tensor* t;
-    if(format=="bin"){
+    if(format=="bin" || format=="fp16" || format=="bf16"){
         t = Tensor::load_from_bin(ifs, start_row, end_row);
     }else{
         msg("Format not implemented: *.'" + format + "'", "Tensor::load");
@@ -215,7 +280,7 @@ void Tensor::save(const string& filename, string format) {
 
     if(format=="png" || format=="bmp" || format=="tga" || format=="jpg" || format=="jpeg" || format=="hdr") { // Images
         save2img(filename, format);
-    }else if(format=="bin" || format=="csv" || format=="tsv" || format=="txt"){
+    }else if(format=="bin" || format=="fp16" || format=="bf16" || format=="csv" || format=="tsv" || format=="txt"){
         // Open file stream, save tensor and close filesteam
         std::ofstream ofs(filename, std::ios::out | std::ios::binary);
         Tensor::savefs(ofs, format);
@@ -235,7 +300,11 @@ void Tensor::savefs(std::ofstream &ofs, string format) {
 
     // Choose format
     if(format=="bin") {
-        save2bin(ofs);
+        save2bin(ofs, this->dtype);
+    } else if(format=="fp16") {
+        save2bin(ofs, DTYPE_FLOAT16);
+    } else if(format=="bf16") {
+        save2bin(ofs, DTYPE_BFLOAT16);
     } else if(format=="csv" || format=="tsv" || format=="txt"){
         char delimiter;
         if (format=="csv") {delimiter = ','; }
@@ -249,7 +318,13 @@ void Tensor::savefs(std::ofstream &ofs, string format) {
 }
 
 
-void Tensor::save2bin(std::ofstream &ofs){
+void Tensor::save2bin(std::ofstream &ofs, int dtype){
+    // Tag 16-bit data (float data keeps the original layout)
+    if (dtype != DTYPE_FLOAT32) {
+        int tag = -dtype;
+        ofs.write(reinterpret_cast<const char *>(&tag), sizeof(int));
+    }
+
     // Save number of dimensions
     ofs.write(reinterpret_cast<const char *>(&this->ndim), sizeof(int));
 
@@ -257,7 +332,14 @@ void Tensor::save2bin(std::ofstream &ofs){
     ofs.write(reinterpret_cast<const char *>(this->shape.data()), this->shape.size() * sizeof(int));
 
     // Save content (row-major)
-    ofs.write(reinterpret_cast<const char *>(this->ptr), this->size * sizeof(float));
+    int elem = (dtype == DTYPE_FLOAT32) ? sizeof(float) : sizeof(uint16_t);
+    if (dtype == this->dtype) {
+        ofs.write(reinterpret_cast<const char *>(this->ptr), this->size * elem);
+    } else {
+        Tensor *t = this->astype(dtype);
+        ofs.write(reinterpret_cast<const char *>(t->ptr), t->size * elem);
+        delete t;
+    }
 }
 
 void Tensor::save2img(const string& filename, string format){
@@ -387,7 +469,8 @@ std::pair<void*, size_t> Tensor::save2ptr() {
 
     // Reserve memory for: ndims value, shape vector and tensor float data
     size_t needed_mem = sizeof(int) + (aux_tensor->shape.size() * sizeof(int)) + (aux_tensor->size * sizeof(float));
-    float * dest = get_fmem(needed_mem, "save2ptr()");
+    // Not from the memory pool: the caller owns it and releases it with free()
+    void * dest = eddl_system_malloc(needed_mem, "save2ptr()");
     char * aux_ptr = (char*) dest;
 
     // Store the number of dimensions
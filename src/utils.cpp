@@ -26,17 +26,23 @@
 #include <vector>
 #include <iomanip>
 #include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <atomic>
 
 
 
 #include "eddl/system_info.h"
 #include "eddl/utils.h"
+#include "eddl/mem_pool.h"
 #include "eddl/profiling.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
 
 #ifdef EDDL_LINUX
 #include "sys/mman.h"
 #include <sys/sysinfo.h>
 #include <unistd.h>
+#include <fcntl.h>
 #endif
 
 #ifdef EDDL_APPLE
@@ -47,6 +53,9 @@
 #include <mach/mach_types.h>
 #include <mach/mach_init.h>
 #include <mach/mach_host.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
 #endif
 
 #ifdef EDDL_WINDOWS
@@ -67,6 +76,23 @@ void msg(const string& text, const string& title) {
 }
 
 void * eddl_malloc(size_t size, const string & str_info)
+{
+    // Cached blocks (see mem_pool.h), or the system allocator if the pool is disabled
+    return mem_pool_malloc(size, str_info);
+}
+
+void eddl_free(void * ptr)
+{
+    if (ptr == nullptr) return;
+
+    // Data mapped from a file (see eddl_mmap)
+    if (eddl_munmap(ptr)) return;
+
+    // Blocks not owned by the pool go straight to the system
+    if (!mem_pool_free(ptr)) eddl_system_free(ptr);
+}
+
+void * eddl_system_malloc(size_t size, const string & str_info)
 {
     constexpr size_t alignment_block_size = 64;
 
@@ -118,17 +144,20 @@ void * eddl_malloc(size_t size, const string & str_info)
     // Check for errors
     // Not enough free memory
     if (error || ptr == nullptr) {
-        if (ptr != nullptr) eddl_free(ptr);
+        if (ptr != nullptr) eddl_system_free(ptr);
         //throw std::runtime_error("Error allocating " + string(bytes2human(size * sizeof(float))) + " in " + string(str));
         throw std::runtime_error("Error " + std::to_string(errno)
                                 + " allocating " + string(bytes2human(size, 0)) + " bytes at "
                                 + string(__FILE__) + "(" + std::to_string(__LINE__) + ") " + str_info);
     }
 
+    // First touch from the threads that will use each part (NUMA)
+    if ((size >= CPU_NUMA_MIN_BYTES) && cpu_numa_first_touch()) cpu_numa_touch(ptr, size);
+
     return ptr;
 }
 
-void eddl_free(void * ptr)
+void eddl_system_free(void * ptr)
 {
 #if defined(EDDL_LINUX) || defined(EDDL_APPLE)
     free(ptr);
@@ -139,6 +168,67 @@ void eddl_free(void * ptr)
 #endif
 }
 
+// Live mappings: data pointer => (start of the mapping, length)
+static std::mutex mmap_mtx;
+static std::atomic<int> mmap_count(0);
+static std::unordered_map<void *, std::pair<void *, size_t>> *mmap_blocks = new std::unordered_map<void *, std::pair<void *, size_t>>();
+
+void * eddl_mmap(const string &filename, size_t offset, size_t size)
+{
+#if defined(EDDL_LINUX) || defined(EDDL_APPLE)
+    if (size == 0) return nullptr;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    // The mapping must start at a page boundary
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    size_t length = offset - start + size;
+
+    // Private mapping: pages come from the page cache (shared with any other process
+    // mapping the same file) and are only copied if they are written
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start);
+    close(fd);  // The mapping keeps its own reference to the file
+    if (base == MAP_FAILED) return nullptr;
+
+    // Read ahead the whole file if it fits in memory, else just what is touched
+    if (length < get_free_mem()) madvise(base, length, MADV_WILLNEED);
+    else madvise(base, length, MADV_RANDOM);
+
+    void *ptr = (char *)base + (offset - start);
+    {
+        std::lock_guard<std::mutex> lock(mmap_mtx);
+        (*mmap_blocks)[ptr] = std::make_pair(base, length);
+        mmap_count++;
+    }
+    return ptr;
+#else
+    return nullptr;
+#endif
+}
+
+bool eddl_munmap(void * ptr)
+{
+#if defined(EDDL_LINUX) || defined(EDDL_APPLE)
+    if (mmap_count == 0) return false;
+
+    std::pair<void *, size_t> block;
+    {
+        std::lock_guard<std::mutex> lock(mmap_mtx);
+        auto it = mmap_blocks->find(ptr);
+        if (it == mmap_blocks->end()) return false;
+        block = it->second;
+        mmap_blocks->erase(it);
+        mmap_count--;
+    }
+    munmap(block.first, block.second);
+    return true;
+#else
+    return false;
+#endif
+}
+
 float *get_fmem(unsigned long int size, const string &str)
 {
     return (float *)eddl_malloc(size * sizeof(float), str);
@@ -263,13 +353,13 @@ vector<vector<int>> parse_indices(vector<string> str_indices, const vector<int>&
             }else{
                 if (pos==0){ // ":5"
                     min = 0;
-                    max = std::stoi(str.substr(pos+delimiter.length(), shape[i]-1)) - 1;
+                    max = std::stoi(str.substr(pos+delimiter.length())) - 1;
                 }else if(pos==str.length()-1){  // "5:"
                     min = std::stoi(str.substr(0, pos));
                     max = shape[i]-1;
                 }else{  // "5:10"
                     min = std::stoi(str.substr(0, pos));
-                    max = std::stoi(str.substr(pos+delimiter.length(), shape[i]-1)) - 1;
+                    max = std::stoi(str.substr(pos+delimiter.length())) - 1;
                 }
             }
         }else{  // Not found => "5"
@@ -1,8 +1,10 @@
 #include <gtest/gtest.h>
+#include <random>
 
 #include "eddl/tensor/tensor.h"
 #include "eddl/tensor/nn/tensor_nn.h"
 #include "eddl/descriptors/descriptors.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
 
 
 
@@ -184,18 +186,18 @@ TEST(Conv2DTestSuite, conv2d_k2x2_s2x2_pad_same)
 
 
     // Forward
-    auto *ptr_fwrd = new float[3*3]{6.00, 7.00, 15.00,
-                                    12.00, 1.00, 5.00,
-                                    0.00, 0.00, 0.00};
+    auto *ptr_fwrd = new float[3*3]{6.00, 7.00, 8.00,
+                                    15.00, 12.00, 7.00,
+                                    1.00, 5.00, 7.00};
     auto* t_fwrd = new Tensor({1, 1, 3, 3}, ptr_fwrd, DEV_CPU);
 
 
     // backward
-    auto *ptr_bwrd = new float[5*5]{1.00, 1.00, 1.00, 1.00, 0.00,
-                                    1.00, 1.00, 1.00, 1.00, 0.00,
-                                    1.00, 1.00, 1.00, 1.00, 0.00,
-                                    1.00, 1.00, 1.00, 1.00, 0.00,
-                                    1.00, 1.00, 1.00, 1.00, 0.00};
+    auto *ptr_bwrd = new float[5*5]{1.00, 1.00, 1.00, 1.00, 1.00,
+                                    1.00, 1.00, 1.00, 1.00, 1.00,
+                                    1.00, 1.00, 1.00, 1.00, 1.00,
+                                    1.00, 1.00, 1.00, 1.00, 1.00,
+                                    1.00, 1.00, 1.00, 1.00, 1.00};
     auto* t_bwrd = new Tensor({1, 1, 5, 5}, ptr_bwrd, DEV_CPU);
 
     // Operation
@@ -393,6 +395,269 @@ TEST(Conv2DTestSuite, conv2d_k3x3_s2x2_pad_same){
     ASSERT_TRUE((bool) Tensor::equivalent(t_bwrd, cd->ID, 10e-5f));
 }
 
+TEST(Conv2DTestSuite, conv2d_k3x3_s1x1_winograd){
+    // F(2x2,3x3) on small maps, F(4x4,3x3) on bigger ones. Sizes that are not
+    // multiples of the tiles, and a sample of several blocks of tiles
+    vector<vector<int>> shapes = {{2, 16, 7, 7}, {2, 17, 21, 19}, {2, 64, 40, 37}};
+    for (auto &shape : shapes) {
+        for (string padding : {"same", "valid"}) {
+            Tensor *t_image = Tensor::randn(shape);
+
+            // Winograd (selected by the descriptor) and im2col
+            ConvolDescriptor *cds[2];
+            for (int i = 0; i < 2; i++) {
+                cds[i] = new ConvolDescriptor(18, {3, 3}, {1, 1}, padding, {}, 1, {1, 1}, true);
+                cds[i]->build(t_image);
+                cds[i]->bias->fill_(0.5f);
+                cds[i]->gK->fill_(0.0f);
+                cds[i]->gbias->fill_(0.0f);
+                cds[i]->ID = Tensor::zeros(cds[i]->I->getShape());
+            }
+            ASSERT_EQ(cds[0]->winograd, (shape[2] > 16) ? 4 : 2);
+            cds[1]->winograd = 0;
+
+            Tensor *t_kernels = Tensor::randn(cds[0]->K->getShape());
+            Tensor *t_delta = Tensor::randn(cds[0]->O->getShape());
+            for (auto cd : cds) {
+                Tensor::copy(t_kernels, cd->K);
+                cd->D = t_delta;
+                tensorNN::Conv2D(cd);
+                tensorNN::Conv2D_grad(cd);
+                tensorNN::Conv2D_back(cd);
+            }
+
+            // The sums of the bigger maps have bigger rounding errors
+            float atol = (shape[1] > 32) ? 1e-2f : 1e-3f;
+            ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->O, cds[1]->O, atol, 1e-4f));
+            ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->gK, cds[1]->gK, atol, 1e-4f));
+            ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->gbias, cds[1]->gbias, atol, 1e-4f));
+            ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->ID, cds[1]->ID, atol, 1e-4f));
+        }
+    }
+}
+
+TEST(Conv2DTestSuite, conv2d_grouped_depthwise){
+    // Each group against a convolution of its channels: two groups (im2col)
+    // and one group for each channel with two kernels (depthwise)
+    Tensor *t_image = Tensor::randn({2, 8, 9, 9});
+    for (int groups : {2, 8}) {
+        for (int s : {1, 2}) {
+            for (string padding : {"same", "valid"}) {
+                int nk = (groups == 2) ? 6 : 16, nkg = nk / groups, kz = 8 / groups;
+
+                auto *cd = new ConvolDescriptor(nk, {3, 3}, {s, s}, padding, {}, groups, {1, 1}, true);
+                cd->build(t_image);
+                ASSERT_EQ(cd->kz, kz);
+                ASSERT_EQ(cd->depthwise, groups == 8);
+                Tensor *t_kernel = Tensor::randn(cd->K->getShape());
+                Tensor::copy(t_kernel, cd->K);
+                cd->bias->fill_(0.5f);
+                cd->gK->fill_(0.0f);
+                cd->gbias->fill_(0.0f);
+                cd->ID = Tensor::zeros(cd->I->getShape());
+                cd->D = Tensor::randn(cd->O->getShape());
+                tensorNN::Conv2D(cd);
+                tensorNN::Conv2D_grad(cd);
+                tensorNN::Conv2D_back(cd);
+
+                vector<Tensor *> O, gK, gbias, ID;
+                for (int g = 0; g < groups; g++) {
+                    string zi = to_string(g * kz) + ":" + to_string((g + 1) * kz);
+                    string zo = to_string(g * nkg) + ":" + to_string((g + 1) * nkg);
+
+                    auto *cdg = new ConvolDescriptor(nkg, {3, 3}, {s, s}, padding, {}, 1, {1, 1}, true);
+                    cdg->build(t_image->select({":", zi}));
+                    Tensor::copy(cd->K->select({zo}), cdg->K);
+                    cdg->bias->fill_(0.5f);
+                    cdg->gK->fill_(0.0f);
+                    cdg->gbias->fill_(0.0f);
+                    cdg->ID = Tensor::zeros(cdg->I->getShape());
+                    cdg->D = cd->D->select({":", zo});
+                    tensorNN::Conv2D(cdg);
+                    tensorNN::Conv2D_grad(cdg);
+                    tensorNN::Conv2D_back(cdg);
+
+                    O.push_back(cdg->O);
+                    gK.push_back(cdg->gK);
+                    gbias.push_back(cdg->gbias);
+                    ID.push_back(cdg->ID);
+                }
+
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->O, Tensor::concat(O, 1), 1e-4f, 1e-5f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gK, Tensor::concat(gK, 0), 1e-4f, 1e-5f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gbias, Tensor::concat(gbias, 0), 1e-4f, 1e-5f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->ID, Tensor::concat(ID, 1), 1e-4f, 1e-5f));
+            }
+        }
+    }
+}
+
+TEST(Conv2DTestSuite, conv2d_dilated){
+    // Against the undilated kernel that has zeros between the elements
+    Tensor *t_image = Tensor::randn({2, 4, 11, 10});
+    for (int groups : {1, 4}) {
+        for (vector<int> d : vector<vector<int>>{{2, 2}, {2, 3}}) {
+            for (int s : {1, 2}) {
+                for (string padding : {"same", "valid"}) {
+                    int kr = 2 * d[0] + 1, kc = d[1] + 1;  // Span of the 3x2 kernel
+
+                    ConvolDescriptor *cds[2];
+                    cds[0] = new ConvolDescriptor(4, {3, 2}, {s, s}, padding, {}, groups, d, true);
+                    cds[1] = new ConvolDescriptor(4, {kr, kc}, {s, s}, padding, {}, groups, {1, 1}, true);
+                    for (auto cd : cds) {
+                        cd->build(t_image);
+                        cd->bias->fill_(0.5f);
+                        cd->gK->fill_(0.0f);
+                        cd->gbias->fill_(0.0f);
+                        cd->ID = Tensor::zeros(cd->I->getShape());
+                    }
+                    ASSERT_EQ(cds[0]->O->getShape(), cds[1]->O->getShape());
+
+                    Tensor::copy(Tensor::randn(cds[0]->K->getShape()), cds[0]->K);
+                    cds[1]->K->fill_(0.0f);
+                    int n = cds[0]->nk * cds[0]->kz;
+                    for (int i = 0; i < n; i++)
+                        for (int ky = 0; ky < 3; ky++)
+                            for (int kx = 0; kx < 2; kx++)
+                                cds[1]->K->ptr[(i * kr + ky * d[0]) * kc + kx * d[1]] = cds[0]->K->ptr[(i * 3 + ky) * 2 + kx];
+
+                    Tensor *t_delta = Tensor::randn(cds[0]->O->getShape());
+                    for (auto cd : cds) {
+                        cd->D = t_delta;
+                        tensorNN::Conv2D(cd);
+                        tensorNN::Conv2D_grad(cd);
+                        tensorNN::Conv2D_back(cd);
+                    }
+
+                    ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->O, cds[1]->O, 1e-4f, 1e-5f));
+                    ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->gbias, cds[1]->gbias, 1e-4f, 1e-5f));
+                    ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->ID, cds[1]->ID, 1e-4f, 1e-5f));
+                    for (int i = 0; i < n; i++)
+                        for (int ky = 0; ky < 3; ky++)
+                            for (int kx = 0; kx < 2; kx++)
+                                ASSERT_NEAR(cds[0]->gK->ptr[(i * 3 + ky) * 2 + kx], cds[1]->gK->ptr[(i * kr + ky * d[0]) * kc + kx * d[1]], 1e-3f);
+                }
+            }
+        }
+    }
+}
+
+// The data of A (b,z,r,c) stored (b,r,c,z), in a tensor of the same shape
+static Tensor *channels_last(Tensor *A){
+    Tensor *P = Tensor::permute(A, {0, 2, 3, 1});
+    Tensor *B = new Tensor(A->getShape());
+    std::copy(P->ptr, P->ptr + P->size, B->ptr);
+    delete P;
+    return B;
+}
+
+TEST(Conv2DTestSuite, conv2d_channels_last){
+    // Against the (b,z,r,c) layout: im2col (several blocks of channels in the
+    // tiles, groups, strides and dilations) and depthwise (one and two kernels
+    // for each channel)
+    struct { vector<int> shape; int nk, groups, s, d; } cases[] = {
+        {{1, 130, 5, 60}, 12, 1, 1, 2}, {{2, 8, 9, 9}, 6, 2, 2, 1}, {{2, 8, 9, 9}, 8, 8, 1, 1}, {{2, 8, 9, 9}, 16, 8, 2, 2}
+    };
+    for (auto &cs : cases) {
+        Tensor *t_image = Tensor::randn(cs.shape);
+        Tensor *t_image_cl = channels_last(t_image);
+        ConvolDescriptor *cds[2];
+        for (int i = 0; i < 2; i++) {
+            cds[i] = new ConvolDescriptor(cs.nk, {3, 3}, {cs.s, cs.s}, "same", {}, cs.groups, {cs.d, cs.d}, true);
+            cds[i]->build(i ? t_image_cl : t_image);
+            cds[i]->winograd = 0;
+            cds[i]->channels_last_in = cds[i]->channels_last_out = (i == 1);
+            cds[i]->bias->fill_(0.5f);
+            cds[i]->gK->fill_(0.0f);
+            cds[i]->gbias->fill_(0.0f);
+            cds[i]->ID = Tensor::zeros(cds[i]->I->getShape());
+        }
+        ASSERT_EQ(cds[0]->depthwise, cs.groups == 8);
+        Tensor::copy(Tensor::randn(cds[0]->K->getShape()), cds[0]->K);
+        Tensor::copy(cds[0]->K, cds[1]->K);
+        cds[0]->D = Tensor::randn(cds[0]->O->getShape());
+        cds[1]->D = channels_last(cds[0]->D);
+        for (auto cd : cds) {
+            tensorNN::Conv2D(cd);
+            tensorNN::Conv2D_grad(cd);
+            tensorNN::Conv2D_back(cd);
+        }
+
+        // Sums of up to 130*9 products in another order
+        ASSERT_TRUE((bool) Tensor::equivalent(channels_last(cds[0]->O), cds[1]->O, 1e-3f, 1e-4f));
+        ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->gK, cds[1]->gK, 1e-3f, 1e-4f));
+        ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->gbias, cds[1]->gbias, 1e-3f, 1e-4f));
+        ASSERT_TRUE((bool) Tensor::equivalent(channels_last(cds[0]->ID), cds[1]->ID, 1e-3f, 1e-4f));
+    }
+}
+
+TEST(Conv2DTestSuite, conv2d_int8){
+    // Integer images and kernels with scales of 1: the int8 products are exact,
+    // and so is the float convolution (sums below 2^24). Channels that are not
+    // a multiple of the vectors, groups, strides, dilations and depthwise
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<int> dist(-127, 127);
+    struct { vector<int> shape; int nk, groups, s, d; bool cl; } cases[] = {
+        {{2, 70, 9, 11}, 5, 1, 1, 1, false}, {{2, 8, 9, 9}, 6, 2, 2, 2, false}, {{2, 8, 9, 9}, 8, 8, 1, 1, true}, {{1, 16, 7, 7}, 12, 4, 2, 1, true}
+    };
+    for (auto &cs : cases) {
+        Tensor *t_image = new Tensor(cs.shape);
+        for (int i = 0; i < t_image->size; i++) t_image->ptr[i] = dist(gen);
+        Tensor *t_input = cs.cl ? channels_last(t_image) : t_image;
+        ConvolDescriptor *cds[2];
+        for (int i = 0; i < 2; i++) {
+            cds[i] = new ConvolDescriptor(cs.nk, {3, 3}, {cs.s, cs.s}, "same", {}, cs.groups, {cs.d, cs.d}, true);
+            cds[i]->build(t_input);
+            cds[i]->winograd = 0;
+            cds[i]->channels_last_in = cds[i]->channels_last_out = cs.cl;
+            cds[i]->bias->fill_(0.5f);
+        }
+        vector<int8_t> Kq(cds[0]->K->size);
+        vector<float> Kq_scale(cs.nk, 1.0f);
+        for (int i = 0; i < Kq.size(); i++) cds[0]->K->ptr[i] = Kq[i] = dist(gen);
+
+        tensorNN::Conv2D(cds[0]);
+        tensorNN::Conv2D_int8(cds[1], 1.0f, Kq.data(), Kq_scale.data());
+        ASSERT_TRUE((bool) Tensor::equivalent(cds[0]->O, cds[1]->O, 0.0f, 0.0f));
+
+        if (t_input != t_image) delete t_input;
+        delete t_image;
+    }
+}
+
+TEST(Conv2DTestSuite, conv2d_grad_batch_chunks){
+    // Few blocks of channels for the threads: the batch is split in chunks with partial gradients
+    Tensor *t_image = Tensor::randn({6, 8, 10, 10});
+    auto *cd = new ConvolDescriptor(8, {3, 2}, {1, 1}, "same", {}, 1, {1, 1}, true);
+    cd->build(t_image);
+    Tensor *t_kernel = Tensor::randn(cd->K->getShape());
+    Tensor::copy(t_kernel, cd->K);
+    cd->D = Tensor::randn(cd->O->getShape());
+    Tensor *init = Tensor::randn(cd->gK->getShape());  // gK accumulates
+
+    int threads = cpu_pool_threads();
+    Tensor *gK[4];
+    for (int i = 0; i < 4; i++) {
+        cpu_set_deterministic(i >= 2);
+        cpu_pool_set_threads((i % 2 == 0) ? 1 : 4);
+        Tensor::copy(init, cd->gK);
+        tensorNN::Conv2D_grad(cd);
+        gK[i] = cd->gK->clone();
+    }
+    cpu_set_deterministic(false);
+    cpu_pool_set_threads(threads);
+
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[0], gK[1], 1e-4f, 1e-5f));
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[0], gK[2], 1e-4f, 1e-5f));
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[2], gK[3], 0.0f, 0.0f));  // Same chunks with any threads
+
+    for (auto t : gK) delete t;
+    delete init;
+    delete t_kernel;
+    delete cd->D;
+    delete t_image;
+}
+
 #ifdef cGPU
 TEST(Conv2DTestSuite, conv2d_k2x2_s2x2_pad_valid_gpu)
 {
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/tensor/nn/tensor_nn.h"
+#include "eddl/descriptors/descriptors.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+
+// Direct loops: O, gK, gbias and ID of the descriptor cd (with the same K, bias and D).
+// The filter o of the group g = o / (nk/groups) reads the channels g*kz..(g+1)*kz-1
+static void conv3d_reference(ConvolDescriptor3D *cd, Tensor *O, Tensor *gK, Tensor *gbias, Tensor *ID){
+    O->fill_(0.0f); gK->fill_(0.0f); gbias->fill_(0.0f); ID->fill_(0.0f);
+    for (int b = 0; b < cd->I->shape[0]; b++)
+    for (int o = 0; o < cd->nk; o++)
+    for (int w = 0; w < cd->d; w++)
+    for (int y = 0; y < cd->r; y++)
+    for (int x = 0; x < cd->c; x++) {
+        int p = (((b * cd->z + o) * cd->d + w) * cd->r + y) * cd->c + x;
+        O->ptr[p] = cd->bias->ptr[o];
+        gbias->ptr[o] += cd->D->ptr[p];
+        int g = o / (cd->nk / cd->groups);
+        for (int z = 0; z < cd->kz; z++)
+        for (int kw = 0; kw < cd->kd; kw++)
+        for (int ky = 0; ky < cd->kr; ky++)
+        for (int kx = 0; kx < cd->kc; kx++) {
+            int pw = w * cd->sd - cd->paddf + kw * cd->dd;
+            int py = y * cd->sr - cd->padrt + ky * cd->dr;
+            int px = x * cd->sc - cd->padcl + kx * cd->dc;
+            if (pw < 0 || pw >= cd->id || py < 0 || py >= cd->ir || px < 0 || px >= cd->ic) continue;
+            int i = (((b * cd->iz + g * cd->kz + z) * cd->id + pw) * cd->ir + py) * cd->ic + px;
+            int k = (((o * cd->kz + z) * cd->kd + kw) * cd->kr + ky) * cd->kc + kx;
+            O->ptr[p] += cd->I->ptr[i] * cd->K->ptr[k];
+            gK->ptr[k] += cd->I->ptr[i] * cd->D->ptr[p];
+            ID->ptr[i] += cd->K->ptr[k] * cd->D->ptr[p];
+        }
+    }
+}
+
+TEST(Conv3DTestSuite, conv3d_vol2col){
+    // The second shape has more than one block of channels in the tiles
+    for (vector<int> shape : vector<vector<int>>{{2, 5, 6, 9, 8}, {1, 64, 3, 5, 60}}) {
+        Tensor *t_image = Tensor::randn(shape);
+        for (vector<int> s : vector<vector<int>>{{1, 1, 1}, {2, 1, 2}}) {
+            for (string padding : {"same", "valid"}) {
+                auto *cd = new ConvolDescriptor3D(4, {3, 3, 2}, s, padding, true);
+                cd->build(t_image);
+                Tensor::copy(Tensor::randn(cd->K->getShape()), cd->K);
+                cd->bias->fill_(0.5f);
+                cd->gK->fill_(0.0f);
+                cd->gbias->fill_(0.0f);
+                cd->ID = Tensor::zeros(cd->I->getShape());
+                cd->D = Tensor::randn(cd->O->getShape());
+
+                tensorNN::Conv3D(cd);
+                tensorNN::Conv3D_grad(cd);
+                tensorNN::Conv3D_back(cd);
+
+                Tensor *O = new Tensor(cd->O->getShape());
+                Tensor *gK = new Tensor(cd->gK->getShape());
+                Tensor *gbias = new Tensor(cd->gbias->getShape());
+                Tensor *ID = new Tensor(cd->ID->getShape());
+                conv3d_reference(cd, O, gK, gbias, ID);
+
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->O, O, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gK, gK, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gbias, gbias, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->ID, ID, 1e-3f, 1e-4f));
+
+                delete O; delete gK; delete gbias; delete ID;
+                delete cd->ID; delete cd->D;
+            }
+        }
+        delete t_image;
+    }
+}
+
+TEST(Conv3DTestSuite, conv3d_groups_dilation){
+    Tensor *t_image = Tensor::randn({2, 6, 7, 8, 9});
+    for (int groups : {1, 2, 3}) {
+        for (vector<int> dilation : vector<vector<int>>{{1, 1, 1}, {2, 1, 3}}) {
+            for (string padding : {"same", "valid"}) {
+                auto *cd = new ConvolDescriptor3D(6, {3, 2, 3}, {1, 2, 1}, padding, groups, dilation, true);
+                cd->build(t_image);
+                ASSERT_EQ(cd->kz, 6 / groups);
+                Tensor::copy(Tensor::randn(cd->K->getShape()), cd->K);
+                cd->bias->fill_(0.5f);
+                cd->gK->fill_(0.0f);
+                cd->gbias->fill_(0.0f);
+                cd->ID = Tensor::zeros(cd->I->getShape());
+                cd->D = Tensor::randn(cd->O->getShape());
+
+                tensorNN::Conv3D(cd);
+                tensorNN::Conv3D_grad(cd);
+                tensorNN::Conv3D_back(cd);
+
+                Tensor *O = new Tensor(cd->O->getShape());
+                Tensor *gK = new Tensor(cd->gK->getShape());
+                Tensor *gbias = new Tensor(cd->gbias->getShape());
+                Tensor *ID = new Tensor(cd->ID->getShape());
+                conv3d_reference(cd, O, gK, gbias, ID);
+
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->O, O, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gK, gK, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->gbias, gbias, 1e-3f, 1e-4f));
+                ASSERT_TRUE((bool) Tensor::equivalent(cd->ID, ID, 1e-3f, 1e-4f));
+
+                delete O; delete gK; delete gbias; delete ID;
+                delete cd->ID; delete cd->D;
+            }
+        }
+    }
+
+    // The channels must be split evenly among the groups
+    auto *cd = new ConvolDescriptor3D(6, {3, 3, 3}, {1, 1, 1}, "same", 4, {1, 1, 1}, true);
+    ASSERT_THROW(cd->build(t_image), std::runtime_error);
+    delete t_image;
+}
+
+TEST(Conv3DTestSuite, conv3d_grad_batch_chunks){
+    // One block of channels for the threads: the batch is split in chunks with partial gradients
+    Tensor *t_image = Tensor::randn({6, 4, 5, 6, 7});
+    auto *cd = new ConvolDescriptor3D(4, {3, 3, 2}, {1, 1, 1}, "same", true);
+    cd->build(t_image);
+    Tensor *t_kernel = Tensor::randn(cd->K->getShape());
+    Tensor::copy(t_kernel, cd->K);
+    cd->D = Tensor::randn(cd->O->getShape());
+    Tensor *init = Tensor::randn(cd->gK->getShape());  // gK accumulates
+
+    int threads = cpu_pool_threads();
+    Tensor *gK[4];
+    for (int i = 0; i < 4; i++) {
+        cpu_set_deterministic(i >= 2);
+        cpu_pool_set_threads((i % 2 == 0) ? 1 : 4);
+        Tensor::copy(init, cd->gK);
+        tensorNN::Conv3D_grad(cd);
+        gK[i] = cd->gK->clone();
+    }
+    cpu_set_deterministic(false);
+    cpu_pool_set_threads(threads);
+
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[0], gK[1], 1e-4f, 1e-5f));
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[0], gK[2], 1e-4f, 1e-5f));
+    ASSERT_TRUE((bool) Tensor::equivalent(gK[2], gK[3], 0.0f, 0.0f));  // Same chunks with any threads
+
+    for (auto t : gK) delete t;
+    delete init;
+    delete t_kernel;
+    delete cd->D;
+    delete t_image;
+}
@@ -273,6 +273,39 @@ TEST(AvgPoolTestSuite, avgpool_k3x3_s2x2_pad_same)
 }
 
 
+TEST(AvgPoolTestSuite, avgpool_channels_last)
+{
+    // Against the (b,z,r,c) layout, with windows in the padding
+    Tensor *t_image = Tensor::randn({2, 20, 7, 8});
+    Tensor *P = Tensor::permute(t_image, {0, 2, 3, 1});
+    Tensor *t_image_cl = new Tensor(t_image->getShape());
+    std::copy(P->ptr, P->ptr + P->size, t_image_cl->ptr);
+
+    PoolDescriptor *pds[2];
+    for (int i = 0; i < 2; i++) {
+        pds[i] = new PoolDescriptor({3, 3}, {2, 2}, "same");
+        pds[i]->build(i ? t_image_cl : t_image);
+        pds[i]->channels_last = (i == 1);
+        pds[i]->ID = Tensor::zeros(pds[i]->I->getShape());
+        pds[i]->indX = new Tensor(pds[i]->O->getShape());
+        pds[i]->indY = new Tensor(pds[i]->O->getShape());
+    }
+    pds[0]->D = Tensor::randn(pds[0]->O->getShape());
+    Tensor *D = Tensor::permute(pds[0]->D, {0, 2, 3, 1});
+    pds[1]->D = new Tensor(pds[0]->D->getShape());
+    std::copy(D->ptr, D->ptr + D->size, pds[1]->D->ptr);
+
+    for (auto pd : pds) {
+        tensorNN::AvgPool2D(pd);
+        tensorNN::AvgPool2D_back(pd);
+    }
+
+    Tensor *O = Tensor::permute(pds[0]->O, {0, 2, 3, 1});
+    Tensor *ID = Tensor::permute(pds[0]->ID, {0, 2, 3, 1});
+    ASSERT_TRUE(std::equal(O->ptr, O->ptr + O->size, pds[1]->O->ptr));
+    ASSERT_TRUE(std::equal(ID->ptr, ID->ptr + ID->size, pds[1]->ID->ptr));
+}
+
 #ifdef cGPU
 TEST(MaxPoolTestSuite, avgpool_k2x2_s2x2_pad_valid_gpu)
 {
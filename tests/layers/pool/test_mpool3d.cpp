@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/tensor/nn/tensor_nn.h"
+#include "eddl/descriptors/descriptors.h"
+
+
+
+TEST(MaxPoolTestSuite, mpool3d_k2x2x2_s2x2x2_pad_valid)
+{
+    // Volume (2 frames)
+    auto *ptr_img = new float[2*4*4]{0, 1, 0, 4,
+                                     2, 3, 2, 1,
+                                     4, 4, 0, 4,
+                                     2, 5, 2, 6,
+
+                                     1, 0, 0, 5,
+                                     7, 2, 3, 1,
+                                     0, 1, 8, 2,
+                                     3, 0, 1, 1};
+    auto* t_image = new Tensor({1, 1, 2, 4, 4}, ptr_img, DEV_CPU);
+
+
+    // Forward
+    auto *ptr_fwrd = new float[2*2]{7, 5,
+                                    5, 8};
+    auto* t_fwrd = new Tensor({1, 1, 1, 2, 2}, ptr_fwrd, DEV_CPU);
+
+
+    // backward
+    auto *ptr_bwrd = new float[2*4*4]{0, 0, 0, 0,
+                                      0, 0, 0, 0,
+                                      0, 0, 0, 0,
+                                      0, 1, 0, 0,
+
+                                      0, 0, 0, 1,
+                                      1, 0, 0, 0,
+                                      0, 0, 1, 0,
+                                      0, 0, 0, 0};
+    auto* t_bwrd = new Tensor({1, 1, 2, 4, 4}, ptr_bwrd, DEV_CPU);
+
+    // Operation
+    auto *pd = new PoolDescriptor3D({2, 2, 2}, {2, 2, 2}, "valid");
+    pd->build(t_image);
+    pd->ID = Tensor::zeros(pd->I->getShape());
+    pd->D = Tensor::ones(pd->O->getShape());
+    pd->indX = new Tensor(pd->O->getShape());
+    pd->indY = new Tensor(pd->O->getShape());
+
+    // Forward
+    tensorNN::MPool3D(pd);
+    ASSERT_TRUE((bool) Tensor::equivalent(t_fwrd, pd->O, 10e-5f));
+
+    // Backward
+    tensorNN::MPool3D_back(pd);
+    ASSERT_TRUE((bool) Tensor::equivalent(t_bwrd, pd->ID, 10e-5f));
+}
+
+
+TEST(MaxPoolTestSuite, mpool3d_k3x3x3_s2x2x2_pad_same)
+{
+    // Against direct loops over the windows clipped to the input
+    Tensor *t_image = Tensor::randn({2, 3, 5, 7, 6});
+
+    auto *pd = new PoolDescriptor3D({3, 3, 3}, {2, 2, 2}, "same");
+    pd->build(t_image);
+    pd->ID = Tensor::zeros(pd->I->getShape());
+    pd->D = Tensor::randn(pd->O->getShape());
+    pd->indX = new Tensor(pd->O->getShape());
+    pd->indY = new Tensor(pd->O->getShape());
+    ASSERT_EQ(pd->O->getShape(), vector<int>({2, 3, 3, 4, 3}));
+
+    tensorNN::MPool3D(pd);
+    tensorNN::MPool3D_back(pd);
+
+    Tensor *O = new Tensor(pd->O->getShape());
+    Tensor *ID = Tensor::zeros(pd->I->getShape());
+    for (int t = 0; t < 2 * 3; t++)
+    for (int w = 0; w < pd->d; w++)
+    for (int y = 0; y < pd->r; y++)
+    for (int x = 0; x < pd->c; x++) {
+        int p = ((t * pd->d + w) * pd->r + y) * pd->c + x, imax = -1;
+        for (int kw = w * pd->sd - pd->paddf; kw < w * pd->sd - pd->paddf + pd->kd; kw++)
+        for (int ky = y * pd->sr - pd->padrt; ky < y * pd->sr - pd->padrt + pd->kr; ky++)
+        for (int kx = x * pd->sc - pd->padcl; kx < x * pd->sc - pd->padcl + pd->kc; kx++) {
+            if (kw < 0 || kw >= pd->id || ky < 0 || ky >= pd->ir || kx < 0 || kx >= pd->ic) continue;
+            int i = ((t * pd->id + kw) * pd->ir + ky) * pd->ic + kx;
+            if (imax < 0 || t_image->ptr[i] > t_image->ptr[imax]) imax = i;
+        }
+        O->ptr[p] = t_image->ptr[imax];
+        ID->ptr[imax] += pd->D->ptr[p];
+    }
+
+    ASSERT_TRUE((bool) Tensor::equivalent(O, pd->O, 10e-5f));
+    ASSERT_TRUE((bool) Tensor::equivalent(ID, pd->ID, 10e-5f));
+}
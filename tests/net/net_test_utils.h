@@ -0,0 +1,52 @@
+#ifndef EDDL_TESTS_NET_TEST_UTILS_H
+#define EDDL_TESTS_NET_TEST_UTILS_H
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+
+
+// Helpers for the tests that build a model twice (reference and variant: memory
+// level, fusion, layout,...) and check that both train the same way.
+
+// Layers with weights, in the order of the net (the same in both builds)
+inline vlayer weighted_layers(Net *net){
+    vlayer w;
+    for (auto l : net->layers) if (!l->params.empty()) w.push_back(l);
+    return w;
+}
+
+inline void copy_weights(Net *from, Net *to){
+    vlayer w = weighted_layers(from), tw = weighted_layers(to);
+    ASSERT_EQ(w.size(), tw.size());
+    for (int i = 0; i < w.size(); i++)
+        for (int j = 0; j < w[i]->params.size(); j++) Tensor::copy(w[i]->params[j], tw[i]->params[j]);
+}
+
+inline ::testing::AssertionResult same_weights(Net *net, Net *other, float atol, float rtol=1e-05){
+    vlayer w = weighted_layers(net), ow = weighted_layers(other);
+    if (w.size() != ow.size()) return ::testing::AssertionFailure() << "different number of layers with weights";
+    for (int i = 0; i < w.size(); i++)
+        for (int j = 0; j < w[i]->params.size(); j++)
+            if (!Tensor::equivalent(w[i]->params[j], ow[i]->params[j], atol, rtol))
+                return ::testing::AssertionFailure() << "param " << j << " of " << w[i]->name << " differs";
+    return ::testing::AssertionSuccess();
+}
+
+// Same batches for both nets
+inline void train_both(Net *net, Net *other, Tensor *x, Tensor *y, int batches){
+    for (int b = 0; b < batches; b++) {
+        eddl::train_batch(net, {x}, {y});
+        eddl::train_batch(other, {x}, {y});
+    }
+}
+
+// Batch of one-hot targets (sample i is of class i % classes)
+inline Tensor *one_hot(int batch, int classes){
+    Tensor *y = Tensor::zeros({batch, classes});
+    for (int i = 0; i < batch; i++) y->ptr[i * classes + (i % classes)] = 1.0f;
+    return y;
+}
+
+#endif //EDDL_TESTS_NET_TEST_UTILS_H
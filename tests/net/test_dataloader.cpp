@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <set>
+#include <string>
+
+#include "eddl/apis/eddl.h"
+#include "eddl/net/dataloader.h"
+
+
+using namespace eddl;
+
+
+TEST(NetTestSuite, dataloader_chunks){
+    // Row i of x is {i, i, i} and row i of y is {i}
+    int n = 25;
+    Tensor *x = new Tensor({n, 3}, DEV_CPU);
+    Tensor *y = new Tensor({n, 1}, DEV_CPU);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 3; j++) x->ptr[i * 3 + j] = (float)i;
+        y->ptr[i] = (float)i;
+    }
+    string fx = "dataloader_x.bin", fy = "dataloader_y.bin";
+    x->save(fx);
+    y->save(fy);
+
+    // Chunks of 12 rows (10 rounded to full batches): 12, 12, 1
+    auto *loader = new DataLoader({fx}, {fy}, 4, 10);
+    ASSERT_EQ(loader->chunk_size, 12);
+    ASSERT_EQ(loader->num_chunks, 3);
+    ASSERT_EQ(loader->num_batches, 6);
+
+    vector<Tensor *> X, Y;
+    loader->new_batch(X, Y);
+    ASSERT_EQ(X[0]->shape, vector<int>({4, 3}));
+    ASSERT_EQ(Y[0]->shape, vector<int>({4, 1}));
+
+    for (int epoch = 0; epoch < 2; epoch++) {
+        std::set<int> seen;
+        int batches = 0;
+        while (loader->next_batch(X, Y)) {
+            for (int b = 0; b < 4; b++) {
+                int row = (int)Y[0]->ptr[b];
+                ASSERT_EQ(X[0]->ptr[b * 3], (float)row);
+                ASSERT_EQ(X[0]->ptr[b * 3 + 2], (float)row);
+                seen.insert(row);
+            }
+            batches++;
+        }
+        // Every row once, but the one of the last (incomplete) chunk
+        ASSERT_EQ(batches, 6);
+        ASSERT_EQ(seen.size(), 24);
+        ASSERT_TRUE(seen.find(24) == seen.end());
+    }
+
+    delete X[0];
+    delete Y[0];
+    delete loader;
+    delete x;
+    delete y;
+    std::remove(fx.c_str());
+    std::remove(fy.c_str());
+}
+
+TEST(NetTestSuite, dataloader_fit){
+    Tensor *x = Tensor::randn({64, 8}, DEV_CPU);
+    Tensor *y = Tensor::zeros({64, 2}, DEV_CPU);
+    string fx = "dataloader_fit_x.bin", fy = "dataloader_fit_y.bin";
+    x->save(fx);
+    y->save(fy);
+
+    layer in = Input({8});
+    layer out = Softmax(Dense(ReLu(Dense(in, 16)), 2));
+    model net = Model({in}, {out});
+    build(net, sgd(0.01), {"soft_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1), true);
+
+    auto *loader = new DataLoader({fx}, {fy}, 8, 16);
+    fit(net, loader, 2);
+    ASSERT_EQ(net->tr_batches, 16);
+
+    delete loader;
+    delete net;
+    delete x;
+    delete y;
+    std::remove(fx.c_str());
+    std::remove(fy.c_str());
+}
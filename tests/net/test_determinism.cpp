@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+
+
+using namespace eddl;
+
+
+// Trains a net with random init, sampling, dropout and noise, from the seed
+static vector<Tensor *> deterministic_run(int threads){
+    set_deterministic(true, 42);
+
+    Tensor *x = Tensor::randn({256, 64}, DEV_CPU);
+    Tensor *y = Tensor::randn({256, 4}, DEV_CPU);
+
+    layer in = Input({64});
+    layer l = ReLu(Dense(in, 128));
+    l = GaussianNoise(Dropout(l, 0.3f), 0.1f);
+    layer out = Softmax(Dense(l, 4));
+    model net = Model({in}, {out});
+    build(net, adam(0.01f), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(threads), true);
+
+    fit(net, {x}, {y}, 32, 2);
+
+    vector<Tensor *> w;
+    for (auto l : net->layers)
+        for (auto p : l->params) w.push_back(p->clone());
+
+    set_deterministic(false);
+    delete net;
+    delete x;
+    delete y;
+    return w;
+}
+
+TEST(NetTestSuite, deterministic_training){
+    vector<Tensor *> a = deterministic_run(1);
+    vector<Tensor *> b = deterministic_run(3);
+
+    ASSERT_EQ(a.size(), b.size());
+    for (int i = 0; i < a.size(); i++) {
+        ASSERT_TRUE(Tensor::equivalent(a[i], b[i], 0.0f));
+        delete a[i];
+        delete b[i];
+    }
+}
+
+TEST(NetTestSuite, deterministic_reductions){
+    // Fixed blocks: the same sum (and argmax of ties) with any threads
+    Tensor *t = Tensor::randn({1000003}, DEV_CPU);
+    t->ptr[12345] = t->ptr[999999] = 100.0f;
+
+    int threads = cpu_pool_threads();
+    cpu_pool_set_threads(1);
+    float s1 = t->sum(), n1 = t->norm();
+    int a1 = t->argmax();
+    cpu_pool_set_threads(4);
+    float s4 = t->sum(), n4 = t->norm();
+    int a4 = t->argmax();
+    cpu_pool_set_threads(threads);
+
+    ASSERT_EQ(s1, s4);
+    ASSERT_EQ(n1, n4);
+    ASSERT_EQ(a1, 12345);
+    ASSERT_EQ(a4, 12345);
+
+    delete t;
+}
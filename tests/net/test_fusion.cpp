@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+
+#include "net_test_utils.h"
+
+
+using namespace eddl;
+
+
+static model fusion_net(bool fuse){
+    layer in = Input({8});
+    layer a = Dense(in, 16);
+    layer b = Dense(in, 16);
+    layer l = ReLu(Add({a, b}));                                   // Add -> ReLu
+    l = Tanh(Sum(Mult(l, 0.5f), Diff(1.0f, Sigmoid(b))));          // Two branches
+    l = Sqrt(Sum(Abs(Div(LeakyReLu(Dense(l, 16)), 2.0f)), 1.0f));  // Unary ops
+    layer out = Dense(l, 2);
+    model net = Model({in}, {out});
+    if (fuse) setFusion(net);
+    build(net, sgd(0.1f), {"mse"}, {"mse"}, CS_CPU(2), true);
+    return net;
+}
+
+TEST(NetTestSuite, pointwise_fusion){
+    Tensor *x = Tensor::randn({32, 8}, DEV_CPU);
+    Tensor *y = Tensor::randn({32, 2}, DEV_CPU);
+
+    model net = fusion_net(false);
+    model fnet = fusion_net(true);
+
+    // Same weights (the fusion keeps the order of the other layers)
+    copy_weights(net, fnet);
+
+    // Two chains (the Sigmoid branch is part of the first one) with one op
+    // for each of the 7 + 4 pointwise layers they replace. The LeakyReLu goes
+    // into its Dense
+    vector<int> nops;
+    for (auto l : fnet->layers)
+        if (auto f = dynamic_cast<LFused *>(l)) nops.push_back(f->ops.size());
+    ASSERT_EQ(nops, vector<int>({7, 4}));
+    ASSERT_EQ(fnet->layers.size(), net->layers.size() - 10);
+
+    // Same outputs and same gradients (weights after training)
+    forward(net, {x});
+    forward(fnet, {x});
+    ASSERT_TRUE(Tensor::equivalent(getOutput(net->lout[0]), getOutput(fnet->lout[0]), 1e-4));
+
+    train_both(net, fnet, x, y, 3);
+    ASSERT_TRUE(same_weights(net, fnet, 1e-4));
+
+    ASSERT_THROW(setFusion(fnet, false), std::runtime_error);
+
+    delete net;
+    delete fnet;
+    delete x;
+    delete y;
+}
+
+
+static model epilogue_net(bool fuse, layer &hidden){
+    layer in = Input({1, 8, 8});
+    layer l = ReLu(Conv(in, 4, {3, 3}));
+    l = MaxPool(LeakyReLu(Conv(l, 4, {3, 3}), 0.1f), {2, 2});
+    l = Reshape(l, {-1});
+    hidden = Tanh(Dense(l, 16));
+    l = Sigmoid(Dense(hidden, 16));
+    layer out = Softmax(Dense(l, 4));
+    model net = Model({in}, {out});
+    if (fuse) setFusion(net);
+    build(net, sgd(0.1f), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1), true);
+    return net;
+}
+
+TEST(NetTestSuite, epilogue_fusion){
+    Tensor *x = Tensor::randn({16, 1, 8, 8}, DEV_CPU);
+    Tensor *y = one_hot(16, 4);
+
+    layer hidden, fhidden;
+    model net = epilogue_net(false, hidden);
+    model fnet = epilogue_net(true, fhidden);
+    copy_weights(net, fnet);
+
+    // Each activation runs inside the Conv or the Dense before it (the
+    // Softmax is not a pointwise activation)
+    vector<int> ops;
+    for (auto l : fnet->layers) {
+        if (auto c = dynamic_cast<LConv *>(l)) ops.push_back(c->epilogue);
+        if (auto d = dynamic_cast<LDense *>(l)) ops.push_back(d->epilogue);
+        ASSERT_EQ(dynamic_cast<LFused *>(l), nullptr);
+    }
+    ASSERT_EQ(ops, vector<int>({FUSED_RELU, FUSED_LEAKY_RELU, FUSED_TANH, FUSED_SIGMOID, FUSED_NONE}));
+    ASSERT_EQ(fnet->layers.size(), net->layers.size() - 4);
+
+    // Same outputs (also through the handle of a fused activation) and same
+    // gradients (weights after training)
+    forward(net, {x});
+    forward(fnet, {x});
+    ASSERT_TRUE(Tensor::equivalent(getOutput(hidden), getOutput(fhidden), 1e-5));
+    ASSERT_TRUE(Tensor::equivalent(getOutput(net->lout[0]), getOutput(fnet->lout[0]), 1e-5));
+
+    train_both(net, fnet, x, y, 3);
+    ASSERT_TRUE(same_weights(net, fnet, 1e-4));
+
+    delete net;
+    delete fnet;
+    delete x;
+    delete y;
+}
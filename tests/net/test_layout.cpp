@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+
+#include "net_test_utils.h"
+
+
+using namespace eddl;
+
+
+static model layout_net(bool channels_last){
+    layer in = Input({3, 16, 16});
+    layer l = ReLu(BatchNormalization(Conv(in, 16, {3, 3})));     // NCHW => NHWC
+    layer p = MaxPool(l, {2, 2});
+    l = ReLu(BatchNormalization(Conv(p, 16, {3, 3})));           // Winograd
+    l = Add({l, p});
+    l = Conv(l, 8, {3, 3}, {1, 1}, "same", false);               // NHWC => NCHW
+    l = AveragePool(ReLu(l), {2, 2});
+    layer out = Dense(Reshape(l, {-1}), 2);
+    model net = Model({in}, {out});
+    if (channels_last) setChannelsLast(net);
+    build(net, sgd(0.01f), {"mse"}, {"mse"}, CS_CPU(2), true);
+    return net;
+}
+
+TEST(NetTestSuite, channels_last_layout){
+    Tensor *x = Tensor::randn({8, 3, 16, 16}, DEV_CPU);
+    Tensor *y = Tensor::randn({8, 2}, DEV_CPU);
+
+    model net = layout_net(false);
+    model cnet = layout_net(true);
+
+    // Same weights
+    ASSERT_EQ(net->layers.size(), cnet->layers.size());
+    copy_weights(net, cnet);
+
+    // From the first convolution to the input of the last one
+    int ncl = 0;
+    for (auto l : cnet->layers) if (l->channels_last) ncl++;
+    ASSERT_EQ(ncl, 8);
+    for (auto l : net->layers) ASSERT_FALSE(l->channels_last);
+
+    // Same outputs and same gradients (weights and running statistics after training)
+    forward(net, {x});
+    forward(cnet, {x});
+    ASSERT_TRUE(Tensor::equivalent(getOutput(net->lout[0]), getOutput(cnet->lout[0]), 1e-4));
+
+    // The outputs keep the NCHW shape but are stored as (b,r,c,z)
+    for (int i = 0; i < cnet->layers.size(); i++) {
+        if (!cnet->layers[i]->channels_last) continue;
+        Tensor *o = net->layers[i]->output, *co = cnet->layers[i]->output;
+        ASSERT_EQ(o->shape, co->shape);
+        int B = o->shape[0], Z = o->shape[1], R = o->shape[2], C = o->shape[3];
+        for (int b = 0; b < B; b++)
+            for (int z = 0; z < Z; z++)
+                for (int r = 0; r < R; r++)
+                    for (int c = 0; c < C; c++)
+                        ASSERT_NEAR(o->ptr[((b * Z + z) * R + r) * C + c], co->ptr[((b * R + r) * C + c) * Z + z], 1e-4);
+    }
+
+    train_both(net, cnet, x, y, 3);
+    ASSERT_TRUE(same_weights(net, cnet, 1e-4));
+
+    ASSERT_THROW(setChannelsLast(cnet, false), std::runtime_error);
+
+    delete net;
+    delete cnet;
+    delete x;
+    delete y;
+}
+
+TEST(NetTestSuite, channels_last_get_output){
+    Tensor *x = Tensor::randn({8, 3, 16, 16}, DEV_CPU);
+    Tensor *y = Tensor::randn({8, 2}, DEV_CPU);
+
+    model net = layout_net(false);
+    model cnet = layout_net(true);
+    copy_weights(net, cnet);
+    train_both(net, cnet, x, y, 1);
+
+    // getOutput and getDelta give NCHW copies whatever the layout
+    for (int i = 0; i < cnet->layers.size(); i++) {
+        if (!cnet->layers[i]->channels_last) continue;
+        Tensor *o = getOutput(net->layers[i]), *co = getOutput(cnet->layers[i]);
+        Tensor *d = getDelta(net->layers[i]), *cd = getDelta(cnet->layers[i]);
+        ASSERT_EQ(o->shape, co->shape);
+        ASSERT_TRUE(Tensor::equivalent(o, co, 1e-4));
+        ASSERT_TRUE(Tensor::equivalent(d, cd, 1e-4));
+        delete o; delete co;
+        delete d; delete cd;
+    }
+
+    // The kernels permuted for the channels-last tiles follow new weights
+    forward(cnet, {x});
+    model other = layout_net(false);
+    vector<vtensor> params = get_parameters(other, true);
+    set_parameters(net, params);
+    set_parameters(cnet, params);
+    forward(net, {x});
+    forward(cnet, {x});
+    Tensor *o = getOutput(net->lout[0]), *co = getOutput(cnet->lout[0]);
+    ASSERT_TRUE(Tensor::equivalent(o, co, 1e-4));
+
+    delete o;
+    delete co;
+    for (auto &v : params) for (auto t : v) delete t;
+    delete other;
+    delete net;
+    delete cnet;
+    delete x;
+    delete y;
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -10,6 +11,9 @@
 #include "eddl/tensor/tensor.h"
 #include "eddl/tensor/nn/tensor_nn.h"
 #include "eddl/descriptors/descriptors.h"
+#include "eddl/mem_pool.h"
+
+#include "net_test_utils.h"
 
 
 using namespace eddl;
@@ -501,3 +505,205 @@ TEST(NetTestSuite, net_delete_nlp_sentiment_lstm){
 TEST(NetTestSuite, net_delete_nlp_machine_translation){
 
 }
+
+
+static model delta_memory_net(){
+    layer in = Input({1, 16, 16});
+    layer l = in;
+
+    l = MaxPool(ReLu(Conv(l, 4, {3, 3})), {2, 2});
+    l = ReLu(Conv(l, 8, {3, 3}));
+    l = Reshape(l, {-1});
+    l = ReLu(Dense(l, 32));
+    layer out = Softmax(Dense(l, 10));
+
+    return Model({in}, {out});
+}
+
+TEST(NetTestSuite, net_delta_memory_pool){
+    mem_pool_enable(true);
+
+    model net_full = delta_memory_net();
+    build(net_full, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "full_mem"));
+
+    model net_low = delta_memory_net();
+    build(net_low, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "low_mem"));
+    copy_weights(net_full, net_low);
+
+    Tensor* x = Tensor::randu({8, 1, 16, 16});
+    Tensor* y = one_hot(8, 10);
+
+    // full_mem keeps every delta, low_mem gives them back after each backward
+    size_t in_use = mem_pool_stats().bytes_in_use;
+    train_batch(net_full, {x}, {y});
+    size_t kept_full = mem_pool_stats().bytes_in_use - in_use;
+    in_use = mem_pool_stats().bytes_in_use;
+    train_batch(net_low, {x}, {y});
+    size_t kept_low = mem_pool_stats().bytes_in_use - in_use;
+    ASSERT_LT(kept_low, kept_full);
+
+    // Once the pool has seen a couple of batches, the deltas come from the
+    // blocks released by the previous ones
+    train_both(net_full, net_low, x, y, 1);
+    mem_pool_reset_stats();
+    train_both(net_full, net_low, x, y, 2);
+    ASSERT_EQ(mem_pool_stats().misses, 0);
+    ASSERT_GT(mem_pool_stats().hits, 0);
+    ASSERT_TRUE(same_weights(net_full, net_low, 1e-5f, 1e-4f));
+
+    delete x;
+    delete y;
+    delete net_full;
+    delete net_low;
+}
+
+
+static model branch_net(){
+    layer in = Input({1, 16, 16});
+    layer l = in;
+
+    l = MaxPool(ReLu(Conv(l, 4, {3, 3})), {2, 2});
+    layer r = ReLu(Conv(l, 4, {3, 3}));
+    l = Add({l, ReLu(Conv(r, 4, {3, 3}))});
+    l = ReLu(Conv(l, 8, {3, 3}));
+    l = Reshape(l, {-1});
+    l = ReLu(Dense(l, 32));
+    layer out = Softmax(Dense(l, 10));
+
+    return Model({in}, {out});
+}
+
+TEST(NetTestSuite, net_delta_memory_plan){
+    model net_full = branch_net();
+    build(net_full, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "full_mem"));
+
+    model net_low = branch_net();
+    build(net_low, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "low_mem"));
+    copy_weights(net_full, net_low);
+
+    ASSERT_EQ(net_full->mem_plan_state, MEM_PLAN_OFF);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_TODO);
+
+    Tensor* x = Tensor::randu({8, 1, 16, 16});
+    Tensor* y = one_hot(8, 10);
+
+    train_both(net_full, net_low, x, y, 3);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_READY);
+    ASSERT_TRUE(same_weights(net_full, net_low, 1e-5f, 1e-4f));
+
+    // The arena is smaller than the deltas it holds, and each one is inside it
+    unsigned long int planned = 0, largest = 0;
+    for(auto l : net_low->layers){
+        if (l->delta_slab == nullptr) continue;
+        ASSERT_GE(l->delta_slab, net_low->mem_plan_arena);
+        ASSERT_LE(l->delta_slab + l->output->size, net_low->mem_plan_arena + net_low->mem_plan_arena_size);
+        planned += l->output->size;
+        largest = std::max(largest, (unsigned long int)l->output->size);
+    }
+    ASSERT_GT(planned, 0);
+    ASSERT_GE(net_low->mem_plan_arena_size, largest);
+    ASSERT_LT(net_low->mem_plan_arena_size, planned);
+
+    // A new batch size needs a new plan
+    vector<int> half = {0, 1, 2, 3};
+    net_low->resize(4);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_TODO);
+    train_batch(net_low, {x}, {y}, half);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_READY);
+
+    delete x;
+    delete y;
+    delete net_full;
+    delete net_low;
+}
+
+TEST(NetTestSuite, net_delta_memory_plan_frozen){
+    model net_full = branch_net();
+    build(net_full, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "full_mem"));
+
+    model net_low = branch_net();
+    build(net_low, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "low_mem"));
+    copy_weights(net_full, net_low);
+
+    Tensor* x = Tensor::randu({8, 1, 16, 16});
+    Tensor* y = one_hot(8, 10);
+
+    train_both(net_full, net_low, x, y, 1);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_READY);
+
+    // A frozen layer stops the backward before some planned deltas are freed:
+    // the plan is dropped and built again for the new path
+    for (auto n : {net_full, net_low}) n->layers[1]->trainable = false;
+    train_batch(net_low, {x}, {y});
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_TODO);
+    train_both(net_full, net_low, x, y, 2);
+    ASSERT_EQ(net_low->mem_plan_state, MEM_PLAN_READY);
+    train_batch(net_full, {x}, {y});
+    ASSERT_TRUE(same_weights(net_full, net_low, 1e-5f, 1e-4f));
+
+    delete x;
+    delete y;
+    delete net_full;
+    delete net_low;
+}
+
+static model recompute_net(){
+    layer in = Input({1, 16, 16});
+    layer l = in;
+
+    l = ReLu(BatchNormalization(Conv(l, 4, {3, 3})));
+    l = MaxPool(ReLu(Conv(l, 4, {3, 3})), {2, 2});
+    layer r = ReLu(Conv(l, 4, {3, 3}));
+    l = Add({l, ReLu(Conv(r, 4, {3, 3}))});
+    l = ReLu(Conv(l, 8, {3, 3}));
+    l = Reshape(l, {-1});
+    l = ReLu(Dense(l, 32));
+    layer out = Softmax(Dense(l, 10));
+
+    return Model({in}, {out});
+}
+
+TEST(NetTestSuite, net_recompute_activations){
+    model net_full = recompute_net();
+    build(net_full, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "full_mem"));
+
+    model net_rec = recompute_net();
+    build(net_rec, sgd(0.01, 0.9), {"softmax_cross_entropy"}, {"categorical_accuracy"}, CS_CPU(1, "recompute_mem"));
+    copy_weights(net_full, net_rec);
+
+    ASSERT_EQ(net_full->recompute_state, RECOMPUTE_OFF);
+    ASSERT_EQ(net_rec->recompute_state, RECOMPUTE_TODO);
+
+    Tensor* x = Tensor::randu({8, 1, 16, 16});
+    Tensor* y = one_hot(8, 10);
+
+    train_both(net_full, net_rec, x, y, 3);
+    ASSERT_EQ(net_rec->recompute_state, RECOMPUTE_READY);
+    ASSERT_GT(net_rec->recompute_layers.size(), 1);
+    ASSERT_TRUE(same_weights(net_full, net_rec, 1e-5f, 1e-4f));
+
+    // Every segment starts at the beginning of the arena, which is as big as
+    // the largest one (instead of the sum of all the recomputed outputs)
+    unsigned long int recomputed = 0, largest = 0;
+    for(auto &seg : net_rec->recompute_layers){
+        ASSERT_EQ(seg[0]->output->ptr, net_rec->recompute_arena);
+        unsigned long int size = 0;
+        for(auto l : seg) size += l->output->size;
+        recomputed += size;
+        largest = std::max(largest, size);
+    }
+    ASSERT_GE(net_rec->recompute_arena_size, largest);
+    ASSERT_LT(net_rec->recompute_arena_size, recomputed);
+
+    // A new batch size gives the outputs their own memory until the next forward
+    vector<int> half = {0, 1, 2, 3};
+    net_rec->resize(4);
+    ASSERT_EQ(net_rec->recompute_state, RECOMPUTE_TODO);
+    train_batch(net_rec, {x}, {y}, half);
+    ASSERT_EQ(net_rec->recompute_state, RECOMPUTE_READY);
+
+    delete x;
+    delete y;
+    delete net_full;
+    delete net_rec;
+}
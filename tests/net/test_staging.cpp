@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+
+
+using namespace eddl;
+
+
+static float eval_loss(model net, Tensor *x, Tensor *y, const vector<int> &ind){
+    net->reset_loss();
+    eval_batch(net, {x}, {y}, ind);
+    return get_losses(net)[0];
+}
+
+TEST(NetTestSuite, prefetch_batch){
+    Tensor *x = Tensor::randn({100, 8}, DEV_CPU);
+    Tensor *y = Tensor::randn({100, 2}, DEV_CPU);
+
+    layer in = Input({8});
+    layer out = Dense(ReLu(Dense(in, 16)), 2);
+    model net = Model({in}, {out});
+    build(net, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(2), true);
+
+    // Off by default
+    prefetch_batch(net, {x}, {y}, random_indices(10, 100));
+    ASSERT_FALSE(net->stage_ready[0].valid() || net->stage_ready[1].valid());
+    setInputOverlap(net);
+
+    vector<int> a = random_indices(10, 100);
+    vector<int> b = random_indices(10, 100);
+    float loss_a = eval_loss(net, x, y, a);
+    float loss_b = eval_loss(net, x, y, b);
+
+    // Staged batches (and batches that were not staged) give the same results
+    prefetch_batch(net, {x}, {y}, a);
+    ASSERT_FLOAT_EQ(eval_loss(net, x, y, a), loss_a);
+    ASSERT_FALSE(net->stage_ready[0].valid() || net->stage_ready[1].valid());  // Used
+
+    prefetch_batch(net, {x}, {y}, a);
+    ASSERT_FLOAT_EQ(eval_loss(net, x, y, b), loss_b);
+    ASSERT_TRUE(net->stage_ready[0].valid() || net->stage_ready[1].valid());  // Not used
+
+    prefetch_batch(net, {x}, {y}, b);
+    prefetch_batch(net, {x}, {y}, a);
+    ASSERT_FLOAT_EQ(eval_loss(net, x, y, b), loss_b);
+    ASSERT_FLOAT_EQ(eval_loss(net, x, y, a), loss_a);
+
+    // Overlapped fit
+    fit(net, {x}, {y}, 10, 2);
+
+    delete net;
+    delete x;
+    delete y;
+}
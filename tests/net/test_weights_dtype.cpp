@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "eddl/apis/eddl.h"
+
+
+using namespace eddl;
+
+
+static model dense_net(int ndim){
+    layer in = Input({32});
+    layer l = ReLu(Dense(in, ndim));
+    layer out = Dense(l, 4);
+    model net = Model({in}, {out});
+    build(net, sgd(0.01f), {"mse"}, {"mse"}, CS_CPU(2), true);
+    return net;
+}
+
+// Output of the forward in TSMODE (the one that uses the 16-bit weights)
+static Tensor *predict_one(model net, Tensor *x){
+    set_mode(net, TSMODE);
+    forward(net, {x});
+    Tensor *y = getOutput(net->lout[0]);
+    set_mode(net, TRMODE);
+    return y;
+}
+
+TEST(NetTestSuite, weights_dtype_refresh){
+    Tensor *x = Tensor::randn({8, 32}, DEV_CPU);
+    Tensor *y = Tensor::randn({8, 4}, DEV_CPU);
+
+    // Small layers keep the float expansion, big ones convert by panels
+    for (int ndim : {16, 4096}) {
+        model net = dense_net(ndim);
+        model ref = dense_net(ndim);
+        for (string dtype : {"bfloat16", "float16"}) {
+            setWeightsDtype(net, dtype);
+
+            // Training and set_parameters change W after the copy
+            train_batch(net, {x}, {y});
+            Tensor *p = predict_one(net, x);
+            ref->set_parameters(net->get_parameters(true));
+            Tensor *p_ref = predict_one(ref, x);
+            ASSERT_TRUE(Tensor::equivalent(p, p_ref, 1e-1, 2e-2));
+            delete p; delete p_ref;
+
+            vector<vtensor> params = net->get_parameters(true);
+            for (auto &lp : params) for (auto t : lp) t->mult_(-1.0f);
+            net->set_parameters(params);
+            ref->set_parameters(params);
+            p = predict_one(net, x);
+            p_ref = predict_one(ref, x);
+            ASSERT_TRUE(Tensor::equivalent(p, p_ref, 1e-1, 2e-2));
+            delete p; delete p_ref;
+            for (auto &lp : params) for (auto t : lp) delete t;
+        }
+        delete net;
+        delete ref;
+    }
+    delete x;
+    delete y;
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <random>
 #include <string>
+#include <fstream>
 
 #include "eddl/apis/eddl.h"
 #include "eddl/serialization/onnx/eddl_onnx.h"
@@ -129,3 +130,170 @@ TEST(ONNXTestSuite, onnx_import){
 
 }
 
+
+TEST(ONNXTestSuite, onnx_quantized){
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "onnx_net_" + to_string(rdn_name) + ".onnx";
+
+    // Conv + Dense net
+    layer in = Input({3, 8, 8});
+    layer l = ReLu(Conv(in, 8, {3, 3}));
+    l = Reshape(l, {-1});
+    layer out = Dense(l, 10);
+    model net_export = Model({in}, {out});
+    build(net_export, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), true);
+
+    Tensor* x = Tensor::randn({16, 3, 8, 8});
+    Tensor* y_float = predict(net_export, {x})[0];
+
+    // Int8 inference (about 1% of error)
+    calibrate(net_export, {x}, 8);
+    quantize(net_export);
+    Tensor* y_int8 = predict(net_export, {x})[0];
+    ASSERT_TRUE(Tensor::equivalent(y_float, y_int8, 0.05f * y_float->max()));
+
+    // Export (QuantizeLinear/DequantizeLinear) and import it
+    save_net_to_onnx_file(net_export, fname);
+    Net* net_import = import_net_from_onnx_file(fname);
+    build(net_import, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), false);
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    ASSERT_EQ(net_export->layers.size(), net_import->layers.size());
+    for(int i=0; i<net_import->layers.size(); i++){
+        if (auto* d = dynamic_cast<LDense*>(net_import->layers[i])) { ASSERT_TRUE(d->quantized); }
+        if (auto* c = dynamic_cast<LConv*>(net_import->layers[i])) { ASSERT_TRUE(c->quantized); }
+    }
+    Tensor* y_import = predict(net_import, {x})[0];
+    ASSERT_TRUE(Tensor::equivalent(y_int8, y_import, 1e-4));
+
+    delete x;
+    delete y_float;
+    delete y_int8;
+    delete y_import;
+    delete net_export;
+    delete net_import;
+}
+
+static long file_size(const string &fname){
+    std::ifstream ifs(fname, std::ios::binary | std::ios::ate);
+    return ifs.tellg();
+}
+
+TEST(ONNXTestSuite, onnx_half_weights){
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "onnx_net_" + to_string(rdn_name) + ".onnx";
+
+    layer in = Input({64});
+    layer l = ReLu(Dense(in, 256));
+    layer out = Dense(l, 10);
+    model net_export = Model({in}, {out});
+    build(net_export, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), true);
+    save_net_to_onnx_file(net_export, fname);
+    long float_size = file_size(fname);
+
+    Tensor* x = Tensor::randn({16, 64});
+    for (int dtype : {DTYPE_FLOAT16, DTYPE_BFLOAT16}) {
+        // The weights of the dense layers are written as 16-bit values and a Cast
+        setWeightsDtype(net_export, (dtype == DTYPE_FLOAT16) ? "float16" : "bfloat16");
+        Tensor* y_half = predict(net_export, {x})[0];
+        save_net_to_onnx_file(net_export, fname);
+        ASSERT_LT(file_size(fname), float_size * 6 / 10);
+
+        Net* net_import = import_net_from_onnx_file(fname);
+        build(net_import, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), false);
+
+        // The imported weights are the 16-bit values
+        ASSERT_EQ(net_export->layers.size(), net_import->layers.size());
+        for(int i=0; i<net_import->layers.size(); i++){
+            auto* d = dynamic_cast<LDense*>(net_export->layers[i]);
+            if (d == nullptr) continue;
+            Tensor* W16 = d->W->astype(dtype);
+            Tensor* W = W16->astype(DTYPE_FLOAT32);
+            ASSERT_TRUE(Tensor::equivalent(W, net_import->layers[i]->params[0], 0.0f, 0.0f));
+            ASSERT_TRUE(Tensor::equivalent(d->bias, net_import->layers[i]->params[1], 0.0f, 0.0f));
+            delete W16;
+            delete W;
+        }
+        Tensor* y_import = predict(net_import, {x})[0];
+        ASSERT_TRUE(Tensor::equivalent(y_half, y_import, 1e-4));
+
+        delete y_half;
+        delete y_import;
+        delete net_import;
+    }
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    delete x;
+    delete net_export;
+}
+
+TEST(ONNXTestSuite, onnx_conv_pads){
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "onnx_net_" + to_string(rdn_name) + ".onnx";
+
+    // Conv nodes are exported with explicit pads and no auto_pad (asymmetric
+    // ones for "same" with stride 2)
+    layer in = Input({3, 8, 8});
+    layer l = ReLu(Conv(in, 4, {3, 3}, {2, 2}, "same"));
+    l = ReLu(Conv(l, 4, {3, 3}, {1, 1}, "valid"));
+    layer out = Conv(l, 2, {3, 3}, {1, 1}, "same");
+    model net_export = Model({in}, {out});
+    build(net_export, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), true);
+    save_net_to_onnx_file(net_export, fname);
+
+    Net* net_import = import_net_from_onnx_file(fname);
+    build(net_import, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), false);
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    Tensor* x = Tensor::randn({4, 3, 8, 8});
+    Tensor* y_export = predict(net_export, {x})[0];
+    Tensor* y_import = predict(net_import, {x})[0];
+    ASSERT_EQ(y_export->shape, y_import->shape);
+    ASSERT_TRUE(Tensor::equivalent(y_export, y_import, 1e-5));
+
+    delete x;
+    delete y_export;
+    delete y_import;
+    delete net_export;
+    delete net_import;
+}
+
+TEST(ONNXTestSuite, onnx_weights_transB){
+    // The int8 Gemm nodes have transB (weights stored outputs x inputs):
+    // set_weights_from_onnx gives them back as inputs x outputs
+    layer in = Input({12});
+    layer out = Dense(in, 5);
+    model net = Model({in}, {out});
+    build(net, sgd(0.01), {"mse"}, {"mse"}, CS_CPU(), true);
+
+    Tensor* x = Tensor::randn({16, 12});
+    calibrate(net, {x}, 16);
+    quantize(net);
+    string* model_string = serialize_net_to_onnx_string(net);
+
+    auto* dense = dynamic_cast<LDense*>(out);
+    Tensor* W = dense->W->clone();
+    dense->W->fill_(0.0f);
+    set_weights_from_onnx(net, model_string);
+
+    // Up to half the step of the int8 weights of each output
+    ASSERT_EQ(W->shape, dense->W->shape);
+    ASSERT_TRUE(Tensor::equivalent(W, dense->W, std::max(W->max(), -W->min()) / 200.0f, 0.0f));
+
+    delete x;
+    delete W;
+    delete model_string;
+    delete net;
+}
@@ -1,11 +1,14 @@
 #include <gtest/gtest.h>
 #include <random>
 #include <string>
+#include <cmath>
 
 #include "eddl/tensor/tensor.h"
 #include "eddl/tensor/tensor_reduction.h"
 #include "eddl/tensor/nn/tensor_nn.h"
 #include "eddl/descriptors/descriptors.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
+#include "eddl/utils.h"
 
 
 using namespace std;
@@ -132,3 +135,191 @@ TEST(TensorTestSuite, tensor_unsqueeze) {
     Tensor* t1_dim0 = t1->unsqueeze(2);
     ASSERT_TRUE(t1_dim0->shape == vector<int>({2, 3, 1, 4}));
 }
+
+
+TEST(TensorTestSuite, tensor_select_strided) {
+    Tensor* t = Tensor::range(0, 23);
+    t->reshape_({2, 3, 4});
+
+    // t[1, :, 1:3]
+    Tensor* sel_ref = new Tensor({13, 14, 17, 18, 21, 22}, {1, 3, 2}, DEV_CPU);
+    Tensor* sel = t->select({"1", ":", "1:3"});
+    ASSERT_TRUE(Tensor::equivalent(sel_ref, sel, 10e-4));
+
+    // Permute (2, 0, 1) => out[k, i, j] = t[i, j, k]
+    Tensor* per = t->permute({2, 0, 1});
+    ASSERT_TRUE(per->shape == vector<int>({4, 2, 3}));
+    for(int i=0; i<2; i++)
+        for(int j=0; j<3; j++)
+            for(int k=0; k<4; k++)
+                ASSERT_EQ(per->ptr[k*6 + i*3 + j], t->ptr[i*12 + j*4 + k]);
+
+    // Batched select (as in LSelect) and its backward
+    auto *sd = new SelDescriptor({":", "1:3"}, DEV_CPU);
+    sd->build({3, 4});
+    Tensor* out = Tensor::empty({2, 3, 2});
+    tensorNN::select(t, out, sd);
+    for(int b=0; b<2; b++)
+        for(int j=0; j<3; j++)
+            for(int k=0; k<2; k++)
+                ASSERT_EQ(out->ptr[b*6 + j*2 + k], t->ptr[b*12 + j*4 + k + 1]);
+
+    Tensor* grad = Tensor::zeros({2, 3, 4});
+    tensorNN::select_back(out, grad, sd);
+    tensorNN::select_back(out, grad, sd);
+    ASSERT_EQ(grad->ptr[0], 0.0f);
+    ASSERT_EQ(grad->ptr[13], 2.0f * t->ptr[13]);
+
+    delete t;
+    delete sel_ref;
+    delete sel;
+    delete per;
+    delete sd;
+    delete out;
+    delete grad;
+}
+
+
+TEST(TensorTestSuite, tensor_permute_blocked) {
+    // Tiles with borders, small dims, runs, dims of size 1 and the BN permutations
+    vector<vector<int>> shapes = {{67, 130}, {3, 5, 70, 9}, {4, 3, 33, 17}, {2, 1, 40, 1, 50}, {5, 7, 9}, {8, 16, 8, 8}};
+    vector<vector<int>> dims = {{1, 0}, {0, 2, 3, 1}, {1, 2, 3, 0}, {4, 1, 2, 3, 0}, {1, 0, 2}, {3, 0, 2, 1}};
+
+    int level = cpu_simd_level();
+    for (int l = CPU_SIMD_NONE; l <= cpu_simd_supported(); l++) {
+        cpu_simd_set_level(l);
+        for (int c = 0; c < shapes.size(); c++) {
+            Tensor* A = Tensor::randn(shapes[c]);
+            Tensor* B = Tensor::ones(permute_shape(shapes[c], dims[c]));
+            int *addr = permute_indices(shapes[c], dims[c]);  // Output => input
+
+            cpu_permute(A->ptr, shapes[c], dims[c], B->ptr);
+            for (int i = 0; i < B->size; i++) ASSERT_EQ(B->ptr[i], A->ptr[addr[i]]);
+
+            // Backward: A += B^-1 (= 2*A)
+            cpu_permute_back(B->ptr, shapes[c], dims[c], A->ptr);
+            for (int i = 0; i < B->size; i++) ASSERT_EQ(A->ptr[addr[i]], 2.0f * B->ptr[i]);
+
+            delete[] addr;
+            delete A;
+            delete B;
+        }
+    }
+    cpu_simd_set_level(level);
+
+    // Layer path (the batch is kept): forward and backward
+    auto *pd = new PermuteDescriptor({2, 0, 1}, DEV_CPU);
+    pd->build({3, 20, 24});
+    Tensor* in = Tensor::randn({2, 3, 20, 24});
+    Tensor* out = Tensor::empty({2, 24, 3, 20});
+    tensorNN::select(in, out, pd);
+    Tensor* ref = Tensor::permute(in, {0, 3, 1, 2});
+    ASSERT_TRUE(Tensor::equivalent(out, ref, 0.0f));
+
+    Tensor* grad = Tensor::zeros({2, 3, 20, 24});
+    tensorNN::select_back(out, grad, pd);
+    ASSERT_TRUE(Tensor::equivalent(grad, in, 0.0f));
+
+    delete pd;
+    delete in;
+    delete out;
+    delete ref;
+    delete grad;
+}
+
+
+TEST(TensorTestSuite, tensor_select_view) {
+    Tensor* t = Tensor::range(0, 23);
+    t->reshape_({2, 3, 4});
+
+    // Contiguous selections share the memory
+    Tensor* v = t->view({"1", "1:3", ":"});
+    ASSERT_TRUE(v->isshared);
+    ASSERT_TRUE(v->shape == vector<int>({1, 2, 4}));
+    ASSERT_EQ(v->ptr, t->ptr + 16);
+
+    v->fill_(-1.0f);
+    ASSERT_EQ(t->ptr[15], 15.0f);
+    ASSERT_EQ(t->ptr[16], -1.0f);
+    ASSERT_EQ(t->ptr[23], -1.0f);
+
+    // Non-contiguous selections must be copied
+    ASSERT_THROW(t->view({":", "0", ":"}), std::runtime_error);
+
+    // Permutations of dimensions of size 1 do not move the data
+    Tensor* p = Tensor::range(0, 5);
+    p->reshape_({1, 6, 1});
+    float *ptr = p->ptr;
+    p->permute_({2, 1, 0});
+    ASSERT_TRUE(p->shape == vector<int>({1, 6, 1}));
+    ASSERT_EQ(p->ptr, ptr);
+    ASSERT_EQ(p->ptr[5], 5.0f);
+
+    delete v;
+    delete t;
+    delete p;
+}
+
+TEST(TensorTestSuite, tensor_astype) {
+    // Exact values, ties to even, overflow, subnormals, inf and nan
+    float values[] = {1.0f, -2.5f, 1.0f + 1.0f/2048, 1.0f + 3.0f/2048, 65504.0f, 65520.0f, 1e-7f,
+                      1.0f + 1.0f/256, 1.0f + 3.0f/256, INFINITY, -INFINITY, NAN};
+    auto* t = new Tensor({12}, DEV_CPU);
+    for (int i = 0; i < 12; i++) t->ptr[i] = values[i];
+
+    Tensor* h = t->astype(DTYPE_FLOAT16);
+    Tensor* b = t->astype(DTYPE_BFLOAT16);
+    ASSERT_EQ(h->dtype, DTYPE_FLOAT16);
+    ASSERT_EQ(reinterpret_cast<uint16_t*>(h->ptr)[0], 0x3c00);
+    ASSERT_EQ(reinterpret_cast<uint16_t*>(b->ptr)[0], 0x3f80);
+
+    Tensor* hf = h->astype(DTYPE_FLOAT32);
+    Tensor* bf = b->astype(DTYPE_FLOAT32);
+    ASSERT_EQ(hf->ptr[0], 1.0f);
+    ASSERT_EQ(hf->ptr[1], -2.5f);
+    ASSERT_EQ(hf->ptr[2], 1.0f);
+    ASSERT_EQ(hf->ptr[3], 1.0f + 4.0f/2048);
+    ASSERT_EQ(hf->ptr[4], 65504.0f);
+    ASSERT_TRUE(std::isinf(hf->ptr[5]));
+    ASSERT_NEAR(hf->ptr[6], 1e-7f, 3e-8f);
+    ASSERT_TRUE(std::isinf(hf->ptr[9]) && hf->ptr[9] > 0);
+    ASSERT_TRUE(std::isinf(hf->ptr[10]) && hf->ptr[10] < 0);
+    ASSERT_TRUE(std::isnan(hf->ptr[11]));
+
+    ASSERT_EQ(bf->ptr[7], 1.0f);
+    ASSERT_EQ(bf->ptr[8], 1.0f + 4.0f/256);
+    ASSERT_EQ(bf->ptr[5], 65536.0f);
+    ASSERT_TRUE(std::isinf(bf->ptr[9]));
+    ASSERT_TRUE(std::isnan(bf->ptr[11]));
+
+    // Clones keep the dtype
+    Tensor* c = b->clone();
+    ASSERT_EQ(c->dtype, DTYPE_BFLOAT16);
+    ASSERT_EQ(reinterpret_cast<uint16_t*>(c->ptr)[7], reinterpret_cast<uint16_t*>(b->ptr)[7]);
+
+    delete t; delete h; delete b; delete hf; delete bf; delete c;
+}
+
+TEST(TensorTestSuite, tensor_mult2D_half) {
+    // Several panels of B (accumulated over C)
+    Tensor* A = Tensor::randn({3, 300});
+    Tensor* At = Tensor::randn({300, 3});
+    Tensor* B = Tensor::randn({300, 4096});
+
+    Tensor* B16 = B->astype(DTYPE_BFLOAT16);
+    Tensor* Bq = B16->astype(DTYPE_FLOAT32);
+
+    Tensor* C = Tensor::full({3, 4096}, 1.0f);
+    Tensor* C_ref = Tensor::full({3, 4096}, 1.0f);
+    Tensor::mult2D(A, 0, B16, 0, C, 1);
+    Tensor::mult2D(A, 0, Bq, 0, C_ref, 1);
+    ASSERT_TRUE(Tensor::equivalent(C, C_ref, 1e-3, 1e-4));
+
+    Tensor::mult2D(At, 1, B16, 0, C, 0);
+    Tensor::mult2D(At, 1, Bq, 0, C_ref, 0);
+    ASSERT_TRUE(Tensor::equivalent(C, C_ref, 1e-3, 1e-4));
+
+    ASSERT_THROW(Tensor::mult2D(A, 0, B16, 1, C, 0), std::runtime_error);
+
+    delete A; delete At; delete B; delete B16; delete Bq; delete C; delete C_ref;
+}
@@ -5,6 +5,8 @@
 #include "eddl/tensor/tensor.h"
 #include "eddl/tensor/nn/tensor_nn.h"
 #include "eddl/descriptors/descriptors.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include "eddl/random.h"
 
 using namespace std;
 
@@ -324,4 +326,50 @@ TEST(TensorTestSuite, tensor_create_diag){
     delete new_t_gpu;
     
 #endif
-}
\ No newline at end of file
+}
+
+TEST(TensorTestSuite, tensor_create_random){
+    // Known answer of Philox4x32-10 (Random123)
+    uint32_t out[4];
+    philox4x32(0, 0, out);
+    ASSERT_EQ(out[0], 0x6627e8d5u);
+    ASSERT_EQ(out[1], 0xe169c58du);
+    ASSERT_EQ(out[2], 0xbc57ac4cu);
+    ASSERT_EQ(out[3], 0x9b00dbd8u);
+
+    // Same seed, same values, whatever the number of threads
+    int threads = cpu_pool_threads();
+    rand_seed(1234);
+    cpu_pool_set_threads(1);
+    Tensor* a = Tensor::randn({1001, 37});
+    Tensor* u = Tensor::randu({1001, 37});
+    rand_seed(1234);
+    cpu_pool_set_threads(4);
+    Tensor* b = Tensor::randn({1001, 37});
+    Tensor* v = Tensor::randu({1001, 37});
+    cpu_pool_set_threads(threads);
+    ASSERT_TRUE(Tensor::equivalent(a, b, 0.0f));
+    ASSERT_TRUE(Tensor::equivalent(u, v, 0.0f));
+
+    // Next fills continue the stream
+    Tensor* c = Tensor::randn({1001, 37});
+    ASSERT_FALSE(Tensor::equivalent(a, c, 1e-3));
+
+    // Moments
+    ASSERT_NEAR(a->mean(), 0.0f, 0.02f);
+    ASSERT_NEAR(a->std(), 1.0f, 0.02f);
+    ASSERT_NEAR(u->mean(), 0.5f, 0.01f);
+    ASSERT_GE(u->min(), 0.0f);
+    ASSERT_LT(u->max(), 1.0f);
+
+    Tensor* m = Tensor::empty({1001, 37});
+    m->fill_rand_binary_(0.3f);
+    ASSERT_NEAR(m->mean(), 0.3f, 0.01f);
+
+    delete a;
+    delete b;
+    delete c;
+    delete u;
+    delete v;
+    delete m;
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <cmath>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/tensor/nn/tensor_nn.h"
+
+
+TEST(TensorTestSuite, tensor_expr){
+    Tensor *a = Tensor::randn({10, 20}, DEV_CPU);
+    Tensor *b = Tensor::randn({10, 20}, DEV_CPU);
+    Tensor *c = Tensor::zeros({10, 20}, DEV_CPU);
+    auto ea = Tensor::expr(a), eb = Tensor::expr(b);
+
+    // Same as the eager operations
+    c->assign(0.9f * ea + (1.0f - 0.9f) * sqr(eb) - ea / (sqrt(abs(eb)) + 1e-8f));
+    for (int i = 0; i < c->size; i++) {
+        float ref = 0.9f * a->ptr[i] + (1.0f - 0.9f) * b->ptr[i] * b->ptr[i] - a->ptr[i] / (::sqrtf(::fabsf(b->ptr[i])) + 1e-8f);
+        ASSERT_NEAR(c->ptr[i], ref, 1e-5);
+    }
+
+    Tensor *s = a->clone();
+    tensorNN::Sigmoid(a, s);
+    c->assign(sigmoid(ea));
+    ASSERT_TRUE(Tensor::equivalent(c, s, 1e-6));
+
+    c->assign(maximum(-ea, 0.0f) + minimum(ea, eb) * exp(-ea * ea));
+    for (int i = 0; i < c->size; i++) {
+        float x = a->ptr[i], y = b->ptr[i];
+        ASSERT_NEAR(c->ptr[i], std::max(-x, 0.0f) + std::min(x, y) * ::expf(-x * x), 1e-5);
+    }
+
+    // The destination can be an operand
+    Tensor *r = a->clone();
+    a->assign(2.0f * ea + 1.0f);
+    r->mult_(2.0f);
+    r->add_(1.0f);
+    ASSERT_TRUE(Tensor::equivalent(a, r, 1e-6));
+
+    // Sizes must match
+    Tensor *d = Tensor::zeros({5}, DEV_CPU);
+    ASSERT_THROW(c->assign(ea + Tensor::expr(d)), std::runtime_error);
+    ASSERT_THROW(d->assign(ea * 2.0f), std::runtime_error);
+
+    delete a;
+    delete b;
+    delete c;
+    delete d;
+    delete r;
+    delete s;
+}
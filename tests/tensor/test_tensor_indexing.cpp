@@ -84,3 +84,39 @@ TEST(TensorTestSuite, tensor_indexing_where){
 
 #endif
 }
+
+
+TEST(TensorTestSuite, tensor_indexing_select_rows){
+    // Rows of 3 floats (unaligned) and long rows
+    for (int s : {3, 40000}) {
+        Tensor* A = Tensor::randn({100, s});
+        vector<int> sind = {7, 0, 99, 7, 3, 0, 42, 7};
+
+        // Gather the rows [2, 8)
+        Tensor* B = Tensor::empty({6, s});
+        Tensor::select(A, B, sind, 2, 8);
+        for (int i = 2; i < 8; i++)
+            for (int j = 0; j < s; j++) ASSERT_EQ(B->ptr[(i - 2) * s + j], A->ptr[sind[i] * s + j]);
+
+        // Rows with index 0 are zeros
+        Tensor::select(A, B, sind, 2, 8, true);
+        for (int j = 0; j < s; j++) ASSERT_EQ(B->ptr[3 * s + j], 0.0f);
+        for (int j = 0; j < s; j++) ASSERT_EQ(B->ptr[j], A->ptr[99 * s + j]);
+
+        // Scatter: repeated rows are added (inc) or the last one is kept
+        Tensor* C = Tensor::zeros({100, s});
+        Tensor::deselect(B, C, sind, 2, 8, 1);
+        Tensor::deselect(B, C, sind, 2, 8, 1);
+        for (int j = 0; j < s; j++) ASSERT_NEAR(C->ptr[7 * s + j], 2.0f * (B->ptr[1 * s + j] + B->ptr[5 * s + j]), 1e-5);
+        for (int j = 0; j < s; j++) ASSERT_EQ(C->ptr[42 * s + j], 2.0f * B->ptr[4 * s + j]);
+
+        Tensor::deselect(B, C, sind, 2, 8, 0);
+        for (int j = 0; j < s; j++) ASSERT_EQ(C->ptr[7 * s + j], B->ptr[5 * s + j]);
+        Tensor::deselect(B, C, sind, 2, 8, 1, true);
+        for (int j = 0; j < s; j++) ASSERT_EQ(C->ptr[j], 0.0f);
+
+        delete A;
+        delete B;
+        delete C;
+    }
+}
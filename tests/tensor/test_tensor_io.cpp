@@ -328,6 +328,93 @@ TEST(TensorTestSuite, tensor_io_bmp)
 //}
 
 
+TEST(TensorTestSuite, tensor_io_bin_half)
+{
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "iris_" + to_string(rdn_name) + ".bin";
+
+    // Save file with 16-bit data (loaded back as float)
+    t_iris->save(fname, "bf16");
+    Tensor* t_load = Tensor::load(fname);
+    Tensor* t_rows = Tensor::load_partial(fname, 10, 20);
+
+    t_iris->save(fname, "fp16");
+    Tensor* t_load16 = Tensor::load(fname);
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    Tensor* t_ref_rows = t_iris->select({"10:20", ":"});
+    // Values below 8: rounding errors up to 2^-6 (bf16) and 2^-9 (fp16)
+    ASSERT_TRUE(Tensor::equivalent(t_iris, t_load, 2e-2));
+    ASSERT_TRUE(Tensor::equivalent(t_ref_rows, t_rows, 2e-2));
+    ASSERT_TRUE(Tensor::equivalent(t_iris, t_load16, 3e-3));
+
+    delete t_load;
+    delete t_rows;
+    delete t_load16;
+    delete t_ref_rows;
+}
+
+TEST(TensorTestSuite, tensor_io_bin_mmap)
+{
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "iris_" + to_string(rdn_name) + ".bin";
+
+    // Mapped file
+    t_iris->save(fname);
+    Tensor* t_map = Tensor::load(fname, "", true);
+    ASSERT_TRUE(Tensor::equivalent(t_iris, t_map, 10e-5));
+
+    // Writes go to private copies of the pages, not to the file
+    t_map->fill_(0.0f);
+    Tensor* t_load = Tensor::load(fname);
+    ASSERT_TRUE(Tensor::equivalent(t_iris, t_load, 10e-5));
+    ASSERT_EQ(t_map->sum(), 0.0f);
+    delete t_map;
+
+    // 16-bit files are read
+    t_iris->save(fname, "fp16");
+    Tensor* t_map16 = Tensor::load(fname, "", true);
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    ASSERT_TRUE(Tensor::equivalent(t_iris, t_map16, 3e-3));
+
+    delete t_load;
+    delete t_map16;
+}
+
+TEST(TensorTestSuite, tensor_io_bin_partial)
+{
+    // Generate random name
+    int rdn_name = dist6(mt);
+    string fname = "iris_" + to_string(rdn_name) + ".bin";
+    t_iris->save(fname);
+
+    // Last rows, and rows out of the file
+    int rows = t_iris->shape[0];
+    Tensor* t_rows = Tensor::load_partial(fname, rows - 10, rows);
+    ASSERT_THROW(Tensor::load_partial(fname, -1, 5), std::runtime_error);
+    ASSERT_THROW(Tensor::load_partial(fname, 10, rows + 1), std::runtime_error);
+    ASSERT_THROW(Tensor::load_partial(fname, 20, 10), std::runtime_error);
+
+    // Delete file
+    int hasFailed = std::remove(fname.c_str());
+    if(hasFailed) { cout << "Error deleting file: " << fname << endl; }
+
+    Tensor* t_ref_rows = t_iris->select({to_string(rows - 10) + ":" + to_string(rows), ":"});
+    ASSERT_TRUE(Tensor::equivalent(t_ref_rows, t_rows, 10e-5));
+
+    delete t_rows;
+    delete t_ref_rows;
+}
+
 TEST(TensorTestSuite, tensor_io_bin)
 {
     // Generate random name
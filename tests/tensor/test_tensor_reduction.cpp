@@ -2,11 +2,14 @@
 #include <random>
 #include <string>
 #include <ctime>
+#include <cmath>
+#include <algorithm>
 
 #include "eddl/tensor/tensor.h"
 #include "eddl/tensor/tensor_reduction.h"
 #include "eddl/tensor/nn/tensor_nn.h"
 #include "eddl/descriptors/descriptors.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
 
 
 using namespace std;
@@ -641,4 +644,119 @@ TEST(TensorTestSuite, tensor_math_reduction_median) {
     delete t_gpu_median;
 
 #endif
-}
\ No newline at end of file
+}
+// Positions of the input reduced into each output (in the order of the outputs)
+static vector<vector<int>> reduction_groups(Tensor *A, const vector<int> &axis) {
+    vector<int> kept = {0}, red = {0};
+    for (int i = 0; i < A->ndim; i++) {
+        vector<int> &v = (find(axis.begin(), axis.end(), i) == axis.end()) ? kept : red;
+        int n = v.size();
+        for (int k = 1; k < A->shape[i]; k++)
+            for (int j = 0; j < n; j++) v.push_back(v[j] + k * A->stride[i]);
+    }
+    sort(kept.begin(), kept.end());
+
+    vector<vector<int>> groups;
+    for (int k : kept) {
+        groups.push_back(vector<int>());
+        for (int r : red) groups.back().push_back(k + r);
+    }
+    return groups;
+}
+
+// Reference: walks the input with the groups of each output
+static void naive_reduce(Tensor *A, const vector<int> &axis, int m, vector<float> &val, vector<int> &ind) {
+    val.clear();
+    ind.clear();
+    for (auto g : reduction_groups(A, axis)) {
+        sort(g.begin(), g.end());  // Ties: first position in memory
+        double s = 0.0;
+        float b = A->ptr[g[0]];
+        int bi = g[0];
+        for (auto p : g) {
+            s += A->ptr[p];
+            if (((m == 2) && (A->ptr[p] > b)) || ((m == 3) && (A->ptr[p] < b))) { b = A->ptr[p]; bi = p; }
+        }
+        if (m == 0) s /= g.size();
+        val.push_back((m < 2) ? (float)s : b);
+        ind.push_back(bi);
+    }
+}
+
+TEST(TensorTestSuite, tensor_math_reduction_engine) {
+    // Reduced dims inside, outside, both and split (few outputs, long reductions)
+    vector<vector<int>> shapes = {{7, 5}, {7, 5}, {4, 3, 5, 6}, {4, 3, 5, 6}, {4, 3, 5, 6}, {2, 1, 70000}, {70000, 3}, {2, 3, 1}};
+    vector<vector<int>> axes = {{0}, {1}, {0, 2, 3}, {1, 3}, {0, 1}, {2}, {0}, {1}};
+
+    for (int c = 0; c < shapes.size(); c++) {
+        Tensor *A = Tensor::randn(shapes[c], DEV_CPU);
+        A->round_();  // Ties for max/min
+
+        for (int m = 0; m < 4; m++) {
+            vector<float> val;
+            vector<int> ind;
+            naive_reduce(A, axes[c], m, val, ind);
+
+            // ReduceDescriptor (keepdims = false)
+            ReduceDescriptor rd(A, axes[c], (m == 0) ? "mean" : (m == 1) ? "sum" : (m == 2) ? "max" : "min", false);
+            cpu_reduction(&rd);
+            for (int i = 0; i < val.size(); i++) {
+                ASSERT_NEAR(rd.O->ptr[i], val[i], 1e-3 * (1.0f + fabs(val[i])));
+                if (m >= 2) ASSERT_EQ((int)rd.S->ptr[i], ind[i]);
+            }
+
+            // ReduceDescriptor2 (tensor API)
+            Tensor *B = (m == 0) ? A->mean(axes[c], false) : (m == 1) ? A->sum(axes[c], false) : (m == 2) ? A->max(axes[c], false) : A->min(axes[c], false);
+            for (int i = 0; i < val.size(); i++) ASSERT_NEAR(B->ptr[i], val[i], 1e-3 * (1.0f + fabs(val[i])));
+
+            delete B;
+            delete rd.O;
+            delete rd.S;
+        }
+
+        // Variance (two passes)
+        Tensor *M = A->mean(axes[c], false);
+        Tensor *V = A->var(axes[c], false, false);
+        vector<vector<int>> groups = reduction_groups(A, axes[c]);
+        ASSERT_EQ(groups.size(), V->size);
+        for (int i = 0; i < groups.size(); i++) {
+            double s = 0.0;
+            for (auto p : groups[i]) s += (A->ptr[p] - M->ptr[i]) * (A->ptr[p] - M->ptr[i]);
+            ASSERT_NEAR(V->ptr[i], s / groups[i].size(), 1e-3 * (1.0f + s / groups[i].size()));
+        }
+
+        delete M;
+        delete V;
+        delete A;
+    }
+}
+
+TEST(TensorTestSuite, tensor_math_reduction_engine_keepdims) {
+    // Outputs and deltas of the reduction layers (keepdims: one value per position)
+    Tensor *A = Tensor::randn({3, 4, 5}, DEV_CPU);
+    Tensor *D = Tensor::randn({3, 4, 5}, DEV_CPU);
+
+    for (int m = 0; m < 2; m++) {
+        ReduceDescriptor rd(A, {1}, (m == 0) ? "mean" : "sum", true);
+        rd.D = D;
+        rd.ID = Tensor::zeros({3, 4, 5}, DEV_CPU);
+        cpu_reduction(&rd);
+        cpu_reduction_back(&rd);
+        ASSERT_TRUE(rd.index.empty());  // Not built on CPU
+
+        for (auto &g : reduction_groups(A, {1})) {
+            float s = 0.0f, d = 0.0f;
+            for (auto p : g) { s += A->ptr[p]; d += D->ptr[p]; }
+            if (m == 0) { s /= g.size(); d /= g.size(); }
+            for (auto p : g) {
+                ASSERT_NEAR(rd.O->ptr[p], s, 1e-4);
+                ASSERT_NEAR(rd.ID->ptr[p], d, 1e-4);
+            }
+        }
+        delete rd.O;
+        delete rd.ID;
+    }
+
+    delete A;
+    delete D;
+}
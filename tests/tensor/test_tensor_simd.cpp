@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/hardware/cpu/cpu_tensor.h"
+
+
+using namespace std;
+
+
+// Distance in units in the last place (floats in order as integers)
+static int64_t ulp_distance(float a, float b){
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(float));
+    memcpy(&ib, &b, sizeof(float));
+    int64_t oa = (ia < 0) ? (int64_t)INT32_MIN - ia : ia;
+    int64_t ob = (ib < 0) ? (int64_t)INT32_MIN - ib : ib;
+    return (oa > ob) ? oa - ob : ob - oa;
+}
+
+// Max error (ulp) of f against the double precision reference
+static int64_t max_ulp(void (*f)(const float *, float *, long int), double (*ref)(double), const vector<float> &x){
+    vector<float> y(x.size());
+    f(x.data(), y.data(), x.size());
+    int64_t worst = 0;
+    for (int i = 0; i < x.size(); i++) worst = std::max(worst, ulp_distance(y[i], (float)ref(x[i])));
+    return worst;
+}
+
+static double ref_sigmoid(double x){ return 1.0 / (1.0 + std::exp(-x)); }
+static double ref_exp(double x){ return std::exp(x); }
+static double ref_log(double x){ return std::log(x); }
+static double ref_tanh(double x){ return std::tanh(x); }
+
+static vector<float> uniform(float lo, float hi, int n){
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(lo, hi);
+    vector<float> x(n);
+    for (auto &v : x) v = dist(gen);
+    return x;
+}
+
+
+TEST(TensorTestSuite, tensor_simd_ulp){
+    // Positive floats of any exponent (denormals too)
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<uint32_t> bits(1, 0x7f7fffff);
+    vector<float> pos(100000);
+    for (auto &v : pos) { uint32_t b = bits(gen); memcpy(&v, &b, sizeof(float)); }
+
+    vector<float> xexp = uniform(-103.0f, 88.7f, 100000);
+    vector<float> xtanh = uniform(-10.0f, 10.0f, 100000);
+    vector<float> xsmall = uniform(-1.0f, 1.0f, 100000);
+    vector<float> xsigm = uniform(-80.0f, 80.0f, 100000);
+
+    int initial = cpu_simd_level();
+    for (int level = CPU_SIMD_NONE; level <= cpu_simd_supported(); level++) {
+        ASSERT_EQ(cpu_simd_set_level(level), level);
+        SCOPED_TRACE(cpu_simd_name(level));
+
+        ASSERT_LE(max_ulp(cpu_vexp, ref_exp, xexp), 2);
+        ASSERT_LE(max_ulp(cpu_vlog, ref_log, pos), 2);
+        ASSERT_LE(max_ulp(cpu_vtanh, ref_tanh, xtanh), 3);
+        ASSERT_LE(max_ulp(cpu_vtanh, ref_tanh, xsmall), 3);
+        ASSERT_LE(max_ulp(cpu_vsigmoid, ref_sigmoid, xsigm), 3);
+
+        // Special values
+        vector<float> x = {INFINITY, -INFINITY, NAN, 0.0f, -0.0f, 100.0f, -200.0f, -1.0f};
+        vector<float> y(x.size());
+        cpu_vexp(x.data(), y.data(), x.size());
+        ASSERT_EQ(y[0], INFINITY);
+        ASSERT_EQ(y[1], 0.0f);
+        ASSERT_TRUE(std::isnan(y[2]));
+        ASSERT_EQ(y[3], 1.0f);
+        ASSERT_EQ(y[5], INFINITY);
+        ASSERT_EQ(y[6], 0.0f);
+        cpu_vlog(x.data(), y.data(), x.size());
+        ASSERT_EQ(y[0], INFINITY);
+        ASSERT_TRUE(std::isnan(y[1]));
+        ASSERT_TRUE(std::isnan(y[2]));
+        ASSERT_EQ(y[3], -INFINITY);
+        ASSERT_EQ(y[4], -INFINITY);
+        ASSERT_TRUE(std::isnan(y[7]));
+        cpu_vtanh(x.data(), y.data(), x.size());
+        ASSERT_EQ(y[0], 1.0f);
+        ASSERT_EQ(y[1], -1.0f);
+        ASSERT_TRUE(std::isnan(y[2]));
+        ASSERT_EQ(y[3], 0.0f);
+        cpu_vsigmoid(x.data(), y.data(), x.size());
+        ASSERT_EQ(y[0], 1.0f);
+        ASSERT_EQ(y[1], 0.0f);
+        ASSERT_EQ(y[3], 0.5f);
+
+        // Any length (tails) and in-place
+        for (int n = 1; n < 40; n++) {
+            vector<float> a(xtanh.begin(), xtanh.begin() + n);
+            vector<float> b(n);
+            cpu_vtanh(a.data(), b.data(), n);
+            cpu_vtanh(a.data(), a.data(), n);
+            for (int i = 0; i < n; i++) ASSERT_EQ(a[i], b[i]);
+        }
+    }
+    cpu_simd_set_level(initial);
+
+    // Tensor ops
+    Tensor *t = Tensor::randn({64, 100}, DEV_CPU);
+    Tensor *r = t->exp();
+    for (int i = 0; i < t->size; i++) ASSERT_LE(ulp_distance(r->ptr[i], (float)std::exp((double)t->ptr[i])), 2);
+
+    delete t;
+    delete r;
+}
+
+TEST(TensorTestSuite, tensor_simd_half){
+    // Every float16 (and floats of any exponent) converts like the scalar code
+    vector<uint16_t> h(65536 + 5), h_ref(h.size());
+    for (int i = 0; i < h.size(); i++) h[i] = (uint16_t)i;
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<uint32_t> bits;
+    vector<float> x(100000);
+    for (auto &v : x) { uint32_t b = bits(gen); memcpy(&v, &b, sizeof(float)); }
+    x[0] = 65519.0f; x[1] = 65520.0f; x[2] = 1e-8f; x[3] = -0.0f;
+
+    int initial = cpu_simd_level();
+    vector<float> f(h.size()), f_ref(h.size());
+    vector<uint16_t> y(x.size()), y_ref(x.size());
+    cpu_simd_set_level(CPU_SIMD_NONE);
+    cpu_half2float(h.data(), f_ref.data(), h.size(), DTYPE_FLOAT16);
+    cpu_float2half(x.data(), y_ref.data(), x.size(), DTYPE_FLOAT16);
+    cpu_simd_set_level(initial);
+    cpu_half2float(h.data(), f.data(), h.size(), DTYPE_FLOAT16);
+    cpu_float2half(x.data(), y.data(), x.size(), DTYPE_FLOAT16);
+
+    for (int i = 0; i < h.size(); i++) {
+        if (std::isnan(f_ref[i])) ASSERT_TRUE(std::isnan(f[i]));
+        else ASSERT_EQ(memcmp(&f[i], &f_ref[i], sizeof(float)), 0);
+    }
+    for (int i = 0; i < x.size(); i++) {
+        if (std::isnan(x[i])) ASSERT_EQ(y[i] & 0x7c00, 0x7c00);
+        else ASSERT_EQ(y[i], y_ref[i]);
+    }
+}
+
+TEST(TensorTestSuite, tensor_simd_int8){
+    // Same sums with every kernel: tails of the blocks of rows and of k, and
+    // the largest values (their pairs of products still fit in int16)
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<int> dist(-127, 127);
+    int m = 7, n = 13, k = 203;
+    vector<int8_t> A(m * k), B(n * k);
+    for (auto &v : A) v = dist(gen);
+    for (auto &v : B) v = dist(gen);
+    for (int p = 0; p < 64; p++) { A[p] = -127; B[p] = (p % 2) ? 127 : -127; }
+
+    int initial = cpu_simd_level();
+    for (int level = CPU_SIMD_NONE; level <= cpu_simd_supported(); level++) {
+        cpu_simd_set_level(level);
+        for (int kk : {k, 64, 31}) {
+            vector<int32_t> C(m * n, -1);
+            cpu_vgemm_int8(A.data(), k, B.data(), k, C.data(), n, m, n, kk);
+            for (int i = 0; i < m; i++)
+                for (int j = 0; j < n; j++) {
+                    int32_t sum = 0;
+                    for (int p = 0; p < kk; p++) sum += (int32_t)A[i * k + p] * B[j * k + p];
+                    ASSERT_EQ(C[i * n + j], sum);
+                }
+        }
+    }
+    cpu_simd_set_level(initial);
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "eddl/tensor/tensor.h"
+#include "eddl/hardware/cpu/cpu_thread_pool.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
+#include "eddl/system_info.h"
+
+#ifdef EDDL_LINUX
+#include <sched.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+using namespace std;
+
+
+TEST(TensorTestSuite, cpu_pool_parallel_for){
+    CPUPool pool(4);
+
+    // Every index once, with tails that do not divide the ranges
+    for (long int n : {1L, 7L, 1000L, 100003L}) {
+        vector<atomic<int>> seen(n);
+        for (auto &s : seen) s = 0;
+        pool.parallel_for(0, n, 16, [&](long int ini, long int end) {
+            for (long int i = ini; i < end; i++) seen[i]++;
+        });
+        for (long int i = 0; i < n; i++) ASSERT_EQ(seen[i].load(), 1);
+    }
+
+    // Not starting at 0
+    atomic<long int> sum(0);
+    pool.parallel_for(100, 200, 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; i++) sum += i;
+    });
+    ASSERT_EQ(sum.load(), 14950);
+
+    // Inner loops run on the thread of the range
+    atomic<int> count(0);
+    pool.parallel_for(0, 64, 1, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; i++)
+            pool.parallel_for(0, 64, 1, [&](long int a, long int b) { count += (int)(b - a); });
+    });
+    ASSERT_EQ(count.load(), 64 * 64);
+
+    // The errors of the threads reach the caller (and the pool keeps working)
+    ASSERT_THROW(pool.parallel_for(0, 1000, 1, [&](long int ini, long int end) {
+        if (ini <= 500 && 500 < end) throw std::runtime_error("range");
+    }), std::runtime_error);
+    count = 0;
+    pool.parallel_for(0, 1000, 1, [&](long int ini, long int end) { count += (int)(end - ini); });
+    ASSERT_EQ(count.load(), 1000);
+}
+
+TEST(TensorTestSuite, cpu_pool_concurrent){
+    // Loops started from several threads at once (one uses the pool, the rest run inline)
+    vector<long int> sums(4, 0);
+    vector<thread> callers;
+    for (int t = 0; t < 4; t++)
+        callers.emplace_back([&, t]() {
+            for (int r = 0; r < 20; r++) {
+                atomic<long int> sum(0);
+                cpu_parallel_for(0, 100000, 1000, [&](long int ini, long int end) {
+                    long int s = 0;
+                    for (long int i = ini; i < end; i++) s += i;
+                    sum += s;
+                });
+                sums[t] = sum.load();
+            }
+        });
+    for (auto &c : callers) c.join();
+    for (auto s : sums) ASSERT_EQ(s, 100000L * 99999L / 2);
+
+    // Same results with any number of threads
+    Tensor *A = Tensor::randn({256, 1024});
+    Tensor *B = A->clone();
+    Tensor *C = A->clone();
+    int threads = cpu_pool_threads();
+    cpu_pool_set_threads(1);
+    B->sigmoid_();
+    B->add_(2.0f);
+    cpu_pool_set_threads(3);
+    C->sigmoid_();
+    C->add_(2.0f);
+    cpu_pool_set_threads(threads);
+    ASSERT_TRUE(Tensor::equivalent(B, C, 0.0f));
+
+    delete A;
+    delete B;
+    delete C;
+}
+
+TEST(TensorTestSuite, cpu_pool_resize){
+    // The pool is replaced while other threads are running loops on it
+    int threads = cpu_pool_threads();
+    atomic<bool> done(false);
+    atomic<int> wrong(0);
+    vector<thread> callers;
+    for (int t = 0; t < 2; t++)
+        callers.emplace_back([&]() {
+            while (!done) {
+                atomic<long int> sum(0);
+                cpu_parallel_for(0, 100000, 1000, [&](long int ini, long int end) {
+                    long int s = 0;
+                    for (long int i = ini; i < end; i++) s += i;
+                    sum += s;
+                });
+                if (sum.load() != 100000L * 99999L / 2) wrong++;
+            }
+        });
+    for (int r = 0; r < 50; r++) cpu_pool_set_threads(1 + r % 4);
+    done = true;
+    for (auto &c : callers) c.join();
+    ASSERT_EQ(wrong.load(), 0);
+
+    cpu_pool_set_threads(threads);
+}
+
+TEST(TensorTestSuite, cpu_pool_numa){
+    // Every core in one node
+    vector<vector<int>> nodes = cpu_numa_topology();
+    ASSERT_GE(nodes.size(), 1);
+    vector<int> all;
+    for (auto &n : nodes) {
+        ASSERT_FALSE(n.empty());
+        all.insert(all.end(), n.begin(), n.end());
+    }
+    sort(all.begin(), all.end());
+    ASSERT_TRUE(adjacent_find(all.begin(), all.end()) == all.end());
+
+    // Pinned threads in groups per node
+    int threads = cpu_pool_threads();
+    cpu_pool_set_threads(4, true, true);
+    ASSERT_EQ(cpu_pool_threads(), 4);
+    for (int t = 1; t < 4; t++) ASSERT_GE(cpu_pool()->group(t), cpu_pool()->group(t - 1));
+    atomic<long int> sum(0);
+    cpu_parallel_for(0, 100000, 100, [&](long int ini, long int end) {
+        for (long int i = ini; i < end; i++) sum += i;
+    });
+    ASSERT_EQ(sum.load(), 100000L * 99999L / 2);
+
+#if defined(EDDL_LINUX) && defined(_OPENMP)
+    // The OpenMP team gets the cores of the pool (but the calling thread)
+    vector<int> single(4, 0), cores(4, -1);
+    #pragma omp parallel num_threads(4)
+    {
+        int t = omp_get_thread_num();
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            single[t] = CPU_COUNT(&set) == 1;
+            for (int c = 0; c < CPU_SETSIZE; c++) if (CPU_ISSET(c, &set)) { cores[t] = c; break; }
+        }
+    }
+    ASSERT_EQ(omp_get_max_threads(), 4);
+    for (int t = 1; t < 4; t++) {
+        int g = cpu_pool()->group(t);
+        ASSERT_TRUE(single[t]);
+        ASSERT_TRUE(find(nodes[g].begin(), nodes[g].end(), cores[t]) != nodes[g].end());
+    }
+#endif
+
+    // First touch (zeros) and placement of blocks in use
+    size_t bytes = 4 * CPU_NUMA_MIN_BYTES + 3;
+    char *p = new char[bytes];
+    memset(p, 1, bytes);
+    cpu_numa_touch(p, bytes);
+    ASSERT_TRUE(count(p, p + bytes, 0) == bytes);
+    if (nodes.size() == 1) {
+        ASSERT_TRUE(cpu_numa_place(p, bytes));
+        ASSERT_TRUE(cpu_numa_interleave(p, bytes));
+    }
+    ASSERT_FALSE(cpu_numa_place(p, 100));
+    delete[] p;
+
+    cpu_pool_set_threads(threads);
+#if defined(EDDL_LINUX) && defined(_OPENMP)
+    // Not pinned any more
+    vector<int> count_cpus(threads, 0);
+    #pragma omp parallel num_threads(threads)
+    {
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) count_cpus[omp_get_thread_num()] = CPU_COUNT(&set);
+    }
+    int all = 0;
+    for (auto &n : nodes) all += n.size();
+    for (int t = 1; t < threads; t++) ASSERT_EQ(count_cpus[t], all);
+#endif
+}
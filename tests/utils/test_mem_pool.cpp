@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "eddl/mem_pool.h"
+#include "eddl/utils.h"
+#include "eddl/tensor/tensor.h"
+#include "eddl/hardware/cpu/cpu_numa.h"
+
+
+TEST(MemPoolTestSuite, size_classes){
+    ASSERT_EQ(mem_pool_size_class(1), 64);
+    ASSERT_EQ(mem_pool_size_class(64), 64);
+    ASSERT_EQ(mem_pool_size_class(65), 80);
+    ASSERT_EQ(mem_pool_size_class(128), 128);
+    ASSERT_EQ(mem_pool_size_class(129), 160);
+    ASSERT_EQ(mem_pool_size_class(1000), 1024);
+    ASSERT_EQ(mem_pool_size_class(1025), 1280);
+}
+
+TEST(MemPoolTestSuite, reuse_blocks){
+    mem_pool_enable(true);
+    mem_pool_trim(0);
+    mem_pool_reset_stats();
+
+    void *p1 = eddl_malloc(1000);
+    ASSERT_EQ(mem_pool_stats().misses, 1);
+    ASSERT_EQ(((size_t)p1) % 64, 0);  // Aligned
+    eddl_free(p1);
+    ASSERT_EQ(mem_pool_stats().bytes_cached, 1024);
+
+    // Same size class => Same block
+    void *p2 = eddl_malloc(990);
+    ASSERT_EQ(p1, p2);
+    ASSERT_EQ(mem_pool_stats().hits, 1);
+    ASSERT_EQ(mem_pool_stats().bytes_cached, 0);
+    eddl_free(p2);
+
+    // Tensors use the pool too
+    auto *t1 = new Tensor({10, 25}, DEV_CPU);
+    delete t1;
+    auto *t2 = new Tensor({25, 10}, DEV_CPU);
+    ASSERT_EQ(t2->ptr, p1);
+    ASSERT_EQ(mem_pool_stats().hits, 3);
+    delete t2;
+
+    ASSERT_EQ(mem_pool_trim(0), 1024);
+    ASSERT_EQ(mem_pool_stats().bytes_cached, 0);
+    ASSERT_GE(mem_pool_stats().peak_bytes, 1024);
+}
+
+TEST(MemPoolTestSuite, max_cached){
+    mem_pool_enable(true);
+    mem_pool_trim(0);
+    size_t old_max = mem_pool_get_max_cached();
+    mem_pool_set_max_cached(1024);
+
+    void *p1 = eddl_malloc(1024);
+    void *p2 = eddl_malloc(1024);
+    eddl_free(p1);
+    eddl_free(p2);  // Does not fit in the cache => released
+    ASSERT_EQ(mem_pool_stats().bytes_cached, 1024);
+
+    mem_pool_set_max_cached(old_max);
+    mem_pool_trim(0);
+}
+
+TEST(MemPoolTestSuite, numa_reuse){
+    mem_pool_enable(true);
+    mem_pool_trim(0);
+    mem_pool_reset_stats();
+    cpu_numa_set_first_touch(true);
+
+    // A reused block is placed again (its pages move, the data stays)
+    size_t bytes = 2 * CPU_NUMA_MIN_BYTES;
+    auto *p1 = (float *)eddl_malloc(bytes);
+    for (size_t i = 0; i < bytes / sizeof(float); i++) p1[i] = (float)i;
+    eddl_free(p1);
+    auto *p2 = (float *)eddl_malloc(bytes);
+    ASSERT_EQ(p1, p2);
+    ASSERT_EQ(mem_pool_stats().hits, 1);
+    for (size_t i = 0; i < bytes / sizeof(float); i++) ASSERT_EQ(p2[i], (float)i);
+    eddl_free(p2);
+
+    cpu_numa_set_first_touch(false);
+    mem_pool_trim(0);
+}
+
+TEST(MemPoolTestSuite, disabled){
+    mem_pool_enable(false);
+    mem_pool_reset_stats();
+
+    void *p1 = eddl_malloc(256);
+    eddl_free(p1);
+    ASSERT_EQ(mem_pool_stats().misses, 0);
+    ASSERT_EQ(mem_pool_stats().bytes_cached, 0);
+
+    mem_pool_enable(true);
+}
+
+TEST(MemPoolTestSuite, save2ptr_not_tracked){
+    mem_pool_enable(true);
+    auto *t1 = Tensor::ones({4, 8}, DEV_CPU);
+    size_t in_use = mem_pool_stats().bytes_in_use;
+
+    // The caller releases it with free()
+    std::pair<void*, size_t> serial = t1->save2ptr();
+    ASSERT_EQ(mem_pool_stats().bytes_in_use, in_use);
+    free(serial.first);
+
+    delete t1;
+}
@@ -62,4 +62,12 @@ TEST(UtilsTestSuite, compute_unsqueeze){
 //    vector<int> vb5 = compute_unsqueeze({1, 7, 2}, -5, false);
 //    vector<int> vb6 = compute_unsqueeze({1, 7, 2}, 5, true);
 //    vector<int> vb7 = compute_unsqueeze({1, 7, 2}, -5, true);
-}
\ No newline at end of file
+}
+
+
+TEST(UtilsTestSuite, parse_indices){
+    // The end of a range can have more digits than the dimension
+    ASSERT_TRUE(parse_indices({"0:1"}, {1}) == vector<vector<int>>({{0, 0}}));
+    ASSERT_TRUE(parse_indices({":1", "2:12"}, {1, 12}) == vector<vector<int>>({{0, 0}, {2, 11}}));
+    ASSERT_TRUE(parse_indices({":", "-2:", "3"}, {5, 10, 4}) == vector<vector<int>>({{0, 4}, {8, 9}, {3, 3}}));
+}